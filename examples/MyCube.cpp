@@ -173,7 +173,7 @@ MyCube::MyCube( float side )
       0.0f, 1.0f
     };
 
-  std::vector< GLuint > el = {
+  _indices = {
     0,1,2,0,2,3,
     4,5,6,4,6,7,
     8,9,10,8,10,11,
@@ -210,7 +210,7 @@ MyCube::MyCube( float side )
   glEnableVertexAttribArray(3);  // texture coords
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _handle[4]);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, el.size( ) * sizeof(GLuint), el.data( ), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size( ) * sizeof(GLuint), _indices.data( ), GL_STATIC_DRAW);
 
   glBindVertexArray(0);
 }
@@ -251,6 +251,11 @@ std::vector< float > MyCube::getPositions( void ) const
   return _v;
 }
 
+std::vector< unsigned int > MyCube::getIndices( void ) const
+{
+  return _indices;
+}
+
 bool MyCube::getSelected( void ) const
 {
   return _selected;
@@ -36,6 +36,7 @@ public:
   void setModel( const std::vector<float> value );
 
   std::vector< float > getPositions( void ) const;
+  std::vector< unsigned int > getIndices( void ) const;
 
   bool getSelected( void ) const;
   void setSelected( const bool& selected );
@@ -46,6 +47,7 @@ private:
   unsigned int _handle[5];
   std::vector< float > _model;
   std::vector< float > _v;
+  std::vector< unsigned int > _indices;
   std::vector< float > _c;
   bool _selected;
 
@@ -158,7 +158,7 @@ void initOGL( void )
   prog.compileAndLink( );
   prog.autocatching( );
 
-  progPick.loadVertexShader( shadersPath + "pick.vert" );
+  progPick.loadVertexShader( shadersPath + "pickSystem.vert" );
   ps = new reto::PickingSystem( &progPick );
 
   glFrontFace( GL_CCW );
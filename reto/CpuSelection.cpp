@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "CpuSelection.h"
+#include "CullingSystem.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include <Eigen/Dense>
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __SSE2__ ) || \
+  ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #define RETO_SELECTION_SSE
+  #include <emmintrin.h>
+#endif
+
+namespace reto
+{
+  namespace
+  {
+    //! Vertices per parallel task, a multiple of four
+    const size_t BLOCK_SIZE = 4096;
+
+    //! Vertices of an object to test against a selection
+    struct Test
+    {
+      //! Column major viewProj * model
+      const float* matrix;
+      const float* x;
+      const float* y;
+      const float* z;
+      //! Rectangle minimum and maximum, nullptr for a lasso
+      const float* rectangle;
+      const float* edges;
+      size_t numEdges;
+    };
+
+    //! Range of vertices of an object
+    struct Block
+    {
+      size_t object;
+      size_t first;
+      size_t last;
+    };
+
+    //! Check if any vertex in [ first, last ) is inside the selection
+    typedef bool ( *Kernel )( const Test& test, size_t first, size_t last );
+
+    // Same operation order as the SSE kernel, so both give the same
+    // results
+    bool testScalar( const Test& test, size_t first, size_t last )
+    {
+      const float* m = test.matrix;
+      for ( size_t i = first; i < last; ++i )
+      {
+        const float x = test.x[ i ];
+        const float y = test.y[ i ];
+        const float z = test.z[ i ];
+        const float w = m[ 3 ] * x + m[ 7 ] * y + m[ 11 ] * z + m[ 15 ];
+        const float u = ( m[ 0 ] * x + m[ 4 ] * y + m[ 8 ] * z + m[ 12 ]) / w;
+        const float v = ( m[ 1 ] * x + m[ 5 ] * y + m[ 9 ] * z + m[ 13 ]) / w;
+
+        if ( test.rectangle )
+        {
+          const float* r = test.rectangle;
+          if ( u >= r[ 0 ] && u < r[ 2 ] && v >= r[ 1 ] && v < r[ 3 ])
+            return true;
+          continue;
+        }
+
+        // Even-odd rule, crossings of a ray towards +x
+        bool inside = false;
+        for ( size_t e = 0; e < test.numEdges; ++e )
+        {
+          const float* edge = test.edges + e * 4;
+          if (( edge[ 1 ] > v ) != ( edge[ 2 ] > v ) &&
+            u < edge[ 0 ] + edge[ 3 ] * ( v - edge[ 1 ]))
+          {
+            inside = !inside;
+          }
+        }
+        if ( inside )
+          return true;
+      }
+      return false;
+    }
+
+#ifdef RETO_SELECTION_SSE
+    bool testSSE( const Test& test, size_t first, size_t last )
+    {
+      const float* m = test.matrix;
+      const __m128 m0 = _mm_set1_ps( m[ 0 ]);
+      const __m128 m1 = _mm_set1_ps( m[ 1 ]);
+      const __m128 m3 = _mm_set1_ps( m[ 3 ]);
+      const __m128 m4 = _mm_set1_ps( m[ 4 ]);
+      const __m128 m5 = _mm_set1_ps( m[ 5 ]);
+      const __m128 m7 = _mm_set1_ps( m[ 7 ]);
+      const __m128 m8 = _mm_set1_ps( m[ 8 ]);
+      const __m128 m9 = _mm_set1_ps( m[ 9 ]);
+      const __m128 m11 = _mm_set1_ps( m[ 11 ]);
+      const __m128 m12 = _mm_set1_ps( m[ 12 ]);
+      const __m128 m13 = _mm_set1_ps( m[ 13 ]);
+      const __m128 m15 = _mm_set1_ps( m[ 15 ]);
+
+      __m128 rectangle[ 4 ];
+      if ( test.rectangle )
+      {
+        for ( int k = 0; k < 4; ++k )
+          rectangle[ k ] = _mm_set1_ps( test.rectangle[ k ]);
+      }
+
+      for ( size_t i = first; i < last; i += 4 )
+      {
+        const __m128 x = _mm_loadu_ps( test.x + i );
+        const __m128 y = _mm_loadu_ps( test.y + i );
+        const __m128 z = _mm_loadu_ps( test.z + i );
+        const __m128 w = _mm_add_ps( _mm_add_ps( _mm_add_ps(
+          _mm_mul_ps( m3, x ), _mm_mul_ps( m7, y )), _mm_mul_ps( m11, z )),
+          m15 );
+        const __m128 u = _mm_div_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps(
+          _mm_mul_ps( m0, x ), _mm_mul_ps( m4, y )), _mm_mul_ps( m8, z )),
+          m12 ), w );
+        const __m128 v = _mm_div_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps(
+          _mm_mul_ps( m1, x ), _mm_mul_ps( m5, y )), _mm_mul_ps( m9, z )),
+          m13 ), w );
+
+        __m128 inside;
+        if ( test.rectangle )
+        {
+          inside = _mm_and_ps(
+            _mm_and_ps( _mm_cmpge_ps( u, rectangle[ 0 ]),
+              _mm_cmplt_ps( u, rectangle[ 2 ])),
+            _mm_and_ps( _mm_cmpge_ps( v, rectangle[ 1 ]),
+              _mm_cmplt_ps( v, rectangle[ 3 ])));
+        }
+        else
+        {
+          // Even-odd rule, each crossing flips the mask of its lanes
+          inside = _mm_setzero_ps( );
+          for ( size_t e = 0; e < test.numEdges; ++e )
+          {
+            const float* edge = test.edges + e * 4;
+            const __m128 startY = _mm_set1_ps( edge[ 1 ]);
+            const __m128 crosses = _mm_xor_ps( _mm_cmpgt_ps( startY, v ),
+              _mm_cmpgt_ps( _mm_set1_ps( edge[ 2 ]), v ));
+            const __m128 crossX = _mm_add_ps( _mm_set1_ps( edge[ 0 ]),
+              _mm_mul_ps( _mm_set1_ps( edge[ 3 ]), _mm_sub_ps( v, startY )));
+            inside = _mm_xor_ps( inside,
+              _mm_and_ps( crosses, _mm_cmplt_ps( u, crossX )));
+          }
+        }
+        if ( _mm_movemask_ps( inside ) != 0 )
+          return true;
+      }
+      return false;
+    }
+#endif
+
+    SimdLevel supportedLevel( void )
+    {
+#ifdef RETO_SELECTION_SSE
+      return SimdLevel::SSE;
+#else
+      return SimdLevel::Scalar;
+#endif
+    }
+  }
+
+  CpuSelection::CpuSelection( unsigned int width, unsigned int height )
+    : _width( width )
+    , _height( height )
+    , _culling( nullptr )
+    , _simdLevel( supportedLevel( ))
+    , _boundsTest( true )
+    , _testedVertices( 0 )
+  {
+  }
+
+  CpuSelection::~CpuSelection( void )
+  {
+  }
+
+  void CpuSelection::resize( unsigned int width, unsigned int height )
+  {
+    _width = width;
+    _height = height;
+  }
+
+  void CpuSelection::addObject( Pickable* object )
+  {
+    if ( _indices.count( object ))
+      return;
+    _indices[ object ] = _objects.size( );
+    _objects.push_back( object );
+    _positions.push_back( Positions( ));
+    readPositions( object, _positions.back( ));
+  }
+
+  void CpuSelection::removeObject( Pickable* object )
+  {
+    const auto it = _indices.find( object );
+    if ( it == _indices.end( ))
+      return;
+    _objects.erase( _objects.begin( ) + it->second );
+    _positions.erase( _positions.begin( ) + it->second );
+    _indices.erase( it );
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+      _indices[ _objects[ i ]] = i;
+    _selected.erase( std::remove( _selected.begin( ), _selected.end( ),
+      object ), _selected.end( ));
+  }
+
+  void CpuSelection::clear( void )
+  {
+    _objects.clear( );
+    _positions.clear( );
+    _indices.clear( );
+    _selected.clear( );
+  }
+
+  void CpuSelection::updateGeometry( Pickable* object )
+  {
+    const auto it = _indices.find( object );
+    if ( it != _indices.end( ))
+      readPositions( object, _positions[ it->second ]);
+  }
+
+  const std::vector< Pickable* >& CpuSelection::objects( void ) const
+  {
+    return _objects;
+  }
+
+  void CpuSelection::setCulling( CullingSystem* culling )
+  {
+    _culling = culling;
+  }
+
+  void CpuSelection::setNumThreads( unsigned int numThreads )
+  {
+    if ( numThreads == 0 )
+      numThreads = std::max( 1u, std::thread::hardware_concurrency( ));
+    if ( numThreads == this->numThreads( ))
+      return;
+
+    if ( numThreads > 1 )
+      _pool = std::make_shared< ThreadPool >( numThreads );
+    else
+      _pool.reset( );
+  }
+
+  unsigned int CpuSelection::numThreads( void ) const
+  {
+    return _pool ? _pool->size( ) : 1;
+  }
+
+  void CpuSelection::setSimdLevel( SimdLevel level )
+  {
+    const SimdLevel supported = supportedLevel( );
+    _simdLevel = level > supported ? supported : level;
+  }
+
+  SimdLevel CpuSelection::simdLevel( void ) const
+  {
+    return _simdLevel;
+  }
+
+  void CpuSelection::setBoundsTest( bool enabled )
+  {
+    _boundsTest = enabled;
+  }
+
+  size_t CpuSelection::selectRectangle( const Point& start, const Point& end,
+    const float* viewProj )
+  {
+    float first[ 2 ];
+    float last[ 2 ];
+    normalize( start, first );
+    normalize( end, last );
+    const float min[ 2 ] = { std::min( first[ 0 ], last[ 0 ]),
+      std::min( first[ 1 ], last[ 1 ])};
+    const float max[ 2 ] = { std::max( first[ 0 ], last[ 0 ]),
+      std::max( first[ 1 ], last[ 1 ])};
+    SelectionRegion region;
+    region.setRectangle( min, max );
+    region.setViewProj( viewProj );
+    return select( region );
+  }
+
+  size_t CpuSelection::selectLasso( const std::vector< Point >& path,
+    const float* viewProj )
+  {
+    std::vector< float > points( path.size( ) * 2 );
+    for ( size_t i = 0; i < path.size( ); ++i )
+      normalize( path[ i ], &points[ i * 2 ]);
+    SelectionRegion region;
+    region.setLasso( points );
+    region.setViewProj( viewProj );
+    return select( region );
+  }
+
+  const std::vector< Pickable* >& CpuSelection::selected( void ) const
+  {
+    return _selected;
+  }
+
+  size_t CpuSelection::testedVertices( void ) const
+  {
+    return _testedVertices;
+  }
+
+  size_t CpuSelection::select( const SelectionRegion& region )
+  {
+    Kernel kernel = testScalar;
+#ifdef RETO_SELECTION_SSE
+    if ( _simdLevel != SimdLevel::Scalar )
+      kernel = testSSE;
+#endif
+
+    // Lasso edges with a vertical extent, as horizontal ones are never
+    // crossed. Less than three points have nothing inside.
+    const float* rectangle = region.lasso( ) ? nullptr : region.rectangle( );
+    const std::vector< float >& points = region.points( );
+    const size_t numPoints = points.size( ) / 2;
+    std::vector< float > edges;
+    for ( size_t i = 0; i < numPoints && numPoints >= 3; ++i )
+    {
+      const float* a = &points[ i * 2 ];
+      const float* b = &points[(( i + 1 ) % numPoints ) * 2 ];
+      if ( a[ 1 ] == b[ 1 ])
+        continue;
+      edges.push_back( a[ 0 ]);
+      edges.push_back( a[ 1 ]);
+      edges.push_back( b[ 1 ]);
+      edges.push_back(( b[ 0 ] - a[ 0 ]) / ( b[ 1 ] - a[ 1 ]));
+    }
+
+    // Combined matrices and blocks of the objects straddling the region,
+    // objects inside it are selected without testing them
+    const Eigen::Map< const Eigen::Matrix4f > vp( region.viewProj( ));
+    std::vector< float > matrices( _objects.size( ) * 16 );
+    std::vector< Block > blocks;
+    std::vector< std::atomic< bool >> hits( _objects.size( ));
+    _testedVertices = 0;
+    for ( size_t i = 0; i < _objects.size( ) &&
+      ( rectangle || !edges.empty( )); ++i )
+    {
+      Positions& positions = _positions[ i ];
+      if ( positions.count == 0 ||
+        ( _culling && !_culling->inFrustum( _objects[ i ])))
+      {
+        positions.tested = false;
+        continue;
+      }
+
+      const std::vector< float > model = _objects[ i ]->getModel( );
+      const bool unchanged = positions.tested && positions.model == model;
+      positions.model = model;
+      positions.tested = true;
+      if ( _boundsTest )
+      {
+        const SelectionRegion::Coverage coverage =
+          region.classify( positions.bounds.world( model ));
+        if ( coverage == SelectionRegion::UNCHANGED && unchanged )
+        {
+          hits[ i ] = positions.selected;
+          continue;
+        }
+        if ( coverage == SelectionRegion::OUTSIDE )
+          continue;
+        if ( coverage == SelectionRegion::INSIDE )
+        {
+          hits[ i ] = true;
+          continue;
+        }
+      }
+      Eigen::Map< Eigen::Matrix4f > matrix( &matrices[ i * 16 ]);
+      if ( model.size( ) >= 16 )
+        matrix = vp * Eigen::Map< const Eigen::Matrix4f >( model.data( ));
+      else
+        matrix = vp;
+
+      const size_t numVertices = positions.x.size( );
+      for ( size_t first = 0; first < numVertices; first += BLOCK_SIZE )
+      {
+        const Block block = { i, first,
+          std::min( first + BLOCK_SIZE, numVertices )};
+        blocks.push_back( block );
+      }
+      _testedVertices += positions.count;
+    }
+
+    // Blocks of an object already selected are skipped
+    const std::function< void( size_t ) > task = [ & ]( size_t index )
+    {
+      const Block& block = blocks[ index ];
+      if ( hits[ block.object ].load( std::memory_order_relaxed ))
+        return;
+      const Positions& positions = _positions[ block.object ];
+      const Test test = { &matrices[ block.object * 16 ],
+        positions.x.data( ), positions.y.data( ), positions.z.data( ),
+        rectangle, edges.data( ), edges.size( ) / 4 };
+      if ( kernel( test, block.first, block.last ))
+        hits[ block.object ].store( true, std::memory_order_relaxed );
+    };
+    if ( _pool && _pool->size( ) > 1 && blocks.size( ) > 1 )
+    {
+      _pool->parallelFor( blocks.size( ), task );
+    }
+    else
+    {
+      for ( size_t i = 0; i < blocks.size( ); ++i )
+        task( i );
+    }
+
+    _selected.clear( );
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+    {
+      const bool selected = hits[ i ].load( std::memory_order_relaxed );
+      _positions[ i ].selected = selected;
+      _objects[ i ]->setSelected( selected );
+      if ( selected )
+        _selected.push_back( _objects[ i ]);
+    }
+    return _selected.size( );
+  }
+
+  void CpuSelection::normalize( const Point& point, float* ndc ) const
+  {
+    ndc[ 0 ] = 2.0f * static_cast< float >( point.first ) / _width - 1.0f;
+    ndc[ 1 ] = 2.0f * static_cast< float >( _height - point.second ) /
+      _height - 1.0f;
+  }
+
+  void CpuSelection::readPositions( Pickable* object, Positions& positions )
+  {
+    const std::vector< float > source = object->getPositions( );
+    const size_t numVertices = source.size( ) / 3;
+    positions.count = numVertices;
+    positions.bounds.setPositions( source );
+    positions.tested = false;
+    const size_t padded = ( numVertices + 3 ) / 4 * 4;
+    positions.x.resize( padded );
+    positions.y.resize( padded );
+    positions.z.resize( padded );
+    for ( size_t i = 0; i < padded; ++i )
+    {
+      const float* p = &source[ std::min( i, numVertices - 1 ) * 3 ];
+      positions.x[ i ] = p[ 0 ];
+      positions.y[ i ] = p[ 1 ];
+      positions.z[ i ] = p[ 2 ];
+    }
+  }
+
+} /* namespace reto */
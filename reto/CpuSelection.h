@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__CPU_SELECTION__
+#define __RETO__CPU_SELECTION__
+
+#include <reto/api.h>
+#include "Pickable.h"
+#include "SelectionRegion.h"
+#include "TangentGenerator.h"
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace reto
+{
+  class CullingSystem;
+  class ThreadPool;
+
+  //! Window point, same as the one of PickingSystem
+  typedef std::pair< unsigned int, unsigned int > Point;
+
+  /**
+   * Class to run the rubberband and lasso selections on the CPU, without
+   * an OpenGL context. Positions of the objects are cached when they are
+   * added and projected by viewProj * model in SIMD batches of four
+   * vertices, split in blocks over a thread pool. Objects are selected
+   * when any of their vertices is inside the selection, and stop being
+   * tested at the first one. Objects are classified by their projected
+   * bounds first, so only those straddling the selection have their
+   * vertices tested. Window points are read as in
+   * SelectionSystem::RubberBand and SelectionSystem::Lasso, so the same
+   * mouse input gives the same setSelected results.
+   * @class CpuSelection
+   */
+  class CpuSelection
+  {
+    public:
+      /**
+       * CpuSelection constructor. Uses the best instruction set supported
+       * by the CPU and the calling thread only.
+       * @param width: screen width
+       * @param height: screen height
+       */
+      RETO_API
+      CpuSelection( unsigned int width, unsigned int height );
+
+      /**
+       * CpuSelection destructor
+       */
+      RETO_API
+      ~CpuSelection( void );
+
+      /**
+       * Method used on resize callback to change width and height for
+       * calculating points
+       * @param width: screen width
+       * @param height: screen height
+       */
+      RETO_API
+      void resize( unsigned int width, unsigned int height );
+
+      /**
+       * Method to add a pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void addObject( reto::Pickable* object );
+
+      /**
+       * Method to remove a pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void removeObject( reto::Pickable* object );
+
+      /**
+       * Method to remove all objects
+       */
+      RETO_API
+      void clear( void );
+
+      /**
+       * Method to read the positions of an object again after they
+       * changed. Model matrices are read on each selection.
+       * @param object: Pickable object
+       */
+      RETO_API
+      void updateGeometry( reto::Pickable* object );
+
+      /**
+       * Method to get the registered objects
+       * @return Objects in insertion order
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& objects( void ) const;
+
+      /**
+       * Method to skip the objects outside the frustum of a culling
+       * system in the selection
+       * @param culling: Culling system ( nullptr to test all objects )
+       * @see TransformFeedback::setCulling
+       */
+      RETO_API
+      void setCulling( reto::CullingSystem* culling );
+
+      /**
+       * Method to set the number of threads used to test the vertices
+       * @param numThreads: Number of threads ( default = 1 ). 0 means one
+       *   per hardware thread.
+       */
+      RETO_API
+      void setNumThreads( unsigned int numThreads );
+
+      /**
+       * Method to get the number of threads used to test the vertices
+       * @return unsigned int
+       */
+      RETO_API
+      unsigned int numThreads( void ) const;
+
+      /**
+       * Method to set the instruction set. Levels not supported by the CPU
+       * fall back to the best supported one, and AVX2 runs the SSE
+       * kernels.
+       * @param level: Instruction set.
+       */
+      RETO_API
+      void setSimdLevel( SimdLevel level );
+
+      /**
+       * Method to get the instruction set in use
+       * @return SimdLevel
+       */
+      RETO_API
+      SimdLevel simdLevel( void ) const;
+
+      /**
+       * Method to classify whole objects by their projected bounds before
+       * testing their vertices
+       * @param enabled: Bounds test flag ( default = true )
+       */
+      RETO_API
+      void setBoundsTest( bool enabled );
+
+      /**
+       * Method to select the objects with a vertex inside a region. With a
+       * previous region, objects away from the change keep the result of
+       * the last selection, unless their model or positions changed.
+       * @param region: Selection region
+       * @return Number of selected objects
+       */
+      RETO_API
+      size_t select( const reto::SelectionRegion& region );
+
+      /**
+       * Method to select the objects with a vertex inside a rectangle, as
+       * RubberBand::mouseDown and RubberBand::mouseUp do
+       * @param start: first point of the selection
+       * @param end: last point of the selection
+       * @param viewProj: Column major view projection matrix
+       * @return Number of selected objects
+       */
+      RETO_API
+      size_t selectRectangle( const Point& start, const Point& end,
+        const float* viewProj );
+
+      /**
+       * Method to select the objects with a vertex inside a lasso, by the
+       * even-odd rule, as the mouse events of Lasso do. The path is
+       * closed from its last point to the first one.
+       * @param path: points of the selection, at least three
+       * @param viewProj: Column major view projection matrix
+       * @return Number of selected objects
+       */
+      RETO_API
+      size_t selectLasso( const std::vector< Point >& path,
+        const float* viewProj );
+
+      /**
+       * Method to get the objects selected by the last selection
+       * @return Objects in insertion order
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& selected( void ) const;
+
+      /**
+       * Method to get the number of vertices of the objects tested vertex
+       * by vertex in the last selection
+       * @return size_t
+       */
+      RETO_API
+      size_t testedVertices( void ) const;
+
+    protected:
+      //! Positions of an object, by coordinate and padded to a multiple
+      //! of four with copies of the last vertex
+      struct Positions
+      {
+        std::vector< float > x;
+        std::vector< float > y;
+        std::vector< float > z;
+        //! Vertices without padding
+        size_t count;
+        //! Bounds of the vertices
+        reto::ObjectBounds bounds;
+        //! Model matrix of the last selection
+        std::vector< float > model;
+        //! Result of the last selection
+        bool selected = false;
+        //! Flag of a last result valid for the model and positions
+        bool tested = false;
+      };
+
+      /*
+        Transform a window point to normalized device coordinates
+        @param Point point
+        @param float* ndc
+      */
+      void normalize( const Point& point, float* ndc ) const;
+
+      /*
+        Read the positions of an object
+        @param Pickable* object
+        @param Positions positions
+      */
+      static void readPositions( reto::Pickable* object,
+        Positions& positions );
+
+      //! Current width
+      unsigned int _width;
+
+      //! Current height
+      unsigned int _height;
+
+      //! Objects in insertion order
+      std::vector< reto::Pickable* > _objects;
+
+      //! Cached positions of each object in _objects
+      std::vector< Positions > _positions;
+
+      //! Position of each object in _objects
+      std::unordered_map< reto::Pickable*, size_t > _indices;
+
+      //! Objects selected by the last selection
+      std::vector< reto::Pickable* > _selected;
+
+      //! Culling system for frustum tests
+      reto::CullingSystem* _culling;
+
+      //! Instruction set in use
+      SimdLevel _simdLevel;
+
+      //! Bounds test flag
+      bool _boundsTest;
+
+      //! Vertices tested in the last selection
+      size_t _testedVertices;
+
+      //! Thread pool ( null when using the calling thread )
+      std::shared_ptr< ThreadPool > _pool;
+
+  }; /* class CpuSelection */
+
+} /* namespace reto */
+
+#endif /* __RETO__CPU_SELECTION__ */
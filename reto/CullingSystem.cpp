@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "CullingSystem.h"
+#include "Camera.h"
+#include "ShaderProgram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Dense>
+
+//OpenGL
+#ifndef SKIP_GLEW_INCLUDE
+#include <GL/glew.h>
+#endif
+#ifdef Darwin
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+namespace reto
+{
+  namespace
+  {
+    // Full screen triangle
+    const char* REDUCE_VERTEX_CODE =
+      "#version 430\n"
+      "void main( ) {\n"
+      "    vec2 p = vec2(( gl_VertexID << 1 ) & 2, gl_VertexID & 2 );\n"
+      "    gl_Position = vec4( p * 2.0 - 1.0, 0.0, 1.0 );\n"
+      "}";
+
+    // Max depth of the scale x scale depth pixels under each texel
+    const char* REDUCE_FRAGMENT_CODE =
+      "#version 430\n"
+      "uniform sampler2D depth;\n"
+      "uniform int scale;\n"
+      "layout(location = 0) out float maxDepth;\n"
+      "void main( ) {\n"
+      "    ivec2 begin = ivec2( gl_FragCoord.xy ) * scale;\n"
+      "    ivec2 end = min( begin + scale, textureSize( depth, 0 ));\n"
+      "    float d = 0.0;\n"
+      "    for ( int y = begin.y; y < end.y; ++y )\n"
+      "      for ( int x = begin.x; x < end.x; ++x )\n"
+      "        d = max( d, texelFetch( depth, ivec2( x, y ), 0 ).r );\n"
+      "    maxDepth = d;\n"
+      "}";
+
+    // Frustum planes ( a, b, c, d ) of a projection view matrix, with the
+    // inside at positive distances
+    void frustumPlanes( const float* projectionView,
+      Eigen::Vector4f planes[ 6 ])
+    {
+      const Eigen::Map< const Eigen::Matrix4f > pv( projectionView );
+      for ( int i = 0; i < 3; ++i )
+      {
+        planes[ 2 * i ] = ( pv.row( 3 ) + pv.row( i )).transpose( );
+        planes[ 2 * i + 1 ] = ( pv.row( 3 ) - pv.row( i )).transpose( );
+      }
+    }
+
+    // World bounds of model space bounds, empty model means identity
+    void worldBounds( const std::vector< float >& model, const float* min,
+      const float* max, Eigen::Vector3f& worldMin, Eigen::Vector3f& worldMax )
+    {
+      const Eigen::Vector3f center = 0.5f * ( Eigen::Vector3f( min[ 0 ],
+        min[ 1 ], min[ 2 ]) + Eigen::Vector3f( max[ 0 ], max[ 1 ], max[ 2 ]));
+      const Eigen::Vector3f extent = Eigen::Vector3f( max[ 0 ], max[ 1 ],
+        max[ 2 ]) - center;
+      if ( model.size( ) != 16 )
+      {
+        worldMin = center - extent;
+        worldMax = center + extent;
+        return;
+      }
+      const Eigen::Map< const Eigen::Matrix4f > m( model.data( ));
+      const Eigen::Vector3f worldCenter =
+        m.topLeftCorner< 3, 3 >( ) * center + m.topRightCorner< 3, 1 >( );
+      const Eigen::Vector3f worldExtent =
+        m.topLeftCorner< 3, 3 >( ).cwiseAbs( ) * extent;
+      worldMin = worldCenter - worldExtent;
+      worldMax = worldCenter + worldExtent;
+    }
+  }
+
+  CullingSystem::CullingSystem( void )
+    : _stats( )
+    , _frame( 0 )
+    , _occlusion( false )
+    , _depthWidth( 0 )
+    , _depthHeight( 0 )
+    , _hizScale( 1 )
+    , _program( nullptr )
+    , _framebuffer( 0 )
+    , _texture( 0 )
+    , _vao( 0 )
+    , _sampler( 0 )
+  {
+  }
+
+  CullingSystem::~CullingSystem( void )
+  {
+    if ( _program )
+    {
+      glDeleteFramebuffers( 1, &_framebuffer );
+      glDeleteTextures( 1, &_texture );
+      glDeleteVertexArrays( 1, &_vao );
+      glDeleteSamplers( 1, &_sampler );
+      delete _program;
+    }
+  }
+
+  void CullingSystem::AddObject( Pickable* object )
+  {
+    if ( _indices.count( object ))
+      return;
+    _indices[ object ] = _objects.size( );
+    Object culled;
+    culled.pickable = object;
+    culled.visibility = VISIBLE;
+    computeBounds( culled );
+    _objects.push_back( culled );
+    ++_frame;
+  }
+
+  void CullingSystem::RemoveObject( Pickable* object )
+  {
+    const auto it = _indices.find( object );
+    if ( it == _indices.end( ))
+      return;
+    _objects.erase( _objects.begin( ) + it->second );
+    _indices.erase( it );
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+      _indices[ _objects[ i ].pickable ] = i;
+    _visible.erase( std::remove( _visible.begin( ), _visible.end( ),
+      object ), _visible.end( ));
+    ++_frame;
+  }
+
+  void CullingSystem::Clear( void )
+  {
+    _objects.clear( );
+    _indices.clear( );
+    _visible.clear( );
+    _stats = CullingStats( );
+    ++_frame;
+  }
+
+  void CullingSystem::updateGeometry( Pickable* object )
+  {
+    const auto it = _indices.find( object );
+    if ( it != _indices.end( ))
+      computeBounds( _objects[ it->second ]);
+  }
+
+  void CullingSystem::setOcclusionCulling( bool enabled )
+  {
+    _occlusion = enabled;
+  }
+
+  bool CullingSystem::occlusionCulling( void ) const
+  {
+    return _occlusion;
+  }
+
+  void CullingSystem::updateOcclusion( unsigned int depthTexture,
+    unsigned int width, unsigned int height )
+  {
+    if ( width == 0 || height == 0 )
+    {
+      clearOcclusion( );
+      return;
+    }
+
+    if ( !_program )
+    {
+      _program = new reto::ShaderProgram( );
+      _program->loadFromText( REDUCE_VERTEX_CODE, REDUCE_FRAGMENT_CODE );
+      _program->compileAndLink( );
+      _program->autocatching( );
+
+      glGenFramebuffers( 1, &_framebuffer );
+      glGenTextures( 1, &_texture );
+      glGenVertexArrays( 1, &_vao );
+
+      // Depth textures are read without filtering or comparison, whatever
+      // their own parameters are
+      glGenSamplers( 1, &_sampler );
+      glSamplerParameteri( _sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glSamplerParameteri( _sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glSamplerParameteri( _sampler, GL_TEXTURE_COMPARE_MODE, GL_NONE );
+    }
+
+    GLint framebuffer, readFramebuffer, program, vao, activeTexture, texture,
+      sampler, packBuffer, packAlignment;
+    GLint viewport[ 4 ];
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer );
+    glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer );
+    glGetIntegerv( GL_CURRENT_PROGRAM, &program );
+    glGetIntegerv( GL_VERTEX_ARRAY_BINDING, &vao );
+    glGetIntegerv( GL_ACTIVE_TEXTURE, &activeTexture );
+    glActiveTexture( GL_TEXTURE0 );
+    glGetIntegerv( GL_TEXTURE_BINDING_2D, &texture );
+    glGetIntegerv( GL_SAMPLER_BINDING, &sampler );
+    glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer );
+    glGetIntegerv( GL_PACK_ALIGNMENT, &packAlignment );
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    const GLboolean depthTest = glIsEnabled( GL_DEPTH_TEST );
+    const GLboolean blend = glIsEnabled( GL_BLEND );
+    const GLboolean scissorTest = glIsEnabled( GL_SCISSOR_TEST );
+
+    // Finest level small enough to be read back every frame
+    _hizScale = std::max(( std::max( width, height ) + HIZ_SIZE - 1 ) /
+      HIZ_SIZE, 1u );
+    const unsigned int hizWidth = ( width + _hizScale - 1 ) / _hizScale;
+    const unsigned int hizHeight = ( height + _hizScale - 1 ) / _hizScale;
+    if ( _hiz.empty( ) || _hiz[ 0 ].width != hizWidth ||
+      _hiz[ 0 ].height != hizHeight )
+    {
+      glBindTexture( GL_TEXTURE_2D, _texture );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_R32F, GLsizei( hizWidth ),
+        GLsizei( hizHeight ), 0, GL_RED, GL_FLOAT, nullptr );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+      glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, _texture, 0 );
+
+      _hiz.clear( );
+      unsigned int levelWidth = hizWidth;
+      unsigned int levelHeight = hizHeight;
+      while ( true )
+      {
+        HiZLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.depth.resize( size_t( levelWidth ) * levelHeight );
+        _hiz.push_back( level );
+        if ( levelWidth == 1 && levelHeight == 1 )
+          break;
+        levelWidth = ( levelWidth + 1 ) / 2;
+        levelHeight = ( levelHeight + 1 ) / 2;
+      }
+    }
+    _depthWidth = width;
+    _depthHeight = height;
+
+    glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+    glViewport( 0, 0, GLsizei( hizWidth ), GLsizei( hizHeight ));
+    glDisable( GL_DEPTH_TEST );
+    glDisable( GL_BLEND );
+    glDisable( GL_SCISSOR_TEST );
+    glBindTexture( GL_TEXTURE_2D, depthTexture );
+    glBindSampler( 0, _sampler );
+    _program->use( );
+    _program->sendUniformi( "depth", 0 );
+    _program->sendUniformi( "scale", int( _hizScale ));
+    glBindVertexArray( _vao );
+    glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glReadPixels( 0, 0, GLsizei( hizWidth ), GLsizei( hizHeight ), GL_RED,
+      GL_FLOAT, _hiz[ 0 ].depth.data( ));
+
+    glPixelStorei( GL_PACK_ALIGNMENT, packAlignment );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, GLuint( packBuffer ));
+    glBindVertexArray( GLuint( vao ));
+    glUseProgram( GLuint( program ));
+    glBindSampler( 0, GLuint( sampler ));
+    glBindTexture( GL_TEXTURE_2D, GLuint( texture ));
+    glActiveTexture( GLenum( activeTexture ));
+    if ( depthTest )
+      glEnable( GL_DEPTH_TEST );
+    if ( blend )
+      glEnable( GL_BLEND );
+    if ( scissorTest )
+      glEnable( GL_SCISSOR_TEST );
+    glViewport( viewport[ 0 ], viewport[ 1 ], viewport[ 2 ], viewport[ 3 ]);
+    glBindFramebuffer( GL_DRAW_FRAMEBUFFER, GLuint( framebuffer ));
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, GLuint( readFramebuffer ));
+
+    // Coarser levels are small, so they are completed on the CPU
+    for ( size_t l = 1; l < _hiz.size( ); ++l )
+    {
+      const HiZLevel& source = _hiz[ l - 1 ];
+      HiZLevel& level = _hiz[ l ];
+      for ( unsigned int y = 0; y < level.height; ++y )
+      {
+        const unsigned int y0 = 2 * y;
+        const unsigned int y1 = std::min( y0 + 1, source.height - 1 );
+        for ( unsigned int x = 0; x < level.width; ++x )
+        {
+          const unsigned int x0 = 2 * x;
+          const unsigned int x1 = std::min( x0 + 1, source.width - 1 );
+          level.depth[ y * level.width + x ] = std::max(
+            std::max( source.depth[ y0 * source.width + x0 ],
+              source.depth[ y0 * source.width + x1 ]),
+            std::max( source.depth[ y1 * source.width + x0 ],
+              source.depth[ y1 * source.width + x1 ]));
+        }
+      }
+    }
+  }
+
+  void CullingSystem::clearOcclusion( void )
+  {
+    _hiz.clear( );
+    _depthWidth = _depthHeight = 0;
+  }
+
+  const std::vector< Pickable* >& CullingSystem::cull(
+    const float* projectionView )
+  {
+    Eigen::Vector4f planes[ 6 ];
+    frustumPlanes( projectionView, planes );
+    const bool occlusion = _occlusion && !_hiz.empty( );
+
+    _visible.clear( );
+    _stats = CullingStats( );
+    _stats.objects = _objects.size( );
+    for ( auto& object : _objects )
+    {
+      object.visibility = VISIBLE;
+
+      // Objects without positions can not be bounded
+      if ( object.min[ 0 ] > object.max[ 0 ])
+      {
+        _visible.push_back( object.pickable );
+        continue;
+      }
+
+      Eigen::Vector3f min, max;
+      worldBounds( object.pickable->getModel( ), object.min, object.max,
+        min, max );
+      const Eigen::Vector3f center = 0.5f * ( min + max );
+      const Eigen::Vector3f extent = max - center;
+      for ( const auto& plane : planes )
+      {
+        if ( plane.head< 3 >( ).dot( center ) + plane.w( ) +
+          plane.head< 3 >( ).cwiseAbs( ).dot( extent ) < 0.0f )
+        {
+          object.visibility = OUTSIDE;
+          break;
+        }
+      }
+
+      if ( object.visibility == VISIBLE && occlusion &&
+        occluded( projectionView, min.data( ), max.data( )))
+      {
+        object.visibility = OCCLUDED;
+      }
+
+      if ( object.visibility == OUTSIDE )
+        ++_stats.frustumCulled;
+      else if ( object.visibility == OCCLUDED )
+        ++_stats.occlusionCulled;
+      else
+        _visible.push_back( object.pickable );
+    }
+    _stats.submitted = _visible.size( );
+    ++_frame;
+    return _visible;
+  }
+
+  const std::vector< Pickable* >& CullingSystem::cull( Camera* camera )
+  {
+    return cull( camera->projectionViewMatrix( ));
+  }
+
+  const std::vector< Pickable* >& CullingSystem::visible( void ) const
+  {
+    return _visible;
+  }
+
+  bool CullingSystem::isVisible( Pickable* object ) const
+  {
+    const auto it = _indices.find( object );
+    return it == _indices.end( ) ||
+      _objects[ it->second ].visibility == VISIBLE;
+  }
+
+  bool CullingSystem::inFrustum( Pickable* object ) const
+  {
+    const auto it = _indices.find( object );
+    return it == _indices.end( ) ||
+      _objects[ it->second ].visibility != OUTSIDE;
+  }
+
+  const CullingStats& CullingSystem::stats( void ) const
+  {
+    return _stats;
+  }
+
+  unsigned int CullingSystem::frame( void ) const
+  {
+    return _frame;
+  }
+
+  bool CullingSystem::occluded( const float* projectionView,
+    const float* min, const float* max ) const
+  {
+    // Screen rectangle and nearest depth of the box
+    const Eigen::Map< const Eigen::Matrix4f > pv( projectionView );
+    float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f;
+    float minZ = 1.0f;
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+      const Eigen::Vector4f clip = pv * Eigen::Vector4f(
+        corner & 1 ? max[ 0 ] : min[ 0 ], corner & 2 ? max[ 1 ] : min[ 1 ],
+        corner & 4 ? max[ 2 ] : min[ 2 ], 1.0f );
+
+      // Boxes crossing the near plane are always drawn
+      if ( clip.w( ) <= std::numeric_limits< float >::epsilon( ))
+        return false;
+      const Eigen::Vector3f ndc = clip.head< 3 >( ) / clip.w( );
+      minX = std::min( minX, ndc.x( ));
+      maxX = std::max( maxX, ndc.x( ));
+      minY = std::min( minY, ndc.y( ));
+      maxY = std::max( maxY, ndc.y( ));
+      minZ = std::min( minZ, ndc.z( ));
+    }
+    const float depth = 0.5f * minZ + 0.5f;
+
+    // Depth pixels covered by the rectangle, in the finest level
+    auto texel = [ this ]( float ndc, unsigned int size )
+    {
+      const float pixel = std::floor(( 0.5f * ndc + 0.5f ) * size );
+      const float clamped = std::min( std::max( pixel, 0.0f ),
+        float( size - 1 ));
+      return unsigned( clamped ) / _hizScale;
+    };
+    unsigned int x0 = texel( minX, _depthWidth );
+    unsigned int x1 = texel( maxX, _depthWidth );
+    unsigned int y0 = texel( minY, _depthHeight );
+    unsigned int y1 = texel( maxY, _depthHeight );
+
+    // Finest level where the rectangle spans at most 4x4 texels
+    size_t l = 0;
+    while ( l + 1 < _hiz.size( ) && ( x1 - x0 > 3 || y1 - y0 > 3 ))
+    {
+      x0 >>= 1;
+      x1 >>= 1;
+      y0 >>= 1;
+      y1 >>= 1;
+      ++l;
+    }
+
+    const HiZLevel& level = _hiz[ l ];
+    float maxDepth = 0.0f;
+    for ( unsigned int y = y0; y <= y1; ++y )
+    {
+      for ( unsigned int x = x0; x <= x1; ++x )
+        maxDepth = std::max( maxDepth, level.depth[ y * level.width + x ]);
+    }
+    return depth > maxDepth;
+  }
+
+  void CullingSystem::computeBounds( Object& object )
+  {
+    const std::vector< float > positions = object.pickable->getPositions( );
+    std::fill( object.min, object.min + 3,
+      std::numeric_limits< float >::max( ));
+    std::fill( object.max, object.max + 3,
+      -std::numeric_limits< float >::max( ));
+    for ( size_t i = 0; i + 2 < positions.size( ); i += 3 )
+    {
+      for ( int j = 0; j < 3; ++j )
+      {
+        object.min[ j ] = std::min( object.min[ j ], positions[ i + j ]);
+        object.max[ j ] = std::max( object.max[ j ], positions[ i + j ]);
+      }
+    }
+  }
+
+} /* namespace reto */
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__CULLING_SYSTEM__
+#define __RETO__CULLING_SYSTEM__
+
+#include <reto/api.h>
+#include "Pickable.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace reto
+{
+  class Camera;
+  class ShaderProgram;
+
+  //! Counters of the last culling pass
+  struct CullingStats
+  {
+    //! Registered objects
+    size_t objects;
+    //! Objects outside the view frustum
+    size_t frustumCulled;
+    //! Objects in the frustum hidden behind the occlusion depth
+    size_t occlusionCulled;
+    //! Objects in the visible set
+    size_t submitted;
+  };
+
+  /**
+   * Class computing once per frame the set of objects that can be visible,
+   * to be consumed by PickingSystem, the selection systems and user render
+   * loops. Objects are tested by their world bounds, taken from
+   * getPositions and getModel, against the view frustum and, optionally,
+   * against a hierarchical depth ( Hi-Z ) of a previous frame. The Hi-Z is
+   * reduced on the GPU to at most HIZ_SIZE texels per side, read back, and
+   * completed to a max depth pyramid on the CPU. Frustum culling does not
+   * need an OpenGL context.
+   * @class CullingSystem
+   */
+  class CullingSystem
+  {
+    public:
+      //! Maximum width and height of the finest level of the Hi-Z
+      static const unsigned int HIZ_SIZE = 128;
+
+      /**
+       * CullingSystem constructor
+       */
+      RETO_API
+      CullingSystem( void );
+
+      /**
+       * CullingSystem destructor
+       */
+      RETO_API
+      ~CullingSystem( void );
+
+      /**
+       * Method to add a Pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void AddObject( reto::Pickable* object );
+
+      /**
+       * Method to remove a Pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void RemoveObject( reto::Pickable* object );
+
+      /**
+       * Method to remove all objects
+       */
+      RETO_API
+      void Clear( void );
+
+      /**
+       * Method to compute the model space bounds of an object again after
+       * its positions changed. Model matrices are read on each cull.
+       * @param object: Pickable object
+       */
+      RETO_API
+      void updateGeometry( reto::Pickable* object );
+
+      /**
+       * Method to enable or disable the occlusion test. Without an
+       * occlusion depth from updateOcclusion only the frustum is tested.
+       * @param enabled: Occlusion culling flag ( default = false ).
+       */
+      RETO_API
+      void setOcclusionCulling( bool enabled );
+
+      /**
+       * Method to check if the occlusion test is enabled
+       * @return bool
+       */
+      RETO_API
+      bool occlusionCulling( void ) const;
+
+      /**
+       * Method to build the Hi-Z from a depth texture, usually the depth of
+       * the previous frame. Depth is expected in [ 0, 1 ] with GL_LESS
+       * testing. Keeps the framebuffer, program, texture and viewport
+       * bindings.
+       * @param depthTexture: OpenGL name of a depth texture
+       * @param width: Texture width
+       * @param height: Texture height
+       */
+      RETO_API
+      void updateOcclusion( unsigned int depthTexture, unsigned int width,
+        unsigned int height );
+
+      /**
+       * Method to drop the Hi-Z, so only the frustum is tested until the
+       * next updateOcclusion
+       */
+      RETO_API
+      void clearOcclusion( void );
+
+      /**
+       * Method to compute the visible set of a view
+       * @param projectionView: Column major projection view matrix
+       * @return Objects that can be visible, in insertion order
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& cull(
+        const float* projectionView );
+
+      /**
+       * Method to compute the visible set of a camera view
+       * @param camera: Camera giving the projection view matrix
+       * @return Objects that can be visible, in insertion order
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& cull( reto::Camera* camera );
+
+      /**
+       * Method to get the visible set of the last cull
+       * @return Objects that can be visible, in insertion order
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& visible( void ) const;
+
+      /**
+       * Method to check if an object passed the last cull. Objects that
+       * were never culled count as visible.
+       * @param object: Pickable object
+       * @return bool
+       */
+      RETO_API
+      bool isVisible( reto::Pickable* object ) const;
+
+      /**
+       * Method to check if an object was inside the frustum in the last
+       * cull, whether or not it was occluded
+       * @param object: Pickable object
+       * @return bool
+       */
+      RETO_API
+      bool inFrustum( reto::Pickable* object ) const;
+
+      /**
+       * Method to get the counters of the last cull
+       * @return CullingStats
+       */
+      RETO_API
+      const CullingStats& stats( void ) const;
+
+      /**
+       * Method to get a serial increased by each cull and each change of
+       * the objects, to detect when the visible set may have changed
+       * @return unsigned int
+       */
+      RETO_API
+      unsigned int frame( void ) const;
+
+    protected:
+      //! Result of an object in the last cull
+      enum Visibility
+      {
+        VISIBLE,
+        OCCLUDED,
+        OUTSIDE
+      };
+
+      //! Culling state of an object
+      struct Object
+      {
+        //! Culled object
+        reto::Pickable* pickable;
+        //! Model space bounds minimum
+        float min[ 3 ];
+        //! Model space bounds maximum
+        float max[ 3 ];
+        //! Result of the last cull
+        Visibility visibility;
+      };
+
+      //! Level of the Hi-Z pyramid
+      struct HiZLevel
+      {
+        unsigned int width;
+        unsigned int height;
+        std::vector< float > depth;
+      };
+
+      /*
+        Test a world space box against the Hi-Z
+        @param const float* projectionView
+        @param const float* min
+        @param const float* max
+        @return bool: true if the box is hidden
+      */
+      bool occluded( const float* projectionView, const float* min,
+        const float* max ) const;
+
+      /*
+        Compute the model space bounds of an object
+        @param Object object
+      */
+      static void computeBounds( Object& object );
+
+      //! Culling state in insertion order
+      std::vector< Object > _objects;
+
+      //! Position of each object in _objects
+      std::unordered_map< reto::Pickable*, size_t > _indices;
+
+      //! Visible set of the last cull
+      std::vector< reto::Pickable* > _visible;
+
+      //! Counters of the last cull
+      CullingStats _stats;
+
+      //! Serial of the last cull
+      unsigned int _frame;
+
+      //! Occlusion culling flag
+      bool _occlusion;
+
+      //! Max depth pyramid, finest level first
+      std::vector< HiZLevel > _hiz;
+
+      //! Depth width of the Hi-Z
+      unsigned int _depthWidth;
+
+      //! Depth height of the Hi-Z
+      unsigned int _depthHeight;
+
+      //! Depth pixels per side of a texel of the finest Hi-Z level
+      unsigned int _hizScale;
+
+      //! Program reducing the depth to the finest Hi-Z level
+      reto::ShaderProgram* _program;
+
+      //! Framebuffer of the reduction
+      unsigned int _framebuffer;
+
+      //! Texture of the finest Hi-Z level
+      unsigned int _texture;
+
+      //! Empty vertex array of the full screen pass
+      unsigned int _vao;
+
+      //! Sampler reading the depth texture without filtering
+      unsigned int _sampler;
+
+  }; /* class CullingSystem */
+
+} /* namespace reto */
+
+#endif /* __RETO__CULLING_SYSTEM__ */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace reto
+{
+
+#ifdef _WIN32
+
+  MappedFile::MappedFile( const std::string& filename, bool sequential )
+    : _data( nullptr )
+    , _size( 0 )
+    , _valid( false )
+    , _file( INVALID_HANDLE_VALUE )
+    , _mapping( nullptr )
+  {
+    _file = CreateFileA( filename.c_str( ), GENERIC_READ, FILE_SHARE_READ,
+      nullptr, OPEN_EXISTING,
+      sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL,
+      nullptr );
+    if ( _file == INVALID_HANDLE_VALUE )
+      return;
+
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( _file, &fileSize ))
+      return;
+    _size = static_cast< size_t >( fileSize.QuadPart );
+    if ( _size == 0 )
+    {
+      _valid = true;
+      return;
+    }
+
+    _mapping = CreateFileMappingA( _file, nullptr, PAGE_READONLY, 0, 0,
+      nullptr );
+    if ( !_mapping )
+      return;
+
+    _data = static_cast< const char* >(
+      MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 ));
+    _valid = _data != nullptr;
+  }
+
+  MappedFile::~MappedFile( void )
+  {
+    if ( _data )
+      UnmapViewOfFile( _data );
+    if ( _mapping )
+      CloseHandle( _mapping );
+    if ( _file != INVALID_HANDLE_VALUE )
+      CloseHandle( _file );
+  }
+
+  void MappedFile::release( size_t, size_t )
+  {
+  }
+
+#else
+
+  MappedFile::MappedFile( const std::string& filename, bool sequential )
+    : _data( nullptr )
+    , _size( 0 )
+    , _valid( false )
+    , _fd( -1 )
+  {
+    _fd = open( filename.c_str( ), O_RDONLY );
+    if ( _fd < 0 )
+      return;
+
+    struct stat info;
+    if ( fstat( _fd, &info ) != 0 )
+      return;
+    _size = static_cast< size_t >( info.st_size );
+    if ( _size == 0 )
+    {
+      _valid = true;
+      return;
+    }
+
+    void* addr = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+    if ( addr == MAP_FAILED )
+      return;
+
+    _data = static_cast< const char* >( addr );
+    if ( sequential )
+      madvise( addr, _size, MADV_SEQUENTIAL );
+    _valid = true;
+  }
+
+  MappedFile::~MappedFile( void )
+  {
+    if ( _data )
+      munmap( const_cast< char* >( _data ), _size );
+    if ( _fd >= 0 )
+      close( _fd );
+  }
+
+  void MappedFile::release( size_t offset, size_t length )
+  {
+    if ( !_data || offset >= _size )
+      return;
+    if ( length > _size - offset )
+      length = _size - offset;
+
+    const size_t page = static_cast< size_t >( sysconf( _SC_PAGESIZE ));
+    const size_t begin = ( offset + page - 1 ) / page * page;
+    const size_t end = ( offset + length ) / page * page;
+    if ( end > begin )
+    {
+      madvise( const_cast< char* >( _data ) + begin, end - begin,
+        MADV_DONTNEED );
+    }
+  }
+
+#endif
+
+  bool MappedFile::isValid( void ) const
+  {
+    return _valid;
+  }
+
+  const char* MappedFile::data( void ) const
+  {
+    return _data;
+  }
+
+  size_t MappedFile::size( void ) const
+  {
+    return _size;
+  }
+
+} /* namespace reto */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__MAPPED_FILE__
+#define __RETO__MAPPED_FILE__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <string>
+
+namespace reto
+{
+  /**
+   * Class to map a whole file read-only in memory
+   * @class MappedFile
+   */
+  class MappedFile
+  {
+    public:
+      /**
+       * MappedFile constructor. Maps the whole file read-only.
+       * @param filename: File route.
+       * @param sequential: Hint the kernel that the file will be read
+       *   sequentially (more read-ahead, pages dropped behind).
+       */
+      RETO_API
+      MappedFile( const std::string& filename, bool sequential = true );
+
+      /**
+       * MappedFile destructor. Unmaps the file.
+       */
+      RETO_API
+      ~MappedFile( void );
+
+      /**
+       * Method to check if the file was successfully mapped
+       * @return bool
+       */
+      RETO_API
+      bool isValid( void ) const;
+
+      /**
+       * Method to get the mapped content. Is not null terminated.
+       * @return pointer to the first byte ( nullptr on empty files ).
+       */
+      RETO_API
+      const char* data( void ) const;
+
+      /**
+       * Method to get the mapped content size
+       * @return size in bytes.
+       */
+      RETO_API
+      size_t size( void ) const;
+
+      /**
+       * Method to tell that a range will not be read again, so its pages
+       * can leave the resident set. Only whole pages inside the range are
+       * released; contents are still readable (they are faulted in again).
+       * @param offset: Range start in bytes.
+       * @param length: Range length in bytes.
+       */
+      RETO_API
+      void release( size_t offset, size_t length );
+
+    private:
+      MappedFile( const MappedFile& );
+      MappedFile& operator=( const MappedFile& );
+
+      //! Mapped content
+      const char* _data;
+
+      //! Mapped content size
+      size_t _size;
+
+      //! Mapping valid flag
+      bool _valid;
+
+#ifdef _WIN32
+      //! File handle
+      void* _file;
+
+      //! File mapping handle
+      void* _mapping;
+#else
+      //! File descriptor
+      int _fd;
+#endif
+
+  }; /* class MappedFile */
+
+} /* namespace reto */
+
+#endif /* __RETO__MAPPED_FILE__ */
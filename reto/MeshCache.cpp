@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "MeshCache.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace reto
+{
+  namespace
+  {
+    const char MAGIC[ 8 ] = { 'R', 'E', 'T', 'O', 'M', 'E', 'S', 'H' };
+    const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    const uint32_t NUM_SECTIONS = 6;
+    const size_t ALIGNMENT = 64;
+
+    //! File header, followed by the section table
+    struct FileHeader
+    {
+      char magic[ 8 ];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t numSections;
+      uint32_t flags;
+      MeshSource source;
+      char padding[ 16 ];
+    };
+
+    //! Section table entry
+    struct SectionEntry
+    {
+      uint32_t section;
+      uint32_t elementSize;
+      uint64_t offset;
+      uint64_t count;
+    };
+
+    inline uint64_t align( uint64_t offset )
+    {
+      return ( offset + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // FNV-1a
+    uint64_t hashBytes( uint64_t hash, const void* data, size_t size )
+    {
+      const unsigned char* bytes = static_cast< const unsigned char* >( data );
+      for ( size_t i = 0; i < size; ++i )
+      {
+        hash ^= bytes[ i ];
+        hash *= 0x100000001B3ull;
+      }
+      return hash;
+    }
+  }
+
+  const uint32_t MeshCache::VERSION;
+  const uint32_t MeshCache::OPTIMIZED;
+
+  MeshCache::MeshCache( const std::string& filename )
+    : _file( new MappedFile( filename, false ))
+    , _flags( 0 )
+    , _valid( false )
+  {
+    memset( &_source, 0, sizeof( _source ));
+    for ( uint32_t i = 0; i < NUM_SECTIONS; ++i )
+    {
+      _sections[ i ] = nullptr;
+      _counts[ i ] = 0;
+    }
+
+    const size_t size = _file->size( );
+    const size_t tableEnd =
+      sizeof( FileHeader ) + NUM_SECTIONS * sizeof( SectionEntry );
+    if ( !_file->isValid( ) || size < tableEnd )
+      return;
+
+    FileHeader header;
+    memcpy( &header, _file->data( ), sizeof( header ));
+    if ( memcmp( header.magic, MAGIC, sizeof( MAGIC )) != 0 ||
+      header.version != VERSION || header.byteOrder != BYTE_ORDER_MARK ||
+      header.numSections != NUM_SECTIONS )
+    {
+      return;
+    }
+
+    for ( uint32_t i = 0; i < NUM_SECTIONS; ++i )
+    {
+      SectionEntry entry;
+      memcpy( &entry, _file->data( ) + sizeof( FileHeader ) +
+        i * sizeof( SectionEntry ), sizeof( entry ));
+      if ( entry.section != i || entry.elementSize != 4 ||
+        entry.offset % ALIGNMENT != 0 || entry.offset > size ||
+        entry.count > ( size - entry.offset ) / entry.elementSize )
+      {
+        return;
+      }
+      _sections[ i ] = entry.count > 0 ? _file->data( ) + entry.offset : nullptr;
+      _counts[ i ] = static_cast< size_t >( entry.count );
+    }
+
+    _source = header.source;
+    _flags = header.flags;
+    _valid = true;
+  }
+
+  MeshCache::~MeshCache( void )
+  {
+  }
+
+  bool MeshCache::isValid( void ) const
+  {
+    return _valid;
+  }
+
+  const MeshSource& MeshCache::source( void ) const
+  {
+    return _source;
+  }
+
+  uint32_t MeshCache::flags( void ) const
+  {
+    return _flags;
+  }
+
+  const void* MeshCache::data( MeshSection section, size_t& count ) const
+  {
+    const size_t i = static_cast< size_t >( section );
+    count = _counts[ i ];
+    return _sections[ i ];
+  }
+
+  Model MeshCache::model( void ) const
+  {
+    Model m;
+    std::vector< float >* floats[ ] = { &m.vertices, &m.normals,
+      &m.texCoords, &m.tangents, &m.bitangents };
+    for ( uint32_t i = 0; i < NUM_SECTIONS - 1; ++i )
+    {
+      const float* values = static_cast< const float* >( _sections[ i ]);
+      floats[ i ]->assign( values, values + _counts[ i ]);
+    }
+
+    const size_t indices = static_cast< size_t >( MeshSection::Indices );
+    const int* values = static_cast< const int* >( _sections[ indices ]);
+    m.indices.assign( values, values + _counts[ indices ]);
+    return m;
+  }
+
+  bool MeshCache::write( const std::string& filename, const Model& model,
+    const MeshSource& source, uint32_t flags )
+  {
+    const void* arrays[ ] = { model.vertices.data( ), model.normals.data( ),
+      model.texCoords.data( ), model.tangents.data( ),
+      model.bitangents.data( ), model.indices.data( ) };
+    const size_t counts[ ] = { model.vertices.size( ), model.normals.size( ),
+      model.texCoords.size( ), model.tangents.size( ),
+      model.bitangents.size( ), model.indices.size( ) };
+
+    FileHeader header;
+    memset( &header, 0, sizeof( header ));
+    memcpy( header.magic, MAGIC, sizeof( MAGIC ));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.numSections = NUM_SECTIONS;
+    header.flags = flags;
+    header.source = source;
+
+    SectionEntry entries[ NUM_SECTIONS ];
+    uint64_t offset =
+      align( sizeof( FileHeader ) + sizeof( entries ));
+    for ( uint32_t i = 0; i < NUM_SECTIONS; ++i )
+    {
+      entries[ i ].section = i;
+      entries[ i ].elementSize = 4;
+      entries[ i ].offset = offset;
+      entries[ i ].count = counts[ i ];
+      offset = align( offset + counts[ i ] * 4 );
+    }
+
+    const std::string temporary = filename + ".tmp";
+    {
+      std::ofstream out( temporary.c_str( ),
+        std::ios::out | std::ios::binary | std::ios::trunc );
+      if ( !out )
+        return false;
+
+      const char zeros[ ALIGNMENT ] = { 0 };
+      out.write( reinterpret_cast< const char* >( &header ), sizeof( header ));
+      out.write( reinterpret_cast< const char* >( entries ), sizeof( entries ));
+      uint64_t written = sizeof( header ) + sizeof( entries );
+      for ( uint32_t i = 0; i < NUM_SECTIONS; ++i )
+      {
+        out.write( zeros, static_cast< std::streamsize >(
+          entries[ i ].offset - written ));
+        out.write( static_cast< const char* >( arrays[ i ]),
+          static_cast< std::streamsize >( counts[ i ] * 4 ));
+        written = entries[ i ].offset + counts[ i ] * 4;
+      }
+      if ( !out )
+      {
+        out.close( );
+        std::remove( temporary.c_str( ));
+        return false;
+      }
+    }
+
+#ifdef _WIN32
+    // rename does not replace existing files on Windows
+    std::remove( filename.c_str( ));
+#endif
+    if ( std::rename( temporary.c_str( ), filename.c_str( )) != 0 )
+    {
+      std::remove( temporary.c_str( ));
+      return false;
+    }
+    return true;
+  }
+
+  bool MeshCache::identify( const std::string& filename, MeshSource& source )
+  {
+#ifdef _WIN32
+    struct _stat64 info;
+    if ( _stat64( filename.c_str( ), &info ) != 0 )
+      return false;
+#else
+    struct stat info;
+    if ( ::stat( filename.c_str( ), &info ) != 0 )
+      return false;
+#endif
+    source.size = static_cast< uint64_t >( info.st_size );
+    source.mtime = static_cast< int64_t >( info.st_mtime );
+
+    std::ifstream in( filename.c_str( ), std::ios::in | std::ios::binary );
+    if ( !in )
+      return false;
+
+    const uint64_t sampleSize = 4096;
+    const uint64_t numSamples = 16;
+    std::vector< char > sample( sampleSize );
+    uint64_t hash = hashBytes( 0xCBF29CE484222325ull,
+      &source.size, sizeof( source.size ));
+    for ( uint64_t i = 0; i < numSamples; ++i )
+    {
+      const uint64_t offset = source.size <= sampleSize ? 0 :
+        ( source.size - sampleSize ) * i / ( numSamples - 1 );
+      in.seekg( static_cast< std::streamoff >( offset ));
+      in.read( sample.data( ), sampleSize );
+      hash = hashBytes( hash, sample.data( ),
+        static_cast< size_t >( in.gcount( )));
+      in.clear( );
+      if ( source.size <= sampleSize )
+        break;
+    }
+    source.hash = hash;
+    return true;
+  }
+
+  std::string MeshCache::cacheFilename( const std::string& filename )
+  {
+    return filename + ".retomesh";
+  }
+
+} /* namespace reto */
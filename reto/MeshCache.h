@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__MESH_CACHE__
+#define __RETO__MESH_CACHE__
+
+#include <reto/api.h>
+#include "ObjParser.h"
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace reto
+{
+  class MappedFile;
+
+  /**
+  * Model arrays stored in a mesh cache
+  * @enum class MeshSection
+  */
+  enum class MeshSection
+  {
+    Vertices,
+    Normals,
+    TexCoords,
+    Tangents,
+    Bitangents,
+    Indices
+  };
+
+  /**
+   * Struct identifying the source file a mesh cache was built from
+   * @struct MeshSource
+   */
+  struct MeshSource
+  {
+    //! File size in bytes
+    uint64_t size;
+    //! Last modification time in seconds since epoch
+    int64_t mtime;
+    //! Hash of the size and of evenly spaced samples of the content
+    uint64_t hash;
+  };
+
+  /**
+   * Read-only view of a .retomesh file, a versioned binary container of a
+   * reto::Model. The file is a header, a section table and the model
+   * arrays stored contiguously, each one 64 byte aligned, in native byte
+   * order. It is memory mapped, so arrays are used in place without
+   * parsing.
+   * @class MeshCache
+   */
+  class MeshCache
+  {
+    public:
+      //! Current format version
+      static const uint32_t VERSION = 2;
+
+      //! Flag of models reordered by MeshOptimizer
+      static const uint32_t OPTIMIZED = 1;
+
+      /**
+       * MeshCache constructor. Maps the file and checks its header.
+       * @param filename: .retomesh file route.
+       */
+      RETO_API
+      MeshCache( const std::string& filename );
+
+      /**
+       * MeshCache destructor. Unmaps the file.
+       */
+      RETO_API
+      ~MeshCache( void );
+
+      /**
+       * Method to check if the file was mapped and is a valid cache of the
+       * current version
+       * @return bool
+       */
+      RETO_API
+      bool isValid( void ) const;
+
+      /**
+       * Method to get the source file the cache was built from
+       * @return MeshSource
+       */
+      RETO_API
+      const MeshSource& source( void ) const;
+
+      /**
+       * Method to get the flags the cache was written with
+       * @return uint32_t
+       */
+      RETO_API
+      uint32_t flags( void ) const;
+
+      /**
+       * Method to get a section of the model
+       * @param section: Section to get.
+       * @param count: Number of elements ( floats or ints ) in the section.
+       * @return pointer to the first element ( nullptr when empty ).
+       */
+      RETO_API
+      const void* data( MeshSection section, size_t& count ) const;
+
+      /**
+       * Method to copy the cached arrays to a Model
+       * @return Model
+       */
+      RETO_API
+      Model model( void ) const;
+
+      /**
+       * Method to write a model cache. Writes a temporary file first and
+       * renames it, so readers never see a partial cache.
+       * @param filename: .retomesh file route.
+       * @param model: Model to store.
+       * @param source: Source file identification.
+       * @param flags: Processing applied to the model ( OPTIMIZED ).
+       * @return false if the file could not be written.
+       */
+      RETO_API
+      static bool write( const std::string& filename, const Model& model,
+        const MeshSource& source, uint32_t flags = 0 );
+
+      /**
+       * Method to identify a source file by size, modification time and a
+       * hash of up to 16 evenly spaced 4 KB samples, so that it does not
+       * need to be read whole.
+       * @param filename: Source file route.
+       * @param source: Source identification.
+       * @return false if the file can not be read.
+       */
+      RETO_API
+      static bool identify( const std::string& filename, MeshSource& source );
+
+      /**
+       * Method to get the cache route of a source file ( the source route
+       * with the .retomesh extension appended ).
+       * @param filename: Source file route.
+       * @return std::string
+       */
+      RETO_API
+      static std::string cacheFilename( const std::string& filename );
+
+    private:
+      MeshCache( const MeshCache& );
+      MeshCache& operator=( const MeshCache& );
+
+      //! Mapped file
+      std::unique_ptr< MappedFile > _file;
+
+      //! Source identification
+      MeshSource _source;
+
+      //! Processing flags
+      uint32_t _flags;
+
+      //! Section pointers and element counts
+      const void* _sections[ 6 ];
+      size_t _counts[ 6 ];
+
+      //! Valid cache flag
+      bool _valid;
+
+  }; /* class MeshCache */
+
+} /* namespace reto */
+
+#endif /* __RETO__MESH_CACHE__ */
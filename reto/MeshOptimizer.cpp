@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace reto
+{
+  namespace
+  {
+    const unsigned int MIN_CACHE_SIZE = 4;
+    const unsigned int MAX_CACHE_SIZE = 64;
+
+    // Scoring parameters from Forsyth's "Linear-Speed Vertex Cache
+    // Optimisation"
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+    const unsigned int MAX_VALENCE = 32;
+
+    //! Precomputed vertex scores
+    class VertexScore
+    {
+    public:
+      VertexScore( unsigned int cacheSize )
+      {
+        _cache[ 0 ] = 0.0f;
+        for ( unsigned int i = 0; i < cacheSize; ++i )
+        {
+          // The vertices of the last triangle get a fixed score, so the
+          // next one does not reuse all of them in a strip-like order
+          _cache[ i + 1 ] = i < 3 ? LAST_TRIANGLE_SCORE :
+            powf( 1.0f - float( i - 3 ) / float( cacheSize - 3 ),
+              CACHE_DECAY_POWER );
+        }
+        _valence[ 0 ] = 0.0f;
+        for ( unsigned int i = 1; i < MAX_VALENCE; ++i )
+          _valence[ i ] = VALENCE_BOOST_SCALE *
+            powf( float( i ), -VALENCE_BOOST_POWER );
+      }
+
+      float operator( )( int position, size_t remaining ) const
+      {
+        if ( remaining == 0 )
+          return 0.0f;
+        return _cache[ position + 1 ] +
+          _valence[ std::min( remaining, size_t( MAX_VALENCE - 1 ))];
+      }
+
+    private:
+      float _cache[ MAX_CACHE_SIZE + 1 ];
+      float _valence[ MAX_VALENCE ];
+    };
+
+    template < typename T >
+    void remap( std::vector< T >& values, const std::vector< int >& newIndex,
+      size_t components )
+    {
+      if ( values.size( ) != newIndex.size( ) * components )
+        return;
+      std::vector< T > result( values.size( ));
+      for ( size_t v = 0; v < newIndex.size( ); ++v )
+      {
+        std::copy( values.begin( ) + v * components,
+          values.begin( ) + ( v + 1 ) * components,
+          result.begin( ) + size_t( newIndex[ v ]) * components );
+      }
+      values.swap( result );
+    }
+  }
+
+  MeshOptimizer::MeshOptimizer( unsigned int cacheSize )
+  {
+    setCacheSize( cacheSize );
+  }
+
+  void MeshOptimizer::setCacheSize( unsigned int cacheSize )
+  {
+    _cacheSize = std::max( MIN_CACHE_SIZE,
+      std::min( cacheSize, MAX_CACHE_SIZE ));
+  }
+
+  unsigned int MeshOptimizer::cacheSize( void ) const
+  {
+    return _cacheSize;
+  }
+
+  MeshOptimizer::Stats MeshOptimizer::optimize( Model& model ) const
+  {
+    const size_t numVertices = model.vertices.size( ) / 3;
+    Stats stats;
+    analyze( model.indices, numVertices, stats.acmrBefore, stats.atvrBefore );
+    optimizeVertexCache( model.indices, numVertices );
+    optimizeVertexFetch( model );
+    analyze( model.indices, numVertices, stats.acmrAfter, stats.atvrAfter );
+    return stats;
+  }
+
+  void MeshOptimizer::optimizeVertexCache( std::vector< int >& indices,
+    size_t numVertices ) const
+  {
+    const size_t numTriangles = indices.size( ) / 3;
+    if ( numTriangles < 2 )
+      return;
+
+    // Triangles using each vertex. The first remaining[ v ] entries of a
+    // vertex list are the triangles not emitted yet.
+    std::vector< size_t > offsets( numVertices + 1, 0 );
+    for ( size_t i = 0; i < numTriangles * 3; ++i )
+      ++offsets[ size_t( indices[ i ])];
+    for ( size_t v = 0; v < numVertices; ++v )
+      offsets[ v + 1 ] += offsets[ v ];
+    std::vector< size_t > adjacency( numTriangles * 3 );
+    for ( size_t i = numTriangles * 3; i-- > 0; )
+      adjacency[ --offsets[ size_t( indices[ i ])]] = i / 3;
+    std::vector< size_t > remaining( numVertices );
+    for ( size_t v = 0; v < numVertices; ++v )
+      remaining[ v ] = offsets[ v + 1 ] - offsets[ v ];
+
+    const VertexScore score( _cacheSize );
+    std::vector< int > position( numVertices, -1 );
+    std::vector< float > vertexScore( numVertices );
+    for ( size_t v = 0; v < numVertices; ++v )
+      vertexScore[ v ] = score( -1, remaining[ v ]);
+
+    std::vector< bool > emitted( numTriangles, false );
+    int best = 0;
+    float bestScore = -1.0f;
+    for ( size_t t = 0; t < numTriangles; ++t )
+    {
+      const int* c = &indices[ t * 3 ];
+      const float triangleScore = vertexScore[ c[ 0 ]] +
+        vertexScore[ c[ 1 ]] + vertexScore[ c[ 2 ]];
+      if ( triangleScore > bestScore )
+      {
+        bestScore = triangleScore;
+        best = int( t );
+      }
+    }
+
+    // LRU cache, with room for the vertices pushed out by a triangle
+    std::vector< int > cache, nextCache;
+    cache.reserve( _cacheSize + 3 );
+    nextCache.reserve( _cacheSize + 3 );
+    std::vector< int > result( indices.size( ));
+    size_t nextUnemitted = 0;
+    for ( size_t n = 0; n < numTriangles; ++n )
+    {
+      if ( best < 0 )
+      {
+        // No triangle touches the cache, continue with the first one left
+        while ( emitted[ nextUnemitted ])
+          ++nextUnemitted;
+        best = int( nextUnemitted );
+      }
+
+      const size_t triangle = size_t( best );
+      const int* c = &indices[ triangle * 3 ];
+      emitted[ triangle ] = true;
+      std::copy( c, c + 3, result.begin( ) + n * 3 );
+
+      nextCache.clear( );
+      for ( int k = 0; k < 3; ++k )
+      {
+        const size_t v = size_t( c[ k ]);
+        size_t* list = &adjacency[ offsets[ v ]];
+        size_t* last = list + remaining[ v ] - 1;
+        std::swap( *std::find( list, last, triangle ), *last );
+        --remaining[ v ];
+
+        if ( std::find( nextCache.begin( ), nextCache.end( ), c[ k ]) ==
+          nextCache.end( ))
+          nextCache.push_back( c[ k ]);
+      }
+      for ( int v : cache )
+      {
+        if ( v != c[ 0 ] && v != c[ 1 ] && v != c[ 2 ])
+          nextCache.push_back( v );
+      }
+
+      // Rescore the cached and evicted vertices and their triangles
+      for ( size_t i = 0; i < nextCache.size( ); ++i )
+      {
+        const int v = nextCache[ i ];
+        position[ v ] = i < _cacheSize ? int( i ) : -1;
+        vertexScore[ v ] = score( position[ v ], remaining[ v ]);
+      }
+      best = -1;
+      bestScore = -1.0f;
+      for ( int v : nextCache )
+      {
+        const size_t* list = &adjacency[ offsets[ v ]];
+        for ( size_t i = 0; i < remaining[ v ]; ++i )
+        {
+          const size_t t = list[ i ];
+          const int* tc = &indices[ t * 3 ];
+          const float triangleScore = vertexScore[ tc[ 0 ]] +
+            vertexScore[ tc[ 1 ]] + vertexScore[ tc[ 2 ]];
+          if ( triangleScore > bestScore )
+          {
+            bestScore = triangleScore;
+            best = int( t );
+          }
+        }
+      }
+
+      if ( nextCache.size( ) > _cacheSize )
+        nextCache.resize( _cacheSize );
+      cache.swap( nextCache );
+    }
+
+    std::copy( result.begin( ), result.begin( ) + numTriangles * 3,
+      indices.begin( ));
+  }
+
+  void MeshOptimizer::optimizeVertexFetch( Model& model )
+  {
+    const size_t numVertices = model.vertices.size( ) / 3;
+    std::vector< int > newIndex( numVertices, -1 );
+    int next = 0;
+    for ( int& index : model.indices )
+    {
+      if ( newIndex[ index ] < 0 )
+        newIndex[ index ] = next++;
+      index = newIndex[ index ];
+    }
+    for ( int& index : newIndex )
+    {
+      if ( index < 0 )
+        index = next++;
+    }
+
+    remap( model.vertices, newIndex, 3 );
+    remap( model.normals, newIndex, 3 );
+    remap( model.texCoords, newIndex, 2 );
+    remap( model.tangents, newIndex, 3 );
+    remap( model.bitangents, newIndex, 3 );
+  }
+
+  void MeshOptimizer::analyze( const std::vector< int >& indices,
+    size_t numVertices, float& acmr, float& atvr ) const
+  {
+    // Insertion time of each vertex. A vertex is cached while less than
+    // cacheSize vertices were inserted after it.
+    std::vector< size_t > inserted( numVertices, 0 );
+    size_t time = _cacheSize + 1;
+    size_t misses = 0;
+    size_t used = 0;
+    const size_t numTriangles = indices.size( ) / 3;
+    for ( size_t i = 0; i < numTriangles * 3; ++i )
+    {
+      size_t& stamp = inserted[ size_t( indices[ i ])];
+      if ( time - stamp > _cacheSize )
+      {
+        if ( stamp == 0 )
+          ++used;
+        stamp = time++;
+        ++misses;
+      }
+    }
+    acmr = numTriangles > 0 ? float( misses ) / float( numTriangles ) : 0.0f;
+    atvr = used > 0 ? float( misses ) / float( used ) : 0.0f;
+  }
+
+} /* namespace reto */
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__MESH_OPTIMIZER__
+#define __RETO__MESH_OPTIMIZER__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace reto
+{
+  struct Model;
+
+  /**
+   * Class to reorder the triangles and vertices of an indexed mesh for
+   * rendering. Triangles are sorted for post-transform vertex cache reuse
+   * with Forsyth's linear-speed algorithm, then vertices are sorted in
+   * order of first use for fetch locality. The geometry and the winding
+   * of every triangle are kept.
+   * @class MeshOptimizer
+   */
+  class MeshOptimizer
+  {
+    public:
+      /**
+       * Struct with vertex cache efficiency before and after optimizing
+       * @struct Stats
+       */
+      struct Stats
+      {
+        //! Average cache miss ratio ( transformed vertices per triangle )
+        float acmrBefore;
+        float acmrAfter;
+        //! Average transform to vertex ratio ( transformed vertices per
+        //! referenced vertex, 1 is optimal )
+        float atvrBefore;
+        float atvrAfter;
+      };
+
+      /**
+       * MeshOptimizer constructor
+       * @param cacheSize: Vertex cache entries, used to sort triangles and
+       *   to measure ( between 4 and 64 ).
+       */
+      RETO_API
+      MeshOptimizer( unsigned int cacheSize = 32 );
+
+      /**
+       * Method to set the vertex cache entries
+       * @param cacheSize: Entries, clamped between 4 and 64.
+       */
+      RETO_API
+      void setCacheSize( unsigned int cacheSize );
+
+      /**
+       * Method to get the vertex cache entries
+       * @return unsigned int
+       */
+      RETO_API
+      unsigned int cacheSize( void ) const;
+
+      /**
+       * Method to reorder the triangles and then the vertices of a model.
+       * All per vertex arrays are remapped. Unused vertices are moved to
+       * the end.
+       * @param model: Model to optimize.
+       * @return cache efficiency before and after.
+       */
+      RETO_API
+      Stats optimize( Model& model ) const;
+
+      /**
+       * Method to reorder triangles for vertex cache reuse
+       * @param indices: Triangle indices, all lower than numVertices.
+       * @param numVertices: Number of vertices.
+       */
+      RETO_API
+      void optimizeVertexCache( std::vector< int >& indices,
+        size_t numVertices ) const;
+
+      /**
+       * Method to renumber the vertices of a model in order of first use,
+       * remapping all per vertex arrays and the indices
+       * @param model: Model to reorder.
+       */
+      RETO_API
+      static void optimizeVertexFetch( Model& model );
+
+      /**
+       * Method to simulate a FIFO vertex cache
+       * @param indices: Triangle indices, all lower than numVertices.
+       * @param numVertices: Number of vertices.
+       * @param acmr: Average cache miss ratio.
+       * @param atvr: Average transform to vertex ratio.
+       */
+      RETO_API
+      void analyze( const std::vector< int >& indices, size_t numVertices,
+        float& acmr, float& atvr ) const;
+
+    private:
+      //! Vertex cache entries
+      unsigned int _cacheSize;
+
+  }; /* class MeshOptimizer */
+
+} /* namespace reto */
+
+#endif /* __RETO__MESH_OPTIMIZER__ */
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace reto
+{
+  namespace
+  {
+    //! Minimum reduction of a level of detail
+    const float MIN_LEVEL_REDUCTION = 0.95f;
+
+    //! Cosine of the largest rotation allowed to a triangle by a collapse
+    const double MAX_FLIP_COSINE = 0.5;
+
+    //! Smallest area ratio allowed to a triangle by a collapse
+    const double MIN_AREA_RATIO = 0.01;
+
+    //! Symmetric plane distance quadric, weighted by triangle area
+    struct Quadric
+    {
+      double a00, a01, a02, a11, a12, a22;
+      double b0, b1, b2;
+      double c;
+      double weight;
+
+      Quadric( void )
+      {
+        memset( this, 0, sizeof( Quadric ));
+      }
+
+      void addPlane( const double* n, double d, double w )
+      {
+        a00 += w * n[ 0 ] * n[ 0 ];
+        a01 += w * n[ 0 ] * n[ 1 ];
+        a02 += w * n[ 0 ] * n[ 2 ];
+        a11 += w * n[ 1 ] * n[ 1 ];
+        a12 += w * n[ 1 ] * n[ 2 ];
+        a22 += w * n[ 2 ] * n[ 2 ];
+        b0 += w * n[ 0 ] * d;
+        b1 += w * n[ 1 ] * d;
+        b2 += w * n[ 2 ] * d;
+        c += w * d * d;
+        weight += w;
+      }
+
+      Quadric& operator+=( const Quadric& q )
+      {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+      }
+
+      // Mean squared distance to the planes
+      double error( const float* p ) const
+      {
+        const double x = p[ 0 ], y = p[ 1 ], z = p[ 2 ];
+        const double e = x * ( a00 * x + 2.0 * ( a01 * y + a02 * z + b0 )) +
+          y * ( a11 * y + 2.0 * ( a12 * z + b1 )) +
+          z * ( a22 * z + 2.0 * b2 ) + c;
+        return weight > 0.0 ? std::max( e, 0.0 ) / weight : 0.0;
+      }
+    };
+
+    inline void cross( const float* p0, const float* p1, const float* p2,
+      double* n )
+    {
+      const double e1[ 3 ] = { double( p1[ 0 ]) - p0[ 0 ],
+        double( p1[ 1 ]) - p0[ 1 ], double( p1[ 2 ]) - p0[ 2 ]};
+      const double e2[ 3 ] = { double( p2[ 0 ]) - p0[ 0 ],
+        double( p2[ 1 ]) - p0[ 1 ], double( p2[ 2 ]) - p0[ 2 ]};
+      n[ 0 ] = e1[ 1 ] * e2[ 2 ] - e1[ 2 ] * e2[ 1 ];
+      n[ 1 ] = e1[ 2 ] * e2[ 0 ] - e1[ 0 ] * e2[ 2 ];
+      n[ 2 ] = e1[ 0 ] * e2[ 1 ] - e1[ 1 ] * e2[ 0 ];
+    }
+
+    inline uint64_t edgeKey( int a, int b )
+    {
+      return ( uint64_t( uint32_t( a )) << 32 ) | uint32_t( b );
+    }
+
+    //! Collapse candidate, moving vertex from onto vertex to
+    struct Collapse
+    {
+      int from;
+      int to;
+      double error;
+
+      bool operator<( const Collapse& other ) const
+      {
+        return error < other.error;
+      }
+    };
+
+    /*
+      Simplification state of a model, continued by each call to run, so
+      a chain of levels keeps the quadrics of the original model
+    */
+    class Simplification
+    {
+    public:
+      Simplification( const Model& model )
+        : _model( model )
+        , _numVertices( model.vertices.size( ) / 3 )
+        , _indices( model.indices.begin( ), model.indices.begin( ) +
+          model.indices.size( ) / 3 * 3 )
+        , _remap( _numVertices )
+        , _error( 0.0 )
+      {
+        for ( size_t v = 0; v < _numVertices; ++v )
+          _remap[ v ] = int( v );
+
+        // Weld vertices by position, seams have several vertices
+        std::vector< int > position( _numVertices );
+        std::vector< unsigned int > wedges;
+        VertexIndexMap positions( _numVertices );
+        for ( size_t v = 0; v < _numVertices; ++v )
+        {
+          int bits[ 3 ];
+          memcpy( bits, &model.vertices[ v * 3 ], sizeof( bits ));
+          position[ v ] = positions.findOrInsert( bits[ 0 ], bits[ 1 ],
+            bits[ 2 ], int( wedges.size( )));
+          if ( size_t( position[ v ]) == wedges.size( ))
+            wedges.push_back( 0 );
+          ++wedges[ position[ v ]];
+        }
+
+        // Each directed edge of a closed manifold surface appears once,
+        // as does its opposite
+        std::vector< uint64_t > edges;
+        edges.reserve( _indices.size( ));
+        for ( size_t i = 0; i < _indices.size( ); i += 3 )
+        {
+          for ( int k = 0; k < 3; ++k )
+          {
+            edges.push_back( edgeKey( position[ _indices[ i + k ]],
+              position[ _indices[ i + ( k + 1 ) % 3 ]]));
+          }
+        }
+        std::sort( edges.begin( ), edges.end( ));
+
+        std::vector< bool > lockedPosition( wedges.size( ), false );
+        for ( size_t p = 0; p < wedges.size( ); ++p )
+          lockedPosition[ p ] = wedges[ p ] > 1;
+        for ( size_t i = 0; i < edges.size( ); ++i )
+        {
+          const int a = int( edges[ i ] >> 32 );
+          const int b = int( edges[ i ] & 0xFFFFFFFF );
+          const uint64_t opposite = edgeKey( b, a );
+          const bool repeated = ( i > 0 && edges[ i - 1 ] == edges[ i ]) ||
+            ( i + 1 < edges.size( ) && edges[ i + 1 ] == edges[ i ]);
+          const auto range =
+            std::equal_range( edges.begin( ), edges.end( ), opposite );
+          if ( repeated || range.second - range.first != 1 )
+          {
+            lockedPosition[ a ] = true;
+            lockedPosition[ b ] = true;
+          }
+        }
+        _locked.resize( _numVertices );
+        for ( size_t v = 0; v < _numVertices; ++v )
+          _locked[ v ] = lockedPosition[ position[ v ]];
+
+        // Vertices that are not locked have a position of their own, so
+        // quadrics are kept per vertex
+        _quadrics.resize( _numVertices );
+        for ( size_t i = 0; i < _indices.size( ); i += 3 )
+        {
+          double n[ 3 ];
+          cross( vertex( _indices[ i ]), vertex( _indices[ i + 1 ]),
+            vertex( _indices[ i + 2 ]), n );
+          const double length =
+            sqrt( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ]);
+          if ( length == 0.0 )
+            continue;
+          n[ 0 ] /= length;
+          n[ 1 ] /= length;
+          n[ 2 ] /= length;
+          const float* p0 = vertex( _indices[ i ]);
+          const double d = -( n[ 0 ] * p0[ 0 ] + n[ 1 ] * p0[ 1 ] +
+            n[ 2 ] * p0[ 2 ]);
+          for ( int k = 0; k < 3; ++k )
+            _quadrics[ _indices[ i + k ]].addPlane( n, d, length * 0.5 );
+        }
+        // Locked vertices of the same position share their quadric
+        std::vector< Quadric > shared( wedges.size( ));
+        for ( size_t v = 0; v < _numVertices; ++v )
+        {
+          if ( _locked[ v ])
+            shared[ position[ v ]] += _quadrics[ v ];
+        }
+        for ( size_t v = 0; v < _numVertices; ++v )
+        {
+          if ( _locked[ v ])
+            _quadrics[ v ] = shared[ position[ v ]];
+        }
+      }
+
+      size_t numTriangles( void ) const
+      {
+        return _indices.size( ) / 3;
+      }
+
+      double error( void ) const
+      {
+        return _error;
+      }
+
+      // Collapse edges, cheapest first, until the model has
+      // targetTriangles triangles or no collapse is below maxError
+      // ( squared distance )
+      void run( size_t targetTriangles, double maxError )
+      {
+        while ( numTriangles( ) > targetTriangles )
+        {
+          if ( !pass( targetTriangles, maxError ))
+            break;
+        }
+      }
+
+      // Model with the current triangles and only the used vertices
+      Model model( void ) const
+      {
+        Model result;
+        std::vector< int > newIndex( _numVertices, -1 );
+        std::vector< int > used;
+        result.indices.reserve( _indices.size( ));
+        for ( int index : _indices )
+        {
+          if ( newIndex[ index ] < 0 )
+          {
+            newIndex[ index ] = int( used.size( ));
+            used.push_back( index );
+          }
+          result.indices.push_back( newIndex[ index ]);
+        }
+        copy( _model.vertices, result.vertices, used, 3 );
+        copy( _model.normals, result.normals, used, 3 );
+        copy( _model.texCoords, result.texCoords, used, 2 );
+        copy( _model.tangents, result.tangents, used, 3 );
+        copy( _model.bitangents, result.bitangents, used, 3 );
+        return result;
+      }
+
+    private:
+      const float* vertex( int v ) const
+      {
+        return &_model.vertices[ size_t( v ) * 3 ];
+      }
+
+      void copy( const std::vector< float >& source,
+        std::vector< float >& target, const std::vector< int >& used,
+        size_t components ) const
+      {
+        if ( source.size( ) != _numVertices * components )
+          return;
+        target.resize( used.size( ) * components );
+        for ( size_t i = 0; i < used.size( ); ++i )
+        {
+          std::copy( source.begin( ) + size_t( used[ i ]) * components,
+            source.begin( ) + size_t( used[ i ] + 1 ) * components,
+            target.begin( ) + i * components );
+        }
+      }
+
+      // Moving from onto to must not flip nor degenerate the triangles
+      // of from that are kept
+      bool flips( int from, int to ) const
+      {
+        for ( size_t i = _offsets[ from ]; i < _offsets[ from + 1 ]; ++i )
+        {
+          const int* t = &_indices[ _triangles[ i ] * 3 ];
+          if ( t[ 0 ] == to || t[ 1 ] == to || t[ 2 ] == to )
+            continue;
+
+          const float* p[ 3 ];
+          const float* q[ 3 ];
+          for ( int k = 0; k < 3; ++k )
+          {
+            p[ k ] = vertex( t[ k ]);
+            q[ k ] = t[ k ] == from ? vertex( to ) : p[ k ];
+          }
+          double before[ 3 ], after[ 3 ];
+          cross( p[ 0 ], p[ 1 ], p[ 2 ], before );
+          cross( q[ 0 ], q[ 1 ], q[ 2 ], after );
+          // Reject rotations over 60 degrees and triangles
+          // shrinking to slivers
+          const double dot = before[ 0 ] * after[ 0 ] +
+            before[ 1 ] * after[ 1 ] + before[ 2 ] * after[ 2 ];
+          const double beforeSquared = before[ 0 ] * before[ 0 ] +
+            before[ 1 ] * before[ 1 ] + before[ 2 ] * before[ 2 ];
+          const double afterSquared = after[ 0 ] * after[ 0 ] +
+            after[ 1 ] * after[ 1 ] + after[ 2 ] * after[ 2 ];
+          if ( dot <= MAX_FLIP_COSINE * sqrt( beforeSquared * afterSquared ) ||
+            afterSquared < MIN_AREA_RATIO * MIN_AREA_RATIO * beforeSquared )
+            return true;
+        }
+        return false;
+      }
+
+      // Moving from onto to must not join two surfaces: the edge must be
+      // shared only by the two triangles around it ( link condition )
+      bool joins( int from, int to ) const
+      {
+        std::vector< int >& neighbours = _neighbours;
+        neighbours.clear( );
+        for ( size_t i = _offsets[ from ]; i < _offsets[ from + 1 ]; ++i )
+        {
+          const int* t = &_indices[ _triangles[ i ] * 3 ];
+          for ( int k = 0; k < 3; ++k )
+          {
+            if ( t[ k ] != from && t[ k ] != to )
+              neighbours.push_back( t[ k ]);
+          }
+        }
+        std::sort( neighbours.begin( ), neighbours.end( ));
+        neighbours.erase( std::unique( neighbours.begin( ), neighbours.end( )),
+          neighbours.end( ));
+
+        std::vector< int >& common = _common;
+        common.clear( );
+        for ( size_t i = _offsets[ to ]; i < _offsets[ to + 1 ]; ++i )
+        {
+          const int* t = &_indices[ _triangles[ i ] * 3 ];
+          for ( int k = 0; k < 3; ++k )
+          {
+            if ( std::binary_search( neighbours.begin( ), neighbours.end( ),
+              t[ k ]))
+            {
+              common.push_back( t[ k ]);
+            }
+          }
+        }
+        std::sort( common.begin( ), common.end( ));
+        return std::unique( common.begin( ), common.end( )) -
+          common.begin( ) > 2;
+      }
+
+      // One round of independent collapses. Returns false if none was
+      // possible.
+      bool pass( size_t targetTriangles, double maxError )
+      {
+        const size_t numIndices = _indices.size( );
+
+        // Triangles of each vertex
+        _offsets.assign( _numVertices + 1, 0 );
+        for ( int index : _indices )
+          ++_offsets[ size_t( index )];
+        for ( size_t v = 0; v < _numVertices; ++v )
+          _offsets[ v + 1 ] += _offsets[ v ];
+        _triangles.resize( numIndices );
+        for ( size_t i = numIndices; i-- > 0; )
+          _triangles[ --_offsets[ size_t( _indices[ i ])]] = i / 3;
+
+        // Every half edge starting at a free vertex
+        std::vector< Collapse > collapses;
+        collapses.reserve( numIndices );
+        for ( size_t i = 0; i < numIndices; ++i )
+        {
+          const int from = _indices[ i ];
+          const int to = _indices[ i - i % 3 + ( i + 1 ) % 3 ];
+          if ( _locked[ from ] || from == to )
+            continue;
+          Quadric q = _quadrics[ from ];
+          q += _quadrics[ to ];
+          const Collapse collapse = { from, to, q.error( vertex( to )) };
+          if ( collapse.error <= maxError )
+            collapses.push_back( collapse );
+        }
+        std::sort( collapses.begin( ), collapses.end( ));
+
+        // Collapses touching the neighbourhood of a previous one in this
+        // round would use outdated costs and triangles
+        std::vector< bool > touched( _numVertices, false );
+        size_t remaining = numTriangles( );
+        size_t applied = 0;
+        for ( const Collapse& collapse : collapses )
+        {
+          if ( remaining <= targetTriangles )
+            break;
+          if ( touched[ collapse.from ] || touched[ collapse.to ] ||
+            flips( collapse.from, collapse.to ) ||
+            joins( collapse.from, collapse.to ))
+          {
+            continue;
+          }
+
+          for ( size_t i = _offsets[ collapse.from ];
+            i < _offsets[ collapse.from + 1 ]; ++i )
+          {
+            const int* t = &_indices[ _triangles[ i ] * 3 ];
+            if ( t[ 0 ] == collapse.to || t[ 1 ] == collapse.to ||
+              t[ 2 ] == collapse.to )
+            {
+              --remaining;
+            }
+            for ( int k = 0; k < 3; ++k )
+              touched[ t[ k ]] = true;
+          }
+          _remap[ collapse.from ] = collapse.to;
+          _quadrics[ collapse.to ] += _quadrics[ collapse.from ];
+          _error = std::max( _error, collapse.error );
+          ++applied;
+        }
+        if ( applied == 0 )
+          return false;
+
+        // Apply the collapses and drop degenerate triangles
+        size_t kept = 0;
+        for ( size_t i = 0; i < numIndices; i += 3 )
+        {
+          const int a = _remap[ _indices[ i ]];
+          const int b = _remap[ _indices[ i + 1 ]];
+          const int c = _remap[ _indices[ i + 2 ]];
+          if ( a == b || b == c || c == a )
+            continue;
+          _indices[ kept++ ] = a;
+          _indices[ kept++ ] = b;
+          _indices[ kept++ ] = c;
+        }
+        _indices.resize( kept );
+        for ( size_t v = 0; v < _numVertices; ++v )
+          _remap[ v ] = int( v );
+        return true;
+      }
+
+      const Model& _model;
+      size_t _numVertices;
+      std::vector< int > _indices;
+      std::vector< int > _remap;
+      std::vector< bool > _locked;
+      std::vector< Quadric > _quadrics;
+      std::vector< size_t > _offsets;
+      std::vector< size_t > _triangles;
+      mutable std::vector< int > _neighbours;
+      mutable std::vector< int > _common;
+      double _error;
+    };
+
+    double diagonal( const Model& model )
+    {
+      if ( model.vertices.size( ) < 3 )
+        return 0.0;
+      float low[ 3 ], high[ 3 ];
+      for ( int k = 0; k < 3; ++k )
+        low[ k ] = high[ k ] = model.vertices[ k ];
+      for ( size_t i = 0; i < model.vertices.size( ); i += 3 )
+      {
+        for ( int k = 0; k < 3; ++k )
+        {
+          low[ k ] = std::min( low[ k ], model.vertices[ i + k ]);
+          high[ k ] = std::max( high[ k ], model.vertices[ i + k ]);
+        }
+      }
+      double size = 0.0;
+      for ( int k = 0; k < 3; ++k )
+        size += double( high[ k ] - low[ k ]) * ( high[ k ] - low[ k ]);
+      return sqrt( size );
+    }
+  }
+
+  Model MeshSimplifier::simplify( const Model& model, size_t targetTriangles,
+    float targetError, float* error ) const
+  {
+    const double scale = diagonal( model );
+    const double maxError = double( targetError ) * scale;
+    Simplification simplification( model );
+    simplification.run( targetTriangles, maxError * maxError );
+    if ( error )
+    {
+      *error = scale > 0.0 ?
+        float( sqrt( simplification.error( )) / scale ) : 0.0f;
+    }
+    return simplification.model( );
+  }
+
+  std::vector< LodLevel > MeshSimplifier::buildLods( const Model& model,
+    unsigned int numLevels, float ratio, float targetError ) const
+  {
+    const double scale = diagonal( model );
+    const double maxError = double( targetError ) * scale;
+    Simplification simplification( model );
+    std::vector< LodLevel > levels;
+    for ( unsigned int i = 0; i < numLevels; ++i )
+    {
+      const size_t previous = simplification.numTriangles( );
+      simplification.run( size_t( double( previous ) * ratio ),
+        maxError * maxError );
+      if ( simplification.numTriangles( ) == 0 ||
+        double( simplification.numTriangles( )) >
+        double( previous ) * MIN_LEVEL_REDUCTION )
+      {
+        break;
+      }
+
+      LodLevel level;
+      level.model = simplification.model( );
+      level.error = scale > 0.0 ?
+        float( sqrt( simplification.error( )) / scale ) : 0.0f;
+      levels.push_back( level );
+    }
+    return levels;
+  }
+
+} /* namespace reto */
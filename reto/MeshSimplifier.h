@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__MESH_SIMPLIFIER__
+#define __RETO__MESH_SIMPLIFIER__
+
+#include <reto/api.h>
+#include "ObjParser.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace reto
+{
+  /**
+   * Level of detail of a model
+   * @struct LodLevel
+   */
+  struct LodLevel
+  {
+    //! Simplified model
+    Model model;
+    //! Error, relative to the model bounding box diagonal
+    float error;
+  };
+
+  /**
+   * Class to reduce the triangles of a model by quadric error edge
+   * collapse. Vertices are moved onto a neighbour, so attributes never
+   * need to be interpolated. Vertices on attribute seams ( positions
+   * shared by several vertices ), on borders and on non manifold edges
+   * are locked, keeping seams and outlines intact. Collapses that would
+   * flip a triangle are rejected.
+   * @class MeshSimplifier
+   */
+  class MeshSimplifier
+  {
+    public:
+      /**
+       * Method to simplify a model until it has targetTriangles triangles
+       * or no collapse is below targetError. Unused vertices are removed
+       * and all per vertex arrays are kept.
+       * @param model: Model to simplify.
+       * @param targetTriangles: Triangle budget.
+       * @param targetError: Maximum error, relative to the model bounding
+       *   box diagonal.
+       * @param error: Optional output of the reached error.
+       * @return simplified model.
+       */
+      RETO_API
+      Model simplify( const Model& model, size_t targetTriangles,
+        float targetError, float* error = nullptr ) const;
+
+      /**
+       * Method to build a chain of levels of detail. Each level targets
+       * ratio times the triangles of the previous one and continues
+       * simplifying it, so errors are measured against the original
+       * model. The chain stops early when a level can not remove at least
+       * 5% of the triangles without exceeding targetError.
+       * @param model: Model to simplify.
+       * @param numLevels: Maximum number of levels, not counting the
+       *   original.
+       * @param ratio: Triangle ratio between consecutive levels.
+       * @param targetError: Maximum error, relative to the model bounding
+       *   box diagonal.
+       * @return levels from finest to coarsest.
+       */
+      RETO_API
+      std::vector< LodLevel > buildLods( const Model& model,
+        unsigned int numLevels, float ratio = 0.5f,
+        float targetError = 0.01f ) const;
+
+  }; /* class MeshSimplifier */
+
+} /* namespace reto */
+
+#endif /* __RETO__MESH_SIMPLIFIER__ */
@@ -21,294 +21,1303 @@
  */
 
 #include "ObjParser.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+#include "TangentGenerator.h"
+
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace reto
 {
 
   ObjParser::ObjParser( void )
+    : _memoryMapping( false )
+    , _meshCache( false )
+    , _meshOptimization( false )
+    , _vertexIndexStats( )
+    , _meshOptimizationStats( )
   {
   }
 
   std::string ObjParser::loadFile( const std::string& filename )
   {
-    std::ifstream file( filename.c_str( ) );
-    std::stringstream buffer;
+    std::ifstream file( filename.c_str( ), std::ios::in | std::ios::binary );
+    std::string str;
+    if ( !file )
+      return str;
 
-    buffer << file.rdbuf( );
-    std::string str = buffer.str( );
+    file.seekg( 0, std::ios::end );
+    const std::streamoff size = file.tellg( );
+    if ( size > 0 )
+    {
+      str.resize( static_cast< size_t >( size ));
+      file.seekg( 0, std::ios::beg );
+      file.read( &str[ 0 ], size );
+      str.resize( static_cast< size_t >( file.gcount( )));
+    }
     return str;
   }
 
-  std::vector< std::string > ObjParser::split( const std::string& s, char c )
+  namespace
   {
-    std::vector< std::string > v;
-    std::string::size_type i = 0;
-    std::string::size_type j = s.find( c );
+    //! Exact powers of ten representable as double
+    const double POW10[ ] =
+    {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-    while ( j != std::string::npos )
+    inline bool isBlank( char c )
     {
-      v.push_back( s.substr( i, j - i ) );
-      i = ++j;
-      j = s.find( c, j );
+      return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
 
-      if ( j == std::string::npos )
-        v.push_back( s.substr( i, s.length( ) ) );
+    inline bool isDigit( char c )
+    {
+      return c >= '0' && c <= '9';
     }
-    return v;
-  }
 
-  bool ObjParser::isNumeric( const std::string& input )
-  {
-    return std::all_of( input.begin( ), input.end( ), ::isdigit );
-  }
+    inline bool isTokenEnd( const char* p, const char* end )
+    {
+      return p == end || *p == '\n' || isBlank( *p );
+    }
 
-  bool ObjParser::isFloat( const std::string& myString )
-  {
-    std::istringstream iss( myString );
-    float f;
-    iss >> std::noskipws >> f;
-    return iss.eof( ) && !iss.fail( );
-  }
+    inline const char* skipBlanks( const char* p, const char* end )
+    {
+      while ( p != end && isBlank( *p ) ) ++p;
+      return p;
+    }
 
-  std::vector< float > ObjParser::splitLineToFloats( std::string& line )
-  {
-    std::vector< float > values;
-    std::vector< std::string > split_ = split( line, ' ' );
-    for ( const auto& str : split_ )
+    inline const char* skipToken( const char* p, const char* end )
+    {
+      while ( !isTokenEnd( p, end ) ) ++p;
+      return p;
+    }
+
+    inline const char* endOfLine( const char* p, const char* end )
+    {
+      const void* eol = memchr( p, '\n', static_cast< size_t >( end - p ) );
+      return eol ? static_cast< const char* >( eol ) : end;
+    }
+
+    /*
+      Parse a decimal float token in place. Uses an exact double fast path
+      and falls back to strtod on a stack copy for long mantissas, so the
+      result is the same as std::stod truncated to float.
+      @return pointer past the token or nullptr if it is not a number
+    */
+    const char* parseFloat( const char* p, const char* end, float& value )
     {
-      if ( isFloat( str ) )
+      const char* start = p;
+      bool negative = false;
+      if ( p != end && ( *p == '-' || *p == '+' ) )
+      {
+        negative = *p == '-';
+        ++p;
+      }
+
+      uint64_t mantissa = 0;
+      int digits = 0;
+      int exponent = 0;
+      bool anyDigit = false;
+      bool exact = true;
+
+      for ( ; p != end && isDigit( *p ); ++p )
+      {
+        anyDigit = true;
+        if ( digits < 19 )
+        {
+          mantissa = mantissa * 10 + static_cast< uint64_t >( *p - '0' );
+          if ( mantissa != 0 ) ++digits;
+        }
+        else
+        {
+          ++exponent;
+          exact = false;
+        }
+      }
+      if ( p != end && *p == '.' )
+      {
+        for ( ++p; p != end && isDigit( *p ); ++p )
+        {
+          anyDigit = true;
+          if ( digits < 19 )
+          {
+            mantissa = mantissa * 10 + static_cast< uint64_t >( *p - '0' );
+            if ( mantissa != 0 ) ++digits;
+            --exponent;
+          }
+          else if ( *p != '0' )
+          {
+            exact = false;
+          }
+        }
+      }
+      if ( !anyDigit ) return nullptr;
+
+      if ( p != end && ( *p == 'e' || *p == 'E' ) )
+      {
+        ++p;
+        bool negativeExp = false;
+        if ( p != end && ( *p == '-' || *p == '+' ) )
+        {
+          negativeExp = *p == '-';
+          ++p;
+        }
+        if ( p == end || !isDigit( *p ) ) return nullptr;
+        int exp = 0;
+        for ( ; p != end && isDigit( *p ); ++p )
+        {
+          if ( exp < 100000 ) exp = exp * 10 + ( *p - '0' );
+        }
+        exponent += negativeExp ? -exp : exp;
+      }
+      if ( !isTokenEnd( p, end ) ) return nullptr;
+
+      if ( exact && mantissa <= ( uint64_t( 1 ) << 53 ) &&
+        exponent >= -22 && exponent <= 22 )
       {
-        values.push_back( std::stod( str ) );
+        double d = static_cast< double >( mantissa );
+        d = exponent < 0 ? d / POW10[ -exponent ] : d * POW10[ exponent ];
+        value = static_cast< float >( negative ? -d : d );
+        return p;
       }
+
+      char buffer[ 128 ];
+      size_t length = static_cast< size_t >( p - start );
+      if ( length < sizeof( buffer ) )
+      {
+        memcpy( buffer, start, length );
+        buffer[ length ] = '\0';
+        value = static_cast< float >( strtod( buffer, nullptr ) );
+      }
+      else
+      {
+        value = static_cast< float >( std::stod( std::string( start, p ) ) );
+      }
+      return p;
     }
-    return values;
-  }
 
-  std::string ObjParser::trim( const std::string& str )
-  {
-    size_t first = str.find_first_not_of( ' ' );
-    size_t last = str.find_last_not_of( ' ' );
-    return str.substr( first, ( last - first + 1 ) );
-  }
+    /*
+      Parse consecutive floats of a line, ignoring tokens that are not
+      numbers. Missing values are left untouched.
+      @return number of values read
+    */
+    unsigned int parseFloats( const char* p, const char* end,
+      float* values, unsigned int count )
+    {
+      unsigned int read = 0;
+      p = skipBlanks( p, end );
+      while ( read < count && p != end && *p != '\n' )
+      {
+        const char* next = parseFloat( p, end, values[ read ] );
+        if ( next )
+        {
+          ++read;
+          p = next;
+        }
+        else
+        {
+          p = skipToken( p, end );
+        }
+        p = skipBlanks( p, end );
+      }
+      return read;
+    }
 
-  std::vector< int > ObjParser::splitFace( std::string& line )
-  {
-    std::vector< int > values;
-    std::vector< std::string > _splitFace = split( line, '/' );
+    inline const char* parseInt( const char* p, const char* end, long& value )
+    {
+      bool negative = false;
+      if ( p != end && ( *p == '-' || *p == '+' ) )
+      {
+        negative = *p == '-';
+        ++p;
+      }
+      if ( p == end || !isDigit( *p ) ) return nullptr;
+      long v = 0;
+      for ( ; p != end && isDigit( *p ); ++p )
+      {
+        v = v * 10 + ( *p - '0' );
+      }
+      value = negative ? -v : v;
+      return p;
+    }
 
-    for ( std::string& face : _splitFace )
+    /*
+      Face corner as written in the file ( v, v/vt, v//vn or v/vt/vn ).
+      Absent references are stored as 0, which is never a valid OBJ index.
+    */
+    struct RawCorner
     {
-      if ( isNumeric( face ) )
-        values.push_back( std::stoi( face ) );
+      int v;
+      int vt;
+      int vn;
+    };
+
+    inline const char* parseIndex( const char* p, const char* end, int& value )
+    {
+      long v = 0;
+      p = parseInt( p, end, v );
+      // Indices out of int range can not be valid, keep them as absent
+      value = ( v > INT_MAX || v < -INT_MAX ) ? 0 : static_cast< int >( v );
+      return p;
     }
-    return values;
-  }
 
-  Model ObjParser::loadObj( const std::string& filename, bool calculateTangAndBi )
-  {
-    Model m;
-    m.vertices.clear( );
-    m.normals.clear( );
-    m.texCoords.clear( );
-    m.indices.clear( );
+    const char* parseCorner( const char* p, const char* end, RawCorner& c )
+    {
+      c.v = c.vt = c.vn = 0;
+      p = parseIndex( p, end, c.v );
+      if ( !p ) return nullptr;
+      if ( p != end && *p == '/' )
+      {
+        ++p;
+        if ( p != end && *p != '/' )
+        {
+          p = parseIndex( p, end, c.vt );
+          if ( !p ) return nullptr;
+        }
+        if ( p != end && *p == '/' )
+        {
+          p = parseIndex( p + 1, end, c.vn );
+          if ( !p ) return nullptr;
+        }
+      }
+      return isTokenEnd( p, end ) ? p : nullptr;
+    }
+
+    /*
+      Number of v, vt and vn records declared before a given point
+    */
+    struct ElementCounts
+    {
+      size_t positions;
+      size_t texCoords;
+      size_t normals;
+    };
+
+    /*
+      Number of records of some content, used to reserve memory up front
+    */
+    struct RecordCounts
+    {
+      ElementCounts elements;
+      //! Corners of all face records
+      size_t faceCorners;
+      //! Indices of the triangulated faces
+      size_t indices;
+    };
+
+    /*
+      Count records without parsing their values
+    */
+    void countRecords( const char* p, const char* end, RecordCounts& counts )
+    {
+      while ( p != end )
+      {
+        const char* eol = endOfLine( p, end );
+        const char* key = skipBlanks( p, eol );
+        const char* keyEnd = skipToken( key, eol );
+        const size_t keyLength = static_cast< size_t >( keyEnd - key );
+
+        if ( keyLength == 1 && key[ 0 ] == 'f' )
+        {
+          size_t corners = 0;
+          for ( const char* q = skipBlanks( keyEnd, eol ); q != eol;
+            q = skipBlanks( skipToken( q, eol ), eol ))
+          {
+            ++corners;
+          }
+          counts.faceCorners += corners;
+          if ( corners >= 3 )
+            counts.indices += ( corners - 2 ) * 3;
+        }
+        else if ( keyLength == 1 && key[ 0 ] == 'v' )
+          ++counts.elements.positions;
+        else if ( keyLength == 2 && key[ 0 ] == 'v' && key[ 1 ] == 't' )
+          ++counts.elements.texCoords;
+        else if ( keyLength == 2 && key[ 0 ] == 'v' && key[ 1 ] == 'n' )
+          ++counts.elements.normals;
 
-    std::vector< float > verts, normals, textures;
-    std::map< std::string, int > idxCache;
-    int idx = 0;
+        p = eol == end ? end : eol + 1;
+      }
+    }
 
-    std::vector< std::string > lines = split( loadFile( filename ), '\n' );
-    for ( auto line : lines )
+    /*
+      Records expected in total bytes from those of the first counted ones,
+      with some headroom so that the reservations grow a few times at most
+    */
+    RecordCounts extrapolate( const RecordCounts& counts, size_t counted,
+      size_t total )
     {
-      auto elems = split( line, ' ' );
-      if ( elems.empty( ) ) continue;
-      elems.erase( elems.begin( ) );
+      if ( counted == 0 || counted >= total )
+        return counts;
+      const double scale = 1.125 * double( total ) / double( counted );
+      const auto grow = [ scale ]( size_t n )
+      {
+        return static_cast< size_t >( double( n ) * scale );
+      };
+      RecordCounts expected;
+      expected.elements.positions = grow( counts.elements.positions );
+      expected.elements.texCoords = grow( counts.elements.texCoords );
+      expected.elements.normals = grow( counts.elements.normals );
+      expected.faceCorners = grow( counts.faceCorners );
+      expected.indices = grow( counts.indices );
+      return expected;
+    }
 
-      std::string type = trim( line.substr( 0, 2 ) );
-      if ( type == "v" )
+    /*
+      Resolve an OBJ index ( 1-based or negative relative ) against the
+      number of elements declared so far.
+      @return 0-based index or -1 if it is absent or out of range
+    */
+    inline long resolveIndex( int idx, size_t count )
+    {
+      long resolved = idx > 0 ? long( idx ) - 1 :
+        static_cast< long >( count ) + idx;
+      if ( idx == 0 || resolved < 0 ||
+        resolved >= static_cast< long >( count ) )
       {
-        auto values = splitLineToFloats( line );
-        verts.push_back( values[ 0 ] );
-        verts.push_back( values[ 1 ] );
-        verts.push_back( values[ 2 ] );
+        return -1;
       }
-      else if ( type == "vn" )
+      return resolved;
+    }
+
+    /*
+      Output of ModelBuilder storing vertices in a Model. Attributes are
+      only stored once their first element has been declared.
+    */
+    class ModelSink
+    {
+    public:
+      ModelSink( Model& model )
+        : _model( model )
       {
-        auto values = splitLineToFloats( line );
-        normals.push_back( values[ 0 ] );
-        normals.push_back( values[ 1 ] );
-        normals.push_back( values[ 2 ] );
       }
-      else if ( type == "vt" )
+
+      void reserve( size_t, size_t numIndices )
       {
-        auto values = splitLineToFloats( line );
-        textures.push_back( values[ 0 ] );
-        textures.push_back( values[ 1 ] );
+        _model.indices.reserve( numIndices );
       }
-      else if ( type == "f" )
+
+      void vertex( const float* position, const float* texCoord,
+        const float* normal, const ElementCounts& declared )
       {
-        bool quad = false;
-        for ( size_t j = 0, size = elems.size( ); j < size; ++j )
+        _model.vertices.insert( _model.vertices.end( ),
+          position, position + 3 );
+        if ( declared.texCoords > 0 )
         {
-          if ( j == 3 && !quad )
+          if ( !texCoord )
           {
-            j = 2;
-            quad = true;
+            _model.texCoords.insert( _model.texCoords.end( ), 2, 0.0f );
           }
-          if ( idxCache.find( elems[ j ] ) != idxCache.end( ) )
+          else
           {
-            m.indices.push_back( idxCache[ elems[ j ] ] );
+            _model.texCoords.insert( _model.texCoords.end( ),
+              texCoord, texCoord + 2 );
           }
-          else
+        }
+        if ( declared.normals > 0 )
+        {
+          if ( !normal )
           {
-            std::vector< int > vertex = splitFace( elems[ j ] );
-            auto v = ( vertex[0] - 1 ) * 3;
-            m.vertices.push_back( verts[ v ] );
-            m.vertices.push_back( verts[ v + 1 ] );
-            m.vertices.push_back( verts[ v + 2 ] );
-            if (!textures.empty())
-            {
-              auto tc = ( vertex[ 1 ] - 1) * 2;
-              m.texCoords.push_back( textures[ tc ] );
-              m.texCoords.push_back( textures[ tc + 1 ] );
-            }
-            auto n = ( vertex[ 2 ] - 1 ) * 3;
-            m.normals.push_back( normals[ n ] );
-            m.normals.push_back( normals[ n + 1] );
-            m.normals.push_back( normals[ n + 2] );
-            idxCache[ elems[ j ] ] = idx;
-            m.indices.push_back( idx );
-            ++idx;
+            _model.normals.insert( _model.normals.end( ), 3, 0.0f );
           }
-          if ( j == 3 && quad )
+          else
           {
-            m.indices.push_back( idxCache[ elems[ 0 ] ] );
+            _model.normals.insert( _model.normals.end( ),
+              normal, normal + 3 );
           }
         }
       }
-    }
 
-    if ( calculateTangAndBi )
+      void index( int index )
+      {
+        _model.indices.push_back( index );
+      }
+
+    private:
+      Model& _model;
+    };
+
+    /*
+      Output of ModelBuilder packing vertices as a layout says
+    */
+    class PackedSink
     {
-      std::vector<std::vector<float>> tangents(m.vertices.size( ) / 3);
-      std::vector<std::vector<float>> bitangents(m.vertices.size( ) / 3);
+    public:
+      PackedSink( PackedModel& model )
+        : _model( model )
+      {
+      }
+
+      void reserve( size_t numVertices, size_t numIndices )
+      {
+        _model.reserve( numVertices, numIndices );
+      }
+
+      void vertex( const float* position, const float* texCoord,
+        const float* normal, const ElementCounts& )
+      {
+        _model.addVertex( position, normal, texCoord );
+      }
 
-      for (size_t j = 0; j < tangents.size( ); ++j)
+      void index( int index )
       {
-        tangents[j] = std::vector<float>(3, 0.0);
-        bitangents[j] = std::vector<float>(3, 0.0);
+        _model.addIndex( static_cast< uint32_t >( index ));
       }
 
-      // Calculate tangents
-      for (size_t i = 0; i < m.indices.size( ); i+=3)
+    private:
+      PackedModel& _model;
+    };
+
+    /*
+      Builds the indexed model from face corners, sharing output vertices
+      between corners with the same v/vt/vn triple. Vertices and indices
+      are sent to a ModelSink or a PackedSink.
+    */
+    template< typename Sink >
+    class ModelBuilder
+    {
+    public:
+      ModelBuilder( const Sink& sink )
+        : _sink( sink )
       {
-        int index = m.indices[i];
+      }
 
-        std::vector<float> v0;
-        v0.push_back(m.vertices[index*3]);
-        v0.push_back(m.vertices[index*3+1]);
-        v0.push_back(m.vertices[index*3+2]);
-        std::vector<float> uv0;
-        uv0.push_back(m.texCoords[index*3]);
-        uv0.push_back(m.texCoords[index*3+1]);
+      std::vector< float > positions;
+      std::vector< float > normals;
+      std::vector< float > texCoords;
 
-        index = m.indices[i+1];
+      /*
+        Reserve memory for the given records. The vertex table is sized
+        for the face corners, bounded by the largest element count, as a
+        corner seldom references more than one new element.
+      */
+      void reserve( const RecordCounts& counts )
+      {
+        const ElementCounts& elements = counts.elements;
+        positions.reserve( elements.positions * 3 );
+        normals.reserve( elements.normals * 3 );
+        texCoords.reserve( elements.texCoords * 2 );
 
-        std::vector<float> v1;
-        v1.push_back(m.vertices[index*3]);
-        v1.push_back(m.vertices[index*3+1]);
-        v1.push_back(m.vertices[index*3+2]);
-        std::vector<float> uv1;
-        uv1.push_back(m.texCoords[index*3]);
-        uv1.push_back(m.texCoords[index*3+1]);
+        const size_t expected = std::min( counts.faceCorners, std::max(
+          elements.positions, std::max( elements.texCoords,
+          elements.normals )));
+        _vertices.reserve( expected );
+        _sink.reserve( expected, counts.indices );
+      }
 
-        index = m.indices[i+2];
+      VertexIndexMap::Stats stats( void ) const
+      {
+        return _vertices.stats( );
+      }
 
-        std::vector<float> v2;
-        v2.push_back(m.vertices[index*3]);
-        v2.push_back(m.vertices[index*3+1]);
-        v2.push_back(m.vertices[index*3+2]);
-        std::vector<float> uv2;
-        uv2.push_back(m.texCoords[index*3]);
-        uv2.push_back(m.texCoords[index*3+1]);
+      ElementCounts declared( void ) const
+      {
+        ElementCounts counts =
+          { positions.size( ) / 3, texCoords.size( ) / 2, normals.size( ) / 3 };
+        return counts;
+      }
 
-        std::vector<float> deltaPos1(3);
-        std::vector<float> deltaPos2(3);
-        for (auto j = 0; j < 3; ++j)
+      /*
+        Add a face
+        @param corners: Face corners
+        @param count: Number of corners
+        @param declared: Elements declared before the face record
+        @return false if the face is not valid
+      */
+      bool addFace( const RawCorner* corners, size_t count,
+        const ElementCounts& declared )
+      {
+        if ( count < 3 ) return false;
+        for ( size_t i = 0; i < count; ++i )
         {
-          deltaPos1[j] = v1[j] - v0[j];
-          deltaPos2[j] = v2[j] - v0[j];
+          if ( resolveIndex( corners[ i ].v, declared.positions ) < 0 )
+            return false;
         }
 
-        std::vector<float> deltaUV1(2);
-        std::vector<float> deltaUV2(2);
-        for (auto j = 0; j < 2; ++j)
+        // Same triangulation order as the original quad support:
+        // ( c0, c1, c2 ), then ( c(k-1), ck, c0 ) for each extra corner.
+        addCorner( corners[ 0 ], declared );
+        addCorner( corners[ 1 ], declared );
+        addCorner( corners[ 2 ], declared );
+        for ( size_t k = 3; k < count; ++k )
         {
-          deltaUV1[j] = uv1[j] - uv0[j];
-          deltaUV2[j] = uv2[j] - uv0[j];
+          addCorner( corners[ k - 1 ], declared );
+          addCorner( corners[ k ], declared );
+          addCorner( corners[ 0 ], declared );
         }
+        return true;
+      }
 
-        float f = 0.0;
-        float aux = ((deltaUV1[0] * deltaUV2[1]) - (deltaUV1[1] * deltaUV2[0]));
-        if (aux != 0) f = 1.0 / aux;
+    private:
+      void addCorner( const RawCorner& corner, const ElementCounts& declared )
+      {
+        const long v = resolveIndex( corner.v, declared.positions );
+        const long vt = resolveIndex( corner.vt, declared.texCoords );
+        const long vn = resolveIndex( corner.vn, declared.normals );
+
+        const int index = _vertices.findOrInsert( static_cast< int >( v ),
+          static_cast< int >( vt ), static_cast< int >( vn ), _nextIndex );
+        if ( index == _nextIndex )
+        {
+          _sink.vertex( &positions[ v * 3 ],
+            vt < 0 ? nullptr : &texCoords[ vt * 2 ],
+            vn < 0 ? nullptr : &normals[ vn * 3 ], declared );
+          ++_nextIndex;
+        }
+        _sink.index( index );
+      }
 
-        std::vector<float> tangent(3);
-        tangent[0] = f * (deltaUV2[1] * deltaPos1[0] - deltaUV1[1] * deltaPos2[0]);
-        tangent[1] = f * (deltaUV2[1] * deltaPos1[1] - deltaUV1[1] * deltaPos2[1]);
-        tangent[2] = f * (deltaUV2[1] * deltaPos1[2] - deltaUV1[1] * deltaPos2[2]);
+      Sink _sink;
+      VertexIndexMap _vertices;
+      int _nextIndex = 0;
+    };
 
-        float normalize = sqrt((tangent[0] * tangent[0]) +
-            (tangent[1] * tangent[1]) + (tangent[2] * tangent[2]));
+    /*
+      Parse the records of a line and forward them to a handler with
+      position, normal, texCoord, face and malformed methods
+    */
+    template< typename Handler >
+    void parseLine( const char* p, const char* eol, Handler& handler,
+      std::vector< RawCorner >& corners )
+    {
+      p = skipBlanks( p, eol );
+      const char* keyEnd = skipToken( p, eol );
+      const size_t keyLength = static_cast< size_t >( keyEnd - p );
 
-        if (normalize != 0)
+      if ( keyLength == 1 && p[ 0 ] == 'v' )
+      {
+        float values[ 3 ] = { 0.0f, 0.0f, 0.0f };
+        parseFloats( keyEnd, eol, values, 3 );
+        handler.position( values );
+      }
+      else if ( keyLength == 2 && p[ 0 ] == 'v' && p[ 1 ] == 'n' )
+      {
+        float values[ 3 ] = { 0.0f, 0.0f, 0.0f };
+        parseFloats( keyEnd, eol, values, 3 );
+        handler.normal( values );
+      }
+      else if ( keyLength == 2 && p[ 0 ] == 'v' && p[ 1 ] == 't' )
+      {
+        float values[ 2 ] = { 0.0f, 0.0f };
+        parseFloats( keyEnd, eol, values, 2 );
+        handler.texCoord( values );
+      }
+      else if ( keyLength == 1 && p[ 0 ] == 'f' )
+      {
+        corners.clear( );
+        const char* q = skipBlanks( keyEnd, eol );
+        while ( q != eol )
         {
-          for (auto j = 0; j < 3; ++j)
+          RawCorner corner;
+          const char* next = parseCorner( q, eol, corner );
+          if ( !next )
           {
-            tangent[j] /= normalize;
+            handler.malformed( );
+            return;
           }
+          corners.push_back( corner );
+          q = skipBlanks( next, eol );
         }
+        handler.face( corners );
+      }
+    }
+
+    template< typename Handler >
+    void parseLines( const char* p, const char* end, Handler& handler,
+      std::vector< RawCorner >& corners )
+    {
+      while ( p != end )
+      {
+        const char* eol = endOfLine( p, end );
+        parseLine( p, eol, handler, corners );
+        p = eol == end ? end : eol + 1;
+      }
+    }
 
-        std::vector<float> bitangent(3);
-        bitangent[0] = f * (-deltaUV2[0] * deltaPos1[0] + deltaUV1[0] * deltaPos2[0]);
-        bitangent[1] = f * (-deltaUV2[0] * deltaPos1[1] + deltaUV1[0] * deltaPos2[1]);
-        bitangent[2] = f * (-deltaUV2[0] * deltaPos1[2] + deltaUV1[0] * deltaPos2[2]);
+    void warnMalformed( size_t malformedFaces )
+    {
+      if ( malformedFaces > 0 )
+      {
+        std::cerr << "WARNING: " << malformedFaces
+          << " malformed face records ignored." << std::endl;
+      }
+    }
 
-        normalize = sqrt((bitangent[0] * bitangent[0]) +
-            (bitangent[1] * bitangent[1]) + (bitangent[2] * bitangent[2]));
+    /*
+      Sequential OBJ reader. Content can be fed in consecutive ranges as
+      long as every range ends at a line boundary.
+    */
+    template< typename Sink >
+    class ObjReader
+    {
+    public:
+      ObjReader( const Sink& sink )
+        : _builder( sink )
+        , _malformedFaces( 0 )
+      {
+      }
 
-        if (normalize != 0)
-          {
-          for (auto j = 0; j < 3; ++j)
-          {
-            bitangent[j] /= normalize;
-          }
+      void parse( const char* p, const char* end )
+      {
+        parseLines( p, end, *this, _corners );
+      }
+
+      void parseLine( const char* p, const char* eol )
+      {
+        reto::parseLine( p, eol, *this, _corners );
+      }
+
+      void reserve( const RecordCounts& counts )
+      {
+        _builder.reserve( counts );
+      }
+
+      VertexIndexMap::Stats finish( void )
+      {
+        warnMalformed( _malformedFaces );
+        return _builder.stats( );
+      }
+
+      void position( const float* values )
+      {
+        _builder.positions.insert( _builder.positions.end( ),
+          values, values + 3 );
+      }
+
+      void normal( const float* values )
+      {
+        _builder.normals.insert( _builder.normals.end( ), values, values + 3 );
+      }
+
+      void texCoord( const float* values )
+      {
+        _builder.texCoords.insert( _builder.texCoords.end( ),
+          values, values + 2 );
+      }
+
+      void face( const std::vector< RawCorner >& corners )
+      {
+        if ( !_builder.addFace( corners.data( ), corners.size( ),
+          _builder.declared( )))
+        {
+          ++_malformedFaces;
         }
+      }
+
+      void malformed( void )
+      {
+        ++_malformedFaces;
+      }
+
+    private:
+      ModelBuilder< Sink > _builder;
+      std::vector< RawCorner > _corners;
+      size_t _malformedFaces;
+    };
+
+    /*
+      Records of a file chunk, stored for an ordered merge. Face corners
+      are kept as written; each face remembers how many elements the chunk
+      had declared before it, so indices resolve exactly as in a
+      sequential parse once the previous chunks are known.
+    */
+    struct ObjChunk
+    {
+      struct Face
+      {
+        size_t firstCorner;
+        size_t numCorners;
+        ElementCounts declared;
+      };
+
+      std::vector< float > positions;
+      std::vector< float > normals;
+      std::vector< float > texCoords;
+      std::vector< RawCorner > corners;
+      std::vector< Face > faces;
+      size_t malformedFaces = 0;
+
+      void position( const float* values )
+      {
+        positions.insert( positions.end( ), values, values + 3 );
+      }
+
+      void normal( const float* values )
+      {
+        normals.insert( normals.end( ), values, values + 3 );
+      }
+
+      void texCoord( const float* values )
+      {
+        texCoords.insert( texCoords.end( ), values, values + 2 );
+      }
+
+      void face( const std::vector< RawCorner >& faceCorners )
+      {
+        Face f;
+        f.firstCorner = corners.size( );
+        f.numCorners = faceCorners.size( );
+        f.declared.positions = positions.size( ) / 3;
+        f.declared.texCoords = texCoords.size( ) / 2;
+        f.declared.normals = normals.size( ) / 3;
+        corners.insert( corners.end( ), faceCorners.begin( ),
+          faceCorners.end( ));
+        faces.push_back( f );
+      }
+
+      void malformed( void )
+      {
+        ++malformedFaces;
+      }
+    };
 
-        // Average the value of the vector outs
-        for (auto v = 0; v < 3; ++v)
+    /*
+      Split content in line aligned ranges
+      @return range boundaries ( numRanges + 1 pointers )
+    */
+    std::vector< const char* > splitLines( const char* begin,
+      const char* end, size_t numRanges )
+    {
+      std::vector< const char* > bounds( 1, begin );
+      const size_t size = static_cast< size_t >( end - begin );
+      for ( size_t i = 1; i < numRanges; ++i )
+      {
+        const char* target = begin + size / numRanges * i;
+        if ( target <= bounds.back( ))
+          continue;
+        const char* eol = endOfLine( target, end );
+        if ( eol == end )
+          break;
+        bounds.push_back( eol + 1 );
+      }
+      bounds.push_back( end );
+      return bounds;
+    }
+
+    /*
+      Parse chunks on a thread pool and merge them in file order
+    */
+    template< typename Sink >
+    VertexIndexMap::Stats parseParallel( const char* begin, const char* end,
+      const Sink& sink, ThreadPool& pool, MappedFile* file )
+    {
+      const size_t minChunkSize = size_t( 1 ) << 20;
+      const size_t size = static_cast< size_t >( end - begin );
+      const size_t numChunks = std::max( size_t( 1 ), std::min(
+        size_t( pool.size( )) * 4, size / minChunkSize ));
+      const std::vector< const char* > bounds =
+        splitLines( begin, end, numChunks );
+
+      std::vector< ObjChunk > chunks( bounds.size( ) - 1 );
+      pool.parallelFor( chunks.size( ), [ & ]( size_t i )
+      {
+        std::vector< RawCorner > corners;
+        parseLines( bounds[ i ], bounds[ i + 1 ], chunks[ i ], corners );
+        if ( file )
+        {
+          file->release( static_cast< size_t >( bounds[ i ] - begin ),
+            static_cast< size_t >( bounds[ i + 1 ] - bounds[ i ] ));
+        }
+      });
+
+      RecordCounts counts = { { 0, 0, 0 }, 0, 0 };
+      for ( const auto& chunk : chunks )
+      {
+        counts.elements.positions += chunk.positions.size( ) / 3;
+        counts.elements.texCoords += chunk.texCoords.size( ) / 2;
+        counts.elements.normals += chunk.normals.size( ) / 3;
+        counts.faceCorners += chunk.corners.size( );
+        for ( const auto& face : chunk.faces )
         {
-          int addTo = m.indices[i+v];
-          for (auto j = 0; j < 3; ++j)
+          if ( face.numCorners >= 3 )
+            counts.indices += ( face.numCorners - 2 ) * 3;
+        }
+      }
+
+      ModelBuilder< Sink > builder( sink );
+      builder.reserve( counts );
+      size_t malformedFaces = 0;
+      for ( auto& chunk : chunks )
+      {
+        const ElementCounts base = builder.declared( );
+        builder.positions.insert( builder.positions.end( ),
+          chunk.positions.begin( ), chunk.positions.end( ));
+        builder.normals.insert( builder.normals.end( ),
+          chunk.normals.begin( ), chunk.normals.end( ));
+        builder.texCoords.insert( builder.texCoords.end( ),
+          chunk.texCoords.begin( ), chunk.texCoords.end( ));
+
+        for ( const auto& face : chunk.faces )
+        {
+          ElementCounts declared;
+          declared.positions = base.positions + face.declared.positions;
+          declared.texCoords = base.texCoords + face.declared.texCoords;
+          declared.normals = base.normals + face.declared.normals;
+          if ( !builder.addFace( &chunk.corners[ face.firstCorner ],
+            face.numCorners, declared ))
           {
-            tangents[addTo][j] += tangent[j];
-            bitangents[addTo][j] += bitangent[j];
+            ++malformedFaces;
           }
         }
+        malformedFaces += chunk.malformedFaces;
+        chunk = ObjChunk( );
       }
+      warnMalformed( malformedFaces );
+      return builder.stats( );
+    }
+
+    /*
+      Call func on consecutive line aligned windows of the content until it
+      returns false. Mapped pages are released after each window so they do
+      not stay in the resident set.
+      @return false if func stopped the iteration
+    */
+    template< typename F >
+    bool forEachWindow( const char* begin, const char* end,
+      MappedFile* file, F func )
+    {
+      if ( !file )
+        return func( begin, end );
 
-      for (size_t j = 0; j < tangents.size( ); ++j)
+      const size_t window = size_t( 64 ) << 20;
+      const char* p = begin;
+      while ( p != end )
       {
-        for (auto k = 0; k < 3; ++k)
+        const char* stop = static_cast< size_t >( end - p ) > window ?
+          endOfLine( p + window, end ) : end;
+        if ( stop != end ) ++stop;
+        const bool proceed = func( p, stop );
+        file->release( static_cast< size_t >( p - begin ),
+          static_cast< size_t >( stop - p ));
+        if ( !proceed )
+          return false;
+        p = stop;
+      }
+      return true;
+    }
+
+    /*
+      Parse content sequentially. Each window is counted right before it is
+      parsed, while its pages are resident, and the output and the vertex
+      table are reserved for the records extrapolated to the whole content.
+    */
+    template< typename Sink >
+    VertexIndexMap::Stats parseSequential( const char* begin,
+      const char* end, const Sink& sink, MappedFile* file )
+    {
+      const size_t total = static_cast< size_t >( end - begin );
+      RecordCounts counts = { { 0, 0, 0 }, 0, 0 };
+      size_t counted = 0;
+      ObjReader< Sink > reader( sink );
+      forEachWindow( begin, end, file, [ & ]( const char* p, const char* e )
+      {
+        countRecords( p, e, counts );
+        counted += static_cast< size_t >( e - p );
+        reader.reserve( extrapolate( counts, counted, total ));
+        reader.parse( p, e );
+        return true;
+      });
+      return reader.finish( );
+    }
+
+    /*
+      Sequential reader sending the model to a callback in batches
+    */
+    class StreamReader
+    {
+    public:
+      StreamReader( const ObjParser::BatchCallback& callback,
+        size_t batchSize, size_t bytesTotal )
+        : _reader( ModelSink( _pending ))
+        , _callback( callback )
+        , _batchIndices( std::max( size_t( 1 ), batchSize ) * 3 )
+        , _bytesTotal( bytesTotal )
+        , _lastReport( 0 )
+        , _emittedVertices( 0 )
+        , _emittedIndices( 0 )
+      {
+      }
+
+      /*
+        Parse a line aligned range
+        @param offset: Bytes of content before p
+        @return false if the callback cancelled the load
+      */
+      bool parse( const char* p, const char* end, size_t offset )
+      {
+        // Report progress at least this often even with no new triangles
+        const size_t progressStep = size_t( 4 ) << 20;
+
+        const char* start = p;
+        while ( p != end )
         {
-          m.tangents.push_back(tangents[j][k]);
-          m.bitangents.push_back(bitangents[j][k]);
+          const char* eol = endOfLine( p, end );
+          _reader.parseLine( p, eol );
+          p = eol == end ? end : eol + 1;
+
+          const size_t bytesRead = offset + static_cast< size_t >( p - start );
+          while ( _pending.indices.size( ) >= _batchIndices )
+          {
+            if ( !emit( bytesRead, _batchIndices ))
+              return false;
+          }
+          if ( bytesRead - _lastReport >= progressStep &&
+            !emit( bytesRead, _pending.indices.size( )))
+          {
+            return false;
+          }
         }
+        return true;
+      }
+
+      /*
+        Emit the remaining geometry
+        @return false if the callback cancelled the load
+      */
+      bool finish( VertexIndexMap::Stats& stats )
+      {
+        stats = _reader.finish( );
+        return emit( _bytesTotal, _pending.indices.size( ));
       }
 
-      tangents.clear( );
-      bitangents.clear( );
+    private:
+      bool emit( size_t bytesRead, size_t numIndices )
+      {
+        // Swap to reuse the previous batch memory for the next one
+        _batch.vertices.swap( _pending.vertices );
+        _batch.normals.swap( _pending.normals );
+        _batch.texCoords.swap( _pending.texCoords );
+        _pending.vertices.clear( );
+        _pending.normals.clear( );
+        _pending.texCoords.clear( );
+
+        // Indices of a polygon may overflow the batch, keep them for the
+        // next one. Their vertices are already in this batch.
+        const auto split = _pending.indices.begin( ) + numIndices;
+        _batch.indices.assign( _pending.indices.begin( ), split );
+        _pending.indices.erase( _pending.indices.begin( ), split );
+
+        _batch.firstVertex = _emittedVertices;
+        _batch.firstIndex = _emittedIndices;
+        _batch.bytesRead = bytesRead;
+        _batch.bytesTotal = _bytesTotal;
+        _emittedVertices += _batch.vertices.size( ) / 3;
+        _emittedIndices += numIndices;
+        _lastReport = bytesRead;
+        return _callback( _batch );
+      }
+
+      Model _pending;
+      ObjReader< ModelSink > _reader;
+      ModelBatch _batch;
+      const ObjParser::BatchCallback& _callback;
+      size_t _batchIndices;
+      size_t _bytesTotal;
+      size_t _lastReport;
+      size_t _emittedVertices;
+      size_t _emittedIndices;
+    };
+  }
+
+  Model ObjParser::loadObj( const std::string& filename, bool calculateTangAndBi )
+  {
+    MeshSource source;
+    const bool useCache = _meshCache && MeshCache::identify( filename, source );
+    Model m;
+    if ( useCache && loadCache( filename, source, calculateTangAndBi, m ))
+      return m;
+
+    if ( !_memoryMapping || !loadMapped( filename, m ))
+    {
+      const std::string content = loadFile( filename );
+      m = parseBuffer( content.data( ), content.data( ) + content.size( ));
+    }
+    optimize( m );
+    if ( calculateTangAndBi )
+    {
+      calculateTangents( m );
     }
 
+    if ( useCache )
+    {
+      MeshCache::write( MeshCache::cacheFilename( filename ), m, source,
+        _meshOptimization ? MeshCache::OPTIMIZED : 0 );
+    }
     return m;
   }
+
+  Model ObjParser::loadObjFromMemory( const char* data, size_t size,
+    bool calculateTangAndBi )
+  {
+    Model m = parseBuffer( data, data + size );
+    optimize( m );
+    if ( calculateTangAndBi )
+    {
+      calculateTangents( m );
+    }
+    return m;
+  }
+
+  PackedModel ObjParser::loadObjPacked( const std::string& filename,
+    const VertexLayout& layout )
+  {
+    // Tangent frames and the optimization need the whole mesh and the
+    // cache stores a Model, so those cases pack the Model afterwards
+    const bool tangents = layout.find( VertexAttribute::Tangent ) ||
+      layout.find( VertexAttribute::Bitangent );
+    if ( tangents || _meshCache || _meshOptimization )
+      return PackedModel::pack( loadObj( filename, tangents ), layout );
+
+    PackedModel m( layout );
+    if ( !_memoryMapping || !loadMapped( filename, m ))
+    {
+      const std::string content = loadFile( filename );
+      parse( content.data( ), content.data( ) + content.size( ), m, nullptr );
+    }
+    return m;
+  }
+
+  PackedModel ObjParser::loadObjPackedFromMemory( const char* data,
+    size_t size, const VertexLayout& layout )
+  {
+    const bool tangents = layout.find( VertexAttribute::Tangent ) ||
+      layout.find( VertexAttribute::Bitangent );
+    if ( tangents || _meshOptimization )
+    {
+      return PackedModel::pack( loadObjFromMemory( data, size, tangents ),
+        layout );
+    }
+
+    PackedModel m( layout );
+    parse( data, data + size, m, nullptr );
+    return m;
+  }
+
+  bool ObjParser::loadObjStream( const std::string& filename,
+    const BatchCallback& callback, size_t batchSize )
+  {
+    if ( _memoryMapping )
+    {
+      MappedFile file( filename );
+      if ( file.isValid( ))
+      {
+        const char* begin = file.data( );
+        StreamReader reader( callback, batchSize, file.size( ));
+        const bool completed = forEachWindow( begin, begin + file.size( ),
+          &file, [ & ]( const char* p, const char* e )
+          {
+            return reader.parse( p, e, static_cast< size_t >( p - begin ));
+          });
+        return completed && reader.finish( _vertexIndexStats );
+      }
+    }
+
+    std::ifstream in( filename.c_str( ), std::ios::in | std::ios::binary );
+    if ( !in )
+      return false;
+    in.seekg( 0, std::ios::end );
+    const std::streamoff fileSize = in.tellg( );
+    in.seekg( 0, std::ios::beg );
+
+    // Read in blocks, parsing the complete lines of each one and moving
+    // the trailing partial line to the start of the next
+    const size_t size = fileSize > 0 ? static_cast< size_t >( fileSize ) : 0;
+    StreamReader reader( callback, batchSize, size );
+    std::vector< char > buffer( std::max( size_t( 4096 ),
+      std::min( size + 1, size_t( 4 ) << 20 )));
+    size_t carried = 0;
+    size_t offset = 0;
+    while ( in )
+    {
+      if ( buffer.size( ) - carried < buffer.size( ) / 2 )
+        buffer.resize( buffer.size( ) * 2 );
+      in.read( &buffer[ carried ],
+        static_cast< std::streamsize >( buffer.size( ) - carried ));
+      const size_t filled = carried + static_cast< size_t >( in.gcount( ));
+      const char* begin = buffer.data( );
+      const char* end = begin + filled;
+
+      const char* stop = end;
+      if ( in )
+      {
+        while ( stop != begin && stop[ -1 ] != '\n' )
+          --stop;
+      }
+      if ( !reader.parse( begin, stop, offset ))
+        return false;
+
+      offset += static_cast< size_t >( stop - begin );
+      carried = static_cast< size_t >( end - stop );
+      std::copy( stop, end, buffer.begin( ));
+    }
+    return reader.finish( _vertexIndexStats );
+  }
+
+  bool ObjParser::loadObjStreamFromMemory( const char* data, size_t size,
+    const BatchCallback& callback, size_t batchSize )
+  {
+    StreamReader reader( callback, batchSize, size );
+    return reader.parse( data, data + size, 0 ) &&
+      reader.finish( _vertexIndexStats );
+  }
+
+  void ObjParser::setMeshCache( bool enabled )
+  {
+    _meshCache = enabled;
+  }
+
+  bool ObjParser::meshCache( void ) const
+  {
+    return _meshCache;
+  }
+
+  void ObjParser::setMeshOptimization( bool enabled )
+  {
+    _meshOptimization = enabled;
+  }
+
+  bool ObjParser::meshOptimization( void ) const
+  {
+    return _meshOptimization;
+  }
+
+  const MeshOptimizer::Stats& ObjParser::meshOptimizationStats( void ) const
+  {
+    return _meshOptimizationStats;
+  }
+
+  void ObjParser::setMemoryMapping( bool enabled )
+  {
+    _memoryMapping = enabled;
+  }
+
+  bool ObjParser::memoryMapping( void ) const
+  {
+    return _memoryMapping;
+  }
+
+  void ObjParser::setNumThreads( unsigned int numThreads )
+  {
+    if ( numThreads == 0 )
+      numThreads = std::max( 1u, std::thread::hardware_concurrency( ));
+    if ( numThreads == this->numThreads( ))
+      return;
+
+    if ( numThreads > 1 )
+      _pool = std::make_shared< ThreadPool >( numThreads );
+    else
+      _pool.reset( );
+  }
+
+  unsigned int ObjParser::numThreads( void ) const
+  {
+    return _pool ? _pool->size( ) : 1;
+  }
+
+  const VertexIndexMap::Stats& ObjParser::vertexIndexStats( void ) const
+  {
+    return _vertexIndexStats;
+  }
+
+  Model ObjParser::parseBuffer( const char* begin, const char* end )
+  {
+    Model m;
+    parse( begin, end, m, nullptr );
+    return m;
+  }
+
+  bool ObjParser::loadMapped( const std::string& filename, Model& m )
+  {
+    MappedFile file( filename );
+    if ( !file.isValid( ))
+      return false;
+
+    parse( file.data( ), file.data( ) + file.size( ), m, &file );
+    return true;
+  }
+
+  bool ObjParser::loadMapped( const std::string& filename, PackedModel& m )
+  {
+    MappedFile file( filename );
+    if ( !file.isValid( ))
+      return false;
+
+    parse( file.data( ), file.data( ) + file.size( ), m, &file );
+    return true;
+  }
+
+  bool ObjParser::loadCache( const std::string& filename,
+    const MeshSource& source, bool calculateTangAndBi, Model& m )
+  {
+    MeshCache cache( MeshCache::cacheFilename( filename ));
+    if ( !cache.isValid( ) || cache.source( ).size != source.size ||
+      cache.source( ).mtime != source.mtime ||
+      cache.source( ).hash != source.hash )
+    {
+      return false;
+    }
+
+    // Tangents are only cached when they were requested, parse again to
+    // add them
+    size_t vertices, tangents;
+    cache.data( MeshSection::Vertices, vertices );
+    cache.data( MeshSection::Tangents, tangents );
+    if ( calculateTangAndBi && tangents == 0 && vertices > 0 )
+      return false;
+    if ( _meshOptimization && ( cache.flags( ) & MeshCache::OPTIMIZED ) == 0 )
+      return false;
+
+    m = cache.model( );
+    if ( !calculateTangAndBi )
+    {
+      m.tangents.clear( );
+      m.bitangents.clear( );
+    }
+    _vertexIndexStats = VertexIndexMap::Stats( );
+    _meshOptimizationStats = MeshOptimizer::Stats( );
+    return true;
+  }
+
+  void ObjParser::parse( const char* begin, const char* end, Model& m,
+    MappedFile* file )
+  {
+    const ModelSink sink( m );
+    if ( _pool )
+      _vertexIndexStats = parseParallel( begin, end, sink, *_pool, file );
+    else
+      _vertexIndexStats = parseSequential( begin, end, sink, file );
+  }
+
+  void ObjParser::parse( const char* begin, const char* end, PackedModel& m,
+    MappedFile* file )
+  {
+    const PackedSink sink( m );
+    if ( _pool )
+      _vertexIndexStats = parseParallel( begin, end, sink, *_pool, file );
+    else
+      _vertexIndexStats = parseSequential( begin, end, sink, file );
+    m.finish( );
+  }
+
+  void ObjParser::optimize( Model& m )
+  {
+    _meshOptimizationStats = MeshOptimizer::Stats( );
+    if ( _meshOptimization )
+      _meshOptimizationStats = MeshOptimizer( ).optimize( m );
+  }
+
+  void ObjParser::calculateTangents( Model& m )
+  {
+    TangentGenerator generator;
+    generator.setThreadPool( _pool );
+    generator.generate( m );
+  }
+
 };
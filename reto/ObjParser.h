@@ -24,7 +24,11 @@
 #define __RETO_OBJPARSER__
 
 #include <reto/api.h>
+#include "VertexIndexMap.h"
+#include "MeshOptimizer.h"
+#include "VertexLayout.h"
 
+#include <cstddef>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -32,9 +36,15 @@
 #include <map>
 #include <iterator>
 #include <algorithm>
+#include <functional>
+#include <memory>
 
 namespace reto
 {
+  class MappedFile;
+  class ThreadPool;
+  struct MeshSource;
+
   //! Auxiliar struct from ObjParser
   struct Model
   {
@@ -51,10 +61,36 @@ namespace reto
     //! Container of raw bitangents
     std::vector< float > bitangents;
   };
+  //! Part of a model emitted while it is being parsed
+  struct ModelBatch
+  {
+    //! Raw vertices added since the previous batch
+    std::vector< float > vertices;
+    //! Raw normals added since the previous batch
+    std::vector< float > normals;
+    //! Raw texCoords added since the previous batch
+    std::vector< float > texCoords;
+    //! Raw indices, referring to vertices of this or previous batches
+    std::vector< int > indices;
+    //! Position in the whole model of the first vertex of this batch
+    size_t firstVertex;
+    //! Position in the whole model of the first index of this batch
+    size_t firstIndex;
+    //! Bytes of content parsed so far
+    size_t bytesRead;
+    //! Content size in bytes
+    size_t bytesTotal;
+  };
   //! Class to read obj mesh files
   class ObjParser
   {
   public:
+    /**
+     * Function receiving the batches of a streamed model. Returning false
+     * cancels the load.
+     */
+    typedef std::function< bool( const ModelBatch& batch ) > BatchCallback;
+
     /**
      * ObjParser constructor
      */
@@ -71,50 +107,248 @@ namespace reto
     RETO_API
     Model loadObj( const std::string& filename,
       bool calculateTangAndBi = false );
+
+    /**
+     * Parse obj content already stored in memory
+     * @param data: Pointer to the Wavefront OBJ content. It does not need
+     *   to be null terminated.
+     * @param size: Content size in bytes.
+     * @param calculateTangAndBi: Calculate tangents and
+     *   bitangents for object.
+     * @return Model object with parsed values.
+     */
+    RETO_API
+    Model loadObjFromMemory( const char* data, size_t size,
+      bool calculateTangAndBi = false );
+
+    /**
+     * Load obj file directly in a vertex layout, without building a Model
+     * first. Tangents and bitangents are calculated when the layout has
+     * them.
+     * @param filename: Wavefront OBJ file route.
+     * @param layout: Vertex layout of the result.
+     * @return PackedModel with parsed values.
+     */
+    RETO_API
+    PackedModel loadObjPacked( const std::string& filename,
+      const VertexLayout& layout );
+
+    /**
+     * Parse obj content already stored in memory directly in a vertex
+     * layout
+     * @param data: Pointer to the Wavefront OBJ content.
+     * @param size: Content size in bytes.
+     * @param layout: Vertex layout of the result.
+     * @return PackedModel with parsed values.
+     */
+    RETO_API
+    PackedModel loadObjPackedFromMemory( const char* data, size_t size,
+      const VertexLayout& layout );
+
+    /**
+     * Load obj file incrementally, sending the deduplicated vertices and
+     * indices to a callback in batches while the file is read. Batches
+     * hold batchSize triangles, except the last one and those emitted to
+     * report progress on long runs of records without faces. Concatenating
+     * all batches gives the same Model as loadObj. The file is always
+     * parsed by the calling thread, and tangents are not calculated.
+     * @param filename: Wavefront OBJ file route.
+     * @param callback: Function receiving each batch.
+     * @param batchSize: Triangles per batch.
+     * @return false if the file could not be read or the callback
+     *   cancelled the load.
+     */
+    RETO_API
+    bool loadObjStream( const std::string& filename,
+      const BatchCallback& callback, size_t batchSize = 65536 );
+
+    /**
+     * Parse obj content already stored in memory incrementally
+     * @param data: Pointer to the Wavefront OBJ content.
+     * @param size: Content size in bytes.
+     * @param callback: Function receiving each batch.
+     * @param batchSize: Triangles per batch.
+     * @return false if the callback cancelled the load.
+     * @see loadObjStream
+     */
+    RETO_API
+    bool loadObjStreamFromMemory( const char* data, size_t size,
+      const BatchCallback& callback, size_t batchSize = 65536 );
+
+    /**
+     * Enable or disable the binary mesh cache. When enabled loadObj stores
+     * the parsed model in a .retomesh file next to the source and, while
+     * the source size, modification time and sampled hash still match,
+     * maps that file instead of parsing the source again.
+     * @param enabled: Mesh cache flag ( default = false ).
+     * @see MeshCache
+     */
+    RETO_API
+    void setMeshCache( bool enabled );
+
+    /**
+     * Check if the binary mesh cache is enabled
+     * @return bool
+     */
+    RETO_API
+    bool meshCache( void ) const;
+
+    /**
+     * Enable or disable the mesh optimization stage. When enabled loadObj
+     * and loadObjPacked reorder the triangles of the parsed model for
+     * vertex cache reuse and its vertices for fetch locality. Streamed
+     * loads are not optimized.
+     * @param enabled: Mesh optimization flag ( default = false ).
+     * @see MeshOptimizer
+     */
+    RETO_API
+    void setMeshOptimization( bool enabled );
+
+    /**
+     * Check if the mesh optimization stage is enabled
+     * @return bool
+     */
+    RETO_API
+    bool meshOptimization( void ) const;
+
+    /**
+     * Get the vertex cache efficiency before and after the optimization
+     * of the last parse ( zero when the model was not optimized or came
+     * from the mesh cache ).
+     * @return MeshOptimizer::Stats
+     */
+    RETO_API
+    const MeshOptimizer::Stats& meshOptimizationStats( void ) const;
+
+    /**
+     * Enable or disable memory mapped loading. When enabled loadObj maps
+     * the file read-only and parses it in place instead of copying it to
+     * memory first. Falls back to regular reading if mapping fails.
+     * @param enabled: Memory mapping flag ( default = false ).
+     */
+    RETO_API
+    void setMemoryMapping( bool enabled );
+
+    /**
+     * Check if memory mapped loading is enabled
+     * @return bool
+     */
+    RETO_API
+    bool memoryMapping( void ) const;
+
+    /**
+     * Set the number of threads used to parse. With more than one thread
+     * the content is split in line aligned chunks parsed in parallel and
+     * merged in file order, producing the same Model as one thread.
+     * @param numThreads: Number of threads ( default = 1 ). 0 means one
+     *   per hardware thread.
+     */
+    RETO_API
+    void setNumThreads( unsigned int numThreads );
+
+    /**
+     * Get the number of threads used to parse
+     * @return unsigned int
+     */
+    RETO_API
+    unsigned int numThreads( void ) const;
+
+    /**
+     * Get the vertex deduplication table statistics of the last parse
+     * ( size, capacity, load factor and probe counts ).
+     * @return VertexIndexMap::Stats
+     */
+    RETO_API
+    const VertexIndexMap::Stats& vertexIndexStats( void ) const;
   protected:
     /*
-      Load all file content
+      Parse obj content walking the buffer once, without creating
+      intermediate strings
+      @param const char* begin
+      @param const char* end
+      @return Model
+    */
+    Model parseBuffer( const char* begin, const char* end );
+    /*
+      Parse a memory mapped file in place
       @param std::string filename
-      @return std::string
+      @param Model m
+      @return bool: false if file could not be mapped
     */
-    std::string loadFile( const std::string& filename );
+    bool loadMapped( const std::string& filename, Model& m );
     /*
-      Split string by character separator
-      @param string line
-      @param char c
-      @return std::vector<std::string>
+      Parse a memory mapped file in place to a vertex layout
+      @param std::string filename
+      @param PackedModel m
+      @return bool: false if file could not be mapped
     */
-    std::vector< std::string > split( const std::string& s, char c );
+    bool loadMapped( const std::string& filename, PackedModel& m );
     /*
-      Check if string is a number
-      @param string input
-      @return bool
+      Load the cache of a source file if it is up to date
+      @param std::string filename: Source file route
+      @param MeshSource source: Current source identification
+      @param bool calculateTangAndBi
+      @param Model m
+      @return bool: false if there is no valid cache for the source
     */
-    bool isNumeric( const std::string& input );
+    bool loadCache( const std::string& filename, const MeshSource& source,
+      bool calculateTangAndBi, Model& m );
     /*
-      Check if string is a float number
-      @param string input
-      @return bool
+      Parse content with the configured number of threads
+      @param const char* begin
+      @param const char* end
+      @param Model m
+      @param MappedFile* file: Mapped source to release consumed pages
+        ( may be nullptr )
     */
-    bool isFloat( const std::string& myString );
+    void parse( const char* begin, const char* end, Model& m,
+      MappedFile* file );
     /*
-      Split string in a float vector
-      @param string line
-      @return std::vector<std::float>
+      Parse content to a vertex layout with the configured number of
+      threads
+      @param const char* begin
+      @param const char* end
+      @param PackedModel m
+      @param MappedFile* file: Mapped source to release consumed pages
+        ( may be nullptr )
     */
-    std::vector< float > splitLineToFloats( std::string& line );
+    void parse( const char* begin, const char* end, PackedModel& m,
+      MappedFile* file );
     /*
-      Remove spaces from left and right of a string
-      @param string line
-      @return std::string
+      Apply the mesh optimization stage to a parsed model if enabled
+      @param Model m
     */
-    std::string trim( const std::string& str );
+    void optimize( Model& m );
     /*
-      Split string in a integer vector
-      @param string line
-      @return std::vector<std::int>
+      Calculate normalized per vertex tangents and bitangents of a parsed
+      model, using the thread pool when there is one
+      @param Model m
     */
-    std::vector< int > splitFace( std::string& line );
+    void calculateTangents( Model& m );
+    /*
+      Load all file content
+      @param std::string filename
+      @return std::string
+    */
+    std::string loadFile( const std::string& filename );
+
+    //! Memory mapped loading flag
+    bool _memoryMapping;
+
+    //! Binary mesh cache flag
+    bool _meshCache;
+
+    //! Mesh optimization flag
+    bool _meshOptimization;
+
+    //! Thread pool for parallel parsing ( null when using one thread )
+    std::shared_ptr< ThreadPool > _pool;
+
+    //! Vertex deduplication statistics of the last parse
+    VertexIndexMap::Stats _vertexIndexStats;
+
+    //! Vertex cache efficiency of the last optimization
+    MeshOptimizer::Stats _meshOptimizationStats;
   };
 }
 
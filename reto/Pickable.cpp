@@ -41,6 +41,16 @@ namespace reto
     _numIds = numIds;
   }  
 
+  int Pickable::getNumIDs( void ) const
+  {
+    return _numIds;
+  }
+
+  std::vector< unsigned int > Pickable::getIndices( void ) const
+  {
+    return std::vector< unsigned int >( );
+  }
+
   int Pickable::getId( void ) const
   {
     return _id;
@@ -57,6 +57,18 @@ namespace reto
     RETO_API
     virtual std::vector< float > getPositions( void ) const = 0;
 
+    /**
+     * Method to get the triangles of getPositions, three indices per
+     * triangle, each one below the number of positions. Empty ( default )
+     * means that getPositions already lists three vertices per triangle,
+     * so objects whose positions are indexed geometry must override it, or
+     * the paths that read the geometry instead of calling render, such as
+     * ray picking, test the wrong triangles.
+     * @return std::vector< unsigned int >
+     */
+    RETO_API
+    virtual std::vector< unsigned int > getIndices( void ) const;
+
     RETO_API
     virtual bool getSelected( void ) const = 0;
 
@@ -69,6 +81,13 @@ namespace reto
     RETO_API
     void setId( const int& id );
 
+    /**
+     * Method to get the number of consecutive picking ids of the object
+     * @return int
+     */
+    RETO_API
+    int getNumIDs( void ) const;
+
   protected:
     int _numIds = 1;
     void setNumIDs( int numIds );
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "PickingRegistry.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace reto
+{
+  namespace
+  {
+    //! Ranges up to this size have a table entry per id
+    const uint32_t SMALL_RANGE = 4096;
+
+    //! Larger ranges are made of aligned blocks of 2^BLOCK_BITS ids
+    const uint32_t BLOCK_BITS = 12;
+
+    //! First id of the large ranges
+    const uint32_t LARGE_BASE = 1u << 30;
+
+    //! Ids stay below 2^31 to fit in the int returned by picks
+    const uint32_t MAX_BLOCKS = (( 1u << 31 ) - LARGE_BASE ) >> BLOCK_BITS;
+
+    const PickHandle INVALID_HANDLE = { 0, 0 };
+
+    template < typename FreeList >
+    void eraseRange( FreeList& free, uint32_t first, uint32_t size )
+    {
+      free.byFirst.erase( first );
+      free.bySize.erase( std::make_pair( size, first ));
+    }
+
+    // Takes the smallest free range that fits size, the rest stays free
+    template < typename FreeList >
+    bool takeRange( FreeList& free, uint32_t size, uint32_t& first )
+    {
+      auto it = free.bySize.lower_bound( std::make_pair( size, 0u ));
+      if ( it == free.bySize.end( ))
+        return false;
+      const uint32_t rangeSize = it->first;
+      first = it->second;
+      free.bySize.erase( it );
+      free.byFirst.erase( first );
+      if ( rangeSize > size )
+      {
+        free.byFirst[ first + size ] = rangeSize - size;
+        free.bySize.emplace( rangeSize - size, first + size );
+      }
+      return true;
+    }
+
+    // Merges a range with its free neighbours, ranges reaching the end of
+    // the space shrink it instead
+    template < typename FreeList >
+    void giveRange( FreeList& free, uint32_t first, uint32_t size,
+      uint32_t& end )
+    {
+      auto next = free.byFirst.find( first + size );
+      if ( next != free.byFirst.end( ))
+      {
+        const uint32_t nextSize = next->second;
+        eraseRange( free, first + size, nextSize );
+        size += nextSize;
+      }
+      auto prev = free.byFirst.lower_bound( first );
+      if ( prev != free.byFirst.begin( ))
+      {
+        --prev;
+        if ( prev->first + prev->second == first )
+        {
+          const uint32_t prevFirst = prev->first;
+          const uint32_t prevSize = prev->second;
+          eraseRange( free, prevFirst, prevSize );
+          first = prevFirst;
+          size += prevSize;
+        }
+      }
+      if ( first + size == end )
+      {
+        end = first;
+        return;
+      }
+      free.byFirst[ first ] = size;
+      free.bySize.emplace( size, first );
+    }
+  }
+
+  PickingRegistry::PickingRegistry( void )
+    : _nextGeneration( 1 )
+  {
+  }
+
+  PickHandle PickingRegistry::add( Pickable* object, uint32_t numIds )
+  {
+    auto it = _slotOf.find( object );
+    if ( it != _slotOf.end( ))
+    {
+      const Slot& slot = _slots[ it->second ];
+      return PickHandle{ slot.firstId, slot.generation };
+    }
+
+    uint32_t index;
+    if ( _freeSlots.empty( ))
+    {
+      index = uint32_t( _slots.size( ));
+      _slots.push_back( Slot( ));
+    }
+    else
+    {
+      index = _freeSlots.back( );
+      _freeSlots.pop_back( );
+    }
+
+    numIds = std::max( numIds, 1u );
+    uint32_t firstId;
+    if ( !allocate( numIds, index, firstId ))
+    {
+      std::cerr << "Warning: no picking ids left for " << numIds
+                << " ids" << std::endl;
+      _freeSlots.push_back( index );
+      return INVALID_HANDLE;
+    }
+
+    Slot& slot = _slots[ index ];
+    slot.object = object;
+    slot.firstId = firstId;
+    slot.numIds = numIds;
+    slot.generation = _nextGeneration++;
+    if ( _nextGeneration == 0 )
+      _nextGeneration = 1;
+    slot.dense = uint32_t( _objects.size( ));
+
+    _slotOf[ object ] = index;
+    _objects.push_back( object );
+    _firstIds.push_back( firstId );
+    _objectSlots.push_back( index );
+    return PickHandle{ slot.firstId, slot.generation };
+  }
+
+  bool PickingRegistry::remove( Pickable* object )
+  {
+    auto it = _slotOf.find( object );
+    if ( it == _slotOf.end( ))
+      return false;
+
+    const uint32_t index = it->second;
+    _slotOf.erase( it );
+    Slot& slot = _slots[ index ];
+    release( slot.firstId, slot.numIds );
+
+    // The last object takes the place of the removed one
+    const uint32_t dense = slot.dense;
+    _objects[ dense ] = _objects.back( );
+    _firstIds[ dense ] = _firstIds.back( );
+    _objectSlots[ dense ] = _objectSlots.back( );
+    _slots[ _objectSlots[ dense ]].dense = dense;
+    _objects.pop_back( );
+    _firstIds.pop_back( );
+    _objectSlots.pop_back( );
+
+    slot.object = nullptr;
+    slot.generation = 0;
+    _freeSlots.push_back( index );
+    return true;
+  }
+
+  void PickingRegistry::clear( void )
+  {
+    // Generations keep growing, so older handles stay invalid
+    _slots.clear( );
+    _freeSlots.clear( );
+    _slotOf.clear( );
+    _objects.clear( );
+    _firstIds.clear( );
+    _objectSlots.clear( );
+    _idSlots.clear( );
+    _blockSlots.clear( );
+    _freeRanges = FreeList( );
+    _freeBlocks = FreeList( );
+  }
+
+  size_t PickingRegistry::size( void ) const
+  {
+    return _objects.size( );
+  }
+
+  PickHandle PickingRegistry::handle( const Pickable* object ) const
+  {
+    auto it = _slotOf.find( object );
+    if ( it == _slotOf.end( ))
+      return INVALID_HANDLE;
+    const Slot& slot = _slots[ it->second ];
+    return PickHandle{ slot.firstId, slot.generation };
+  }
+
+  PickHandle PickingRegistry::owner( uint32_t id ) const
+  {
+    const uint32_t index = slotOf( id );
+    if ( index == 0 )
+      return INVALID_HANDLE;
+    const Slot& slot = _slots[ index - 1 ];
+    return PickHandle{ slot.firstId, slot.generation };
+  }
+
+  Pickable* PickingRegistry::object( uint32_t id ) const
+  {
+    const uint32_t index = slotOf( id );
+    return index == 0 ? nullptr : _slots[ index - 1 ].object;
+  }
+
+  Pickable* PickingRegistry::object( const PickHandle& handle ) const
+  {
+    const uint32_t index = slotOf( handle.id );
+    if ( index == 0 || handle.generation == 0 )
+      return nullptr;
+    const Slot& slot = _slots[ index - 1 ];
+    return slot.generation == handle.generation ? slot.object : nullptr;
+  }
+
+  const std::vector< Pickable* >& PickingRegistry::objects( void ) const
+  {
+    return _objects;
+  }
+
+  const std::vector< uint32_t >& PickingRegistry::firstIds( void ) const
+  {
+    return _firstIds;
+  }
+
+  bool PickingRegistry::allocate( uint32_t numIds, uint32_t slot,
+    uint32_t& firstId )
+  {
+    if ( numIds <= SMALL_RANGE )
+    {
+      if ( !takeRange( _freeRanges, numIds, firstId ))
+      {
+        if ( _idSlots.size( ) + numIds > LARGE_BASE )
+          return false;
+        firstId = uint32_t( _idSlots.size( ));
+        _idSlots.resize( _idSlots.size( ) + numIds );
+      }
+      std::fill( _idSlots.begin( ) + firstId,
+        _idSlots.begin( ) + firstId + numIds, slot + 1 );
+      return true;
+    }
+
+    const uint32_t numBlocks =
+      ( numIds + ( 1u << BLOCK_BITS ) - 1 ) >> BLOCK_BITS;
+    uint32_t firstBlock;
+    if ( !takeRange( _freeBlocks, numBlocks, firstBlock ))
+    {
+      if ( numBlocks > MAX_BLOCKS ||
+        _blockSlots.size( ) > MAX_BLOCKS - numBlocks )
+      {
+        return false;
+      }
+      firstBlock = uint32_t( _blockSlots.size( ));
+      _blockSlots.resize( _blockSlots.size( ) + numBlocks );
+    }
+    std::fill( _blockSlots.begin( ) + firstBlock,
+      _blockSlots.begin( ) + firstBlock + numBlocks, slot + 1 );
+    firstId = LARGE_BASE + ( firstBlock << BLOCK_BITS );
+    return true;
+  }
+
+  void PickingRegistry::release( uint32_t firstId, uint32_t numIds )
+  {
+    if ( numIds <= SMALL_RANGE )
+    {
+      std::fill( _idSlots.begin( ) + firstId,
+        _idSlots.begin( ) + firstId + numIds, 0 );
+      uint32_t end = uint32_t( _idSlots.size( ));
+      giveRange( _freeRanges, firstId, numIds, end );
+      _idSlots.resize( end );
+      return;
+    }
+
+    const uint32_t numBlocks =
+      ( numIds + ( 1u << BLOCK_BITS ) - 1 ) >> BLOCK_BITS;
+    const uint32_t firstBlock = ( firstId - LARGE_BASE ) >> BLOCK_BITS;
+    std::fill( _blockSlots.begin( ) + firstBlock,
+      _blockSlots.begin( ) + firstBlock + numBlocks, 0 );
+    uint32_t end = uint32_t( _blockSlots.size( ));
+    giveRange( _freeBlocks, firstBlock, numBlocks, end );
+    _blockSlots.resize( end );
+  }
+
+  uint32_t PickingRegistry::slotOf( uint32_t id ) const
+  {
+    if ( id < LARGE_BASE )
+      return id < _idSlots.size( ) ? _idSlots[ id ] : 0;
+
+    const uint32_t block = ( id - LARGE_BASE ) >> BLOCK_BITS;
+    if ( block >= _blockSlots.size( ) || _blockSlots[ block ] == 0 )
+      return 0;
+    // The last block of a range may be partially used
+    const Slot& slot = _slots[ _blockSlots[ block ] - 1 ];
+    return id - slot.firstId < slot.numIds ? _blockSlots[ block ] : 0;
+  }
+
+} /* namespace reto */
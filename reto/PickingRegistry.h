@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__PICKING_REGISTRY__
+#define __RETO__PICKING_REGISTRY__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace reto
+{
+  class Pickable;
+
+  //! Registration of an object, detecting ids later reused by others
+  struct PickHandle
+  {
+    //! First id of the object
+    uint32_t id;
+    //! Registration serial of the object ( 0 for invalid handles )
+    uint32_t generation;
+  };
+
+  /**
+   * Stable picking ids of Pickable objects. Each object reserves a range
+   * of consecutive ids when it is added ( one per id it renders ), keeps
+   * it until it is removed. Freed ranges are merged with their free
+   * neighbours, and later objects take the smallest free range that fits
+   * them, so the id space does not grow when sizes change. Adding and
+   * removing an object are logarithmic in the number of free ranges.
+   * Objects live in a slot map with a generation counter per
+   * registration, so finding the owner of an id is constant time, and
+   * handles of removed objects stay invalid after their ids are reused.
+   * @class PickingRegistry
+   */
+  class PickingRegistry
+  {
+    public:
+      /**
+       * PickingRegistry constructor
+       */
+      RETO_API
+      PickingRegistry( void );
+
+      /**
+       * Method to register an object
+       * @param object: Pickable object
+       * @param numIds: Number of consecutive ids reserved for the object
+       * @return PickHandle of the object ( the current one if it was
+       *   already registered, invalid if the ids are exhausted )
+       */
+      RETO_API
+      PickHandle add( reto::Pickable* object, uint32_t numIds = 1 );
+
+      /**
+       * Method to unregister an object and free its ids
+       * @param object: Pickable object
+       * @return bool: false if it was not registered
+       */
+      RETO_API
+      bool remove( reto::Pickable* object );
+
+      /**
+       * Method to unregister all objects
+       */
+      RETO_API
+      void clear( void );
+
+      /**
+       * Method to get the number of registered objects
+       * @return size_t
+       */
+      RETO_API
+      size_t size( void ) const;
+
+      /**
+       * Method to get the handle of a registered object
+       * @param object: Pickable object
+       * @return PickHandle ( invalid if it is not registered )
+       */
+      RETO_API
+      PickHandle handle( const reto::Pickable* object ) const;
+
+      /**
+       * Method to find the object owning an id
+       * @param id: Picking id
+       * @return PickHandle of the owner ( invalid for free ids )
+       */
+      RETO_API
+      PickHandle owner( uint32_t id ) const;
+
+      /**
+       * Method to get the object owning an id
+       * @param id: Picking id
+       * @return Pickable* ( nullptr for free ids )
+       */
+      RETO_API
+      reto::Pickable* object( uint32_t id ) const;
+
+      /**
+       * Method to get the object of a handle
+       * @param handle: Handle returned by add, handle or owner
+       * @return Pickable* ( nullptr if the object was removed )
+       */
+      RETO_API
+      reto::Pickable* object( const PickHandle& handle ) const;
+
+      /**
+       * Method to get the registered objects, in no particular order
+       * @return const std::vector< Pickable* >&
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& objects( void ) const;
+
+      /**
+       * Method to get the first id of each object of objects
+       * @return const std::vector< uint32_t >&
+       */
+      RETO_API
+      const std::vector< uint32_t >& firstIds( void ) const;
+
+    protected:
+      //! Registered object
+      struct Slot
+      {
+        reto::Pickable* object;
+        uint32_t firstId;
+        uint32_t numIds;
+        uint32_t generation;
+        //! Position in _objects
+        uint32_t dense;
+      };
+
+      //! Free ranges of an id space, without adjacent ones
+      struct FreeList
+      {
+        //! Size of each range by its first element
+        std::map< uint32_t, uint32_t > byFirst;
+        //! Size and first element of each range, smallest first
+        std::set< std::pair< uint32_t, uint32_t >> bySize;
+      };
+
+      /*
+        Reserve a range of ids
+        @param uint32_t numIds
+        @param uint32_t slot: Owner of the range
+        @param uint32_t firstId: out first id of the range
+        @return bool: false if the ids are exhausted
+      */
+      bool allocate( uint32_t numIds, uint32_t slot, uint32_t& firstId );
+      /*
+        Free a range of ids
+        @param uint32_t firstId
+        @param uint32_t numIds
+      */
+      void release( uint32_t firstId, uint32_t numIds );
+      /*
+        Slot owning an id
+        @param uint32_t id
+        @return uint32_t: slot plus one ( 0 for free ids )
+      */
+      uint32_t slotOf( uint32_t id ) const;
+
+      //! Objects by slot
+      std::vector< Slot > _slots;
+
+      //! Slots ready to be reused
+      std::vector< uint32_t > _freeSlots;
+
+      //! Slot of each registered object
+      std::unordered_map< const reto::Pickable*, uint32_t > _slotOf;
+
+      //! Registered objects without gaps
+      std::vector< reto::Pickable* > _objects;
+
+      //! First id of each object of _objects
+      std::vector< uint32_t > _firstIds;
+
+      //! Slot of each object of _objects
+      std::vector< uint32_t > _objectSlots;
+
+      //! Slot plus one owning each id of small ranges
+      std::vector< uint32_t > _idSlots;
+
+      //! Slot plus one owning each block of ids of large ranges
+      std::vector< uint32_t > _blockSlots;
+
+      //! Freed small ranges of ids
+      FreeList _freeRanges;
+
+      //! Freed large ranges of blocks
+      FreeList _freeBlocks;
+
+      //! Generation of the next registration
+      uint32_t _nextGeneration;
+
+  }; /* class PickingRegistry */
+
+} /* namespace reto */
+
+#endif /* __RETO__PICKING_REGISTRY__ */
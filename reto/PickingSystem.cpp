@@ -22,6 +22,17 @@
 
 #include "PickingSystem.h"
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include <Eigen/Dense>
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __SSE2__ ) || \
+  ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #define RETO_PICKING_SSE
+  #include <emmintrin.h>
+#endif
 
 //OpenGL
 #ifndef SKIP_GLEW_INCLUDE
@@ -38,30 +49,135 @@
 
 namespace reto
 {
-  PickingSystem::PickingSystem( )
+  namespace
   {
-    _program->loadFromText(
-      _VertexCode( ),
+    // Picking pixels store the id plus one, zero is the background
+    inline void addId( uint32_t pixel, std::vector< uint32_t >& ids )
+    {
+      if ( pixel != 0 )
+        ids.push_back( pixel - 1 );
+    }
+
+    // Collects the ids of a block of picking pixels. Only pixels that
+    // differ from the previous one are decoded, so the flat regions of each
+    // object are skipped four pixels at a time. Ids may be repeated.
+    void collectIds( const uint32_t* pixels, size_t count,
+      std::vector< uint32_t >& ids )
+    {
+      if ( count == 0 )
+        return;
+      addId( pixels[ 0 ], ids );
+
+      size_t i = 1;
+#ifdef RETO_PICKING_SSE
+      for ( ; i + 4 <= count; i += 4 )
+      {
+        const __m128i current = _mm_loadu_si128(
+          reinterpret_cast< const __m128i* >( pixels + i ));
+        const __m128i previous = _mm_loadu_si128(
+          reinterpret_cast< const __m128i* >( pixels + i - 1 ));
+        int changed = _mm_movemask_ps( _mm_castsi128_ps(
+          _mm_cmpeq_epi32( current, previous ))) ^ 0xF;
+        for ( size_t j = i; changed; changed >>= 1, ++j )
+        {
+          if ( changed & 1 )
+            addId( pixels[ j ], ids );
+        }
+      }
+#endif
+      for ( ; i < count; ++i )
+      {
+        if ( pixels[ i ] != pixels[ i - 1 ] )
+          addId( pixels[ i ], ids );
+      }
+    }
+
+    //! Bytes read back for a hit: id, primitive, depth and depth slopes
+    const size_t HIT_SIZE = 5 * sizeof( uint32_t );
+
+    // The window depth of a triangle is a plane in window coordinates, so
+    // its slopes and the depth of a pixel give the triangle around it
+    const char* const FRAGMENT_CODE =
       "#version 430\n"
-      "layout(location = 0) out vec4 ourColor;\n"
-      "in float pid;\n"
+      "layout(location = 0) out uvec2 pickPixel;\n"
+      "layout(location = 1) out vec2 pickSlope;\n"
+      "flat in uint pid;\n"
+      "void main( ) {\n"
+      "  pickPixel = uvec2( pid, uint( gl_PrimitiveID ));\n"
+      "  pickSlope = vec2( dFdx( gl_FragCoord.z ), dFdy( gl_FragCoord.z ));\n"
+      "}\n";
 
-      "float module(float x, float y) {\n"
-      "  return x - y * floor(x / y);\n"
-      "}\n"
+    // Reads the id, primitive, depth and depth slopes of a pixel
+    void readHit( int x, int y, char* data )
+    {
+      glReadPixels( x, y, 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, data );
+      glReadPixels( x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT,
+        data + 2 * sizeof( uint32_t ));
+      glReadBuffer( GL_COLOR_ATTACHMENT1 );
+      glReadPixels( x, y, 1, 1, GL_RG, GL_FLOAT,
+        data + 3 * sizeof( uint32_t ));
+      glReadBuffer( GL_COLOR_ATTACHMENT0 );
+    }
 
-      "vec3 unpackColor(float f) {\n"
-      "  vec3 color;\n"
-      "  color.b = floor(f / (256 * 256));\n"
-      "  color.g = floor((f - color.b * 256 * 256) / 256);\n"
-      "  color.r = floor(module(f, 256.0));\n"
-      "  return color / 255.0;\n"
-      "}\n"
+    // Window coordinates to world coordinates
+    Eigen::Vector3d unproject( const Eigen::Matrix4d& inverse,
+      const int* viewport, double x, double y, double depth )
+    {
+      const Eigen::Vector4d ndc(
+        2.0 * ( x - viewport[ 0 ]) / viewport[ 2 ] - 1.0,
+        2.0 * ( y - viewport[ 1 ]) / viewport[ 3 ] - 1.0,
+        2.0 * depth - 1.0, 1.0 );
+      const Eigen::Vector4d world = inverse * ndc;
+      return world.head< 3 >( ) / world.w( );
+    }
 
+    // The per instance attribute draw is fetched at the baseInstance of
+    // each command, giving the id and the object of the draw without
+    // gl_DrawID
+    const char* const INDIRECT_VERTEX_CODE =
+      "#version 430\n"
+      "layout(location = 0) in vec3 position;\n"
+      "layout(location = 1) in uvec2 draw;\n"
+      "layout(std430, binding = 0) readonly buffer Models\n"
+      "{\n"
+      "  mat4 models[ ];\n"
+      "};\n"
+      "uniform mat4 projectionView;\n"
+      "flat out uint pid;\n"
       "void main( ) {\n"
-      "  vec3 cc = unpackColor(pid);\n"
-      "  ourColor = vec4(cc, 1.0);\n"
-      "}\n");
+      "  pid = draw.x;\n"
+      "  gl_Position = projectionView * models[ draw.y ] *\n"
+      "    vec4( position, 1.0 );\n"
+      "}\n";
+
+    const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    //! Layout of the commands of glMultiDrawElementsIndirect
+    struct DrawElementsCommand
+    {
+      GLuint count;
+      GLuint instanceCount;
+      GLuint firstIndex;
+      GLint baseVertex;
+      GLuint baseInstance;
+    };
+
+    enum IndirectBuffer
+    {
+      POSITIONS = 0,
+      INDICES,
+      DRAWS,
+      COMMANDS,
+      MODELS
+    };
+  }
+
+  PickingSystem::PickingSystem( )
+    : _program( new reto::ShaderProgram( ))
+  {
+    _ownsProgram = true;
+    _program->loadFromText( _VertexCode( ), FRAGMENT_CODE );
     _program->compileAndLink( );
 
     _program->autocatching( );
@@ -75,106 +191,458 @@ namespace reto
   }
 
   PickingSystem::PickingSystem( reto::ShaderProgram* prog )
+    : _program( prog )
   {
-    _program = prog;
-    _program->loadFragmentShaderFromText(
-      "#version 430\n"
-      "layout(location = 0) out vec4 ourColor;\n"
-      "in float pid;\n"
-
-      "float module(float x, float y) {\n"
-      "  return x - y * floor(x / y);\n"
-      "}\n"
-
-      "vec3 unpackColor(float f) {\n"
-      "  vec3 color;\n"
-      "  color.b = floor(f / (256 * 256));\n"
-      "  color.g = floor((f - color.b * 256 * 256) / 256);\n"
-      "  color.r = floor(module(f, 256.0));\n"
-      "  return color / 255.0;\n"
-      "}\n"
-
-      "void main( ) {\n"
-      "  vec3 cc = unpackColor(pid);\n"
-      "  ourColor = vec4(cc, 1.0);\n"
-      "}\n");
+    _program->loadFragmentShaderFromText( FRAGMENT_CODE );
     _program->compileAndLink( );
     _program->autocatching( );
   }
 
   void PickingSystem::renderObjects( void )
   {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    unsigned int currentId = 0;
-    //std::set< reto::Pickable* >::iterator it;
-    for ( const auto& object : _objects )
+    const auto& objects = _registry.objects( );
+    const auto& firstIds = _registry.firstIds( );
+    for ( size_t i = 0; i < objects.size( ); ++i )
     {
-      currentId = object->sendId( currentId );
+      if ( _culling && !_culling->isVisible( objects[ i ]))
+        continue;
+      // Pixels store the id plus one, so zero is the background
+      this->_program->sendUniformu( "id", firstIds[ i ] + 1 );
       // WARNING: SEND ID (OR ANOTHER VALUE) HERE!
-      this->_program->sendUniformf("id", currentId);
-      object->render( this->_program );
+      objects[ i ]->sendId( firstIds[ i ]);
+      objects[ i ]->render( this->_program );
     }
   }
 
   PickingSystem::~PickingSystem( void )
   {
     this->Clear( );
+
+    for ( const auto& pick : _pendingPicks )
+    {
+      glDeleteSync( static_cast< GLsync >( pick.second.fence ));
+      glDeleteBuffers( 1, &pick.second.buffer );
+    }
+    if ( !_freeBuffers.empty( ))
+    {
+      glDeleteBuffers( GLsizei( _freeBuffers.size( )), _freeBuffers.data( ));
+    }
+    if ( _batchBuffer )
+      glDeleteBuffers( 1, &_batchBuffer );
+    if ( _indirectVao )
+    {
+      glDeleteVertexArrays( 1, &_indirectVao );
+      glDeleteBuffers( 5, _indirectBuffers );
+    }
+    delete _indirectProgram;
+    if ( _framebuffer )
+    {
+      glDeleteFramebuffers( 1, &_framebuffer );
+      glDeleteRenderbuffers( 1, &_colorBuffer );
+      glDeleteRenderbuffers( 1, &_slopeBuffer );
+      glDeleteRenderbuffers( 1, &_depthBuffer );
+    }
+    if ( _ownsProgram )
+      delete _program;
   }
 
   int PickingSystem::click( Point point )
   {
-    int selected = -1;
-    glScissor( point.first, point.second, 1, 1 );
-    glEnable(GL_SCISSOR_TEST);
-    std::cout << _objects.size( ) << std::endl;
-    this->renderObjects( );
-    glDisable(GL_SCISSOR_TEST);
+    uint32_t pixel;
+    renderIds( point.first, point.second, 1, 1, false, 0, &pixel );
+    return selectedId( pixel );
+  }
+
+  PickHit PickingSystem::clickHit( Point point )
+  {
+    uint32_t pixel[ HIT_SIZE / sizeof( uint32_t )];
+    renderIds( point.first, point.second, 1, 1, true, 0, pixel );
+    return decodeHit( pixel, point, _view );
+  }
+
+  std::vector< int > PickingSystem::clickBatch(
+    const std::vector< Point >& points )
+  {
+    std::vector< int > ids( points.size( ), -1 );
+    if ( points.empty( ))
+      return ids;
+    renderPoints( points, false );
+    for ( size_t i = 0; i < points.size( ); ++i )
+      ids[ i ] = selectedId( _pixels[ i ]);
+    return ids;
+  }
 
-    GLubyte color[4];
-    glReadPixels(point.first, point.second, 1, 1,
-      GL_RGBA, GL_UNSIGNED_BYTE, color);
-    int value = color[0] + color[1] * 256 + color[2] * 256 * 256;
-    if (value < 3355443) {
-       std::cout << value << std::endl;
+  std::vector< PickHit > PickingSystem::clickHitBatch(
+    const std::vector< Point >& points )
+  {
+    std::vector< PickHit > hits;
+    if ( points.empty( ))
+      return hits;
+    renderPoints( points, true );
+    hits.reserve( points.size( ));
+    const size_t stride = HIT_SIZE / sizeof( uint32_t );
+    for ( size_t i = 0; i < points.size( ); ++i )
+      hits.push_back( decodeHit( &_pixels[ i * stride ], points[ i ], _view ));
+    return hits;
+  }
+
+  void PickingSystem::renderPoints( const std::vector< Point >& points,
+    bool hit )
+  {
+    Point minPoint = points.front( );
+    Point maxPoint = points.front( );
+    for ( const auto& point : points )
+    {
+      minPoint.first = std::min( minPoint.first, point.first );
+      minPoint.second = std::min( minPoint.second, point.second );
+      maxPoint.first = std::max( maxPoint.first, point.first );
+      maxPoint.second = std::max( maxPoint.second, point.second );
     }
-    std::cout << "R: " << (int)color[0] << ", G: " << (int)color[1] << ", B: " << (int)color[2] << std::endl;
-    if( value < (int)_objects.size( ))
+
+    const size_t pixelSize = hit ? HIT_SIZE : sizeof( uint32_t );
+    const size_t size = points.size( ) * pixelSize;
+    GLint packBuffer;
+    glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer );
+    if ( size > _batchBufferSize )
     {
-      selected = value;
+      if ( !_batchBuffer )
+        glGenBuffers( 1, &_batchBuffer );
+      _batchBufferSize = std::max( size, 2 * _batchBufferSize );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, _batchBuffer );
+      glBufferData( GL_PIXEL_PACK_BUFFER, _batchBufferSize, nullptr,
+        GL_STREAM_READ );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, packBuffer );
     }
 
-    //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    return selected;
+    // One pass over the bounding area, the pixels are copied on the GPU
+    renderIds( minPoint.first, minPoint.second,
+      maxPoint.first - minPoint.first + 1,
+      maxPoint.second - minPoint.second + 1, hit, _batchBuffer, nullptr,
+      &points );
+
+    _pixels.resize( size / sizeof( uint32_t ));
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, _batchBuffer );
+    glGetBufferSubData( GL_PIXEL_PACK_BUFFER, 0, size, _pixels.data( ));
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, packBuffer );
   }
 
   std::set< unsigned int > PickingSystem::area( Point minPoint, Point maxPoint )
   {
     std::set<unsigned int> ret;
+    if ( maxPoint.first <= minPoint.first ||
+      maxPoint.second <= minPoint.second )
+    {
+      return ret;
+    }
+    const int width = maxPoint.first - minPoint.first;
+    const int height = maxPoint.second - minPoint.second;
+
+    // Read the whole area at once in client memory
+    _pixels.resize( size_t( width ) * size_t( height ));
+    renderIds( minPoint.first, minPoint.second, width, height, false, 0,
+      _pixels.data( ));
+
+    _areaIds.clear( );
+    collectIds( _pixels.data( ), _pixels.size( ), _areaIds );
+    std::sort( _areaIds.begin( ), _areaIds.end( ));
+    for ( uint32_t id : _areaIds )
+      ret.insert( ret.end( ), id );
+
+    return ret;
+  }
+
+  PickTicket PickingSystem::clickAsync( Point point )
+  {
+    PendingPick pick;
+    if ( _freeBuffers.empty( ))
+    {
+      GLint packBuffer;
+      glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer );
+      glGenBuffers( 1, &pick.buffer );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, pick.buffer );
+      glBufferData( GL_PIXEL_PACK_BUFFER, HIT_SIZE, nullptr,
+        GL_STREAM_READ );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, packBuffer );
+    }
+    else
+    {
+      pick.buffer = _freeBuffers.back( );
+      _freeBuffers.pop_back( );
+    }
+    renderIds( point.first, point.second, 1, 1, true, pick.buffer, nullptr );
+    pick.point = point;
+    pick.view = _view;
+    pick.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    // Submit the pick now, so the fence is signaled without more GL calls
+    glFlush( );
+
+    const PickTicket ticket = _nextTicket++;
+    _pendingPicks[ ticket ] = pick;
+    return ticket;
+  }
+
+  bool PickingSystem::clickResult( PickTicket ticket, int& selected )
+  {
+    PickHit hit;
+    const bool ready = clickResult( ticket, hit );
+    if ( ready )
+      selected = hit.id;
+    return ready;
+  }
+
+  bool PickingSystem::clickResult( PickTicket ticket, PickHit& hit )
+  {
+    auto it = _pendingPicks.find( ticket );
+    if ( it == _pendingPicks.end( ))
+    {
+      hit = decodeHit( nullptr, Point( ), _view );
+      return true;
+    }
+
+    const GLenum status = glClientWaitSync(
+      static_cast< GLsync >( it->second.fence ), 0, 0 );
+    if ( status == GL_TIMEOUT_EXPIRED )
+      return false;
+
+    hit = collect( it );
+    return true;
+  }
+
+  int PickingSystem::clickWait( PickTicket ticket )
+  {
+    return clickWaitHit( ticket ).id;
+  }
+
+  PickHit PickingSystem::clickWaitHit( PickTicket ticket )
+  {
+    auto it = _pendingPicks.find( ticket );
+    if ( it == _pendingPicks.end( ))
+      return decodeHit( nullptr, Point( ), _view );
+
+    const GLuint64 timeout = 1000000000; // 1 s
+    while ( glClientWaitSync( static_cast< GLsync >( it->second.fence ),
+      GL_SYNC_FLUSH_COMMANDS_BIT, timeout ) == GL_TIMEOUT_EXPIRED )
+    {
+    }
+    return collect( it );
+  }
+
+  size_t PickingSystem::pendingPicks( void ) const
+  {
+    return _pendingPicks.size( );
+  }
+
+  PickHit PickingSystem::collect(
+    std::map< PickTicket, PendingPick >::iterator it )
+  {
+    const PendingPick pick = it->second;
+    _pendingPicks.erase( it );
+
+    GLint packBuffer;
+    glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer );
+    uint32_t pixel[ HIT_SIZE / sizeof( uint32_t )];
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, pick.buffer );
+    glGetBufferSubData( GL_PIXEL_PACK_BUFFER, 0, HIT_SIZE, pixel );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, packBuffer );
+
+    glDeleteSync( static_cast< GLsync >( pick.fence ));
+    _freeBuffers.push_back( pick.buffer );
+
+    return decodeHit( pixel, pick.point, pick.view );
+  }
+
+  int PickingSystem::selectedId( uint32_t pixel ) const
+  {
+    return pixel == 0 ? -1 : int( pixel - 1 );
+  }
+
+  PickHit PickingSystem::decodeHit( const uint32_t* pixel, Point point,
+    const PickView& view ) const
+  {
+    PickHit hit;
+    hit.id = pixel ? selectedId( pixel[ 0 ]) : -1;
+    hit.object = -1;
+    hit.instance = 0;
+    hit.primitive = 0;
+    hit.depth = 1.0f;
+    std::fill( hit.position, hit.position + 3, 0.0f );
+    std::fill( hit.normal, hit.normal + 3, 0.0f );
+    if ( hit.id < 0 )
+      return hit;
 
-    glScissor( minPoint.first, minPoint.second, maxPoint.first, maxPoint.second );
+    hit.primitive = pixel[ 1 ];
+    std::memcpy( &hit.depth, pixel + 2, sizeof( float ));
+    float slope[ 2 ];
+    std::memcpy( slope, pixel + 3, sizeof( slope ));
+
+    // Pixel center and its neighbours on the plane of the triangle
+    const Eigen::Matrix4d inverse = Eigen::Map< const Eigen::Matrix4f >(
+      view.projectionView ).cast< double >( ).inverse( );
+    const double x = point.first + 0.5;
+    const double y = point.second + 0.5;
+    const Eigen::Vector3d center = unproject( inverse, view.viewport, x, y,
+      hit.depth );
+    const Eigen::Vector3d right = unproject( inverse, view.viewport, x + 1.0,
+      y, hit.depth + slope[ 0 ]);
+    const Eigen::Vector3d up = unproject( inverse, view.viewport, x, y + 1.0,
+      hit.depth + slope[ 1 ]);
+    Eigen::Vector3d normal = ( right - center ).cross( up - center );
+    const Eigen::Vector3d toViewer =
+      unproject( inverse, view.viewport, x, y, 0.0 ) - center;
+    if ( normal.dot( toViewer ) < 0.0 )
+      normal = -normal;
+    if ( normal.norm( ) > 0.0 )
+      normal.normalize( );
+    for ( int i = 0; i < 3; ++i )
+    {
+      hit.position[ i ] = float( center[ i ]);
+      hit.normal[ i ] = float( normal[ i ]);
+    }
+
+    // Object whose id range contains the id ( the id itself when
+    // renderObjects is overridden with ids not in the registry )
+    const PickHandle owner = _registry.owner( uint32_t( hit.id ));
+    if ( owner.generation == 0 )
+    {
+      hit.object = hit.id;
+      return hit;
+    }
+    hit.object = int( owner.id );
+    hit.instance = uint32_t( hit.id ) - owner.id;
+    return hit;
+  }
+
+  void PickingSystem::renderIds( int x, int y, int width, int height,
+    bool hit, unsigned int packBuffer, void* data,
+    const std::vector< Point >* points )
+  {
+    GLint drawFramebuffer, readFramebuffer;
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer );
+    glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer );
+
+    GLint* viewport = _view.viewport;
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    std::copy( projectionView( ), projectionView( ) + 16,
+      _view.projectionView );
+    resizeTarget( viewport[ 0 ] + viewport[ 2 ], viewport[ 1 ] + viewport[ 3 ]);
+
+    // The depth slopes are only written for hits
+    const GLenum drawBuffers[ 2 ] = { GL_COLOR_ATTACHMENT0,
+      hit ? GLenum( GL_COLOR_ATTACHMENT1 ) : GLenum( GL_NONE )};
+    glDrawBuffers( 2, drawBuffers );
+
+    // Only the requested pixels are cleared and rendered, the scissor of
+    // the caller is kept
+    GLint scissorBox[ 4 ];
+    glGetIntegerv( GL_SCISSOR_BOX, scissorBox );
+    const GLboolean scissorTest = glIsEnabled( GL_SCISSOR_TEST );
+    glScissor( x, y, width, height );
     glEnable(GL_SCISSOR_TEST);
-    this->renderObjects( );
-    //glDisable(GL_SCISSOR_TEST);
+    const GLuint background[ 4 ] = { 0, 0, 0, 0 };
+    glClearBufferuiv( GL_COLOR, 0, background );
+    if ( hit )
+    {
+      const GLfloat flat[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      glClearBufferfv( GL_COLOR, 1, flat );
+    }
+    glClear( GL_DEPTH_BUFFER_BIT );
+    if ( _indirect )
+      renderIndirect( );
+    else
+      this->renderObjects( );
+    if ( !scissorTest )
+      glDisable( GL_SCISSOR_TEST );
+    glScissor( scissorBox[ 0 ], scissorBox[ 1 ], scissorBox[ 2 ],
+      scissorBox[ 3 ]);
 
-    GLubyte color[4];
-    unsigned int value;
+    GLint alignment, rowLength, previousBuffer;
+    glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+    glGetIntegerv( GL_PACK_ROW_LENGTH, &rowLength );
+    glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glPixelStorei( GL_PACK_ROW_LENGTH, 0 );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, packBuffer );
 
-    for( auto x = minPoint.first; x < maxPoint.first; x++ )
+    if ( points )
     {
-      for( auto y = minPoint.second; y < maxPoint.second; y++ )
+      char* pixel = static_cast< char* >( data );
+      for ( const auto& point : *points )
       {
-        glReadPixels( x, y, 1, 1, GL_RGBA,
-                      GL_UNSIGNED_BYTE, color );
-        value = ( unsigned int )( color[2] + color[1] * 256 +
-                              color[0] * 256 * 256 );
-        if( value < _objects.size( ))
+        if ( hit )
         {
-          ret.insert( value );
+          readHit( point.first, point.second, pixel );
+          pixel += HIT_SIZE;
+        }
+        else
+        {
+          glReadPixels( point.first, point.second, 1, 1, GL_RED_INTEGER,
+            GL_UNSIGNED_INT, pixel );
+          pixel += sizeof( uint32_t );
         }
       }
     }
+    else if ( hit )
+    {
+      readHit( x, y, static_cast< char* >( data ));
+    }
+    else
+    {
+      glReadPixels( x, y, width, height, GL_RED_INTEGER, GL_UNSIGNED_INT,
+        data );
+    }
 
-    return ret;
+    glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+    glPixelStorei( GL_PACK_ROW_LENGTH, rowLength );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, previousBuffer );
+
+    glBindFramebuffer( GL_DRAW_FRAMEBUFFER, drawFramebuffer );
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, readFramebuffer );
+  }
+
+  void PickingSystem::resizeTarget( int width, int height )
+  {
+    if ( _framebuffer && width <= _targetWidth && height <= _targetHeight )
+    {
+      glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+      return;
+    }
+
+    if ( !_framebuffer )
+    {
+      glGenFramebuffers( 1, &_framebuffer );
+      glGenRenderbuffers( 1, &_colorBuffer );
+      glGenRenderbuffers( 1, &_slopeBuffer );
+      glGenRenderbuffers( 1, &_depthBuffer );
+    }
+    _targetWidth = std::max( width, _targetWidth );
+    _targetHeight = std::max( height, _targetHeight );
+
+    GLint renderbuffer;
+    glGetIntegerv( GL_RENDERBUFFER_BINDING, &renderbuffer );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, _colorBuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_RG32UI, _targetWidth,
+      _targetHeight );
+    glBindRenderbuffer( GL_RENDERBUFFER, _slopeBuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_RG32F, _targetWidth,
+      _targetHeight );
+    glBindRenderbuffer( GL_RENDERBUFFER, _depthBuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
+      _targetWidth, _targetHeight );
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffer );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, _framebuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, _colorBuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+      GL_RENDERBUFFER, _slopeBuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+      GL_RENDERBUFFER, _depthBuffer );
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) !=
+      GL_FRAMEBUFFER_COMPLETE )
+    {
+      std::cerr << "Warning: incomplete picking framebuffer" << std::endl;
+    }
   }
 
   std::string PickingSystem::_VertexCode( void )
@@ -182,27 +650,272 @@ namespace reto
     return std::string("#version 430\n"
       "layout (location = 0) in vec3 Position;\n"
       "uniform mat4 modelViewProj;\n"
-      "uniform int id;\n"
-      "out float pid;\n"
+      "uniform uint id;\n"
+      "flat out uint pid;\n"
       "void main( ) {\n"
-      "    pid = float(id);\n"
+      "    pid = id + uint(gl_InstanceID);\n"
       "    gl_Position = modelViewProj * vec4(Position,1.0);\n"
       "}");
   }
 
+  void PickingSystem::setIndirectRendering( bool enabled )
+  {
+    _indirect = enabled;
+  }
+
+  bool PickingSystem::indirectRendering( void ) const
+  {
+    return _indirect;
+  }
+
+  void PickingSystem::setProjectionView( const float* projectionView )
+  {
+    std::copy( projectionView, projectionView + 16, _projectionView );
+  }
+
+  void PickingSystem::setCamera( Camera* camera )
+  {
+    _camera = camera;
+  }
+
+  const float* PickingSystem::projectionView( void ) const
+  {
+    return _camera ? _camera->projectionViewMatrix( ) : _projectionView;
+  }
+
+  void PickingSystem::setCulling( CullingSystem* culling )
+  {
+    _culling = culling;
+  }
+
+  CullingSystem* PickingSystem::culling( void ) const
+  {
+    return _culling;
+  }
+
+  void PickingSystem::updateGeometry( Pickable* )
+  {
+    _indirectDirty = true;
+  }
+
+  void PickingSystem::renderIndirect( void )
+  {
+    if ( _indirectDirty )
+      buildIndirect( );
+    if ( _indirectDraws == 0 )
+      return;
+
+    // Models change every frame, so they are gathered on each pass
+    _indirectModels.resize( _indirectDraws * 16 );
+    float* model = _indirectModels.data( );
+    for ( const auto& object : _registry.objects( ))
+    {
+      const std::vector< float > matrix = object->getModel( );
+      if ( matrix.size( ) == 16 )
+        std::copy( matrix.begin( ), matrix.end( ), model );
+      else
+        std::copy( IDENTITY, IDENTITY + 16, model );
+      model += 16;
+    }
+
+    GLint program, vao, indirectBuffer, storageBuffer, arrayBuffer;
+    glGetIntegerv( GL_CURRENT_PROGRAM, &program );
+    glGetIntegerv( GL_VERTEX_ARRAY_BINDING, &vao );
+    glGetIntegerv( GL_DRAW_INDIRECT_BUFFER_BINDING, &indirectBuffer );
+    glGetIntegeri_v( GL_SHADER_STORAGE_BUFFER_BINDING, 0, &storageBuffer );
+    glGetIntegerv( GL_ARRAY_BUFFER_BINDING, &arrayBuffer );
+
+    glBindBuffer( GL_ARRAY_BUFFER, _indirectBuffers[ MODELS ]);
+    glBufferData( GL_ARRAY_BUFFER,
+      _indirectModels.size( ) * sizeof( float ), _indirectModels.data( ),
+      GL_STREAM_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, arrayBuffer );
+
+    _indirectProgram->use( );
+    _indirectProgram->sendUniform4m( "projectionView", projectionView( ));
+    glBindVertexArray( _indirectVao );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, _indirectBuffers[ COMMANDS ]);
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0,
+      _indirectBuffers[ MODELS ]);
+
+    if ( _indirectCulling != _culling ||
+      ( _culling && _indirectCullingFrame != _culling->frame( )))
+    {
+      cullIndirect( );
+    }
+
+    glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+      GLsizei( _indirectDraws ), 0 );
+
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, storageBuffer );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+    glBindVertexArray( vao );
+    glUseProgram( program );
+
+    // Objects left out of the shared geometry, as in renderObjects
+    const auto& objects = _registry.objects( );
+    const auto& firstIds = _registry.firstIds( );
+    for ( const size_t i : _indirectFallback )
+    {
+      if ( _culling && !_culling->isVisible( objects[ i ]))
+        continue;
+      this->_program->sendUniformu( "id", firstIds[ i ] + 1 );
+      objects[ i ]->sendId( firstIds[ i ]);
+      objects[ i ]->render( this->_program );
+    }
+  }
+
+  void PickingSystem::buildIndirect( void )
+  {
+    if ( !_indirectProgram )
+    {
+      _indirectProgram = new reto::ShaderProgram( );
+      _indirectProgram->loadFromText( INDIRECT_VERTEX_CODE, FRAGMENT_CODE );
+      _indirectProgram->compileAndLink( );
+      _indirectProgram->autocatching( );
+
+      glGenVertexArrays( 1, &_indirectVao );
+      glGenBuffers( 5, _indirectBuffers );
+    }
+
+    // One command per object, so the base instance is the object. Objects
+    // with several ids, drawn as instances of their own render, and objects
+    // with invalid indices keep an empty command and use render instead
+    std::vector< float > positions;
+    std::vector< GLuint > indices;
+    std::vector< GLuint > draws;
+    std::vector< DrawElementsCommand > commands;
+    const auto& objects = _registry.objects( );
+    commands.reserve( objects.size( ));
+    draws.reserve( 2 * objects.size( ));
+    _indirectFallback.clear( );
+    for ( size_t i = 0; i < objects.size( ); ++i )
+    {
+      const Pickable* object = objects[ i ];
+      const std::vector< float > objectPositions = object->getPositions( );
+      std::vector< unsigned int > objectIndices = object->getIndices( );
+      const GLuint numVertices = GLuint( objectPositions.size( ) / 3 );
+      if ( objectIndices.empty( ))
+      {
+        objectIndices.resize( numVertices - numVertices % 3 );
+        std::iota( objectIndices.begin( ), objectIndices.end( ), 0u );
+      }
+      bool fallback = object->getNumIDs( ) > 1;
+      if ( std::any_of( objectIndices.begin( ), objectIndices.end( ),
+        [ numVertices ]( unsigned int index ){ return index >= numVertices; }))
+      {
+        std::cerr << "Warning: picking indices of object " << i
+                  << " out of its positions, rendered without indirect"
+                  << " rendering" << std::endl;
+        fallback = true;
+      }
+      if ( fallback )
+      {
+        _indirectFallback.push_back( i );
+        objectIndices.clear( );
+      }
+
+      DrawElementsCommand command;
+      command.count = GLuint( objectIndices.size( ));
+      command.instanceCount = 1;
+      command.firstIndex = GLuint( indices.size( ));
+      command.baseVertex = GLint( positions.size( ) / 3 );
+      command.baseInstance = GLuint( commands.size( ));
+      commands.push_back( command );
+
+      if ( !fallback )
+      {
+        positions.insert( positions.end( ), objectPositions.begin( ),
+          objectPositions.begin( ) + numVertices * 3 );
+        indices.insert( indices.end( ), objectIndices.begin( ),
+          objectIndices.end( ));
+      }
+
+      // Pixels store the id plus one, so zero is the background
+      draws.push_back( _registry.firstIds( )[ i ] + 1 );
+      draws.push_back( command.baseInstance );
+    }
+    _indirectDraws = commands.size( );
+    _indirectDirty = false;
+    _indirectCulling = nullptr;
+
+    GLint vao, arrayBuffer, indirectBuffer;
+    glGetIntegerv( GL_VERTEX_ARRAY_BINDING, &vao );
+    glGetIntegerv( GL_ARRAY_BUFFER_BINDING, &arrayBuffer );
+    glGetIntegerv( GL_DRAW_INDIRECT_BUFFER_BINDING, &indirectBuffer );
+
+    glBindVertexArray( _indirectVao );
+    glBindBuffer( GL_ARRAY_BUFFER, _indirectBuffers[ POSITIONS ]);
+    glBufferData( GL_ARRAY_BUFFER, positions.size( ) * sizeof( float ),
+      positions.data( ), GL_STATIC_DRAW );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+
+    glBindBuffer( GL_ARRAY_BUFFER, _indirectBuffers[ DRAWS ]);
+    glBufferData( GL_ARRAY_BUFFER, draws.size( ) * sizeof( GLuint ),
+      draws.data( ), GL_STATIC_DRAW );
+    glVertexAttribIPointer( 1, 2, GL_UNSIGNED_INT, 0, 0 );
+    glVertexAttribDivisor( 1, 1 );
+    glEnableVertexAttribArray( 1 );
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indirectBuffers[ INDICES ]);
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size( ) * sizeof( GLuint ),
+      indices.data( ), GL_STATIC_DRAW );
+
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, _indirectBuffers[ COMMANDS ]);
+    glBufferData( GL_DRAW_INDIRECT_BUFFER,
+      commands.size( ) * sizeof( DrawElementsCommand ), commands.data( ),
+      GL_STATIC_DRAW );
+
+    glBindVertexArray( vao );
+    glBindBuffer( GL_ARRAY_BUFFER, arrayBuffer );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+  }
+
+  void PickingSystem::cullIndirect( void )
+  {
+    // Culled objects keep their command, with no instances
+    DrawElementsCommand* commands = static_cast< DrawElementsCommand* >(
+      glMapBufferRange( GL_DRAW_INDIRECT_BUFFER, 0,
+      _indirectDraws * sizeof( DrawElementsCommand ), GL_MAP_WRITE_BIT ));
+    if ( !commands )
+      return;
+    const auto& objects = _registry.objects( );
+    for ( size_t i = 0; i < _indirectDraws; ++i )
+    {
+      commands[ i ].instanceCount =
+        !_culling || _culling->isVisible( objects[ i ]) ? 1 : 0;
+    }
+    glUnmapBuffer( GL_DRAW_INDIRECT_BUFFER );
+
+    _indirectCulling = _culling;
+    _indirectCullingFrame = _culling ? _culling->frame( ) : 0;
+  }
+
   void PickingSystem::AddObject( Pickable* pickSystem )
   {
-    _objects.insert( pickSystem );
+    const PickHandle handle = _registry.add( pickSystem,
+      uint32_t( pickSystem->getNumIDs( )));
+    if ( handle.generation != 0 )
+      pickSystem->setId( int( handle.id ));
+    _indirectDirty = true;
   }
 
   void PickingSystem::RemoveObject( Pickable* pickSystem )
   {
-    _objects.erase( pickSystem );
+    _registry.remove( pickSystem );
+    _indirectDirty = true;
   }
 
   void PickingSystem::Clear ( void )
   {
-    _objects.clear( );
+    _registry.clear( );
+    _indirectDirty = true;
+  }
+
+  const PickingRegistry& PickingSystem::registry( void ) const
+  {
+    return _registry;
   }
 
   reto::ShaderProgram* const& PickingSystem::program( ) const
@@ -31,7 +31,11 @@
 #include "ShaderProgram.h"
 #include "Camera.h"
 #include "Pickable.h"
+#include "PickingRegistry.h"
+#include "CullingSystem.h"
 
+#include <map>
+#include <stdint.h>
 #include <tuple>
 #include <reto/api.h>
 
@@ -39,6 +43,31 @@ namespace reto
 {
   typedef std::pair<unsigned int, unsigned int> Point;
 
+  //! Identifier of an asynchronous pick
+  typedef unsigned int PickTicket;
+
+  //! Front fragment found in a point
+  struct PickHit
+  {
+    //! Picking id, as click returns it ( -1 for the background )
+    int id;
+    //! First id of the Pickable whose id range contains the id
+    int object;
+    //! Id relative to the first id of the object, the instance when the
+    //! vertex shader adds gl_InstanceID to the id
+    unsigned int instance;
+    //! gl_PrimitiveID of the fragment inside its draw
+    unsigned int primitive;
+    //! Window depth of the fragment ( 1 for the background )
+    float depth;
+    //! World position of the pixel center on the fragment, unprojected
+    //! with the projection view matrix of the pick ( 0 for the background )
+    float position[ 3 ];
+    //! World normal of the triangle of the fragment, facing the viewer
+    //! ( 0 for the background )
+    float normal[ 3 ];
+  };
+
   class PickingSystem
   {
     public:
@@ -46,7 +75,10 @@ namespace reto
       PickingSystem( );
       
       /**
-       * Reuse a ShaderProgram that lacks fragment shader
+       * Reuse a ShaderProgram that lacks fragment shader. Its vertex shader
+       * must pass the unsigned integer uniform id to the picking fragment
+       * shader as "flat out uint pid", adding gl_InstanceID for instanced
+       * objects. The id and gl_PrimitiveID are written to an RG32UI target.
        * @param prog: ProgramShader*
        **/
       RETO_API
@@ -56,7 +88,9 @@ namespace reto
       virtual ~PickingSystem( );
 
       /**
-       * Method to add a Pickable object
+       * Method to add a Pickable object. It reserves getNumIDs consecutive
+       * ids, kept until it is removed, and its Pickable::setId is called
+       * with the first one.
        * @param pickSystem: Pickable object
        */
       RETO_API
@@ -76,22 +110,191 @@ namespace reto
       void Clear( void );
 
       /**
-       * Method to find front object in a specific point
+       * Method to find front object in a specific point. Objects are
+       * rendered in an offscreen integer target of the viewport size that
+       * is reused between calls, so the visible frame is not modified.
        * @param point: Point (in OpenGL coordinates)
-       * @return int: Indice that is visible
+       * @return int: Id that is visible ( -1 for none ). registry( ).object
+       *   gives its Pickable.
        */
       RETO_API
       int click( Point point );
 
       /**
-       * Method to find front object in a specific area
-       * @param minPoint: minPoint (in OpenGL coordinates)
-       * @param maxPoint: maxPoint (in OpenGL coordinates)
+       * Method to find the front fragment in a specific point, resolving
+       * the object, instance, primitive, depth, world position and normal
+       * in the same pass. Instanced objects reserve one id per instance
+       * with Pickable::setNumIDs.
+       * @see setCamera
+       * @param point: Point (in OpenGL coordinates)
+       * @return PickHit of the front fragment
+       */
+      RETO_API
+      PickHit clickHit( Point point );
+
+      /**
+       * Method to find the front objects in several points at once. The
+       * objects are rendered once over the bounding area of the points,
+       * and only the pixels of the points are copied to a pixel buffer
+       * object that is read back once.
+       * @param points: Points (in OpenGL coordinates)
+       * @return std::vector<int>: Indice visible in each point, the same
+       *   that click would return
+       */
+      RETO_API
+      std::vector< int > clickBatch( const std::vector< Point >& points );
+
+      /**
+       * Method to find the front fragments in several points at once
+       * @param points: Points (in OpenGL coordinates)
+       * @return std::vector<PickHit>: Hit of each point, the same that
+       *   clickHit would return
+       * @see clickBatch
+       */
+      RETO_API
+      std::vector< PickHit > clickHitBatch(
+        const std::vector< Point >& points );
+
+      /**
+       * Method to start finding the front object in a specific point
+       * without waiting for the GPU. The pixel of the offscreen target is
+       * copied to a pixel buffer object guarded by a fence, so the result
+       * is usually ready a frame or two later.
+       * @param point: Point (in OpenGL coordinates)
+       * @return PickTicket to query the result with clickResult or clickWait
+       */
+      RETO_API
+      PickTicket clickAsync( Point point );
+
+      /**
+       * Method to get the result of an asynchronous pick if it is ready.
+       * Never blocks. Once a result is returned the ticket is released.
+       * @param ticket: Ticket returned by clickAsync
+       * @param selected: Indice that is visible, the same that click would
+       *   return ( -1 for unknown or already released tickets )
+       * @return bool: false while the pick is still in flight
+       */
+      RETO_API
+      bool clickResult( PickTicket ticket, int& selected );
+
+      /**
+       * Method to get the hit of an asynchronous pick if it is ready
+       * @param ticket: Ticket returned by clickAsync
+       * @param hit: Front fragment, the same that clickHit would return
+       * @return bool: false while the pick is still in flight
+       * @see clickResult
+       */
+      RETO_API
+      bool clickResult( PickTicket ticket, PickHit& hit );
+
+      /**
+       * Method to wait for the result of an asynchronous pick and release
+       * the ticket
+       * @param ticket: Ticket returned by clickAsync
+       * @return int: Indice that is visible ( -1 for unknown tickets )
+       */
+      RETO_API
+      int clickWait( PickTicket ticket );
+
+      /**
+       * Method to wait for the hit of an asynchronous pick and release the
+       * ticket
+       * @param ticket: Ticket returned by clickAsync
+       * @return PickHit of the front fragment
+       */
+      RETO_API
+      PickHit clickWaitHit( PickTicket ticket );
+
+      /**
+       * Method to get the number of asynchronous picks not released yet
+       * @return size_t
+       */
+      RETO_API
+      size_t pendingPicks( void ) const;
+
+      /**
+       * Method to find front object in a specific area. The whole area is
+       * read back from the framebuffer at once.
+       * @param minPoint: minPoint (in OpenGL coordinates, inclusive)
+       * @param maxPoint: maxPoint (in OpenGL coordinates, exclusive)
        * @return std::set<unsigned int> Indices that objects are visibles
        */
       RETO_API
       std::set<unsigned int> area( Point minPoint, Point maxPoint );
 
+      /**
+       * Method to enable or disable the indirect rendering path. When
+       * enabled the ids are not rendered with Pickable::render: the
+       * triangles of getPositions and getIndices of every object are
+       * registered once in shared buffers, the getModel matrices are
+       * uploaded to a shader storage buffer on each pick, and the whole
+       * pass is a single glMultiDrawElementsIndirect with its own program.
+       * Each object gets one id over all its triangles. Objects with
+       * several ids ( instances ), or with indices out of their positions,
+       * are still rendered with Pickable::render after that draw.
+       * @param enabled: Indirect rendering flag ( default = false )
+       * @see setProjectionView, updateGeometry
+       */
+      RETO_API
+      void setIndirectRendering( bool enabled );
+
+      /**
+       * Method to check if the indirect rendering path is enabled
+       * @return bool
+       */
+      RETO_API
+      bool indirectRendering( void ) const;
+
+      /**
+       * Method to set the projection view matrix of the picks. It is used
+       * to unproject the position and normal of the hits, and applied after
+       * the model matrices in the indirect rendering path.
+       * @param projectionView: Column major projection view matrix
+       *   ( default = identity )
+       */
+      RETO_API
+      void setProjectionView( const float* projectionView );
+
+      /**
+       * Method to take the projection view matrix of the picks from a
+       * camera, reading it on each pick instead of setProjectionView
+       * @param camera: Camera ( nullptr to use setProjectionView again )
+       */
+      RETO_API
+      void setCamera( reto::Camera* camera );
+
+      /**
+       * Method to render only the visible set of a culling system in the
+       * picks. Its cull must use the view of the picks, and objects it does
+       * not know are always rendered.
+       * @param culling: Culling system ( nullptr to render all objects )
+       */
+      RETO_API
+      void setCulling( reto::CullingSystem* culling );
+
+      /**
+       * Method to get the culling system of the picks
+       * @return CullingSystem ( may be nullptr )
+       */
+      RETO_API
+      reto::CullingSystem* culling( void ) const;
+
+      /**
+       * Method to register again the geometry of an object whose positions
+       * or indices changed, for the indirect rendering path. Adding or
+       * removing objects does it automatically.
+       * @param object: Pickable object
+       */
+      RETO_API
+      void updateGeometry( reto::Pickable* object );
+
+      /**
+       * Method to get the ids of the objects
+       * @return const PickingRegistry&
+       */
+      RETO_API
+      const reto::PickingRegistry& registry( void ) const;
+
       RETO_API
       reto::ShaderProgram* const& program( ) const;
 
@@ -104,15 +307,209 @@ namespace reto
       virtual void init( void );
 
       /**
-       * This method is invoked to render objects.
-       * Override thist just like you want it (Default: Send id uniform)
+       * This method is invoked to render objects, with the offscreen target
+       * bound and cleared. Override thist just like you want it (Default:
+       * Send id uniform as the first id of each object in the registry
+       * plus one)
        */
       RETO_API
       virtual void renderObjects( void );
 
+      //! Viewport and matrix to unproject the hits of a pick
+      struct PickView
+      {
+        int viewport[ 4 ];
+        float projectionView[ 16 ];
+      };
+
+      //! Asynchronous pick waiting for its readback
+      struct PendingPick
+      {
+        //! Picked pixel
+        Point point;
+        //! View when the pick was rendered
+        PickView view;
+        //! Pixel buffer object holding the pixel
+        unsigned int buffer;
+        //! Fence ( GLsync ) signaled when the pixel is in the buffer
+        void* fence;
+      };
+
+      /**
+       * Method to render the ids of an area in the offscreen target and
+       * read them back, keeping the framebuffer bindings and pack state
+       * @param x: Left pixel
+       * @param y: Bottom pixel
+       * @param width: Width in pixels
+       * @param height: Height in pixels
+       * @param hit: Read the primitive and the depth after the id ( only
+       *   for a single pixel )
+       * @param packBuffer: Pixel buffer object to read to ( 0 for client
+       *   memory )
+       * @param data: Client memory, or offset in packBuffer
+       * @param points: Pixels to read one after the other instead of the
+       *   whole area ( nullptr to read the area )
+       */
+      void renderIds( int x, int y, int width, int height, bool hit,
+        unsigned int packBuffer, void* data,
+        const std::vector< Point >* points = nullptr );
+
+      /**
+       * Method to render the ids around several points and read back
+       * their pixels to _pixels
+       * @param points: Points (in OpenGL coordinates, not empty)
+       * @param hit: Read the primitive and the depth after each id
+       */
+      void renderPoints( const std::vector< Point >& points, bool hit );
+
+      /**
+       * Method to render the ids of all objects with one indirect draw,
+       * registering their geometry first if needed
+       */
+      void renderIndirect( void );
+
+      /**
+       * Method to register the geometry of all objects in the shared
+       * buffers of the indirect rendering path
+       */
+      void buildIndirect( void );
+
+      /**
+       * Method to give no instances to the draw commands of the objects
+       * culled by the culling system, with the draw command buffer bound
+       */
+      void cullIndirect( void );
+
+      /**
+       * Method to decode a pixel of the offscreen target
+       * @param pixel: Id plus one, or zero for the background
+       * @return int: Indice that is visible ( -1 for the background )
+       */
+      int selectedId( uint32_t pixel ) const;
+
+      /**
+       * Method to decode the id, primitive, depth and depth slopes read for
+       * a hit, unprojecting its position and normal
+       * @param pixel: Values read back ( nullptr for no hit )
+       * @param point: Picked pixel
+       * @param view: View of the pick
+       * @return PickHit
+       */
+      PickHit decodeHit( const uint32_t* pixel, Point point,
+        const PickView& view ) const;
+
+      /**
+       * Method to get the projection view matrix of the picks
+       * @return const float*: Camera or setProjectionView matrix
+       */
+      const float* projectionView( void ) const;
+
+      /**
+       * Method to grow the offscreen target of the picks to
+       * cover a size, and bind it
+       * @param width: Minimum width in pixels
+       * @param height: Minimum height in pixels
+       */
+      void resizeTarget( int width, int height );
+
+      /**
+       * Method to read the pixel of a finished pick and release its ticket
+       * @param it: Pending pick
+       * @return PickHit of the pixel
+       */
+      PickHit collect( std::map< PickTicket, PendingPick >::iterator it );
+
+      //! Offscreen framebuffer of the picks
+      unsigned int _framebuffer = 0;
+
+      //! Integer id and primitive renderbuffer of the offscreen target
+      unsigned int _colorBuffer = 0;
+
+      //! Window depth slopes renderbuffer of the offscreen target
+      unsigned int _slopeBuffer = 0;
+
+      //! Depth renderbuffer of the offscreen target
+      unsigned int _depthBuffer = 0;
+
+      //! Offscreen target width
+      int _targetWidth = 0;
+
+      //! Offscreen target height
+      int _targetHeight = 0;
+
+      //! Asynchronous picks in flight or not collected
+      std::map< PickTicket, PendingPick > _pendingPicks;
+
+      //! Pixel buffer objects ready to be reused
+      std::vector< unsigned int > _freeBuffers;
+
+      //! Pixel buffer object of the batched picks
+      unsigned int _batchBuffer = 0;
+
+      //! Size in bytes of the pixel buffer object of the batched picks
+      size_t _batchBufferSize = 0;
+
+      //! Next ticket to return
+      PickTicket _nextTicket = 1;
+
+      //! Pixels of the last area read back
+      std::vector< uint32_t > _pixels;
+
+      //! Indices found in the last area
+      std::vector< uint32_t > _areaIds;
+
+      //! Indirect rendering flag
+      bool _indirect = false;
+
+      //! Flag to register the geometry again before the next indirect pass
+      bool _indirectDirty = true;
+
+      //! Program of the indirect rendering path
+      reto::ShaderProgram* _indirectProgram = nullptr;
+
+      //! Vertex array of the shared geometry
+      unsigned int _indirectVao = 0;
+
+      //! Positions, indices, per draw ids, draw commands and model buffers
+      unsigned int _indirectBuffers[ 5 ] = { 0, 0, 0, 0, 0 };
+
+      //! Number of draw commands ( one per object )
+      size_t _indirectDraws = 0;
+
+      //! Objects ( by position in the registry ) rendered with
+      //! Pickable::render after the indirect draw
+      std::vector< size_t > _indirectFallback;
+
+      //! Model matrices uploaded in the last indirect pass
+      std::vector< float > _indirectModels;
+
+      //! Projection view matrix of the indirect rendering path
+      float _projectionView[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+      //! Stable ids of the objects
+      reto::PickingRegistry _registry;
+
+      //! Camera giving the projection view matrix ( may be nullptr )
+      reto::Camera* _camera = nullptr;
+
+      //! Culling system giving the rendered objects ( may be nullptr )
+      reto::CullingSystem* _culling = nullptr;
+
+      //! Culling system applied to the indirect draw commands
+      reto::CullingSystem* _indirectCulling = nullptr;
+
+      //! Culling frame applied to the indirect draw commands
+      unsigned int _indirectCullingFrame = 0;
+
+      //! View of the last pick
+      PickView _view;
+
+      //! Flag to delete the program created by the default constructor
+      bool _ownsProgram = false;
+
     public:
       reto::ShaderProgram* _program;
-      std::set< reto::Pickable* > _objects;
 
       virtual std::string _VertexCode( void );
   };
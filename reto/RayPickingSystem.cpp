@@ -0,0 +1,655 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "RayPickingSystem.h"
+#include "Camera.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+namespace reto
+{
+  namespace
+  {
+    //! Maximum triangles or objects in a hierarchy leaf
+    const uint32_t LEAF_SIZE = 4;
+
+    inline void resetBounds( float* min, float* max )
+    {
+      for ( int i = 0; i < 3; ++i )
+      {
+        min[ i ] = std::numeric_limits< float >::max( );
+        max[ i ] = -std::numeric_limits< float >::max( );
+      }
+    }
+
+    inline void growBounds( float* min, float* max, const float* p )
+    {
+      for ( int i = 0; i < 3; ++i )
+      {
+        min[ i ] = std::min( min[ i ], p[ i ]);
+        max[ i ] = std::max( max[ i ], p[ i ]);
+      }
+    }
+
+    inline void transformPoint( const float* m, const float* p, float* out )
+    {
+      for ( int i = 0; i < 3; ++i )
+        out[ i ] = m[ i ] * p[ 0 ] + m[ 4 + i ] * p[ 1 ] + m[ 8 + i ] * p[ 2 ]
+          + m[ 12 + i ];
+    }
+
+    inline void transformVector( const float* m, const float* v, float* out )
+    {
+      for ( int i = 0; i < 3; ++i )
+        out[ i ] = m[ i ] * v[ 0 ] + m[ 4 + i ] * v[ 1 ] + m[ 8 + i ] * v[ 2 ];
+    }
+
+    // Slab test, returning the entry distance
+    inline bool rayBox( const float* min, const float* max,
+      const float* origin, const float* invDirection, float maxDistance,
+      float& entry )
+    {
+      float tMin = 0.0f;
+      float tMax = maxDistance;
+      for ( int i = 0; i < 3; ++i )
+      {
+        float t0 = ( min[ i ] - origin[ i ]) * invDirection[ i ];
+        float t1 = ( max[ i ] - origin[ i ]) * invDirection[ i ];
+        if ( t0 > t1 )
+          std::swap( t0, t1 );
+        // Written so that NaN ( origin on a slab of a flat box ) is ignored
+        tMin = t0 > tMin ? t0 : tMin;
+        tMax = t1 < tMax ? t1 : tMax;
+        if ( tMin > tMax )
+          return false;
+      }
+      entry = tMin;
+      return true;
+    }
+
+    // Two sided Moller-Trumbore intersection
+    inline bool rayTriangle( const float* v, const float* origin,
+      const float* direction, float& distance )
+    {
+      const float e1[ 3 ] = { v[ 3 ] - v[ 0 ], v[ 4 ] - v[ 1 ], v[ 5 ] - v[ 2 ]};
+      const float e2[ 3 ] = { v[ 6 ] - v[ 0 ], v[ 7 ] - v[ 1 ], v[ 8 ] - v[ 2 ]};
+      const float p[ 3 ] = { direction[ 1 ] * e2[ 2 ] - direction[ 2 ] * e2[ 1 ],
+        direction[ 2 ] * e2[ 0 ] - direction[ 0 ] * e2[ 2 ],
+        direction[ 0 ] * e2[ 1 ] - direction[ 1 ] * e2[ 0 ]};
+      const float det = e1[ 0 ] * p[ 0 ] + e1[ 1 ] * p[ 1 ] + e1[ 2 ] * p[ 2 ];
+      if ( det == 0.0f )
+        return false;
+      const float invDet = 1.0f / det;
+
+      const float s[ 3 ] = { origin[ 0 ] - v[ 0 ], origin[ 1 ] - v[ 1 ],
+        origin[ 2 ] - v[ 2 ]};
+      const float u = ( s[ 0 ] * p[ 0 ] + s[ 1 ] * p[ 1 ] + s[ 2 ] * p[ 2 ])
+        * invDet;
+      if ( u < 0.0f || u > 1.0f )
+        return false;
+
+      const float q[ 3 ] = { s[ 1 ] * e1[ 2 ] - s[ 2 ] * e1[ 1 ],
+        s[ 2 ] * e1[ 0 ] - s[ 0 ] * e1[ 2 ],
+        s[ 0 ] * e1[ 1 ] - s[ 1 ] * e1[ 0 ]};
+      const float w = ( direction[ 0 ] * q[ 0 ] + direction[ 1 ] * q[ 1 ] +
+        direction[ 2 ] * q[ 2 ]) * invDet;
+      if ( w < 0.0f || u + w > 1.0f )
+        return false;
+
+      const float t = ( e2[ 0 ] * q[ 0 ] + e2[ 1 ] * q[ 1 ] + e2[ 2 ] * q[ 2 ])
+        * invDet;
+      if ( t < 0.0f || t >= distance )
+        return false;
+      distance = t;
+      return true;
+    }
+
+    inline void inverseDirection( const float* direction, float* inverse )
+    {
+      for ( int i = 0; i < 3; ++i )
+        inverse[ i ] = 1.0f / direction[ i ];
+    }
+
+    // Builds a hierarchy over items given by their bounds ( 6 floats per
+    // item, min then max ), splitting nodes at the median of the longest
+    // centroid axis. order receives the items in leaf order, and children
+    // are always stored after their parent.
+    template< typename NodeT >
+    void buildHierarchy( const std::vector< float >& itemBounds,
+      std::vector< uint32_t >& order, std::vector< NodeT >& nodes )
+    {
+      const uint32_t count = uint32_t( itemBounds.size( ) / 6 );
+      order.resize( count );
+      for ( uint32_t i = 0; i < count; ++i )
+        order[ i ] = i;
+      nodes.clear( );
+      if ( count == 0 )
+        return;
+
+      auto centroid = [ & ]( uint32_t item, int axis )
+      {
+        return itemBounds[ item * 6 + axis ] + itemBounds[ item * 6 + 3 + axis ];
+      };
+
+      NodeT root;
+      root.first = 0;
+      root.count = count;
+      nodes.reserve( 2 * count / LEAF_SIZE + 1 );
+      nodes.push_back( root );
+      std::vector< uint32_t > stack( 1, 0 );
+      while ( !stack.empty( ))
+      {
+        const uint32_t index = stack.back( );
+        stack.pop_back( );
+        const uint32_t first = nodes[ index ].first;
+        const uint32_t size = nodes[ index ].count;
+
+        float centroidMin[ 3 ], centroidMax[ 3 ];
+        resetBounds( nodes[ index ].bounds.min, nodes[ index ].bounds.max );
+        resetBounds( centroidMin, centroidMax );
+        for ( uint32_t i = first; i < first + size; ++i )
+        {
+          const float* b = &itemBounds[ order[ i ] * 6 ];
+          growBounds( nodes[ index ].bounds.min, nodes[ index ].bounds.max,
+            b );
+          growBounds( nodes[ index ].bounds.min, nodes[ index ].bounds.max,
+            b + 3 );
+          const float c[ 3 ] = { centroid( order[ i ], 0 ),
+            centroid( order[ i ], 1 ), centroid( order[ i ], 2 )};
+          growBounds( centroidMin, centroidMax, c );
+        }
+        if ( size <= LEAF_SIZE )
+          continue;
+
+        int axis = 0;
+        for ( int i = 1; i < 3; ++i )
+        {
+          if ( centroidMax[ i ] - centroidMin[ i ] >
+            centroidMax[ axis ] - centroidMin[ axis ])
+          {
+            axis = i;
+          }
+        }
+        if ( centroidMax[ axis ] <= centroidMin[ axis ])
+          continue;
+
+        const uint32_t half = size / 2;
+        std::nth_element( order.begin( ) + first,
+          order.begin( ) + first + half, order.begin( ) + first + size,
+          [ & ]( uint32_t a, uint32_t b )
+          {
+            return centroid( a, axis ) < centroid( b, axis );
+          });
+
+        NodeT left, right;
+        left.first = first;
+        left.count = half;
+        right.first = first + half;
+        right.count = size - half;
+        nodes[ index ].first = uint32_t( nodes.size( ));
+        nodes[ index ].count = 0;
+        stack.push_back( uint32_t( nodes.size( )));
+        nodes.push_back( left );
+        stack.push_back( uint32_t( nodes.size( )));
+        nodes.push_back( right );
+      }
+    }
+  }
+
+  RayPickingSystem::RayPickingSystem( void )
+    : _dirty( false )
+  {
+  }
+
+  void RayPickingSystem::AddObject( Pickable* object )
+  {
+    _registry.add( object, uint32_t( object->getNumIDs( )));
+    _dirty = true;
+  }
+
+  void RayPickingSystem::RemoveObject( Pickable* object )
+  {
+    _registry.remove( object );
+    _dirty = true;
+  }
+
+  void RayPickingSystem::Clear( void )
+  {
+    _registry.clear( );
+    _dirty = true;
+  }
+
+  void RayPickingSystem::updateGeometry( Pickable* object )
+  {
+    if ( _dirty )
+      return;
+    for ( auto& o : _scene )
+    {
+      if ( o.pickable == object )
+      {
+        buildMesh( object, o.mesh );
+        updateModel( o, true );
+        buildTopLevel( );
+        return;
+      }
+    }
+  }
+
+  size_t RayPickingSystem::update( void )
+  {
+    if ( _dirty )
+    {
+      rebuildScene( );
+      return _scene.size( );
+    }
+
+    size_t changed = 0;
+    bool validityChanged = false;
+    for ( auto& o : _scene )
+    {
+      const bool valid = o.valid;
+      if ( updateModel( o, false ))
+      {
+        ++changed;
+        validityChanged = validityChanged || valid != o.valid;
+      }
+    }
+    if ( changed == 0 )
+      return 0;
+    if ( validityChanged )
+    {
+      buildTopLevel( );
+      return changed;
+    }
+
+    // Refit, children are stored after their parents
+    for ( size_t i = _nodes.size( ); i-- > 0; )
+    {
+      Node& node = _nodes[ i ];
+      resetBounds( node.bounds.min, node.bounds.max );
+      if ( node.count == 0 )
+      {
+        for ( uint32_t child = node.first; child < node.first + 2; ++child )
+        {
+          growBounds( node.bounds.min, node.bounds.max,
+            _nodes[ child ].bounds.min );
+          growBounds( node.bounds.min, node.bounds.max,
+            _nodes[ child ].bounds.max );
+        }
+      }
+      else
+      {
+        for ( uint32_t j = node.first; j < node.first + node.count; ++j )
+        {
+          const Bounds& b = _scene[ _leafObjects[ j ]].bounds;
+          growBounds( node.bounds.min, node.bounds.max, b.min );
+          growBounds( node.bounds.min, node.bounds.max, b.max );
+        }
+      }
+    }
+    return changed;
+  }
+
+  int RayPickingSystem::click( Point point, const float* projectionView,
+    unsigned int width, unsigned int height )
+  {
+    return clickHit( point, projectionView, width, height ).id;
+  }
+
+  int RayPickingSystem::click( Point point, Camera* camera,
+    unsigned int width, unsigned int height )
+  {
+    return clickHit( point, camera->projectionViewMatrix( ), width,
+      height ).id;
+  }
+
+  PickHit RayPickingSystem::clickHit( Point point, Camera* camera,
+    unsigned int width, unsigned int height )
+  {
+    return clickHit( point, camera->projectionViewMatrix( ), width,
+      height );
+  }
+
+  PickHit RayPickingSystem::clickHit( Point point,
+    const float* projectionView, unsigned int width, unsigned int height )
+  {
+    PickHit hit;
+    hit.id = hit.object = -1;
+    hit.instance = hit.primitive = 0;
+    hit.depth = 1.0f;
+
+    // Ray through the pixel center from the near to the far plane
+    const Eigen::Map< const Eigen::Matrix4f > pv( projectionView );
+    const Eigen::Matrix4f inversePv = pv.inverse( );
+    const float x = 2.0f * ( point.first + 0.5f ) / width - 1.0f;
+    const float y = 2.0f * ( point.second + 0.5f ) / height - 1.0f;
+    const Eigen::Vector4f nearPoint =
+      inversePv * Eigen::Vector4f( x, y, -1.0f, 1.0f );
+    const Eigen::Vector4f farPoint =
+      inversePv * Eigen::Vector4f( x, y, 1.0f, 1.0f );
+    const Eigen::Vector3f origin = nearPoint.head< 3 >( ) / nearPoint.w( );
+    const Eigen::Vector3f direction =
+      farPoint.head< 3 >( ) / farPoint.w( ) - origin;
+
+    float distance;
+    if ( !raycast( origin.data( ), direction.data( ), hit, distance, 1.0f ))
+      return hit;
+
+    const Eigen::Vector3f position = origin + distance * direction;
+    const Eigen::Vector4f clip = pv * Eigen::Vector4f( position.x( ),
+      position.y( ), position.z( ), 1.0f );
+    hit.depth = std::min( std::max( 0.5f * clip.z( ) / clip.w( ) + 0.5f,
+      0.0f ), 1.0f );
+    return hit;
+  }
+
+  bool RayPickingSystem::raycast( const float* origin, const float* direction,
+    PickHit& hit, float& distance, float maxDistance )
+  {
+    update( );
+
+    hit.id = hit.object = -1;
+    hit.instance = hit.primitive = 0;
+    hit.depth = 1.0f;
+    std::fill( hit.position, hit.position + 3, 0.0f );
+    std::fill( hit.normal, hit.normal + 3, 0.0f );
+    if ( _nodes.empty( ))
+      return false;
+
+    float invDirection[ 3 ];
+    inverseDirection( direction, invDirection );
+
+    float best = maxDistance;
+    float entry;
+    const Object* hitObject = nullptr;
+    uint32_t hitTriangle = 0;
+    std::vector< uint32_t > stack( 1, 0 );
+    while ( !stack.empty( ))
+    {
+      const Node& node = _nodes[ stack.back( )];
+      stack.pop_back( );
+      if ( !rayBox( node.bounds.min, node.bounds.max, origin, invDirection,
+        best, entry ))
+      {
+        continue;
+      }
+
+      if ( node.count == 0 )
+      {
+        stack.push_back( node.first + 1 );
+        stack.push_back( node.first );
+        continue;
+      }
+
+      for ( uint32_t i = node.first; i < node.first + node.count; ++i )
+      {
+        const Object& object = _scene[ _leafObjects[ i ]];
+        float modelOrigin[ 3 ], modelDirection[ 3 ];
+        transformPoint( object.inverse, origin, modelOrigin );
+        transformVector( object.inverse, direction, modelDirection );
+        if ( intersectMesh( object.mesh, modelOrigin, modelDirection, best,
+          hitTriangle ))
+        {
+          hitObject = &object;
+        }
+      }
+    }
+
+    distance = best;
+    if ( !hitObject )
+      return false;
+
+    hit.id = hit.object = int( hitObject->id );
+    hit.primitive = hitObject->mesh.primitives[ hitTriangle ];
+    for ( int i = 0; i < 3; ++i )
+      hit.position[ i ] = origin[ i ] + best * direction[ i ];
+
+    // Normals go to world space with the transposed inverse model matrix
+    const float* v = &hitObject->mesh.triangles[ hitTriangle * 9 ];
+    const float e1[ 3 ] = { v[ 3 ] - v[ 0 ], v[ 4 ] - v[ 1 ], v[ 5 ] - v[ 2 ]};
+    const float e2[ 3 ] = { v[ 6 ] - v[ 0 ], v[ 7 ] - v[ 1 ], v[ 8 ] - v[ 2 ]};
+    const float n[ 3 ] = { e1[ 1 ] * e2[ 2 ] - e1[ 2 ] * e2[ 1 ],
+      e1[ 2 ] * e2[ 0 ] - e1[ 0 ] * e2[ 2 ],
+      e1[ 0 ] * e2[ 1 ] - e1[ 1 ] * e2[ 0 ]};
+    const float* inverse = hitObject->inverse;
+    float length = 0.0f;
+    float facing = 0.0f;
+    for ( int i = 0; i < 3; ++i )
+    {
+      hit.normal[ i ] = inverse[ i * 4 ] * n[ 0 ] +
+        inverse[ i * 4 + 1 ] * n[ 1 ] + inverse[ i * 4 + 2 ] * n[ 2 ];
+      length += hit.normal[ i ] * hit.normal[ i ];
+      facing += hit.normal[ i ] * direction[ i ];
+    }
+    length = std::sqrt( length );
+    if ( length > 0.0f )
+    {
+      // Facing the ray origin
+      const float scale = ( facing > 0.0f ? -1.0f : 1.0f ) / length;
+      for ( int i = 0; i < 3; ++i )
+        hit.normal[ i ] *= scale;
+    }
+    return true;
+  }
+
+  bool RayPickingSystem::intersectMesh( const Mesh& mesh,
+    const float* origin, const float* direction, float& distance,
+    uint32_t& triangle ) const
+  {
+    float invDirection[ 3 ];
+    inverseDirection( direction, invDirection );
+
+    bool found = false;
+    uint32_t stack[ 64 ];
+    uint32_t size = 0;
+    stack[ size++ ] = 0;
+    float entry;
+    while ( size > 0 )
+    {
+      const Node& node = mesh.nodes[ stack[ --size ]];
+      if ( !rayBox( node.bounds.min, node.bounds.max, origin, invDirection,
+        distance, entry ))
+      {
+        continue;
+      }
+
+      if ( node.count == 0 )
+      {
+        // Visit the nearest child first
+        const Node& left = mesh.nodes[ node.first ];
+        const Node& right = mesh.nodes[ node.first + 1 ];
+        float leftEntry, rightEntry;
+        const bool hitLeft = rayBox( left.bounds.min, left.bounds.max,
+          origin, invDirection, distance, leftEntry );
+        const bool hitRight = rayBox( right.bounds.min, right.bounds.max,
+          origin, invDirection, distance, rightEntry );
+        if ( hitLeft && hitRight )
+        {
+          const bool leftFirst = leftEntry <= rightEntry;
+          stack[ size++ ] = leftFirst ? node.first + 1 : node.first;
+          stack[ size++ ] = leftFirst ? node.first : node.first + 1;
+        }
+        else if ( hitLeft )
+          stack[ size++ ] = node.first;
+        else if ( hitRight )
+          stack[ size++ ] = node.first + 1;
+        continue;
+      }
+
+      for ( uint32_t i = node.first; i < node.first + node.count; ++i )
+      {
+        if ( rayTriangle( &mesh.triangles[ i * 9 ], origin, direction,
+          distance ))
+        {
+          triangle = i;
+          found = true;
+        }
+      }
+    }
+    return found;
+  }
+
+  void RayPickingSystem::buildMesh( const Pickable* object, Mesh& mesh ) const
+  {
+    const std::vector< float > positions = object->getPositions( );
+    std::vector< unsigned int > indices = object->getIndices( );
+    const size_t numVertices = positions.size( ) / 3;
+    if ( indices.empty( ))
+    {
+      indices.resize( numVertices - numVertices % 3 );
+      for ( size_t i = 0; i < indices.size( ); ++i )
+        indices[ i ] = unsigned( i );
+    }
+
+    // Triangles with indices out of range are skipped
+    std::vector< uint32_t > valid;
+    std::vector< float > bounds;
+    valid.reserve( indices.size( ) / 3 );
+    bounds.reserve( indices.size( ) / 3 * 6 );
+    for ( size_t t = 0; t + 2 < indices.size( ); t += 3 )
+    {
+      if ( indices[ t ] >= numVertices || indices[ t + 1 ] >= numVertices ||
+        indices[ t + 2 ] >= numVertices )
+      {
+        continue;
+      }
+      float min[ 3 ], max[ 3 ];
+      resetBounds( min, max );
+      for ( int c = 0; c < 3; ++c )
+        growBounds( min, max, &positions[ indices[ t + c ] * 3 ]);
+      valid.push_back( uint32_t( t / 3 ));
+      bounds.insert( bounds.end( ), min, min + 3 );
+      bounds.insert( bounds.end( ), max, max + 3 );
+    }
+
+    std::vector< uint32_t > order;
+    buildHierarchy( bounds, order, mesh.nodes );
+
+    mesh.triangles.resize( order.size( ) * 9 );
+    mesh.primitives.resize( order.size( ));
+    for ( size_t i = 0; i < order.size( ); ++i )
+    {
+      const uint32_t primitive = valid[ order[ i ]];
+      mesh.primitives[ i ] = primitive;
+      for ( int c = 0; c < 3; ++c )
+      {
+        const float* p = &positions[ indices[ primitive * 3 + c ] * 3 ];
+        std::copy( p, p + 3, &mesh.triangles[ i * 9 + c * 3 ]);
+      }
+    }
+  }
+
+  bool RayPickingSystem::updateModel( Object& object, bool force ) const
+  {
+    std::vector< float > model = object.pickable->getModel( );
+    if ( !force && model == object.model )
+      return false;
+    object.model = model;
+
+    if ( model.size( ) != 16 )
+    {
+      // Objects without model matrix are already in world space
+      model.assign( 16, 0.0f );
+      model[ 0 ] = model[ 5 ] = model[ 10 ] = model[ 15 ] = 1.0f;
+    }
+    const Eigen::Map< const Eigen::Matrix4f > m( model.data( ));
+    Eigen::Matrix4f inverse;
+    bool invertible;
+    m.computeInverseWithCheck( inverse, invertible );
+    object.valid = invertible && !object.mesh.nodes.empty( );
+    if ( !object.valid )
+      return true;
+    Eigen::Map< Eigen::Matrix4f >( object.inverse ) = inverse;
+
+    // World bounds of the corners of the model bounds
+    const Bounds& local = object.mesh.nodes[ 0 ].bounds;
+    resetBounds( object.bounds.min, object.bounds.max );
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+      const float p[ 3 ] = {
+        corner & 1 ? local.max[ 0 ] : local.min[ 0 ],
+        corner & 2 ? local.max[ 1 ] : local.min[ 1 ],
+        corner & 4 ? local.max[ 2 ] : local.min[ 2 ]};
+      float world[ 3 ];
+      transformPoint( model.data( ), p, world );
+      growBounds( object.bounds.min, object.bounds.max, world );
+    }
+    return true;
+  }
+
+  void RayPickingSystem::rebuildScene( void )
+  {
+    std::map< Pickable*, Object* > previous;
+    for ( auto& o : _scene )
+      previous[ o.pickable ] = &o;
+
+    const auto& objects = _registry.objects( );
+    std::vector< Object > scene( objects.size( ));
+    for ( size_t i = 0; i < objects.size( ); ++i )
+    {
+      Pickable* pickable = objects[ i ];
+      Object& o = scene[ i ];
+      auto it = previous.find( pickable );
+      if ( it != previous.end( ))
+      {
+        o = std::move( *it->second );
+        updateModel( o, false );
+      }
+      else
+      {
+        o.pickable = pickable;
+        buildMesh( pickable, o.mesh );
+        updateModel( o, true );
+      }
+      o.id = _registry.firstIds( )[ i ];
+    }
+    _scene.swap( scene );
+    buildTopLevel( );
+    _dirty = false;
+  }
+
+  void RayPickingSystem::buildTopLevel( void )
+  {
+    std::vector< uint32_t > objects;
+    std::vector< float > bounds;
+    for ( uint32_t i = 0; i < _scene.size( ); ++i )
+    {
+      if ( !_scene[ i ].valid )
+        continue;
+      objects.push_back( i );
+      bounds.insert( bounds.end( ), _scene[ i ].bounds.min,
+        _scene[ i ].bounds.min + 3 );
+      bounds.insert( bounds.end( ), _scene[ i ].bounds.max,
+        _scene[ i ].bounds.max + 3 );
+    }
+
+    std::vector< uint32_t > order;
+    buildHierarchy( bounds, order, _nodes );
+    _leafObjects.resize( order.size( ));
+    for ( size_t j = 0; j < order.size( ); ++j )
+      _leafObjects[ j ] = objects[ order[ j ]];
+  }
+
+} /* namespace reto */
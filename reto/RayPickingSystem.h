@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__RAY_PICKING_SYSTEM__
+#define __RETO__RAY_PICKING_SYSTEM__
+
+#include <reto/api.h>
+#include "PickingSystem.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace reto
+{
+  class Camera;
+
+  /**
+   * Picking backend that casts rays on the CPU instead of rendering. Each
+   * object has a bounding volume hierarchy of its triangles in model space,
+   * built from getPositions and getIndices, and a top level hierarchy over
+   * the world bounds of the objects is refitted when their model matrices
+   * change. Does not need an OpenGL context.
+   * @class RayPickingSystem
+   */
+  class RayPickingSystem
+  {
+    public:
+      /**
+       * RayPickingSystem constructor
+       */
+      RETO_API
+      RayPickingSystem( void );
+
+      /**
+       * Method to add a Pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void AddObject( reto::Pickable* object );
+
+      /**
+       * Method to remove a Pickable object
+       * @param object: Pickable object
+       */
+      RETO_API
+      void RemoveObject( reto::Pickable* object );
+
+      /**
+       * Method to clear Pickable elements
+       */
+      RETO_API
+      void Clear( void );
+
+      /**
+       * Method to rebuild the hierarchy of an object whose positions or
+       * indices changed
+       * @param object: Pickable object
+       */
+      RETO_API
+      void updateGeometry( reto::Pickable* object );
+
+      /**
+       * Method to refit the top level hierarchy to the current model
+       * matrices. Picks call it, so it is only needed to control when the
+       * work is done.
+       * @return size_t: Number of objects whose model matrix changed
+       */
+      RETO_API
+      size_t update( void );
+
+      /**
+       * Method to find front object in a specific point
+       * @param point: Point (in OpenGL coordinates)
+       * @param projectionView: Column major projection view matrix
+       * @param width: Viewport width
+       * @param height: Viewport height
+       * @return int: Indice that is visible ( -1 for none )
+       */
+      RETO_API
+      int click( Point point, const float* projectionView,
+        unsigned int width, unsigned int height );
+
+      /**
+       * Method to find front object in a specific point of a camera
+       * @param point: Point (in OpenGL coordinates)
+       * @param camera: Camera whose projectionViewMatrix is used
+       * @param width: Viewport width
+       * @param height: Viewport height
+       * @return int: Indice that is visible ( -1 for none )
+       */
+      RETO_API
+      int click( Point point, Camera* camera, unsigned int width,
+        unsigned int height );
+
+      /**
+       * Method to find the front triangle in a specific point. The id and
+       * the object are the first id of the object, assigned like
+       * PickingSystem does, so both agree when they get the same objects
+       * in the same order. The primitive is the triangle in getIndices
+       * order and the depth is the window depth of the hit.
+       * Hits outside the near and far planes are ignored.
+       * @param point: Point (in OpenGL coordinates)
+       * @param projectionView: Column major projection view matrix
+       * @param width: Viewport width
+       * @param height: Viewport height
+       * @return PickHit of the front triangle
+       */
+      RETO_API
+      PickHit clickHit( Point point, const float* projectionView,
+        unsigned int width, unsigned int height );
+
+      /**
+       * Method to find the front triangle in a specific point of a camera
+       * @param point: Point (in OpenGL coordinates)
+       * @param camera: Camera whose projectionViewMatrix is used
+       * @param width: Viewport width
+       * @param height: Viewport height
+       * @return PickHit of the front triangle
+       */
+      RETO_API
+      PickHit clickHit( Point point, Camera* camera, unsigned int width,
+        unsigned int height );
+
+      /**
+       * Method to find the nearest triangle along a world space ray
+       * @param origin: Ray origin ( 3 floats )
+       * @param direction: Ray direction ( 3 floats, not normalized )
+       * @param hit: Object, primitive, position and normal hit ( depth
+       *   is not set )
+       * @param distance: Hit distance in direction lengths
+       * @param maxDistance: Maximum distance in direction lengths
+       * @return bool: false if nothing is hit
+       */
+      RETO_API
+      bool raycast( const float* origin, const float* direction,
+        PickHit& hit, float& distance, float maxDistance = 1e30f );
+
+    protected:
+      //! Axis aligned bounding box
+      struct Bounds
+      {
+        float min[ 3 ];
+        float max[ 3 ];
+      };
+
+      //! Hierarchy node. Leaves reference count primitives from first,
+      //! inner nodes ( count == 0 ) have their children at first and
+      //! first + 1
+      struct Node
+      {
+        Bounds bounds;
+        uint32_t first;
+        uint32_t count;
+      };
+
+      //! Triangles of an object in model space and their hierarchy
+      struct Mesh
+      {
+        //! Triangle corners in hierarchy order ( 9 floats per triangle )
+        std::vector< float > triangles;
+        //! Triangle in getIndices order of each hierarchy triangle
+        std::vector< uint32_t > primitives;
+        //! Hierarchy nodes, root first
+        std::vector< Node > nodes;
+      };
+
+      //! Object of the scene
+      struct Object
+      {
+        reto::Pickable* pickable;
+        //! First picking id
+        uint32_t id;
+        Mesh mesh;
+        //! Model matrix used by the top level hierarchy
+        std::vector< float > model;
+        //! Inverse of the model matrix ( column major )
+        float inverse[ 16 ];
+        //! World bounds
+        Bounds bounds;
+        //! False for empty objects and singular model matrices
+        bool valid;
+      };
+
+      /*
+        Build the hierarchy of the triangles of an object
+        @param Pickable object
+        @param Mesh mesh
+      */
+      void buildMesh( const reto::Pickable* object, Mesh& mesh ) const;
+      /*
+        Read the model matrix of an object and update its world bounds
+        @param Object object
+        @param bool force: update even if the matrix did not change
+        @return bool: false if the matrix did not change
+      */
+      bool updateModel( Object& object, bool force ) const;
+      /*
+        Rebuild the scene after objects were added or removed, keeping
+        the meshes of the remaining objects
+      */
+      void rebuildScene( void );
+      /*
+        Build the top level hierarchy over the object bounds
+      */
+      void buildTopLevel( void );
+      /*
+        Nearest triangle of an object along a model space ray
+        @param Mesh mesh
+        @param float* origin
+        @param float* direction
+        @param float distance: in and out nearest distance
+        @param uint32_t triangle: out triangle in hierarchy order
+        @return bool
+      */
+      bool intersectMesh( const Mesh& mesh, const float* origin,
+        const float* direction, float& distance, uint32_t& triangle ) const;
+
+      //! Pickable objects
+      reto::PickingRegistry _registry;
+
+      //! Objects in registry order
+      std::vector< Object > _scene;
+
+      //! Top level hierarchy nodes over _scene
+      std::vector< Node > _nodes;
+
+      //! Objects of the top level leaves
+      std::vector< uint32_t > _leafObjects;
+
+      //! Flag to rebuild the scene on the next pick
+      bool _dirty;
+
+  }; /* class RayPickingSystem */
+
+} /* namespace reto */
+
+#endif /* __RETO__RAY_PICKING_SYSTEM__ */
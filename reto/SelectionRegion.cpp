@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SelectionRegion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace reto
+{
+  namespace
+  {
+    //! Margin relative to the magnitude of the projected boxes, for the
+    //! rounding differences with the projection of each vertex
+    const float EPSILON = 1e-4f;
+
+    const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Liang-Barsky clipping of the segment ab against a box
+    bool segmentInBox( const float* a, const float* b, const float* min,
+      const float* max )
+    {
+      float t0 = 0.0f;
+      float t1 = 1.0f;
+      for ( int k = 0; k < 2; ++k )
+      {
+        const float d = b[ k ] - a[ k ];
+        if ( d == 0.0f )
+        {
+          if ( a[ k ] < min[ k ] || a[ k ] > max[ k ])
+            return false;
+          continue;
+        }
+        float ta = ( min[ k ] - a[ k ]) / d;
+        float tb = ( max[ k ] - a[ k ]) / d;
+        if ( ta > tb )
+          std::swap( ta, tb );
+        t0 = std::max( t0, ta );
+        t1 = std::min( t1, tb );
+        if ( t0 > t1 )
+          return false;
+      }
+      return true;
+    }
+
+    // Boxes covering the part of the box a outside the box b
+    void difference( const float* a, const float* b,
+      std::vector< float >& boxes )
+    {
+      if ( a[ 2 ] <= b[ 0 ] || b[ 2 ] <= a[ 0 ] ||
+        a[ 3 ] <= b[ 1 ] || b[ 3 ] <= a[ 1 ])
+      {
+        boxes.insert( boxes.end( ), a, a + 4 );
+        return;
+      }
+      const float x0 = std::max( a[ 0 ], b[ 0 ]);
+      const float x1 = std::min( a[ 2 ], b[ 2 ]);
+      const float strips[ 4 ][ 4 ] = {{ a[ 0 ], a[ 1 ], b[ 0 ], a[ 3 ]},
+        { b[ 2 ], a[ 1 ], a[ 2 ], a[ 3 ]}, { x0, a[ 1 ], x1, b[ 1 ]},
+        { x0, b[ 3 ], x1, a[ 3 ]}};
+      for ( const auto& strip : strips )
+      {
+        if ( strip[ 0 ] < strip[ 2 ] && strip[ 1 ] < strip[ 3 ])
+          boxes.insert( boxes.end( ), strip, strip + 4 );
+      }
+    }
+
+    // Even-odd rule, crossings of a ray towards +x
+    bool inPolygon( const std::vector< float >& points, float u, float v )
+    {
+      bool inside = false;
+      const size_t numPoints = points.size( ) / 2;
+      for ( size_t i = 0; i < numPoints; ++i )
+      {
+        const float* a = &points[ i * 2 ];
+        const float* b = &points[(( i + 1 ) % numPoints ) * 2 ];
+        if (( a[ 1 ] > v ) != ( b[ 1 ] > v ) &&
+          u < a[ 0 ] + ( b[ 0 ] - a[ 0 ]) / ( b[ 1 ] - a[ 1 ]) * ( v - a[ 1 ]))
+        {
+          inside = !inside;
+        }
+      }
+      return inside;
+    }
+  }
+
+  ObjectBounds::ObjectBounds( void )
+    : _valid( false )
+    , _empty( true )
+  {
+    std::fill( _box, _box + 6, 0.0f );
+    std::fill( _world, _world + 6, 0.0f );
+  }
+
+  void ObjectBounds::setPositions( const std::vector< float >& positions )
+  {
+    const size_t numVertices = positions.size( ) / 3;
+    _empty = numVertices == 0;
+    _valid = false;
+    for ( int k = 0; k < 3; ++k )
+    {
+      _box[ k ] = std::numeric_limits< float >::max( );
+      _box[ k + 3 ] = -std::numeric_limits< float >::max( );
+    }
+    for ( size_t i = 0; i < numVertices; ++i )
+    {
+      for ( int k = 0; k < 3; ++k )
+      {
+        _box[ k ] = std::min( _box[ k ], positions[ i * 3 + k ]);
+        _box[ k + 3 ] = std::max( _box[ k + 3 ], positions[ i * 3 + k ]);
+      }
+    }
+  }
+
+  bool ObjectBounds::empty( void ) const
+  {
+    return _empty;
+  }
+
+  const float* ObjectBounds::world( const std::vector< float >& model )
+  {
+    if ( _valid && model == _model )
+      return _world;
+    _model = model;
+    _valid = true;
+
+    // Box of the transformed corners
+    const float* m = model.size( ) >= 16 ? model.data( ) : IDENTITY;
+    for ( int k = 0; k < 3; ++k )
+    {
+      _world[ k ] = std::numeric_limits< float >::max( );
+      _world[ k + 3 ] = -std::numeric_limits< float >::max( );
+    }
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+      const float x = _box[ corner & 1 ? 3 : 0 ];
+      const float y = _box[ corner & 2 ? 4 : 1 ];
+      const float z = _box[ corner & 4 ? 5 : 2 ];
+      for ( int k = 0; k < 3; ++k )
+      {
+        const float p = m[ k ] * x + m[ k + 4 ] * y + m[ k + 8 ] * z +
+          m[ k + 12 ];
+        _world[ k ] = std::min( _world[ k ], p );
+        _world[ k + 3 ] = std::max( _world[ k + 3 ], p );
+      }
+    }
+    return _world;
+  }
+
+  SelectionRegion::SelectionRegion( void )
+    : _lasso( false )
+    , _incremental( false )
+  {
+    std::fill( _rectangle, _rectangle + 4, 0.0f );
+    std::fill( _pointsBox, _pointsBox + 4, 0.0f );
+    std::copy( IDENTITY, IDENTITY + 16, _viewProj );
+    _margin[ 0 ] = _margin[ 1 ] = 0.0f;
+  }
+
+  void SelectionRegion::setRectangle( const float* min, const float* max )
+  {
+    _lasso = false;
+    _incremental = false;
+    _points.clear( );
+    _rectangle[ 0 ] = min[ 0 ];
+    _rectangle[ 1 ] = min[ 1 ];
+    _rectangle[ 2 ] = max[ 0 ];
+    _rectangle[ 3 ] = max[ 1 ];
+  }
+
+  void SelectionRegion::setLasso( const std::vector< float >& points )
+  {
+    _lasso = true;
+    _incremental = false;
+    _points = points;
+    _points.resize( points.size( ) / 2 * 2 );
+    _pointsBox[ 0 ] = _pointsBox[ 1 ] = std::numeric_limits< float >::max( );
+    _pointsBox[ 2 ] = _pointsBox[ 3 ] = -std::numeric_limits< float >::max( );
+    for ( size_t i = 0; i < _points.size( ); ++i )
+    {
+      _pointsBox[ i & 1 ] = std::min( _pointsBox[ i & 1 ], _points[ i ]);
+      _pointsBox[ 2 + ( i & 1 )] = std::max( _pointsBox[ 2 + ( i & 1 )],
+        _points[ i ]);
+    }
+  }
+
+  void SelectionRegion::setViewProj( const float* viewProj )
+  {
+    std::copy( viewProj, viewProj + 16, _viewProj );
+    _incremental = false;
+  }
+
+  void SelectionRegion::setMargin( float x, float y )
+  {
+    _margin[ 0 ] = x;
+    _margin[ 1 ] = y;
+    _incremental = false;
+  }
+
+  void SelectionRegion::setPrevious( const SelectionRegion& previous )
+  {
+    _changes.clear( );
+    _incremental = false;
+    if ( previous._lasso != _lasso ||
+      !std::equal( _viewProj, _viewProj + 16, previous._viewProj ) ||
+      !std::equal( _margin, _margin + 2, previous._margin ))
+    {
+      return;
+    }
+
+    if ( !_lasso )
+    {
+      difference( _rectangle, previous._rectangle, _changes );
+      difference( previous._rectangle, _rectangle, _changes );
+      _incremental = true;
+      return;
+    }
+
+    // A lasso extending the previous one differs inside the loop closed
+    // by the new points and the previous closing edge
+    const std::vector< float >& before = previous._points;
+    if ( before.empty( ) || before.size( ) > _points.size( ) ||
+      !std::equal( before.begin( ), before.end( ), _points.begin( )))
+    {
+      return;
+    }
+    _incremental = true;
+    if ( before.size( ) == _points.size( ))
+      return;
+    float box[ 4 ] = { _points[ 0 ], _points[ 1 ], _points[ 0 ],
+      _points[ 1 ]};
+    for ( size_t i = before.size( ) - 2; i < _points.size( ); ++i )
+    {
+      box[ i & 1 ] = std::min( box[ i & 1 ], _points[ i ]);
+      box[ 2 + ( i & 1 )] = std::max( box[ 2 + ( i & 1 )], _points[ i ]);
+    }
+    _changes.insert( _changes.end( ), box, box + 4 );
+  }
+
+  bool SelectionRegion::incremental( void ) const
+  {
+    return _incremental;
+  }
+
+  bool SelectionRegion::lasso( void ) const
+  {
+    return _lasso;
+  }
+
+  const float* SelectionRegion::rectangle( void ) const
+  {
+    return _rectangle;
+  }
+
+  const std::vector< float >& SelectionRegion::points( void ) const
+  {
+    return _points;
+  }
+
+  const float* SelectionRegion::viewProj( void ) const
+  {
+    return _viewProj;
+  }
+
+  SelectionRegion::Coverage SelectionRegion::classify(
+    const float* world ) const
+  {
+    if ( _lasso && _points.size( ) < 6 )
+      return OUTSIDE;
+
+    // Box of the projected corners
+    const float* m = _viewProj;
+    float min[ 2 ] = { std::numeric_limits< float >::max( ),
+      std::numeric_limits< float >::max( )};
+    float max[ 2 ] = { -std::numeric_limits< float >::max( ),
+      -std::numeric_limits< float >::max( )};
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+      const float x = world[ corner & 1 ? 3 : 0 ];
+      const float y = world[ corner & 2 ? 4 : 1 ];
+      const float z = world[ corner & 4 ? 5 : 2 ];
+      const float w = m[ 3 ] * x + m[ 7 ] * y + m[ 11 ] * z + m[ 15 ];
+      if ( !( w > 0.0f ))
+        return STRADDLING;
+      for ( int k = 0; k < 2; ++k )
+      {
+        const float p = ( m[ k ] * x + m[ k + 4 ] * y + m[ k + 8 ] * z +
+          m[ k + 12 ]) / w;
+        min[ k ] = std::min( min[ k ], p );
+        max[ k ] = std::max( max[ k ], p );
+      }
+    }
+    for ( int k = 0; k < 2; ++k )
+    {
+      const float margin = _margin[ k ] + EPSILON * ( 1.0f + std::max(
+        std::fabs( min[ k ]), std::fabs( max[ k ])));
+      if ( !std::isfinite( margin ))
+        return STRADDLING;
+      min[ k ] -= margin;
+      max[ k ] += margin;
+    }
+
+    if ( _incremental )
+    {
+      bool changed = false;
+      for ( size_t i = 0; i < _changes.size( ) && !changed; i += 4 )
+      {
+        const float* c = &_changes[ i ];
+        changed = min[ 0 ] <= c[ 2 ] && max[ 0 ] >= c[ 0 ] &&
+          min[ 1 ] <= c[ 3 ] && max[ 1 ] >= c[ 1 ];
+      }
+      if ( !changed )
+        return UNCHANGED;
+    }
+
+    if ( !_lasso )
+    {
+      const float* r = _rectangle;
+      if ( max[ 0 ] < r[ 0 ] || min[ 0 ] >= r[ 2 ] ||
+        max[ 1 ] < r[ 1 ] || min[ 1 ] >= r[ 3 ])
+      {
+        return OUTSIDE;
+      }
+      if ( min[ 0 ] >= r[ 0 ] && max[ 0 ] < r[ 2 ] &&
+        min[ 1 ] >= r[ 1 ] && max[ 1 ] < r[ 3 ])
+      {
+        return INSIDE;
+      }
+      return STRADDLING;
+    }
+
+    const float* b = _pointsBox;
+    if ( max[ 0 ] < b[ 0 ] || min[ 0 ] > b[ 2 ] ||
+      max[ 1 ] < b[ 1 ] || min[ 1 ] > b[ 3 ])
+    {
+      return OUTSIDE;
+    }
+
+    // Without edges crossing the box, all of it is on the same side as
+    // its center
+    const size_t numPoints = _points.size( ) / 2;
+    for ( size_t i = 0; i < numPoints; ++i )
+    {
+      if ( segmentInBox( &_points[ i * 2 ],
+        &_points[(( i + 1 ) % numPoints ) * 2 ], min, max ))
+      {
+        return STRADDLING;
+      }
+    }
+    return inPolygon( _points, 0.5f * ( min[ 0 ] + max[ 0 ]),
+      0.5f * ( min[ 1 ] + max[ 1 ])) ? INSIDE : OUTSIDE;
+  }
+
+} /* namespace reto */
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__SELECTION_REGION__
+#define __RETO__SELECTION_REGION__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace reto
+{
+  /**
+   * Class to cache the box bounding the positions of an object, in model
+   * space and in world space. The world box is computed again only when
+   * the model matrix changes.
+   * @class ObjectBounds
+   */
+  class ObjectBounds
+  {
+    public:
+      /**
+       * ObjectBounds constructor, without vertices
+       */
+      RETO_API
+      ObjectBounds( void );
+
+      /**
+       * Method to set the positions bounded
+       * @param positions: 3 floats per vertex
+       */
+      RETO_API
+      void setPositions( const std::vector< float >& positions );
+
+      /**
+       * Method to check if there are no positions
+       * @return bool
+       */
+      RETO_API
+      bool empty( void ) const;
+
+      /**
+       * Method to get the world box of the positions
+       * @param model: Column major model matrix ( empty for identity )
+       * @return 6 floats, minimum and maximum
+       */
+      RETO_API
+      const float* world( const std::vector< float >& model );
+
+    private:
+      //! Model space minimum and maximum
+      float _box[ 6 ];
+
+      //! World space minimum and maximum
+      float _world[ 6 ];
+
+      //! Model matrix of the world box
+      std::vector< float > _model;
+
+      //! World box up to date flag
+      bool _valid;
+
+      //! No positions flag
+      bool _empty;
+
+  }; /* class ObjectBounds */
+
+  /**
+   * Class describing a rubberband or lasso selection in normalized device
+   * coordinates, to classify whole objects from their projected world
+   * boxes before testing their vertices. A vertex is inside a rectangle
+   * when min <= p < max on both axes, and inside a lasso by the even-odd
+   * rule. Boxes are grown by a margin before being classified, so objects
+   * near the border are always tested vertex by vertex.
+   *
+   * A region can also be compared with the previous one of an incremental
+   * selection, as the rubberband or lasso grows while the mouse moves.
+   * Boxes away from the area where both differ keep the result of the
+   * previous selection.
+   * @class SelectionRegion
+   */
+  class SelectionRegion
+  {
+    public:
+      //! Result of classifying an object
+      enum Coverage
+      {
+        //! No vertex can be inside
+        OUTSIDE,
+        //! Every vertex is inside
+        INSIDE,
+        //! Vertices must be tested
+        STRADDLING,
+        //! Vertices keep the result of the previous selection
+        UNCHANGED
+      };
+
+      /**
+       * SelectionRegion constructor, an empty rectangle with an identity
+       * view projection matrix and no margin
+       */
+      RETO_API
+      SelectionRegion( void );
+
+      /**
+       * Method to select a rectangle
+       * @param min: Lower left corner
+       * @param max: Upper right corner
+       */
+      RETO_API
+      void setRectangle( const float* min, const float* max );
+
+      /**
+       * Method to select a lasso, closed from its last point to the first
+       * one. Less than three points select nothing.
+       * @param points: 2 floats per point
+       */
+      RETO_API
+      void setLasso( const std::vector< float >& points );
+
+      /**
+       * Method to set the view projection matrix of the selection
+       * @param viewProj: Column major view projection matrix
+       */
+      RETO_API
+      void setViewProj( const float* viewProj );
+
+      /**
+       * Method to set the margin added to the projected boxes, in
+       * normalized device coordinates, for selections whose border is
+       * not exact, as a rasterized one
+       * @param x: Horizontal margin
+       * @param y: Vertical margin
+       */
+      RETO_API
+      void setMargin( float x, float y );
+
+      /**
+       * Method to compare with the region of the previous selection, after
+       * setting this one. Boxes only touching the area where both differ
+       * are classified, the rest are UNCHANGED. Rectangles are compared
+       * with rectangles, and lassos with the lassos whose points they
+       * extend. Other changes, including the matrix or the margin, make
+       * every box be classified.
+       * @param previous: Region of the previous selection
+       */
+      RETO_API
+      void setPrevious( const SelectionRegion& previous );
+
+      /**
+       * Method to check if there is a previous region to compare with
+       * @return bool
+       */
+      RETO_API
+      bool incremental( void ) const;
+
+      /**
+       * Method to check if the selection is a lasso
+       * @return bool
+       */
+      RETO_API
+      bool lasso( void ) const;
+
+      /**
+       * Method to get the selected rectangle
+       * @return 4 floats: minimum x and y, maximum x and y
+       */
+      RETO_API
+      const float* rectangle( void ) const;
+
+      /**
+       * Method to get the points of the lasso
+       * @return 2 floats per point
+       */
+      RETO_API
+      const std::vector< float >& points( void ) const;
+
+      /**
+       * Method to get the view projection matrix
+       * @return Column major matrix
+       */
+      RETO_API
+      const float* viewProj( void ) const;
+
+      /**
+       * Method to classify the vertices inside a world box. Boxes
+       * crossing the plane of the eye are always straddling.
+       * @param world: 6 floats, minimum and maximum
+       * @return Coverage
+       */
+      RETO_API
+      Coverage classify( const float* world ) const;
+
+    private:
+      //! Rectangle minimum and maximum
+      float _rectangle[ 4 ];
+
+      //! Lasso points
+      std::vector< float > _points;
+
+      //! Lasso box minimum and maximum
+      float _pointsBox[ 4 ];
+
+      //! Lasso flag
+      bool _lasso;
+
+      //! View projection matrix
+      float _viewProj[ 16 ];
+
+      //! Margin of the projected boxes
+      float _margin[ 2 ];
+
+      //! Boxes covering the difference with the previous region, 4 floats
+      //! each: minimum x and y, maximum x and y
+      std::vector< float > _changes;
+
+      //! Previous region flag
+      bool _incremental;
+
+  }; /* class SelectionRegion */
+
+} /* namespace reto */
+
+#endif /* __RETO__SELECTION_REGION__ */
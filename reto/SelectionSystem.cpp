@@ -46,6 +46,11 @@ namespace reto
         , _lineWidth( 1.0f )
         , _width( width )
         , _height( height )
+        , _boundsTest( true )
+        , _livePreview( false )
+        , _previewInterval( 1.0f / 60.0f )
+        , _previewed( false )
+        , _pendingPreview( false )
         , _program( new reto::ShaderProgram( ) )
     {
       create( );
@@ -57,7 +62,7 @@ namespace reto
 
       //Create Transform Feedback
       _tf = new reto::TransformFeedback( _VertexCodeTransformFeedback( ),
-        { "insideBS" }, GL_SEPARATE_ATTRIBS );
+        { "insideBS" }, GL_SEPARATE_ATTRIBS, _ComputeCodeSelection( ));
     }
 
     RubberBand::~RubberBand( void )
@@ -101,6 +106,9 @@ namespace reto
     {
       addStartPosition( point );
       generate( );
+      _lastPreview = std::chrono::steady_clock::time_point( );
+      _previewed = false;
+      _pendingPreview = false;
     }
 
     void RubberBand::mouseMove( const Point& point )
@@ -109,17 +117,39 @@ namespace reto
       generate( );
     }
 
+    void RubberBand::mouseMove( const Point& point, float* viewProj )
+    {
+      mouseMove( point );
+      if ( !_livePreview )
+        return;
+
+      // At most one preview per interval, skipped moves stay pending
+      // until the next move or flushPreview
+      _pendingPreview = true;
+      flushPreview( viewProj );
+    }
+
+    bool RubberBand::flushPreview( float* viewProj )
+    {
+      if ( !_pendingPreview )
+        return false;
+
+      const auto now = std::chrono::steady_clock::now( );
+      if ( now - _lastPreview < _previewInterval )
+        return false;
+      _lastPreview = now;
+      _pendingPreview = false;
+      select( viewProj );
+      return true;
+    }
+
     void RubberBand::mouseUp( const Point& point, float* viewProj )
     {
       addEndPosition( point );
       generate( );
-
-      //Do the transform feedback with _startPoint & _endPoint
-      _tf->program( )->use( );
-      _tf->program( )->sendUniform4m( "viewProj", viewProj );
-      _tf->program( )->sendUniform2v( "bsMin", _bsMin );
-      _tf->program( )->sendUniform2v( "bsMax", _bsMax );
-      _tf->draw( );
+      select( viewProj );
+      _previewed = false;
+      _pendingPreview = false;
 
       //Remove rubberband
       clearPositions( );
@@ -140,6 +170,37 @@ namespace reto
       _tf->removeObject( object );
     }
 
+    void RubberBand::setCulling( reto::CullingSystem* culling )
+    {
+      _tf->setCulling( culling );
+    }
+
+    void RubberBand::setComputeSelection( bool enabled )
+    {
+      _tf->setComputeSelection( enabled );
+    }
+
+    void RubberBand::setBoundsTest( bool enabled )
+    {
+      _boundsTest = enabled;
+    }
+
+    void RubberBand::setLivePreview( bool enabled, float interval )
+    {
+      _livePreview = enabled;
+      _previewInterval = std::chrono::duration< float >( interval );
+    }
+
+    bool RubberBand::livePreview( void ) const
+    {
+      return _livePreview;
+    }
+
+    reto::TransformFeedback* const& RubberBand::transformFeedback( void ) const
+    {
+      return _tf;
+    }
+
     void RubberBand::create( void )
     {
       //Vars
@@ -172,6 +233,32 @@ namespace reto
         &_positions[ 0 ], GL_DYNAMIC_DRAW );
     }
 
+    void RubberBand::select( float* viewProj )
+    {
+      //Do the transform feedback with _startPoint & _endPoint
+      _tf->program( )->use( );
+      _tf->program( )->sendUniform4m( "viewProj", viewProj );
+      _tf->program( )->sendUniform2v( "bsMin", _bsMin );
+      _tf->program( )->sendUniform2v( "bsMax", _bsMax );
+      if ( _boundsTest )
+      {
+        // Objects away from the change since the last preview keep their
+        // result
+        SelectionRegion region;
+        region.setRectangle( _bsMin.data( ), _bsMax.data( ));
+        region.setViewProj( viewProj );
+        if ( _previewed )
+          region.setPrevious( _previewRegion );
+        _tf->draw( region );
+        _previewRegion = region;
+      }
+      else
+      {
+        _tf->draw( );
+      }
+      _previewed = _boundsTest;
+    }
+
     void RubberBand::drawLine( void )
     {
       glLineWidth( _lineWidth );
@@ -285,6 +372,8 @@ namespace reto
       "}\n");
     }
 
+    // Follows the shader contract of TransformFeedback: #version 430,
+    // position at location 0, model defined by TransformFeedback
     std::string RubberBand::_VertexCodeTransformFeedback( void ) const
     {
       return std::string("#version 430\n"
@@ -293,7 +382,6 @@ namespace reto
         "uniform vec2 bsMax;\n"
         "out float insideBS;\n"
         "uniform mat4 viewProj;\n"
-        "uniform mat4 model;\n"
 
         "float inBS( in vec2 bbMin, in vec2 bbMax, in vec2 p )\n"
         "{\n"
@@ -309,11 +397,32 @@ namespace reto
         "}");
     }
 
+    std::string RubberBand::_ComputeCodeSelection( void ) const
+    {
+      return std::string(
+        "uniform vec2 bsMin;\n"
+        "uniform vec2 bsMax;\n"
+        "uniform mat4 viewProj;\n"
+
+        "float inside( vec3 position, mat4 model )\n"
+        "{\n"
+        "  vec4 p = viewProj * model * vec4( position, 1.0 );\n"
+        "  vec2 ndcSpace = p.xy / p.w;\n"
+        "  vec2 s = step( bsMin, ndcSpace ) - step( bsMax, ndcSpace );\n"
+        "  return s.x * s.y;\n"
+        "}\n");
+    }
+
     Lasso::Lasso( const unsigned int& width, const unsigned int& height )
       : _color( Eigen::Vector4f::Zero(4) )
       , _lineWidth( 1.0f )
       , _width( width )
       , _height( height )
+      , _boundsTest( true )
+      , _livePreview( false )
+      , _previewInterval( 1.0f / 60.0f )
+      , _previewed( false )
+      , _pendingPreview( false )
       ,  _programLine( new reto::ShaderProgram( ) )
       ,  _programFilling( new reto::ShaderProgram( ) )
     {
@@ -350,7 +459,7 @@ namespace reto
 
       //Create Transform Feedback
       _tf = new reto::TransformFeedback( _VertexCodeTransformFeedback( ),
-        { "insideBS" }, GL_SEPARATE_ATTRIBS );
+        { "insideBS" }, GL_SEPARATE_ATTRIBS, _ComputeCodeSelection( ));
     }
 
     Lasso::~Lasso( void )
@@ -390,13 +499,7 @@ namespace reto
 
       //Filling
       //First pass
-      _fb->bind( );
-      glClearColor( 0.0f, 0.5f, 0.0f, 0.0f ); //watch out!
-      glClear( GL_COLOR_BUFFER_BIT );
-      glViewport(0, 0, _width, _height);
-      _programFilling->use( );
-      drawFilling( );
-      _fb->unbind( );
+      fill( );
 
       //Second pass
       glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
@@ -416,6 +519,9 @@ namespace reto
     {
       addPosition( point );
       generate( );
+      _lastPreview = std::chrono::steady_clock::time_point( );
+      _previewed = false;
+      _pendingPreview = false;
     }
 
     void Lasso::mouseMove( const Point& point )
@@ -425,15 +531,39 @@ namespace reto
       generate( );
     }
 
+    void Lasso::mouseMove( const Point& point, float* viewProj )
+    {
+      mouseMove( point );
+      if ( !_livePreview )
+        return;
+
+      // At most one preview per interval, skipped moves stay pending
+      // until the next move or flushPreview
+      _pendingPreview = true;
+      flushPreview( viewProj );
+    }
+
+    bool Lasso::flushPreview( float* viewProj )
+    {
+      if ( !_pendingPreview )
+        return false;
+
+      const auto now = std::chrono::steady_clock::now( );
+      if ( now - _lastPreview < _previewInterval )
+        return false;
+      _lastPreview = now;
+      _pendingPreview = false;
+      select( viewProj );
+      return true;
+    }
+
     void Lasso::mouseUp( const Point& point, float* viewProj )
     {
       addPosition( point );
       generate(  );
-
-      //Do the transform feedback
-      _tf->program( )->use( );
-      _tf->program( )->sendUniform4m( "viewProj", viewProj );
-      _tf->draw( );
+      select( viewProj );
+      _previewed = false;
+      _pendingPreview = false;
 
       //Remove lasso
       clearPositions( );
@@ -459,6 +589,37 @@ namespace reto
       _tf->removeObject( object );
     }
 
+    void Lasso::setCulling( reto::CullingSystem* culling )
+    {
+      _tf->setCulling( culling );
+    }
+
+    void Lasso::setComputeSelection( bool enabled )
+    {
+      _tf->setComputeSelection( enabled );
+    }
+
+    void Lasso::setBoundsTest( bool enabled )
+    {
+      _boundsTest = enabled;
+    }
+
+    void Lasso::setLivePreview( bool enabled, float interval )
+    {
+      _livePreview = enabled;
+      _previewInterval = std::chrono::duration< float >( interval );
+    }
+
+    bool Lasso::livePreview( void ) const
+    {
+      return _livePreview;
+    }
+
+    reto::TransformFeedback* const& Lasso::transformFeedback( void ) const
+    {
+      return _tf;
+    }
+
     void Lasso::create( void )
     {
       //Vars
@@ -485,6 +646,36 @@ namespace reto
         &_positions[ 0 ], GL_DYNAMIC_DRAW );
     }
 
+    void Lasso::select( float* viewProj )
+    {
+      // The selection reads the filling of the current positions
+      fill( );
+
+      //Do the transform feedback, sampling the filling in unit 0
+      _fb->bindAttachments( );
+      _tf->program( )->use( );
+      _tf->program( )->sendUniformi( "colorTex", 0 );
+      _tf->program( )->sendUniform4m( "viewProj", viewProj );
+      if ( _boundsTest )
+      {
+        // The texture of the lasso is exact up to a pixel. Objects away
+        // from the change since the last preview keep their result
+        SelectionRegion region;
+        region.setLasso( _positions );
+        region.setViewProj( viewProj );
+        region.setMargin( 2.0f / _width, 2.0f / _height );
+        if ( _previewed )
+          region.setPrevious( _previewRegion );
+        _tf->draw( region );
+        _previewRegion = region;
+      }
+      else
+      {
+        _tf->draw( );
+      }
+      _previewed = _boundsTest;
+    }
+
     void Lasso::drawLine( void )
     {
       glLineWidth( _lineWidth );
@@ -511,6 +702,33 @@ namespace reto
       glEnable( GL_CULL_FACE );
     }
 
+    void Lasso::fill( void )
+    {
+      // Clear color, viewport and framebuffers are kept for the caller
+      GLfloat clearColor[ 4 ];
+      GLint viewport[ 4 ];
+      GLint drawFramebuffer, readFramebuffer;
+      glGetFloatv( GL_COLOR_CLEAR_VALUE, clearColor );
+      glGetIntegerv( GL_VIEWPORT, viewport );
+      glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer );
+      glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer );
+
+      glBindVertexArray( _vao );
+      _fb->bind( );
+      glClearColor( 0.0f, 0.0f, 0.0f, 0.0f ); //watch out!
+      glClear( GL_COLOR_BUFFER_BIT );
+      glViewport(0, 0, _width, _height);
+      _programFilling->use( );
+      drawFilling( );
+      glBindFramebuffer( GL_DRAW_FRAMEBUFFER, drawFramebuffer );
+      glBindFramebuffer( GL_READ_FRAMEBUFFER, readFramebuffer );
+      glBindVertexArray( 0 );
+
+      glClearColor( clearColor[ 0 ], clearColor[ 1 ], clearColor[ 2 ],
+        clearColor[ 3 ]);
+      glViewport( viewport[ 0 ], viewport[ 1 ], viewport[ 2 ], viewport[ 3 ]);
+    }
+
     std::vector< float > Lasso::normalize( const reto::Point& point ) const
     {
       return
@@ -609,26 +827,18 @@ namespace reto
         "void main( void )\n"
         "{\n"
         "  vec2 tex = vec4( texture( colorTex, texCoord ) ).rg;\n"
-        "  float substract = tex.r - tex.g;\n"
-        "  if ( substract == 0.0 )\n"
+        "  // Fan triangles covering the pixel, inside when odd\n"
+        "  float count = floor(( tex.r + tex.g ) * 255.0 + 0.5 );\n"
+        "  if ( mod( count, 2.0 ) == 0.0 )\n"
         "  {\n"
         "    discard;\n"
         "  }\n"
-        "  else\n"
-        "  {\n"
-        "    if ( mod( floor( abs( substract) * 255.0 ), 2.0 ) == 0.0 )\n"
-        "    {\n"
-        "      outColor = color;\n"
-        "    }\n"
-        "    else\n"
-        "    {\n"
-        "      discard;\n"
-        "    }\n"
-        "  }\n"
+        "  outColor = color;\n"
 
         "}\n");
     }
 
+    // Same contract as the RubberBand shader
     std::string Lasso::_VertexCodeTransformFeedback( void ) const
     {
       return std::string("#version 430\n"
@@ -636,7 +846,6 @@ namespace reto
         "in vec2 texCoord;\n"
         "uniform sampler2D colorTex;\n"
         "uniform mat4 viewProj;\n"
-        "uniform mat4 model;\n"
         "out float insideBS;\n"
 
         "void main( void )\n"
@@ -645,22 +854,25 @@ namespace reto
         "  vec2 ndcSpace = p.xy / p.w;\n"
         "  vec2 texCoord = ( ndcSpace + vec2( 1.0, 1.0 ) ) / 2.0;\n"
         "  vec2 tex = vec4( texture( colorTex, texCoord ) ).rg;\n"
-        "  float substract = tex.r - tex.g;\n"
-        "  if ( substract == 0.0 )\n"
-        "  {\n"
-        "    insideBS = 0.0;\n"
-        "  }\n"
-        "  else\n"
-        "  {\n"
-        "    if ( mod( floor( abs( substract ) * 255.0 ), 2.0 ) == 0.0 )\n"
-        "    {\n"
-        "      insideBS = 1.0;\n"
-        "    }\n"
-        "    else\n"
-        "    {\n"
-        "      insideBS = 0.0;\n"
-        "    }\n"
-        "  }\n"
+        "  // Fan triangles covering the vertex, inside when odd\n"
+        "  float count = floor(( tex.r + tex.g ) * 255.0 + 0.5 );\n"
+        "  insideBS = mod( count, 2.0 );\n"
+        "}\n");
+    }
+
+    std::string Lasso::_ComputeCodeSelection( void ) const
+    {
+      return std::string(
+        "uniform sampler2D colorTex;\n"
+        "uniform mat4 viewProj;\n"
+
+        "float inside( vec3 position, mat4 model )\n"
+        "{\n"
+        "  vec4 p = viewProj * model * vec4( position, 1.0 );\n"
+        "  vec2 ndcSpace = p.xy / p.w;\n"
+        "  vec2 texCoord = ( ndcSpace + vec2( 1.0, 1.0 ) ) / 2.0;\n"
+        "  vec2 tex = textureLod( colorTex, texCoord, 0.0 ).rg;\n"
+        "  return mod( floor(( tex.r + tex.g ) * 255.0 + 0.5 ), 2.0 );\n"
         "}\n");
     }
 
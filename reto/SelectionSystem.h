@@ -25,6 +25,7 @@
 #define __RETO__SELECTION_SYSTEM__
 
 //std
+#include <chrono>
 #include <vector>
 
 //glew
@@ -110,6 +111,15 @@ namespace reto
         RETO_API
         void mouseMove( const Point& point );
 
+        /**
+         * Method used on mouse move callback to get a point and, with live
+         * preview, update the selection
+         * @param point: last point of the selection (while moving)
+         * @param viewProj: view projection matrix
+         */
+        RETO_API
+        void mouseMove( const Point& point, float* viewProj );
+
         /**
          * Method used on mouse up callback to get the a point, call to
          * transform feedback and clear points
@@ -119,6 +129,15 @@ namespace reto
         RETO_API
         void mouseUp( const Point& point, float* viewProj );
 
+        /**
+         * Method to update the selection with the last move skipped by the
+         * live preview interval, meant to be called from the render loop
+         * @param viewProj: view projection matrix
+         * @return true if the selection was updated
+         */
+        RETO_API
+        bool flushPreview( float* viewProj );
+
         /**
          * Method to get program handler for line and filling
          * @return program handler.
@@ -140,6 +159,61 @@ namespace reto
         RETO_API
         void removeObject( reto::Pickable* object );
 
+        /**
+         * Method to skip the objects outside the frustum of a culling
+         * system in the selection
+         * @param culling: Culling system ( nullptr to test all objects )
+         * @see TransformFeedback::setCulling
+         */
+        RETO_API
+        void setCulling( reto::CullingSystem* culling );
+
+        /**
+         * Method to test the objects with a compute shader instead of
+         * transform feedback
+         * @param enabled: Compute selection flag ( default = false )
+         * @see TransformFeedback::setComputeSelection
+         */
+        RETO_API
+        void setComputeSelection( bool enabled );
+
+        /**
+         * Method to classify whole objects by their projected bounds
+         * before testing their vertices
+         * @param enabled: Bounds test flag ( default = true )
+         * @see TransformFeedback::draw( const SelectionRegion& )
+         */
+        RETO_API
+        void setBoundsTest( bool enabled );
+
+        /**
+         * Method to update the selection while the mouse moves, on the
+         * mouseMove calls with a view projection matrix. Previews are
+         * throttled to one per interval, and with the bounds test they
+         * only test the objects near the area changed since the previous
+         * one, as does the final selection of mouseUp. A move skipped by
+         * the interval is previewed by the next one or by flushPreview.
+         * @param enabled: Live preview flag ( default = false )
+         * @param interval: Minimum seconds between previews
+         *   ( default = 1/60 )
+         */
+        RETO_API
+        void setLivePreview( bool enabled, float interval = 1.0f / 60.0f );
+
+        /**
+         * Method to check if the live preview is enabled
+         * @return bool
+         */
+        RETO_API
+        bool livePreview( void ) const;
+
+        /**
+         * Method to get the transform feedback of the selection
+         * @return transform feedback handler.
+         */
+        RETO_API
+        reto::TransformFeedback* const& transformFeedback( void ) const;
+
       private:
 
         //! Selection color
@@ -166,6 +240,27 @@ namespace reto
         //!Transform Feedback
         reto::TransformFeedback* _tf;
 
+        //! Bounds test flag
+        bool _boundsTest;
+
+        //! Live preview flag
+        bool _livePreview;
+
+        //! Minimum time between previews
+        std::chrono::duration< float > _previewInterval;
+
+        //! Time of the last preview
+        std::chrono::steady_clock::time_point _lastPreview;
+
+        //! Region of the last selection, compared with the next one
+        reto::SelectionRegion _previewRegion;
+
+        //! Flag of a previous region in the current selection
+        bool _previewed;
+
+        //! Flag of a move not previewed yet because of the interval
+        bool _pendingPreview;
+
         //! Shader program for
         reto::ShaderProgram* _program;
 
@@ -191,6 +286,12 @@ namespace reto
          */
         void generate( void );
 
+        /**
+         * Method to select the objects inside the current positions
+         * @param viewProj: view projection matrix
+         */
+        void select( float* viewProj );
+
         /**
          * Method to draw rubberband line
          */
@@ -258,6 +359,12 @@ namespace reto
          */
         std::string _VertexCodeTransformFeedback( void ) const;
 
+        /**
+         * Method to return compute selection inside function code
+         * @return Compute shader code.
+         */
+        std::string _ComputeCodeSelection( void ) const;
+
     }; /* class RubberBand */
 
     /**
@@ -325,6 +432,15 @@ namespace reto
         RETO_API
         void mouseMove( const Point& point );
 
+        /**
+         * Method used on mouse move callback to get a point and, with live
+         * preview, update the selection
+         * @param point: next point of the selection
+         * @param viewProj: view projection matrix
+         */
+        RETO_API
+        void mouseMove( const Point& point, float* viewProj );
+
         /**
          * Method used on mouse up callback to get the a point, call to
          * transform feedback and clear points
@@ -334,6 +450,15 @@ namespace reto
         RETO_API
         void mouseUp( const Point& point, float* viewProj );
 
+        /**
+         * Method to update the selection with the last move skipped by the
+         * live preview interval, meant to be called from the render loop
+         * @param viewProj: view projection matrix
+         * @return true if the selection was updated
+         */
+        RETO_API
+        bool flushPreview( float* viewProj );
+
         /**
          * Method to get program handler for line
          * @return program handler.
@@ -362,6 +487,61 @@ namespace reto
         RETO_API
         void removeObject( reto::Pickable* object );
 
+        /**
+         * Method to skip the objects outside the frustum of a culling
+         * system in the selection
+         * @param culling: Culling system ( nullptr to test all objects )
+         * @see TransformFeedback::setCulling
+         */
+        RETO_API
+        void setCulling( reto::CullingSystem* culling );
+
+        /**
+         * Method to test the objects with a compute shader instead of
+         * transform feedback
+         * @param enabled: Compute selection flag ( default = false )
+         * @see TransformFeedback::setComputeSelection
+         */
+        RETO_API
+        void setComputeSelection( bool enabled );
+
+        /**
+         * Method to classify whole objects by their projected bounds
+         * before testing their vertices
+         * @param enabled: Bounds test flag ( default = true )
+         * @see TransformFeedback::draw( const SelectionRegion& )
+         */
+        RETO_API
+        void setBoundsTest( bool enabled );
+
+        /**
+         * Method to update the selection while the mouse moves, on the
+         * mouseMove calls with a view projection matrix. Previews are
+         * throttled to one per interval, and with the bounds test they
+         * only test the objects near the area changed since the previous
+         * one, as does the final selection of mouseUp. A move skipped by
+         * the interval is previewed by the next one or by flushPreview.
+         * @param enabled: Live preview flag ( default = false )
+         * @param interval: Minimum seconds between previews
+         *   ( default = 1/60 )
+         */
+        RETO_API
+        void setLivePreview( bool enabled, float interval = 1.0f / 60.0f );
+
+        /**
+         * Method to check if the live preview is enabled
+         * @return bool
+         */
+        RETO_API
+        bool livePreview( void ) const;
+
+        /**
+         * Method to get the transform feedback of the selection
+         * @return transform feedback handler.
+         */
+        RETO_API
+        reto::TransformFeedback* const& transformFeedback( void ) const;
+
       private:
 
         //! Selection color
@@ -388,6 +568,27 @@ namespace reto
         //!Transform Feedback
         reto::TransformFeedback* _tf;
 
+        //! Bounds test flag
+        bool _boundsTest;
+
+        //! Live preview flag
+        bool _livePreview;
+
+        //! Minimum time between previews
+        std::chrono::duration< float > _previewInterval;
+
+        //! Time of the last preview
+        std::chrono::steady_clock::time_point _lastPreview;
+
+        //! Region of the last selection, compared with the next one
+        reto::SelectionRegion _previewRegion;
+
+        //! Flag of a previous region in the current selection
+        bool _previewed;
+
+        //! Flag of a move not previewed yet because of the interval
+        bool _pendingPreview;
+
         //! Shader program for line
         reto::ShaderProgram* _programLine;
 
@@ -407,6 +608,12 @@ namespace reto
          */
         void generate( void );
 
+        /**
+         * Method to select the objects inside the current positions
+         * @param viewProj: view projection matrix
+         */
+        void select( float* viewProj );
+
         /**
          * Method to draw lasso line
          */
@@ -417,6 +624,12 @@ namespace reto
          */
         void drawFilling( void );
 
+        /**
+         * Method to render the lasso filling to the framebuffer texture
+         * read by the selection
+         */
+        void fill( void );
+
         /**
          * Method to normalize a point
          * @param point: screen point.
@@ -482,6 +695,12 @@ namespace reto
          */
         std::string _VertexCodeTransformFeedback( void ) const;
 
+        /**
+         * Method to return compute selection inside function code
+         * @return Compute shader code.
+         */
+        std::string _ComputeCodeSelection( void ) const;
+
     }; /* class Lasso */
 
   } /* namespace SelectionSystem */
@@ -495,6 +495,10 @@ namespace reto
         glGetActiveAttrib( this->_program, (GLuint)i, bufSize, &length,
             &size, &type, name);
 
+        // Some drivers list gl_VertexID and gl_InstanceID as attributes
+        if ( std::string( name ).compare( 0, 3, "gl_" ) == 0 )
+          continue;
+
         this->addAttribute( name );
 
         //printf("Attribute #%d Type: %u Name: %s\n", i, type, name);
@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "TangentGenerator.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __SSE2__ ) || \
+  ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #define RETO_TANGENTS_SSE
+  #include <emmintrin.h>
+  #if defined( _MSC_VER )
+    #define RETO_TANGENTS_AVX2
+    #define RETO_TARGET_AVX2
+    #include <immintrin.h>
+    #include <intrin.h>
+  #elif defined( __clang__ ) || \
+    ( defined( __GNUC__ ) && ( __GNUC__ * 100 + __GNUC_MINOR__ >= 409 ))
+    #define RETO_TANGENTS_AVX2
+    #define RETO_TARGET_AVX2 __attribute__(( target( "avx2" )))
+    #include <immintrin.h>
+  #endif
+#endif
+
+namespace reto
+{
+  namespace
+  {
+    //! Triangles or vertices per parallel task
+    const size_t BLOCK_SIZE = 16384;
+
+    //! Input arrays
+    struct Mesh
+    {
+      const float* vertices;
+      const float* texCoords;
+      const int* indices;
+    };
+
+    //! Normalized frame of each triangle, one array per component
+    struct Frames
+    {
+      float* t[ 3 ];
+      float* b[ 3 ];
+    };
+
+    typedef void ( *FrameKernel )( const Mesh&, size_t, size_t,
+      const Frames& );
+
+    void framesScalar( const Mesh& mesh, size_t first, size_t last,
+      const Frames& out )
+    {
+      for ( size_t t = first; t < last; ++t )
+      {
+        const int* c = mesh.indices + t * 3;
+        const float* p0 = mesh.vertices + size_t( c[ 0 ]) * 3;
+        const float* p1 = mesh.vertices + size_t( c[ 1 ]) * 3;
+        const float* p2 = mesh.vertices + size_t( c[ 2 ]) * 3;
+        const float* uv0 = mesh.texCoords + size_t( c[ 0 ]) * 2;
+        const float* uv1 = mesh.texCoords + size_t( c[ 1 ]) * 2;
+        const float* uv2 = mesh.texCoords + size_t( c[ 2 ]) * 2;
+
+        const float du1 = uv1[ 0 ] - uv0[ 0 ];
+        const float dv1 = uv1[ 1 ] - uv0[ 1 ];
+        const float du2 = uv2[ 0 ] - uv0[ 0 ];
+        const float dv2 = uv2[ 1 ] - uv0[ 1 ];
+        const float aux = du1 * dv2 - dv1 * du2;
+        const float f = aux != 0.0f ? 1.0f / aux : 0.0f;
+
+        float tangent[ 3 ];
+        float bitangent[ 3 ];
+        for ( int k = 0; k < 3; ++k )
+        {
+          const float dp1 = p1[ k ] - p0[ k ];
+          const float dp2 = p2[ k ] - p0[ k ];
+          tangent[ k ] = f * ( dv2 * dp1 - dv1 * dp2 );
+          bitangent[ k ] = f * ( du1 * dp2 - du2 * dp1 );
+        }
+
+        const float tLength = sqrtf( tangent[ 0 ] * tangent[ 0 ] +
+          tangent[ 1 ] * tangent[ 1 ] + tangent[ 2 ] * tangent[ 2 ]);
+        const float bLength = sqrtf( bitangent[ 0 ] * bitangent[ 0 ] +
+          bitangent[ 1 ] * bitangent[ 1 ] + bitangent[ 2 ] * bitangent[ 2 ]);
+        for ( int k = 0; k < 3; ++k )
+        {
+          out.t[ k ][ t ] = tLength != 0.0f ?
+            tangent[ k ] / tLength : tangent[ k ];
+          out.b[ k ][ t ] = bLength != 0.0f ?
+            bitangent[ k ] / bLength : bitangent[ k ];
+        }
+      }
+    }
+
+#ifdef RETO_TANGENTS_SSE
+    void framesSSE( const Mesh& mesh, size_t first, size_t last,
+      const Frames& out )
+    {
+      const __m128 zero = _mm_setzero_ps( );
+      const __m128 one = _mm_set1_ps( 1.0f );
+      size_t t = first;
+      for ( ; t + 4 <= last; t += 4 )
+      {
+        // Transpose the corners of 4 triangles to one register per
+        // component
+        const int* c = mesh.indices + t * 3;
+        __m128 p[ 3 ][ 3 ];
+        __m128 uv[ 3 ][ 2 ];
+        for ( int corner = 0; corner < 3; ++corner )
+        {
+          const float* a = mesh.vertices + size_t( c[ corner ]) * 3;
+          const float* b = mesh.vertices + size_t( c[ corner + 3 ]) * 3;
+          const float* d = mesh.vertices + size_t( c[ corner + 6 ]) * 3;
+          const float* e = mesh.vertices + size_t( c[ corner + 9 ]) * 3;
+          for ( int k = 0; k < 3; ++k )
+            p[ corner ][ k ] = _mm_setr_ps( a[ k ], b[ k ], d[ k ], e[ k ]);
+
+          a = mesh.texCoords + size_t( c[ corner ]) * 2;
+          b = mesh.texCoords + size_t( c[ corner + 3 ]) * 2;
+          d = mesh.texCoords + size_t( c[ corner + 6 ]) * 2;
+          e = mesh.texCoords + size_t( c[ corner + 9 ]) * 2;
+          for ( int k = 0; k < 2; ++k )
+            uv[ corner ][ k ] = _mm_setr_ps( a[ k ], b[ k ], d[ k ], e[ k ]);
+        }
+
+        const __m128 du1 = _mm_sub_ps( uv[ 1 ][ 0 ], uv[ 0 ][ 0 ]);
+        const __m128 dv1 = _mm_sub_ps( uv[ 1 ][ 1 ], uv[ 0 ][ 1 ]);
+        const __m128 du2 = _mm_sub_ps( uv[ 2 ][ 0 ], uv[ 0 ][ 0 ]);
+        const __m128 dv2 = _mm_sub_ps( uv[ 2 ][ 1 ], uv[ 0 ][ 1 ]);
+        const __m128 aux = _mm_sub_ps( _mm_mul_ps( du1, dv2 ),
+          _mm_mul_ps( dv1, du2 ));
+        const __m128 f = _mm_and_ps( _mm_cmpneq_ps( aux, zero ),
+          _mm_div_ps( one, aux ));
+
+        __m128 tangent[ 3 ];
+        __m128 bitangent[ 3 ];
+        for ( int k = 0; k < 3; ++k )
+        {
+          const __m128 dp1 = _mm_sub_ps( p[ 1 ][ k ], p[ 0 ][ k ]);
+          const __m128 dp2 = _mm_sub_ps( p[ 2 ][ k ], p[ 0 ][ k ]);
+          tangent[ k ] = _mm_mul_ps( f, _mm_sub_ps( _mm_mul_ps( dv2, dp1 ),
+            _mm_mul_ps( dv1, dp2 )));
+          bitangent[ k ] = _mm_mul_ps( f, _mm_sub_ps( _mm_mul_ps( du1, dp2 ),
+            _mm_mul_ps( du2, dp1 )));
+        }
+
+        const __m128 tLength = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps(
+          _mm_mul_ps( tangent[ 0 ], tangent[ 0 ]),
+          _mm_mul_ps( tangent[ 1 ], tangent[ 1 ])),
+          _mm_mul_ps( tangent[ 2 ], tangent[ 2 ])));
+        const __m128 bLength = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps(
+          _mm_mul_ps( bitangent[ 0 ], bitangent[ 0 ]),
+          _mm_mul_ps( bitangent[ 1 ], bitangent[ 1 ])),
+          _mm_mul_ps( bitangent[ 2 ], bitangent[ 2 ])));
+        const __m128 tMask = _mm_cmpneq_ps( tLength, zero );
+        const __m128 bMask = _mm_cmpneq_ps( bLength, zero );
+        for ( int k = 0; k < 3; ++k )
+        {
+          const __m128 tUnit = _mm_div_ps( tangent[ k ], tLength );
+          const __m128 bUnit = _mm_div_ps( bitangent[ k ], bLength );
+          _mm_storeu_ps( out.t[ k ] + t, _mm_or_ps(
+            _mm_and_ps( tMask, tUnit ), _mm_andnot_ps( tMask, tangent[ k ])));
+          _mm_storeu_ps( out.b[ k ] + t, _mm_or_ps(
+            _mm_and_ps( bMask, bUnit ),
+            _mm_andnot_ps( bMask, bitangent[ k ])));
+        }
+      }
+      framesScalar( mesh, t, last, out );
+    }
+#endif
+
+#ifdef RETO_TANGENTS_AVX2
+    RETO_TARGET_AVX2
+    void framesAVX2( const Mesh& mesh, size_t first, size_t last,
+      const Frames& out )
+    {
+      const __m256 zero = _mm256_setzero_ps( );
+      const __m256 one = _mm256_set1_ps( 1.0f );
+      const __m256i stride = _mm256_setr_epi32( 0, 3, 6, 9, 12, 15, 18, 21 );
+      const __m256i three = _mm256_set1_epi32( 3 );
+      size_t t = first;
+      for ( ; t + 8 <= last; t += 8 )
+      {
+        // Gather the corners of 8 triangles, one register per component
+        const int* c = mesh.indices + t * 3;
+        __m256 p[ 3 ][ 3 ];
+        __m256 uv[ 3 ][ 2 ];
+        for ( int corner = 0; corner < 3; ++corner )
+        {
+          const __m256i index =
+            _mm256_i32gather_epi32( c + corner, stride, 4 );
+          const __m256i vertex = _mm256_mullo_epi32( index, three );
+          const __m256i texCoord = _mm256_add_epi32( index, index );
+          for ( int k = 0; k < 3; ++k )
+            p[ corner ][ k ] =
+              _mm256_i32gather_ps( mesh.vertices + k, vertex, 4 );
+          for ( int k = 0; k < 2; ++k )
+            uv[ corner ][ k ] =
+              _mm256_i32gather_ps( mesh.texCoords + k, texCoord, 4 );
+        }
+
+        const __m256 du1 = _mm256_sub_ps( uv[ 1 ][ 0 ], uv[ 0 ][ 0 ]);
+        const __m256 dv1 = _mm256_sub_ps( uv[ 1 ][ 1 ], uv[ 0 ][ 1 ]);
+        const __m256 du2 = _mm256_sub_ps( uv[ 2 ][ 0 ], uv[ 0 ][ 0 ]);
+        const __m256 dv2 = _mm256_sub_ps( uv[ 2 ][ 1 ], uv[ 0 ][ 1 ]);
+        const __m256 aux = _mm256_sub_ps( _mm256_mul_ps( du1, dv2 ),
+          _mm256_mul_ps( dv1, du2 ));
+        const __m256 f = _mm256_and_ps(
+          _mm256_cmp_ps( aux, zero, _CMP_NEQ_UQ ), _mm256_div_ps( one, aux ));
+
+        __m256 tangent[ 3 ];
+        __m256 bitangent[ 3 ];
+        for ( int k = 0; k < 3; ++k )
+        {
+          const __m256 dp1 = _mm256_sub_ps( p[ 1 ][ k ], p[ 0 ][ k ]);
+          const __m256 dp2 = _mm256_sub_ps( p[ 2 ][ k ], p[ 0 ][ k ]);
+          tangent[ k ] = _mm256_mul_ps( f, _mm256_sub_ps(
+            _mm256_mul_ps( dv2, dp1 ), _mm256_mul_ps( dv1, dp2 )));
+          bitangent[ k ] = _mm256_mul_ps( f, _mm256_sub_ps(
+            _mm256_mul_ps( du1, dp2 ), _mm256_mul_ps( du2, dp1 )));
+        }
+
+        const __m256 tLength = _mm256_sqrt_ps( _mm256_add_ps( _mm256_add_ps(
+          _mm256_mul_ps( tangent[ 0 ], tangent[ 0 ]),
+          _mm256_mul_ps( tangent[ 1 ], tangent[ 1 ])),
+          _mm256_mul_ps( tangent[ 2 ], tangent[ 2 ])));
+        const __m256 bLength = _mm256_sqrt_ps( _mm256_add_ps( _mm256_add_ps(
+          _mm256_mul_ps( bitangent[ 0 ], bitangent[ 0 ]),
+          _mm256_mul_ps( bitangent[ 1 ], bitangent[ 1 ])),
+          _mm256_mul_ps( bitangent[ 2 ], bitangent[ 2 ])));
+        const __m256 tMask = _mm256_cmp_ps( tLength, zero, _CMP_NEQ_UQ );
+        const __m256 bMask = _mm256_cmp_ps( bLength, zero, _CMP_NEQ_UQ );
+        for ( int k = 0; k < 3; ++k )
+        {
+          _mm256_storeu_ps( out.t[ k ] + t, _mm256_blendv_ps( tangent[ k ],
+            _mm256_div_ps( tangent[ k ], tLength ), tMask ));
+          _mm256_storeu_ps( out.b[ k ] + t, _mm256_blendv_ps( bitangent[ k ],
+            _mm256_div_ps( bitangent[ k ], bLength ), bMask ));
+        }
+      }
+      framesScalar( mesh, t, last, out );
+    }
+
+    bool cpuHasAVX2( void )
+    {
+  #ifdef _MSC_VER
+      int info[ 4 ];
+      __cpuid( info, 0 );
+      if ( info[ 0 ] < 7 )
+        return false;
+      // AVX state must also be enabled by the operating system
+      __cpuid( info, 1 );
+      if (( info[ 2 ] & ( 1 << 27 )) == 0 || ( info[ 2 ] & ( 1 << 28 )) == 0 ||
+        ( _xgetbv( 0 ) & 6 ) != 6 )
+        return false;
+      __cpuidex( info, 7, 0 );
+      return ( info[ 1 ] & ( 1 << 5 )) != 0;
+  #else
+      __builtin_cpu_init( );
+      return __builtin_cpu_supports( "avx2" ) != 0;
+  #endif
+    }
+#endif
+
+    FrameKernel frameKernel( SimdLevel level )
+    {
+      switch ( level )
+      {
+#ifdef RETO_TANGENTS_AVX2
+      case SimdLevel::AVX2:
+        return framesAVX2;
+#endif
+#ifdef RETO_TANGENTS_SSE
+      case SimdLevel::SSE:
+        return framesSSE;
+#endif
+      default:
+        return framesScalar;
+      }
+    }
+
+    inline void normalize( float* v )
+    {
+      const float length = sqrtf( v[ 0 ] * v[ 0 ] + v[ 1 ] * v[ 1 ] +
+        v[ 2 ] * v[ 2 ]);
+      if ( length > 0.0f )
+      {
+        v[ 0 ] /= length;
+        v[ 1 ] /= length;
+        v[ 2 ] /= length;
+      }
+    }
+
+    // Run task( first, last ) over [ 0, count ) in blocks, on the pool when
+    // there is more than one block
+    template < typename Task >
+    void forBlocks( ThreadPool* pool, size_t count, const Task& task )
+    {
+      const size_t blocks = ( count + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+      if ( !pool || pool->size( ) < 2 || blocks < 2 )
+      {
+        task( size_t( 0 ), count );
+        return;
+      }
+      pool->parallelFor( blocks, [ & ]( size_t block )
+      {
+        const size_t first = block * BLOCK_SIZE;
+        task( first, std::min( first + BLOCK_SIZE, count ));
+      });
+    }
+  }
+
+  TangentGenerator::TangentGenerator( void )
+    : _simdLevel( supportedSimdLevel( ))
+  {
+  }
+
+  void TangentGenerator::setSimdLevel( SimdLevel level )
+  {
+    const SimdLevel supported = supportedSimdLevel( );
+    _simdLevel = level > supported ? supported : level;
+  }
+
+  SimdLevel TangentGenerator::simdLevel( void ) const
+  {
+    return _simdLevel;
+  }
+
+  SimdLevel TangentGenerator::supportedSimdLevel( void )
+  {
+#if defined( RETO_TANGENTS_AVX2 )
+    static const SimdLevel level = cpuHasAVX2( ) ?
+      SimdLevel::AVX2 : SimdLevel::SSE;
+    return level;
+#elif defined( RETO_TANGENTS_SSE )
+    return SimdLevel::SSE;
+#else
+    return SimdLevel::Scalar;
+#endif
+  }
+
+  void TangentGenerator::setThreadPool(
+    const std::shared_ptr< ThreadPool >& pool )
+  {
+    _pool = pool;
+  }
+
+  void TangentGenerator::generate( Model& model ) const
+  {
+    const size_t numVertices = model.vertices.size( ) / 3;
+    model.tangents.resize( numVertices * 3 );
+    model.bitangents.resize( numVertices * 3 );
+
+    const bool texCoords = model.texCoords.size( ) >= numVertices * 2;
+    generate( model.vertices.data( ),
+      texCoords ? model.texCoords.data( ) : nullptr, numVertices,
+      model.indices.data( ), model.indices.size( ),
+      model.tangents.data( ), model.bitangents.data( ));
+  }
+
+  void TangentGenerator::generate( const float* vertices,
+    const float* texCoords, size_t numVertices, const int* indices,
+    size_t numIndices, float* tangents, float* bitangents ) const
+  {
+    std::fill( tangents, tangents + numVertices * 3, 0.0f );
+    std::fill( bitangents, bitangents + numVertices * 3, 0.0f );
+    const size_t numTriangles = numIndices / 3;
+    if ( !texCoords || numTriangles == 0 )
+      return;
+
+    // Normalized frame of each triangle
+    std::vector< float > frameData( numTriangles * 6 );
+    Frames frames;
+    for ( int k = 0; k < 3; ++k )
+    {
+      frames.t[ k ] = frameData.data( ) + numTriangles * k;
+      frames.b[ k ] = frameData.data( ) + numTriangles * ( k + 3 );
+    }
+    const Mesh mesh = { vertices, texCoords, indices };
+    const FrameKernel kernel = frameKernel( _simdLevel );
+    ThreadPool* pool = _pool.get( );
+    forBlocks( pool, numTriangles, [ & ]( size_t first, size_t last )
+    {
+      kernel( mesh, first, last, frames );
+    });
+
+    const bool parallel = pool && pool->size( ) > 1 &&
+      numVertices > BLOCK_SIZE &&
+      numIndices <= std::numeric_limits< uint32_t >::max( );
+    if ( !parallel )
+    {
+      for ( size_t t = 0; t < numTriangles; ++t )
+      {
+        for ( int corner = 0; corner < 3; ++corner )
+        {
+          const size_t v = size_t( indices[ t * 3 + corner ]) * 3;
+          for ( int k = 0; k < 3; ++k )
+          {
+            tangents[ v + k ] += frames.t[ k ][ t ];
+            bitangents[ v + k ] += frames.b[ k ][ t ];
+          }
+        }
+      }
+      for ( size_t v = 0; v < numVertices; ++v )
+      {
+        normalize( tangents + v * 3 );
+        normalize( bitangents + v * 3 );
+      }
+      return;
+    }
+
+    // List the triangles of each vertex in triangle order, so each vertex
+    // adds its frames in the same order as the sequential loop and the
+    // result does not depend on the number of threads. Filling backwards
+    // from the end of each list leaves offsets at the list starts.
+    std::vector< uint32_t > offsets( numVertices + 1, 0 );
+    for ( size_t i = 0; i < numTriangles * 3; ++i )
+      ++offsets[ size_t( indices[ i ])];
+    for ( size_t v = 0; v < numVertices; ++v )
+      offsets[ v + 1 ] += offsets[ v ];
+    std::vector< uint32_t > triangles( numTriangles * 3 );
+    for ( size_t i = numTriangles * 3; i-- > 0; )
+      triangles[ --offsets[ size_t( indices[ i ])]] = uint32_t( i / 3 );
+
+    forBlocks( pool, numVertices, [ & ]( size_t first, size_t last )
+    {
+      for ( size_t v = first; v < last; ++v )
+      {
+        float* tangent = tangents + v * 3;
+        float* bitangent = bitangents + v * 3;
+        for ( size_t i = offsets[ v ]; i < offsets[ v + 1 ]; ++i )
+        {
+          const size_t t = triangles[ i ];
+          for ( int k = 0; k < 3; ++k )
+          {
+            tangent[ k ] += frames.t[ k ][ t ];
+            bitangent[ k ] += frames.b[ k ][ t ];
+          }
+        }
+        normalize( tangent );
+        normalize( bitangent );
+      }
+    });
+  }
+
+} /* namespace reto */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__TANGENT_GENERATOR__
+#define __RETO__TANGENT_GENERATOR__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace reto
+{
+  class ThreadPool;
+  struct Model;
+
+  /**
+   * Instruction set used to compute triangle tangent frames
+   * @enum class SimdLevel
+   */
+  enum class SimdLevel
+  {
+    Scalar,
+    SSE,
+    AVX2
+  };
+
+  /**
+   * Class to calculate per vertex tangents and bitangents of an indexed
+   * triangle mesh. Triangle frames are computed several triangles at a
+   * time in SIMD lanes, then added to the vertices of each triangle in
+   * triangle order and normalized, so the result does not depend on the
+   * number of threads.
+   * @class TangentGenerator
+   */
+  class TangentGenerator
+  {
+    public:
+      /**
+       * TangentGenerator constructor. Uses the best instruction set
+       * supported by the CPU and the calling thread only.
+       */
+      RETO_API
+      TangentGenerator( void );
+
+      /**
+       * Method to set the instruction set. Levels not supported by the CPU
+       * fall back to the best supported one.
+       * @param level: Instruction set.
+       */
+      RETO_API
+      void setSimdLevel( SimdLevel level );
+
+      /**
+       * Method to get the instruction set in use
+       * @return SimdLevel
+       */
+      RETO_API
+      SimdLevel simdLevel( void ) const;
+
+      /**
+       * Method to get the best instruction set supported by the CPU
+       * @return SimdLevel
+       */
+      RETO_API
+      static SimdLevel supportedSimdLevel( void );
+
+      /**
+       * Method to set the thread pool used to compute frames and to
+       * accumulate and normalize them
+       * @param pool: Thread pool ( nullptr to use the calling thread ).
+       */
+      RETO_API
+      void setThreadPool( const std::shared_ptr< ThreadPool >& pool );
+
+      /**
+       * Method to calculate the tangents and bitangents of a model,
+       * replacing the previous ones. Models without texture coordinates
+       * get zero vectors.
+       * @param model: Model with vertices, texCoords and indices.
+       */
+      RETO_API
+      void generate( Model& model ) const;
+
+      /**
+       * Method to calculate tangents and bitangents of raw arrays
+       * @param vertices: Positions, 3 floats per vertex.
+       * @param texCoords: Texture coordinates, 2 floats per vertex
+       *   ( nullptr gives zero vectors ).
+       * @param numVertices: Number of vertices.
+       * @param indices: Triangle indices, all lower than numVertices.
+       * @param numIndices: Number of indices. Trailing indices of an
+       *   incomplete triangle are ignored.
+       * @param tangents: Output, 3 floats per vertex.
+       * @param bitangents: Output, 3 floats per vertex.
+       */
+      RETO_API
+      void generate( const float* vertices, const float* texCoords,
+        size_t numVertices, const int* indices, size_t numIndices,
+        float* tangents, float* bitangents ) const;
+
+    private:
+      //! Instruction set in use
+      SimdLevel _simdLevel;
+
+      //! Thread pool ( null when using the calling thread )
+      std::shared_ptr< ThreadPool > _pool;
+
+  }; /* class TangentGenerator */
+
+} /* namespace reto */
+
+#endif /* __RETO__TANGENT_GENERATOR__ */
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace reto
+{
+
+  ThreadPool::ThreadPool( unsigned int numThreads )
+    : _job( nullptr )
+    , _lastJobId( 0 )
+    , _stop( false )
+  {
+    if ( numThreads == 0 )
+      numThreads = std::max( 1u, std::thread::hardware_concurrency( ));
+
+    for ( unsigned int i = 1; i < numThreads; ++i )
+      _workers.push_back( std::thread( &ThreadPool::work, this ));
+  }
+
+  ThreadPool::~ThreadPool( void )
+  {
+    {
+      std::lock_guard< std::mutex > lock( _mutex );
+      _stop = true;
+    }
+    _wake.notify_all( );
+    for ( auto& worker : _workers )
+      worker.join( );
+  }
+
+  unsigned int ThreadPool::size( void ) const
+  {
+    return static_cast< unsigned int >( _workers.size( )) + 1;
+  }
+
+  void ThreadPool::parallelFor( size_t count,
+    const std::function< void( size_t ) >& task )
+  {
+    if ( count == 0 )
+      return;
+    if ( _workers.empty( ) || count == 1 )
+    {
+      for ( size_t i = 0; i < count; ++i )
+        task( i );
+      return;
+    }
+
+    std::lock_guard< std::mutex > call( _callMutex );
+    Job job;
+    job.task = &task;
+    job.count = count;
+    job.next = 0;
+    job.pending = count;
+    job.users = 0;
+    {
+      std::lock_guard< std::mutex > lock( _mutex );
+      job.id = ++_lastJobId;
+      _job = &job;
+    }
+    _wake.notify_all( );
+
+    run( job );
+
+    std::unique_lock< std::mutex > lock( _mutex );
+    _done.wait( lock, [ &job ]( )
+      { return job.pending == 0 && job.users == 0; });
+    _job = nullptr;
+  }
+
+  void ThreadPool::run( Job& job )
+  {
+    for ( size_t i = job.next++; i < job.count; i = job.next++ )
+    {
+      ( *job.task )( i );
+      --job.pending;
+    }
+  }
+
+  void ThreadPool::work( void )
+  {
+    unsigned long lastId = 0;
+    while ( true )
+    {
+      Job* job;
+      {
+        std::unique_lock< std::mutex > lock( _mutex );
+        _wake.wait( lock, [ this, lastId ]( )
+          { return _stop || ( _job && _job->id != lastId ); });
+        if ( _stop )
+          return;
+        job = _job;
+        lastId = job->id;
+        ++job->users;
+      }
+
+      run( *job );
+
+      {
+        std::lock_guard< std::mutex > lock( _mutex );
+        --job->users;
+      }
+      _done.notify_all( );
+    }
+  }
+
+} /* namespace reto */
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__THREAD_POOL__
+#define __RETO__THREAD_POOL__
+
+#include <reto/api.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reto
+{
+  /**
+   * Class to run indexed tasks on a fixed set of worker threads
+   * @class ThreadPool
+   */
+  class ThreadPool
+  {
+    public:
+      /**
+       * ThreadPool constructor
+       * @param numThreads: Number of threads used by parallelFor, including
+       *   the calling one. 0 means one per hardware thread.
+       */
+      RETO_API
+      ThreadPool( unsigned int numThreads = 0 );
+
+      /**
+       * ThreadPool destructor. Joins the worker threads.
+       */
+      RETO_API
+      ~ThreadPool( void );
+
+      /**
+       * Method to get the number of threads used by parallelFor
+       * @return number of threads ( workers plus calling thread ).
+       */
+      RETO_API
+      unsigned int size( void ) const;
+
+      /**
+       * Method to run task( i ) for every i in [ 0, count ). Blocks until
+       * all of them have finished. The calling thread also runs tasks.
+       * Tasks must not call parallelFor on the same pool.
+       * @param count: Number of tasks.
+       * @param task: Task to run with each index.
+       */
+      RETO_API
+      void parallelFor( size_t count,
+        const std::function< void( size_t ) >& task );
+
+    private:
+      ThreadPool( const ThreadPool& );
+      ThreadPool& operator=( const ThreadPool& );
+
+      /**
+       * Struct to share a parallelFor call with the workers
+       * @struct Job
+       */
+      struct Job
+      {
+        const std::function< void( size_t ) >* task;
+        size_t count;
+        unsigned long id;
+        std::atomic< size_t > next;
+        std::atomic< size_t > pending;
+        unsigned int users;
+      };
+
+      /**
+       * Method to run tasks of a job until there are none left
+       * @param job: Job to run.
+       */
+      void run( Job& job );
+
+      /**
+       * Worker thread loop
+       */
+      void work( void );
+
+      //! Worker threads
+      std::vector< std::thread > _workers;
+
+      //! Mutex for current job and stop flag
+      std::mutex _mutex;
+
+      //! Serializes parallelFor calls
+      std::mutex _callMutex;
+
+      //! Condition to wake workers up
+      std::condition_variable _wake;
+
+      //! Condition to notify that a job has no more users
+      std::condition_variable _done;
+
+      //! Current job
+      Job* _job;
+
+      //! Last job identifier
+      unsigned long _lastJobId;
+
+      //! Stop flag
+      bool _stop;
+
+  }; /* class ThreadPool */
+
+} /* namespace reto */
+
+#endif /* __RETO__THREAD_POOL__ */
@@ -23,9 +23,9 @@
 #include "TransformFeedback.h"
 
 //std
-#include <iostream>
-#include <sstream>
 #include <algorithm>
+#include <regex>
+#include <stdexcept>
 
 // OpenGL, GLEW, GLUT.
 #include <GL/glew.h>
@@ -40,160 +40,583 @@
 
 namespace reto
 {
+  namespace
+  {
+    // Inserted after the #version line of the vertex shader
+    const char* MODEL_CODE =
+      "layout( location = 1 ) in uint retoObject;\n"
+      "layout( std430, binding = 0 ) readonly buffer RetoModels\n"
+      "{\n"
+      "  mat4 retoModels[ ];\n"
+      "};\n"
+      "#define model retoModels[ retoObject ]\n";
+
+    // Sets the bit of the object of each captured 1.0
+    const char* REDUCE_CODE =
+      "#version 430\n"
+      "layout( local_size_x = 256 ) in;\n"
+      "layout( std430, binding = 0 ) readonly buffer Capture\n"
+      "{\n"
+      "  float capture[ ];\n"
+      "};\n"
+      "layout( std430, binding = 1 ) readonly buffer Objects\n"
+      "{\n"
+      "  uint objects[ ];\n"
+      "};\n"
+      "layout( std430, binding = 2 ) buffer Flags\n"
+      "{\n"
+      "  uint flags[ ];\n"
+      "};\n"
+      "layout( std430, binding = 3 ) readonly buffer Indices\n"
+      "{\n"
+      "  uint indices[ ];\n"
+      "};\n"
+      "uniform uint firstVertex;\n"
+      "uniform uint numVertices;\n"
+      "uniform uint indexed;\n"
+      "void main( void )\n"
+      "{\n"
+      "  uint v = firstVertex + gl_GlobalInvocationID.x;\n"
+      "  if ( v >= numVertices || capture[ v ] != 1.0 )\n"
+      "    return;\n"
+      "  uint object = objects[ indexed != 0u ? indices[ v ] : v ];\n"
+      "  atomicOr( flags[ object >> 5u ], 1u << ( object & 31u ));\n"
+      "}\n";
+
+    // Counts the vertices inside the selection of each object, the inside
+    // function comes after this code. The tested vertices are the first
+    // ones, or those of an index list.
+    const char* COMPUTE_CODE =
+      "#version 430\n"
+      "layout( local_size_x = 256 ) in;\n"
+      "layout( std430, binding = 0 ) readonly buffer RetoModels\n"
+      "{\n"
+      "  mat4 retoModels[ ];\n"
+      "};\n"
+      "layout( std430, binding = 1 ) readonly buffer RetoPositions\n"
+      "{\n"
+      "  float retoPositions[ ];\n"
+      "};\n"
+      "layout( std430, binding = 2 ) readonly buffer RetoObjects\n"
+      "{\n"
+      "  uint retoObjects[ ];\n"
+      "};\n"
+      "layout( std430, binding = 3 ) buffer RetoHits\n"
+      "{\n"
+      "  uint retoHits[ ];\n"
+      "};\n"
+      "layout( std430, binding = 4 ) readonly buffer RetoIndices\n"
+      "{\n"
+      "  uint retoIndices[ ];\n"
+      "};\n"
+      "uniform uint retoNumVertices;\n"
+      "uniform uint retoIndexed;\n"
+      "float inside( vec3 position, mat4 model );\n"
+      "void main( void )\n"
+      "{\n"
+      "  uint v = ( gl_WorkGroupID.y * gl_NumWorkGroups.x +\n"
+      "    gl_WorkGroupID.x ) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;\n"
+      "  if ( v >= retoNumVertices )\n"
+      "    return;\n"
+      "  if ( retoIndexed != 0u )\n"
+      "    v = retoIndices[ v ];\n"
+      "  uint object = retoObjects[ v ];\n"
+      "  vec3 position = vec3( retoPositions[ 3u * v ],\n"
+      "    retoPositions[ 3u * v + 1u ], retoPositions[ 3u * v + 2u ]);\n"
+      "  if ( inside( position, retoModels[ object ]) == 1.0 )\n"
+      "    atomicAdd( retoHits[ object ], 1u );\n"
+      "}\n";
+
+    const unsigned int REDUCE_GROUP_SIZE = 256;
+    const unsigned int MAX_REDUCE_GROUPS = 65535;
+
+    const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // The models buffer needs GLSL 4.30
+    const int MIN_VERSION = 430;
+
+    // Checks the vertex shader against the contract of TransformFeedback
+    // and inserts the model definition after its #version line. A
+    // declaration of model as a uniform, the contract before the packed
+    // pass, is removed
+    std::string withModel( const std::string& vertexCode )
+    {
+      std::smatch version;
+      if ( !std::regex_search( vertexCode, version,
+        std::regex( "#[ \\t]*version[ \\t]+([0-9]+)[^\\n]*\\n?" )))
+      {
+        throw std::runtime_error( "Error: transform feedback vertex shader "
+          "without #version, it must be 430 or later." );
+      }
+      if ( std::stoi( version[ 1 ].str( )) < MIN_VERSION )
+      {
+        throw std::runtime_error( "Error: transform feedback vertex shader "
+          "#version " + version[ 1 ].str( ) + ", it must be 430 or later." );
+      }
+      if ( std::regex_search( vertexCode,
+        std::regex( "location\\s*=\\s*1\\s*(,[^)]*)?\\)\\s*in\\s" )))
+      {
+        throw std::runtime_error( "Error: transform feedback vertex shader "
+          "uses the attribute location 1, which is reserved for the object "
+          "of each vertex." );
+      }
+
+      const size_t line = size_t( version.position( 0 ) + version.length( 0 ));
+      const std::string code = std::regex_replace( vertexCode.substr( line ),
+        std::regex( "uniform\\s+(highp\\s+)?mat4\\s+model\\s*;" ), "" );
+      std::string head = vertexCode.substr( 0, line );
+      if ( head.back( ) != '\n' )
+        head += '\n';
+      return head + MODEL_CODE + code;
+    }
+  }
 
   TransformFeedback::TransformFeedback( const std::string& vertexCode,
-    std::vector< const char* > varyings, int mode )
+    std::vector< const char* > varyings, int mode,
+    const std::string& computeCode )
   {
     _program = new reto::ShaderProgram( );
-    _program->loadVertexShaderFromText( vertexCode );
+    _program->loadVertexShaderFromText( withModel( vertexCode ));
     _program->create( );
     _program->feedbackVarying( varyings.data( ) ,
       static_cast< GLsizei >( varyings.size( ) ), mode );
     _program->link( );
     _program->autocatching( );
+
+    #ifdef RETO_COMPUTE_SHADERS
+      _reduceProgram = new reto::ShaderProgram( );
+      _reduceProgram->loadComputeShaderFromText( REDUCE_CODE );
+      _reduceProgram->compileAndLink( );
+      _reduceProgram->autocatching( );
+
+      if ( !computeCode.empty( ))
+      {
+        _computeProgram = new reto::ShaderProgram( );
+        _computeProgram->loadComputeShaderFromText(
+          std::string( COMPUTE_CODE ) + computeCode );
+        _computeProgram->compileAndLink( );
+        _computeProgram->autocatching( );
+      }
+    #else
+      (void) computeCode;
+    #endif
   }
 
   TransformFeedback::~TransformFeedback( void )
   {
     clear( );
+    delete _computeProgram;
+    delete _reduceProgram;
+    delete _program;
   }
 
   void TransformFeedback::draw( void )
   {
-    std::stringstream idsMsg;
-    int selected = 0;
-    for ( auto object : _objects )
-    {
-      const std::vector< float > positions = object.first->getPositions( );
-
-      Buffers* buffers = object.second;
+    select( nullptr );
+  }
 
-      // Disable rasterizer, use Program and bind Vertex Array
-      glEnable( GL_RASTERIZER_DISCARD );
-      program( )->use( );
-      program( )->sendUniform4m( "model", object.first->getModel( ) );
-      glBindVertexArray( buffers->_vao );
+  void TransformFeedback::draw( const SelectionRegion& region )
+  {
+    select( &region );
+  }
 
-      // Begin Transform Feedback
-      glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, buffers->_tfo );
-      glBeginTransformFeedback( GL_POINTS );
+  void TransformFeedback::addObject( Pickable* object )
+  {
+    if ( std::find( _objects.begin( ), _objects.end( ), object ) !=
+      _objects.end( ))
+    {
+      return;
+    }
+    _objects.push_back( object );
+    _dirty = true;
+  }
 
-      // Draw
-      glDrawArrays( GL_POINTS, 0, static_cast< GLsizei >( positions.size( ) ) );
+  void TransformFeedback::removeObject( Pickable* object )
+  {
+    const auto it = std::find( _objects.begin( ), _objects.end( ), object );
+    if ( it == _objects.end( ))
+      return;
+    _objects.erase( it );
+    _dirty = true;
+  }
 
-      // End Transform Feedback
-      glEndTransformFeedback( );
-      //glFlush( );
-      glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, 0 );
+  void TransformFeedback::setCulling( CullingSystem* culling )
+  {
+    _culling = culling;
+  }
 
-      // Unbind Vertex Array, unuse Program and enable rasterizer
-      glBindVertexArray( 0 );
-      glUseProgram( 0 );
-      glDisable( GL_RASTERIZER_DISCARD );
+  void TransformFeedback::setComputeSelection( bool enabled )
+  {
+    _computeSelection = enabled;
+  }
 
-      // Get results
-      std::vector< float > resutlBuffer( positions.size( ) / 3 );
-      glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, buffers->_tbo );
-      glGetBufferSubData( GL_TRANSFORM_FEEDBACK_BUFFER, 0,
-        positions.size( ) / 3 * sizeof( float ), resutlBuffer.data( ) );
-      glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, 0 );
+  bool TransformFeedback::computeSelection( void ) const
+  {
+    return _computeSelection && _computeProgram;
+  }
 
-      // If any position is inside of rubberband, set this object selected
-      if( std::find( resutlBuffer.begin( ), resutlBuffer.end( ), 1.0f )
-        != resutlBuffer.end( ) )
-      {
-        object.first->setSelected( true );
-        //getId only if you want to know which cube is selected
-        idsMsg << object.first->getId( ) << " ";
-        //selected only to std::cout number of selected objects
-        selected++;
-      }
-      else
-      {
-        object.first->setSelected( false );
-      }
-    }
-    if( !idsMsg.str( ).empty( ) )
-    {
-      std::stringstream selMsg;
-      selMsg << "\nObjects ids:\n" << idsMsg.str( ) << "\n\n" << selected
-        << " objects selected.";
-      std::cout << selMsg.str( ) << std::endl;
-    }
+  const std::vector< Pickable* >& TransformFeedback::objects( void ) const
+  {
+    return _objects;
   }
 
-  void TransformFeedback::addObject( Pickable* object )
+  const std::vector< unsigned int >& TransformFeedback::hitCounts( void ) const
   {
-    _objects[ object ] = new Buffers( );
-    generate( object );
+    return _hitCounts;
   }
 
-  void TransformFeedback::removeObject( Pickable* object )
+  unsigned int TransformFeedback::testedVertices( void ) const
   {
-    _objects.erase( object );
+    return _testedVertices;
   }
 
   reto::ShaderProgram* const& TransformFeedback::program( void ) const
   {
-    return _program;
+    return computeSelection( ) ? _computeProgram : _program;
   }
 
   void TransformFeedback::clear( void )
   {
-    for ( auto object : _objects )
+    _objects.clear( );
+    _firstVertices.clear( );
+    _flags.clear( );
+    _hitCounts.clear( );
+    _bounds.clear( );
+    _coverage.clear( );
+    _indices.clear( );
+    _testedVertices = 0;
+    if ( _vao != 0 )
     {
-      object.second->clear( );
+      glDeleteBuffers( NUM_BUFFERS, _buffers );
+      glDeleteTransformFeedbacks( 1, &_tfo );
+      glDeleteVertexArrays( 1, &_vao );
+      std::fill( _buffers, _buffers + NUM_BUFFERS, 0u );
+      _tfo = _vao = 0;
     }
-    _objects.clear( );
-    delete _program;
+    _dirty = true;
   }
 
-  void TransformFeedback::generate( reto::Pickable* object )
+  void TransformFeedback::select( const SelectionRegion* region )
   {
-    const std::vector< float > positions = object->getPositions( );
-    Buffers* buffers = _objects[ object ];
+    const bool repacked = _dirty;
+    if ( _dirty )
+      generate( );
+    const unsigned int numVertices = _firstVertices.back( );
 
-    // Vars
-    GLuint vertexAttribIndex = 0;
+    // Results of the previous draw, kept by the unchanged objects of an
+    // incremental region
+    std::vector< unsigned int > previousHits( _objects.size( ), 0u );
+    std::vector< float > previousModels;
+    previousHits.swap( _hitCounts );
+    previousModels.swap( _models );
 
-    // Create objects
-    glGenVertexArrays( 1, &buffers->_vao );
-    glGenBuffers( 1, &buffers->_vbo );
-    glGenTransformFeedbacks( 1, &buffers->_tfo );
-    glGenBuffers( 1, &buffers->_tbo );
+    std::fill( _flags.begin( ), _flags.end( ), 0u );
+    _coverage.assign( _objects.size( ), SelectionRegion::STRADDLING );
+    _testedVertices = 0;
+    if ( numVertices > 0 )
+    {
+      // Models change every frame, so they are gathered on each draw, and
+      // the objects are classified with them
+      _models.resize( _objects.size( ) * 16 );
+      float* model = _models.data( );
+      for ( size_t i = 0; i < _objects.size( ); ++i )
+      {
+        const std::vector< float > matrix = _objects[ i ]->getModel( );
+        if ( matrix.size( ) == 16 )
+          std::copy( matrix.begin( ), matrix.end( ), model );
+        else
+          std::copy( IDENTITY, IDENTITY + 16, model );
+        model += 16;
 
-    //Vertex Array
-    glBindVertexArray( buffers->_vao );
-    glBindBuffer( GL_ARRAY_BUFFER, buffers->_vbo );
-    glVertexAttribPointer( vertexAttribIndex, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-    glBindBuffer( GL_ARRAY_BUFFER, 0 );
-    glEnableVertexAttribArray( 0 );
-    glBindVertexArray( 0 );
+        if ( !region )
+          continue;
+        if ( _bounds[ i ].empty( ) ||
+          ( _culling && !_culling->inFrustum( _objects[ i ])))
+        {
+          _coverage[ i ] = SelectionRegion::OUTSIDE;
+        }
+        else
+        {
+          _coverage[ i ] = region->classify( _bounds[ i ].world( matrix ));
+        }
 
-    // Vertex Buffer
-    glBindBuffer( GL_ARRAY_BUFFER, buffers->_vbo );
+        // The previous result is only valid for the same packing and model
+        if ( _coverage[ i ] == SelectionRegion::UNCHANGED && ( repacked ||
+          previousModels.size( ) != _models.size( ) ||
+          !std::equal( model - 16, model, previousModels.data( ) + i * 16 )))
+        {
+          _coverage[ i ] = SelectionRegion::STRADDLING;
+        }
+      }
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ MODELS ]);
+      glBufferData( GL_SHADER_STORAGE_BUFFER, _models.size( ) * sizeof( float ),
+        _models.data( ), GL_STREAM_DRAW );
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+
+    // Only the vertices of straddling objects are tested, through an
+    // index list when some objects are left out
+    _testedVertices = numVertices;
+    if ( region )
+    {
+      _indices.clear( );
+      for ( size_t i = 0; i < _objects.size( ); ++i )
+      {
+        if ( _coverage[ i ] != SelectionRegion::STRADDLING )
+          continue;
+        for ( unsigned int v = _firstVertices[ i ];
+          v < _firstVertices[ i + 1 ]; ++v )
+        {
+          _indices.push_back( v );
+        }
+      }
+      _testedVertices = static_cast< unsigned int >( _indices.size( ));
+    }
+    const bool indexed = _testedVertices < numVertices;
+    if ( indexed && _testedVertices > 0 )
+    {
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ INDICES ]);
+      glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0,
+        _indices.size( ) * sizeof( GLuint ), _indices.data( ));
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+
+    if ( _testedVertices > 0 && computeSelection( ))
+    {
+      dispatch( _testedVertices, indexed );
+    }
+    else if ( _testedVertices > 0 )
+    {
+      // Disable rasterizer, use Program and bind Vertex Array
+      glEnable( GL_RASTERIZER_DISCARD );
+      program( )->use( );
+      glBindVertexArray( _vao );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, _buffers[ MODELS ]);
+
+      // One pass over the tested vertices of all objects
+      glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, _tfo );
+      glBeginTransformFeedback( GL_POINTS );
+      if ( indexed )
+      {
+        glDrawElements( GL_POINTS, static_cast< GLsizei >( _testedVertices ),
+          GL_UNSIGNED_INT, 0 );
+      }
+      else
+      {
+        glDrawArrays( GL_POINTS, 0, static_cast< GLsizei >( numVertices ));
+      }
+      glEndTransformFeedback( );
+      glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, 0 );
+
+      // Unbind Vertex Array, unuse Program and enable rasterizer
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
+      glBindVertexArray( 0 );
+      glUseProgram( 0 );
+      glDisable( GL_RASTERIZER_DISCARD );
+
+      reduce( _testedVertices, indexed );
+      for ( size_t i = 0; i < _objects.size( ); ++i )
+        _hitCounts[ i ] = _flags[ i >> 5 ] >> ( i & 31 ) & 1u;
+    }
+
+    // Objects inside the region have all their vertices inside, and
+    // unchanged objects keep their previous count
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+    {
+      if ( _coverage[ i ] == SelectionRegion::INSIDE )
+        _hitCounts[ i ] = _firstVertices[ i + 1 ] - _firstVertices[ i ];
+      else if ( _coverage[ i ] == SelectionRegion::UNCHANGED )
+        _hitCounts[ i ] = previousHits[ i ];
+    }
+
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+    {
+      Pickable* object = _objects[ i ];
+
+      // If any position is inside of the selection, set this object selected
+      object->setSelected( _hitCounts[ i ] > 0 &&
+        ( !_culling || _culling->inFrustum( object )));
+    }
+  }
+
+  void TransformFeedback::generate( void )
+  {
+    if ( _vao == 0 )
+    {
+      glGenVertexArrays( 1, &_vao );
+      glGenBuffers( NUM_BUFFERS, _buffers );
+      glGenTransformFeedbacks( 1, &_tfo );
+    }
+
+    // Positions of all objects one after the other, and the object of
+    // each vertex
+    std::vector< float > positions;
+    std::vector< GLuint > objects;
+    _firstVertices.clear( );
+    _bounds.resize( _objects.size( ));
+    for ( size_t i = 0; i < _objects.size( ); ++i )
+    {
+      const std::vector< float > objectPositions =
+        _objects[ i ]->getPositions( );
+      _bounds[ i ].setPositions( objectPositions );
+      const size_t numVertices = objectPositions.size( ) / 3;
+      _firstVertices.push_back( GLuint( positions.size( ) / 3 ));
+      positions.insert( positions.end( ), objectPositions.begin( ),
+        objectPositions.begin( ) + numVertices * 3 );
+      objects.insert( objects.end( ), numVertices, GLuint( i ));
+    }
+    _firstVertices.push_back( GLuint( positions.size( ) / 3 ));
+    _flags.assign(( _objects.size( ) + 31 ) / 32, 0u );
+    _hitCounts.assign( _objects.size( ), 0u );
+    _dirty = false;
+
+    //Vertex Array
+    glBindVertexArray( _vao );
+    glBindBuffer( GL_ARRAY_BUFFER, _buffers[ POSITIONS ]);
     glBufferData( GL_ARRAY_BUFFER, positions.size( ) * sizeof( float ),
       positions.data( ), GL_STATIC_DRAW );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, _buffers[ OBJECTS ]);
+    glBufferData( GL_ARRAY_BUFFER, objects.size( ) * sizeof( GLuint ),
+      objects.data( ), GL_STATIC_DRAW );
+    glVertexAttribIPointer( 1, 1, GL_UNSIGNED_INT, 0, 0 );
+    glEnableVertexAttribArray( 1 );
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
-    // Transform Feedback
-    glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, buffers->_tfo );
-    glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers->_tbo );
-    glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, 0 );
+    // Packed vertices of the straddling objects, also read by the compute
+    // shaders
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _buffers[ INDICES ]);
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER,
+      std::max< size_t >( objects.size( ), 1 ) * sizeof( GLuint ), NULL,
+      GL_DYNAMIC_DRAW );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 
-    // Transform Feedback Buffer
-    glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, buffers->_tbo );
+    // Transform Feedback Buffer, one float per vertex
+    glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, _buffers[ CAPTURE ]);
     glBufferData( GL_TRANSFORM_FEEDBACK_BUFFER,
-      positions.size( ) / 3 * sizeof( float ), NULL, GL_DYNAMIC_COPY);
+      std::max< size_t >( objects.size( ), 1 ) * sizeof( float ), NULL,
+      GL_DYNAMIC_COPY );
     glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, 0 );
+
+    // Transform Feedback
+    glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, _tfo );
+    glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, _buffers[ CAPTURE ]);
+    glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, 0 );
+
+    // Selection bits
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ FLAGS ]);
+    glBufferData( GL_SHADER_STORAGE_BUFFER,
+      std::max< size_t >( _flags.size( ), 1 ) * sizeof( GLuint ), NULL,
+      GL_DYNAMIC_READ );
+
+    // Vertices inside of each object of the compute selection
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ HITS ]);
+    glBufferData( GL_SHADER_STORAGE_BUFFER,
+      std::max< size_t >( _hitCounts.size( ), 1 ) * sizeof( GLuint ), NULL,
+      GL_DYNAMIC_READ );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
   }
 
-  void TransformFeedback::Buffers::clear( void )
+  void TransformFeedback::reduce( unsigned int numVertices, bool indexed )
   {
-    glDeleteBuffers( 1, &_tbo );
-    glDeleteTransformFeedbacks( 1, &_tfo );
-    glDeleteBuffers( 1, &_vbo );
-    glDeleteVertexArrays( 1, &_vao );
+    #ifdef RETO_COMPUTE_SHADERS
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ FLAGS ]);
+      glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+        GL_UNSIGNED_INT, NULL );
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+      _reduceProgram->use( );
+      _reduceProgram->sendUniformu( "numVertices", numVertices );
+      _reduceProgram->sendUniformu( "indexed", indexed ? 1u : 0u );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, _buffers[ CAPTURE ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, _buffers[ OBJECTS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, _buffers[ FLAGS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, _buffers[ INDICES ]);
+      const unsigned int numGroups =
+        ( numVertices + REDUCE_GROUP_SIZE - 1 ) / REDUCE_GROUP_SIZE;
+      for ( unsigned int group = 0; group < numGroups;
+        group += MAX_REDUCE_GROUPS )
+      {
+        _reduceProgram->sendUniformu( "firstVertex",
+          group * REDUCE_GROUP_SIZE );
+        _reduceProgram->launchComputeWork(
+          std::min( numGroups - group, MAX_REDUCE_GROUPS ), 1, 1 );
+      }
+      for ( GLuint binding = 0; binding < 4; ++binding )
+        glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
+      glUseProgram( 0 );
+
+      // Get results
+      glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ FLAGS ]);
+      glGetBufferSubData( GL_SHADER_STORAGE_BUFFER, 0,
+        _flags.size( ) * sizeof( GLuint ), _flags.data( ));
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    #else
+      // Without compute shaders the capture is read back once and reduced
+      // on the CPU. Indexed captures hold the straddling objects one after
+      // the other.
+      std::vector< float > capture( numVertices );
+      glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, _buffers[ CAPTURE ]);
+      glGetBufferSubData( GL_TRANSFORM_FEEDBACK_BUFFER, 0,
+        capture.size( ) * sizeof( float ), capture.data( ));
+      glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, 0 );
+      auto first = capture.begin( );
+      for ( size_t i = 0; i < _objects.size( ); ++i )
+      {
+        if ( indexed && _coverage[ i ] != SelectionRegion::STRADDLING )
+          continue;
+        const auto last = first +
+          ( _firstVertices[ i + 1 ] - _firstVertices[ i ]);
+        if ( std::find( first, last, 1.0f ) != last )
+          _flags[ i >> 5 ] |= 1u << ( i & 31 );
+        first = last;
+      }
+    #endif
+  }
+
+  void TransformFeedback::dispatch( unsigned int numVertices,
+    bool indexed )
+  {
+    #ifdef RETO_COMPUTE_SHADERS
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ HITS ]);
+      glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+        GL_UNSIGNED_INT, NULL );
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+      _computeProgram->use( );
+      _computeProgram->sendUniformu( "retoNumVertices", numVertices );
+      _computeProgram->sendUniformu( "retoIndexed", indexed ? 1u : 0u );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, _buffers[ MODELS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, _buffers[ POSITIONS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, _buffers[ OBJECTS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, _buffers[ HITS ]);
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, _buffers[ INDICES ]);
+
+      // A single dispatch, with rows of groups past the limit of one row
+      const unsigned int numGroups =
+        ( numVertices + REDUCE_GROUP_SIZE - 1 ) / REDUCE_GROUP_SIZE;
+      const unsigned int numGroupsX = std::min( numGroups, MAX_REDUCE_GROUPS );
+      _computeProgram->launchComputeWork( numGroupsX,
+        ( numGroups + numGroupsX - 1 ) / numGroupsX, 1 );
+
+      for ( GLuint binding = 0; binding < 5; ++binding )
+        glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
+      glUseProgram( 0 );
+
+      // Get results
+      glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, _buffers[ HITS ]);
+      glGetBufferSubData( GL_SHADER_STORAGE_BUFFER, 0,
+        _hitCounts.size( ) * sizeof( GLuint ), _hitCounts.data( ));
+      glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    #else
+      (void) numVertices;
+      (void) indexed;
+    #endif
   }
 
 }
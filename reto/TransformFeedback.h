@@ -24,8 +24,8 @@
 #define __RETO__TRANSFORM_FEEDBACK__
 
 //std
+#include <string>
 #include <vector>
-#include <map>
 
 //glew
 #ifndef __gl_h_
@@ -36,12 +36,49 @@
 #include <reto/api.h>
 #include "ShaderProgram.h"
 #include "Pickable.h"
+#include "CullingSystem.h"
+#include "SelectionRegion.h"
 
 namespace reto
 {
 
   /**
-   * Class to manage transform feedbacks
+   * Class to manage transform feedbacks. The positions of all objects are
+   * packed once in shared buffers, and each draw is a single feedback pass
+   * over them followed by a single readback of one bit per object.
+   *
+   * The vertex shader must follow this contract:
+   *  - Its #version is 430 or later.
+   *  - It reads the position at attribute location 0. Location 1 is
+   *    reserved for the object of each vertex.
+   *  - It uses model, the getModel matrix of the object of the vertex,
+   *    without declaring it. TransformFeedback inserts its definition
+   *    after the #version line, and removes a "uniform mat4 model;".
+   *  - Its first varying is the capture: an object is selected when it is
+   *    1.0 for any of its vertices.
+   *
+   * For instance:
+   * @code
+   * #version 430
+   * layout( location = 0 ) in vec3 inPos;
+   * uniform mat4 viewProj;
+   * out float inside;
+   * void main( void )
+   * {
+   *   vec4 p = viewProj * model * vec4( inPos, 1.0 );
+   *   inside = float( all( lessThan( abs( p.xy / p.w ), vec2( 0.5 ))));
+   * }
+   * @endcode
+   *
+   * Optionally the same test runs as a compute shader over the packed
+   * buffers instead, in one dispatch that counts the vertices inside each
+   * object with atomic adds. Its code defines the uniforms it needs and
+   * float inside( vec3 position, mat4 model ), returning 1.0 for vertices
+   * inside the selection.
+   *
+   * Drawing with a SelectionRegion first classifies each object by its
+   * projected bounds, and only the vertices of the objects straddling the
+   * region go through the shaders.
    * @class TransformFeedback
    */
   class TransformFeedback
@@ -54,10 +91,14 @@ namespace reto
        * @param vertexCode: vertex shader code
        * @param varyings: transform feedback varying names
        * @param mode: transform feedback mode
+       * @param computeCode: inside function of the compute selection
+       *   ( empty to only use transform feedback )
+       * @throw std::runtime_error if vertexCode breaks the shader contract
        */
       RETO_API
       TransformFeedback( const std::string& vertexCode,
-        std::vector< const char* > varyings, int mode );
+        std::vector< const char* > varyings, int mode,
+        const std::string& computeCode = std::string( ));
 
       /**
        * TransformFeedback destructor
@@ -70,6 +111,18 @@ namespace reto
       RETO_API
       void draw( void );
 
+      /**
+       * Method to draw transform feedback testing only the vertices of the
+       * objects whose bounds straddle a region. Objects inside it are
+       * selected and objects outside are not, without testing them. The
+       * region must describe the test of the shaders. With a previous
+       * region, objects away from the change keep the result of the last
+       * draw, unless the objects were repacked or their model changed.
+       * @param region: Selection region
+       */
+      RETO_API
+      void draw( const reto::SelectionRegion& region );
+
       /**
        * Method to add a pickable object
        * @param object: Pickable object
@@ -85,7 +138,56 @@ namespace reto
       void removeObject( reto::Pickable* object );
 
       /**
-       * Method to get program handler
+       * Method to deselect the objects outside the frustum of a culling
+       * system whatever their capture. Its cull must use the view of the
+       * selection. Occluded objects are still tested.
+       * @param culling: Culling system ( nullptr to test all objects )
+       */
+      RETO_API
+      void setCulling( reto::CullingSystem* culling );
+
+      /**
+       * Method to select with the compute shader instead of the transform
+       * feedback pass. Needs RETO_COMPUTE_SHADERS and a computeCode.
+       * @param enabled: Compute selection flag ( default = false )
+       */
+      RETO_API
+      void setComputeSelection( bool enabled );
+
+      /**
+       * Method to check if the compute shader selects
+       * @return bool
+       */
+      RETO_API
+      bool computeSelection( void ) const;
+
+      /**
+       * Method to get the objects in packing order
+       * @return const std::vector< Pickable* >&
+       */
+      RETO_API
+      const std::vector< reto::Pickable* >& objects( void ) const;
+
+      /**
+       * Method to get the vertices inside the selection of each object in
+       * the last draw, in packing order. The transform feedback pass only
+       * tells if there is any, so it gives 1.
+       * @return const std::vector< unsigned int >&
+       */
+      RETO_API
+      const std::vector< unsigned int >& hitCounts( void ) const;
+
+      /**
+       * Method to get the number of vertices tested by the shaders in the
+       * last draw
+       * @return unsigned int
+       */
+      RETO_API
+      unsigned int testedVertices( void ) const;
+
+      /**
+       * Method to get the program receiving the uniforms of the selection,
+       * the compute shader one when it selects
        * @return program handler.
        */
       RETO_API
@@ -99,42 +201,99 @@ namespace reto
 
     private:
 
+      //! Shared buffers
+      enum Buffer
+      {
+        POSITIONS,
+        OBJECTS,
+        MODELS,
+        CAPTURE,
+        FLAGS,
+        HITS,
+        INDICES,
+        NUM_BUFFERS
+      };
+
       //! Shader program
       reto::ShaderProgram* _program;
 
-      /**
-       * Struct to manage object buffers
-       * @struct Buffers
-       */
-      struct Buffers
-      {
-        //! Vertex array handler
-        unsigned int _vao;
+      //! Program reducing the capture to one bit per object
+      reto::ShaderProgram* _reduceProgram = nullptr;
 
-        //! Vertex buffer handler
-        unsigned int _vbo;
+      //! Program of the compute selection ( may be nullptr )
+      reto::ShaderProgram* _computeProgram = nullptr;
 
-        //! Transform feedback handler
-        unsigned int _tfo;
+      //! Compute selection flag
+      bool _computeSelection = false;
 
-        //! Transform feedback buffer handler
-        unsigned int _tbo;
+      //! Objects in packing order
+      std::vector< reto::Pickable* > _objects;
 
-        /**
-         * Method to clear buffers per object
-         */
-        void clear( void );
+      //! First packed vertex of each object, and the number of vertices
+      std::vector< unsigned int > _firstVertices;
 
-      };
+      //! Flag to pack the positions again before the next draw
+      bool _dirty = true;
+
+      //! Vertex array of the packed positions
+      unsigned int _vao = 0;
+
+      //! Transform feedback handler
+      unsigned int _tfo = 0;
+
+      //! Shared buffer handlers
+      unsigned int _buffers[ NUM_BUFFERS ] = { 0, 0, 0, 0, 0, 0, 0 };
+
+      //! Model matrices uploaded in the last draw
+      std::vector< float > _models;
+
+      //! Selection bits read back in the last draw
+      std::vector< unsigned int > _flags;
+
+      //! Vertices inside the selection of each object in the last draw
+      std::vector< unsigned int > _hitCounts;
+
+      //! Culling system of the selection ( may be nullptr )
+      reto::CullingSystem* _culling = nullptr;
 
-      //! Map of [ object, buffers ]
-      std::map< reto::Pickable*, Buffers* > _objects;
+      //! Bounds of each object, in packing order
+      std::vector< reto::ObjectBounds > _bounds;
+
+      //! Classification of each object in the last draw
+      std::vector< reto::SelectionRegion::Coverage > _coverage;
+
+      //! Packed vertices of the straddling objects in the last draw
+      std::vector< unsigned int > _indices;
+
+      //! Vertices tested by the shaders in the last draw
+      unsigned int _testedVertices = 0;
 
       /**
-       * Method to generate transform feedback for an object
-       * @return program handler.
+       * Method to test the objects, classifying them first when there is
+       * a region
+       * @param region: Selection region ( may be nullptr )
+       */
+      void select( const reto::SelectionRegion* region );
+
+      /**
+       * Method to pack the positions of all objects
+       */
+      void generate( void );
+
+      /**
+       * Method to reduce the capture to the selection bits
+       * @param numVertices: Number of tested vertices
+       * @param indexed: The tested vertices are in _indices
+       */
+      void reduce( unsigned int numVertices, bool indexed );
+
+      /**
+       * Method to count the vertices inside the selection with the compute
+       * shader
+       * @param numVertices: Number of tested vertices
+       * @param indexed: The tested vertices are in _indices
        */
-      void generate( reto::Pickable* object );
+      void dispatch( unsigned int numVertices, bool indexed );
 
   }; /* class TransformFeedback */
 
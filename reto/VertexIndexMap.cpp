@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "VertexIndexMap.h"
+
+namespace reto
+{
+  namespace
+  {
+    const size_t MIN_CAPACITY = 16;
+
+    // Load factor is kept below MAX_LOAD_NUM / MAX_LOAD_DEN
+    const size_t MAX_LOAD_NUM = 7;
+    const size_t MAX_LOAD_DEN = 10;
+  }
+
+  VertexIndexMap::VertexIndexMap( size_t expectedSize )
+    : _mask( 0 )
+    , _shift( 0 )
+    , _size( 0 )
+    , _growSize( 0 )
+    , _lookups( 0 )
+    , _probes( 0 )
+    , _maxProbes( 0 )
+    , _rehashes( 0 )
+  {
+    rehash( MIN_CAPACITY );
+    reserve( expectedSize );
+  }
+
+  void VertexIndexMap::reserve( size_t expectedSize )
+  {
+    size_t capacity = _slots.size( );
+    while ( capacity / MAX_LOAD_DEN * MAX_LOAD_NUM < expectedSize )
+      capacity *= 2;
+    if ( capacity != _slots.size( ))
+      rehash( capacity );
+  }
+
+  void VertexIndexMap::clear( void )
+  {
+    for ( auto& slot : _slots )
+      slot.index = -1;
+    _size = 0;
+    _lookups = 0;
+    _probes = 0;
+    _maxProbes = 0;
+    _rehashes = 0;
+  }
+
+  int VertexIndexMap::find( int v, int vt, int vn ) const
+  {
+    for ( size_t i = slotOf( v, vt, vn ); ; i = ( i + 1 ) & _mask )
+    {
+      const Slot& slot = _slots[ i ];
+      if ( slot.index < 0 )
+        return -1;
+      if ( slot.v == v && slot.vt == vt && slot.vn == vn )
+        return slot.index;
+    }
+  }
+
+  size_t VertexIndexMap::size( void ) const
+  {
+    return _size;
+  }
+
+  size_t VertexIndexMap::capacity( void ) const
+  {
+    return _slots.size( );
+  }
+
+  VertexIndexMap::Stats VertexIndexMap::stats( void ) const
+  {
+    Stats stats;
+    stats.size = _size;
+    stats.capacity = _slots.size( );
+    stats.loadFactor = float( _size ) / float( _slots.size( ));
+    stats.lookups = _lookups;
+    stats.probes = _probes;
+    stats.maxProbes = _maxProbes;
+    stats.rehashes = _rehashes;
+    return stats;
+  }
+
+  void VertexIndexMap::rehash( size_t capacity )
+  {
+    std::vector< Slot > old;
+    old.swap( _slots );
+
+    Slot empty = { 0, 0, 0, -1 };
+    _slots.assign( capacity, empty );
+    _mask = capacity - 1;
+    _shift = 64;
+    for ( size_t c = capacity; c > 1; c >>= 1 )
+      --_shift;
+    _growSize = capacity / MAX_LOAD_DEN * MAX_LOAD_NUM;
+    if ( _size > 0 )
+      ++_rehashes;
+
+    for ( const auto& slot : old )
+    {
+      if ( slot.index < 0 )
+        continue;
+      size_t i = slotOf( slot.v, slot.vt, slot.vn );
+      while ( _slots[ i ].index >= 0 )
+        i = ( i + 1 ) & _mask;
+      _slots[ i ] = slot;
+    }
+  }
+
+} /* namespace reto */
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__VERTEX_INDEX_MAP__
+#define __RETO__VERTEX_INDEX_MAP__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace reto
+{
+  /**
+   * Open addressing hash table mapping resolved face corners ( position,
+   * texture coordinate and normal indices ) to output vertex indices.
+   * Uses linear probing over a power of two capacity and grows when the
+   * load factor would exceed 0.7.
+   * @class VertexIndexMap
+   */
+  class VertexIndexMap
+  {
+    public:
+      /**
+       * Struct with table usage statistics
+       * @struct Stats
+       */
+      struct Stats
+      {
+        //! Number of stored corners
+        size_t size;
+        //! Number of slots
+        size_t capacity;
+        //! Stored corners divided by slots
+        float loadFactor;
+        //! Number of lookups ( found or inserted )
+        uint64_t lookups;
+        //! Slots inspected by all lookups
+        uint64_t probes;
+        //! Longest probe sequence of a single lookup
+        size_t maxProbes;
+        //! Number of times the table had to grow
+        size_t rehashes;
+      };
+
+      /**
+       * VertexIndexMap constructor
+       * @param expectedSize: Number of corners to reserve space for.
+       */
+      RETO_API
+      VertexIndexMap( size_t expectedSize = 0 );
+
+      /**
+       * Method to reserve space for a number of corners without growing.
+       * @param expectedSize: Number of corners.
+       */
+      RETO_API
+      void reserve( size_t expectedSize );
+
+      /**
+       * Method to remove all corners and reset statistics. Keeps capacity.
+       */
+      RETO_API
+      void clear( void );
+
+      /**
+       * Method to find the index of a corner, inserting it if not present.
+       * @param v: Position index.
+       * @param vt: Texture coordinate index ( -1 if absent ).
+       * @param vn: Normal index ( -1 if absent ).
+       * @param index: Non negative index stored if the corner is new.
+       * @return stored index. Equals index when the corner was inserted.
+       */
+      int findOrInsert( int v, int vt, int vn, int index );
+
+      /**
+       * Method to find the index of a corner
+       * @return stored index or -1 if not present.
+       */
+      RETO_API
+      int find( int v, int vt, int vn ) const;
+
+      /**
+       * Method to get the number of stored corners
+       * @return size_t
+       */
+      RETO_API
+      size_t size( void ) const;
+
+      /**
+       * Method to get the number of slots
+       * @return size_t
+       */
+      RETO_API
+      size_t capacity( void ) const;
+
+      /**
+       * Method to get table statistics
+       * @return Stats
+       */
+      RETO_API
+      Stats stats( void ) const;
+
+    private:
+      //! Table entry. Empty entries have a negative index.
+      struct Slot
+      {
+        int v;
+        int vt;
+        int vn;
+        int index;
+      };
+
+      size_t slotOf( int v, int vt, int vn ) const;
+
+      void rehash( size_t capacity );
+
+      //! Table slots
+      std::vector< Slot > _slots;
+
+      //! Capacity minus one
+      size_t _mask;
+
+      //! Shift to take the hash high bits
+      unsigned int _shift;
+
+      //! Number of stored corners
+      size_t _size;
+
+      //! Size that triggers growth
+      size_t _growSize;
+
+      //! Statistics counters
+      uint64_t _lookups;
+      uint64_t _probes;
+      size_t _maxProbes;
+      size_t _rehashes;
+
+  }; /* class VertexIndexMap */
+
+  inline size_t VertexIndexMap::slotOf( int v, int vt, int vn ) const
+  {
+    // Pack the indices in 64 bits, mix them and keep the high bits
+    uint64_t h = ( uint64_t( uint32_t( v )) << 32 ) ^
+      ( uint64_t( uint32_t( vt )) << 16 ) ^ uint32_t( vn );
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return static_cast< size_t >( h >> _shift );
+  }
+
+  inline int VertexIndexMap::findOrInsert( int v, int vt, int vn, int index )
+  {
+    if ( _size >= _growSize )
+      rehash( _slots.size( ) * 2 );
+
+    size_t i = slotOf( v, vt, vn );
+    size_t probes = 1;
+    for ( ;; ++probes, i = ( i + 1 ) & _mask )
+    {
+      Slot& slot = _slots[ i ];
+      if ( slot.index < 0 )
+      {
+        slot.v = v;
+        slot.vt = vt;
+        slot.vn = vn;
+        slot.index = index;
+        ++_size;
+        break;
+      }
+      if ( slot.v == v && slot.vt == vt && slot.vn == vn )
+      {
+        index = slot.index;
+        break;
+      }
+    }
+
+    ++_lookups;
+    _probes += probes;
+    if ( probes > _maxProbes )
+      _maxProbes = probes;
+    return index;
+  }
+
+} /* namespace reto */
+
+#endif /* __RETO__VERTEX_INDEX_MAP__ */
@@ -0,0 +1,515 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "VertexLayout.h"
+#include "ObjParser.h"
+
+// OpenGL, GLEW.
+#include <GL/glew.h>
+
+#ifdef Darwin
+  #define __gl_h_
+  #define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED
+  #include <OpenGL/gl.h>
+#else
+  #include <GL/gl.h>
+#endif
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace reto
+{
+  namespace
+  {
+    const size_t BUFFER_ALIGNMENT = 16;
+
+    inline size_t alignUp( size_t value, size_t alignment )
+    {
+      return ( value + alignment - 1 ) / alignment * alignment;
+    }
+
+    unsigned int numComponents( VertexAttribute attribute )
+    {
+      return attribute == VertexAttribute::TexCoord ? 2 : 3;
+    }
+
+    /*
+      Convert a float to half precision, rounding to nearest even
+    */
+    uint16_t toHalf( float value )
+    {
+      uint32_t bits;
+      memcpy( &bits, &value, sizeof( bits ));
+      const uint32_t sign = ( bits >> 16 ) & 0x8000;
+      const uint32_t absBits = bits & 0x7FFFFFFF;
+
+      // NaN and infinity, and values rounding above the largest half
+      if ( absBits > 0x7F800000 )
+        return static_cast< uint16_t >( sign | 0x7E00 );
+      if ( absBits >= 0x477FF000 )
+        return static_cast< uint16_t >( sign | 0x7C00 );
+
+      // Half subnormals
+      if ( absBits < 0x38800000 )
+      {
+        if ( absBits < 0x33000000 )
+          return static_cast< uint16_t >( sign );
+        const uint32_t mantissa = ( absBits & 0x7FFFFF ) | 0x800000;
+        const uint32_t shift = 126 - ( absBits >> 23 );
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & (( 1u << shift ) - 1 );
+        const uint32_t middle = 1u << ( shift - 1 );
+        if ( rest > middle || ( rest == middle && ( half & 1 )))
+          ++half;
+        return static_cast< uint16_t >( sign | half );
+      }
+
+      // Normals: rebias the exponent, a mantissa carry is still valid
+      uint32_t half = ( absBits - 0x38000000 ) >> 13;
+      const uint32_t rest = absBits & 0x1FFF;
+      if ( rest > 0x1000 || ( rest == 0x1000 && ( half & 1 )))
+        ++half;
+      return static_cast< uint16_t >( sign | half );
+    }
+
+    inline int toSnorm( float value, float scale )
+    {
+      const float clamped = std::max( -1.0f, std::min( 1.0f, value ));
+      return static_cast< int >( roundf( clamped * scale ));
+    }
+
+    /*
+      Store the components of an attribute in its format
+    */
+    void writeAttribute( AttributeFormat format, const float* source,
+      unsigned int components, unsigned char* dest )
+    {
+      float values[ 3 ] = { 0.0f, 0.0f, 0.0f };
+      if ( source )
+        std::copy( source, source + components, values );
+
+      switch ( format )
+      {
+        case AttributeFormat::Float32:
+          memcpy( dest, values, components * sizeof( float ));
+          break;
+        case AttributeFormat::Float16:
+          for ( unsigned int i = 0; i < components; ++i )
+          {
+            const uint16_t half = toHalf( values[ i ]);
+            memcpy( dest + i * 2, &half, 2 );
+          }
+          break;
+        case AttributeFormat::Snorm16:
+          for ( unsigned int i = 0; i < components; ++i )
+          {
+            const int16_t snorm =
+              static_cast< int16_t >( toSnorm( values[ i ], 32767.0f ));
+            memcpy( dest + i * 2, &snorm, 2 );
+          }
+          break;
+        case AttributeFormat::Snorm8:
+          for ( unsigned int i = 0; i < components; ++i )
+          {
+            const int8_t snorm =
+              static_cast< int8_t >( toSnorm( values[ i ], 127.0f ));
+            memcpy( dest + i, &snorm, 1 );
+          }
+          break;
+        case AttributeFormat::Snorm10:
+        {
+          uint32_t packed = 0;
+          for ( unsigned int i = 0; i < components; ++i )
+          {
+            const uint32_t snorm =
+              static_cast< uint32_t >( toSnorm( values[ i ], 511.0f ));
+            packed |= ( snorm & 0x3FF ) << ( 10 * i );
+          }
+          memcpy( dest, &packed, sizeof( packed ));
+          break;
+        }
+      }
+    }
+  }
+
+  VertexLayout::VertexLayout( bool interleaved )
+    : _interleaved( interleaved )
+    , _indexFormat( IndexFormat::Auto )
+    , _strideAlignment( 4 )
+  {
+  }
+
+  VertexLayout& VertexLayout::add( VertexAttribute attribute,
+    AttributeFormat format )
+  {
+    auto existing = std::find_if( _attributes.begin( ), _attributes.end( ),
+      [ & ]( const Attribute& attr ){ return attr.attribute == attribute; });
+    if ( existing != _attributes.end( ))
+    {
+      existing->format = format;
+    }
+    else
+    {
+      Attribute added;
+      added.attribute = attribute;
+      added.format = format;
+      _attributes.push_back( added );
+    }
+    update( );
+    return *this;
+  }
+
+  VertexLayout& VertexLayout::setIndexFormat( IndexFormat format )
+  {
+    _indexFormat = format;
+    return *this;
+  }
+
+  VertexLayout& VertexLayout::setStrideAlignment( size_t alignment )
+  {
+    _strideAlignment = std::max( size_t( 4 ), alignment );
+    update( );
+    return *this;
+  }
+
+  bool VertexLayout::interleaved( void ) const
+  {
+    return _interleaved;
+  }
+
+  const std::vector< VertexLayout::Attribute >&
+  VertexLayout::attributes( void ) const
+  {
+    return _attributes;
+  }
+
+  const VertexLayout::Attribute* VertexLayout::find(
+    VertexAttribute attribute ) const
+  {
+    for ( const auto& attr : _attributes )
+    {
+      if ( attr.attribute == attribute )
+        return &attr;
+    }
+    return nullptr;
+  }
+
+  size_t VertexLayout::numStreams( void ) const
+  {
+    return _strides.size( );
+  }
+
+  size_t VertexLayout::stride( size_t stream ) const
+  {
+    return _strides[ stream ];
+  }
+
+  size_t VertexLayout::vertexSize( void ) const
+  {
+    size_t size = 0;
+    for ( size_t stride : _strides )
+      size += stride;
+    return size;
+  }
+
+  IndexFormat VertexLayout::indexFormat( void ) const
+  {
+    return _indexFormat;
+  }
+
+  void VertexLayout::update( void )
+  {
+    _strides.clear( );
+    size_t offset = 0;
+    for ( auto& attr : _attributes )
+    {
+      const unsigned int components = numComponents( attr.attribute );
+      switch ( attr.format )
+      {
+        case AttributeFormat::Float32:
+          attr.components = components;
+          attr.size = components * 4;
+          attr.glType = GL_FLOAT;
+          attr.normalized = false;
+          break;
+        case AttributeFormat::Float16:
+          attr.components = components;
+          attr.size = alignUp( components * 2, 4 );
+          attr.glType = GL_HALF_FLOAT;
+          attr.normalized = false;
+          break;
+        case AttributeFormat::Snorm16:
+          attr.components = components;
+          attr.size = alignUp( components * 2, 4 );
+          attr.glType = GL_SHORT;
+          attr.normalized = true;
+          break;
+        case AttributeFormat::Snorm8:
+          attr.components = components;
+          attr.size = 4;
+          attr.glType = GL_BYTE;
+          attr.normalized = true;
+          break;
+        case AttributeFormat::Snorm10:
+          attr.components = 4;
+          attr.size = 4;
+          attr.glType = GL_INT_2_10_10_10_REV;
+          attr.normalized = true;
+          break;
+      }
+
+      if ( _interleaved )
+      {
+        attr.stream = 0;
+        attr.offset = offset;
+        offset += attr.size;
+      }
+      else
+      {
+        attr.stream = static_cast< unsigned int >( _strides.size( ));
+        attr.offset = 0;
+        _strides.push_back( alignUp( attr.size, _strideAlignment ));
+      }
+    }
+    if ( _interleaved && !_attributes.empty( ))
+      _strides.push_back( alignUp( offset, _strideAlignment ));
+  }
+
+  AlignedBuffer::AlignedBuffer( void )
+    : _data( nullptr )
+    , _size( 0 )
+    , _capacity( 0 )
+  {
+  }
+
+  AlignedBuffer::AlignedBuffer( const AlignedBuffer& other )
+    : _data( nullptr )
+    , _size( 0 )
+    , _capacity( 0 )
+  {
+    *this = other;
+  }
+
+  AlignedBuffer& AlignedBuffer::operator=( const AlignedBuffer& other )
+  {
+    if ( this != &other )
+    {
+      _size = 0;
+      reserve( other._size );
+      if ( other._size > 0 )
+        memcpy( _data, other._data, other._size );
+      _size = other._size;
+    }
+    return *this;
+  }
+
+  AlignedBuffer::AlignedBuffer( AlignedBuffer&& other )
+    : _storage( std::move( other._storage ))
+    , _data( other._data )
+    , _size( other._size )
+    , _capacity( other._capacity )
+  {
+    other._data = nullptr;
+    other._size = other._capacity = 0;
+  }
+
+  AlignedBuffer& AlignedBuffer::operator=( AlignedBuffer&& other )
+  {
+    if ( this != &other )
+    {
+      _storage = std::move( other._storage );
+      _data = other._data;
+      _size = other._size;
+      _capacity = other._capacity;
+      other._data = nullptr;
+      other._size = other._capacity = 0;
+    }
+    return *this;
+  }
+
+  void AlignedBuffer::resize( size_t size )
+  {
+    if ( size > _capacity )
+      reserve( std::max( size, _capacity * 2 ));
+    _size = size;
+  }
+
+  void AlignedBuffer::reserve( size_t capacity )
+  {
+    if ( capacity <= _capacity )
+      return;
+
+    std::unique_ptr< unsigned char[ ] > storage(
+      new unsigned char[ capacity + BUFFER_ALIGNMENT - 1 ]);
+    const size_t address = reinterpret_cast< size_t >( storage.get( ));
+    unsigned char* data =
+      storage.get( ) + ( alignUp( address, BUFFER_ALIGNMENT ) - address );
+    if ( _size > 0 )
+      memcpy( data, _data, _size );
+
+    _storage = std::move( storage );
+    _data = data;
+    _capacity = capacity;
+  }
+
+  size_t AlignedBuffer::size( void ) const
+  {
+    return _size;
+  }
+
+  unsigned char* AlignedBuffer::data( void )
+  {
+    return _data;
+  }
+
+  const unsigned char* AlignedBuffer::data( void ) const
+  {
+    return _data;
+  }
+
+  PackedModel::PackedModel( const VertexLayout& layout )
+    : _layout( layout )
+    , _streams( layout.numStreams( ))
+    , _numVertices( 0 )
+    , _numIndices( 0 )
+    , _indexFormat( IndexFormat::UInt32 )
+  {
+  }
+
+  PackedModel PackedModel::pack( const Model& model,
+    const VertexLayout& layout )
+  {
+    PackedModel packed( layout );
+    const size_t numVertices = model.vertices.size( ) / 3;
+    packed.reserve( numVertices, model.indices.size( ));
+
+    // Attribute arrays shorter than the vertex count are treated as absent
+    auto element = [ ]( const std::vector< float >& values, size_t size,
+      size_t i ) -> const float*
+    {
+      return ( i + 1 ) * size <= values.size( ) ? &values[ i * size ] : nullptr;
+    };
+    for ( size_t i = 0; i < numVertices; ++i )
+    {
+      packed.addVertex( &model.vertices[ i * 3 ],
+        element( model.normals, 3, i ), element( model.texCoords, 2, i ),
+        element( model.tangents, 3, i ), element( model.bitangents, 3, i ));
+    }
+    for ( int index : model.indices )
+      packed.addIndex( static_cast< uint32_t >( index ));
+    packed.finish( );
+    return packed;
+  }
+
+  void PackedModel::reserve( size_t numVertices, size_t numIndices )
+  {
+    for ( size_t i = 0; i < _streams.size( ); ++i )
+      _streams[ i ].reserve( numVertices * _layout.stride( i ));
+    _indices.reserve( numIndices * sizeof( uint32_t ));
+  }
+
+  void PackedModel::addVertex( const float* position, const float* normal,
+    const float* texCoord, const float* tangent, const float* bitangent )
+  {
+    const float* sources[ ] =
+      { position, normal, texCoord, tangent, bitangent };
+
+    // Clear the new vertex so padding bytes are always zero
+    for ( size_t i = 0; i < _streams.size( ); ++i )
+    {
+      const size_t stride = _layout.stride( i );
+      _streams[ i ].resize( ( _numVertices + 1 ) * stride );
+      memset( _streams[ i ].data( ) + _numVertices * stride, 0, stride );
+    }
+
+    for ( const auto& attr : _layout.attributes( ))
+    {
+      unsigned char* dest = _streams[ attr.stream ].data( ) +
+        _numVertices * _layout.stride( attr.stream ) + attr.offset;
+      writeAttribute( attr.format,
+        sources[ static_cast< size_t >( attr.attribute )],
+        numComponents( attr.attribute ), dest );
+    }
+    ++_numVertices;
+  }
+
+  void PackedModel::addIndex( uint32_t index )
+  {
+    _indices.resize( ( _numIndices + 1 ) * sizeof( uint32_t ));
+    memcpy( _indices.data( ) + _numIndices * sizeof( uint32_t ),
+      &index, sizeof( index ));
+    ++_numIndices;
+  }
+
+  void PackedModel::finish( void )
+  {
+    if ( _indexFormat == IndexFormat::UInt16 ||
+      _layout.indexFormat( ) == IndexFormat::UInt32 ||
+      _numVertices > 65536 )
+    {
+      return;
+    }
+
+    // Narrow in place, front to back never overwrites unread indices
+    unsigned char* data = _indices.data( );
+    for ( size_t i = 0; i < _numIndices; ++i )
+    {
+      uint32_t index;
+      memcpy( &index, data + i * 4, 4 );
+      const uint16_t narrow = static_cast< uint16_t >( index );
+      memcpy( data + i * 2, &narrow, 2 );
+    }
+    _indices.resize( _numIndices * 2 );
+    _indexFormat = IndexFormat::UInt16;
+  }
+
+  const VertexLayout& PackedModel::layout( void ) const
+  {
+    return _layout;
+  }
+
+  size_t PackedModel::numVertices( void ) const
+  {
+    return _numVertices;
+  }
+
+  size_t PackedModel::numIndices( void ) const
+  {
+    return _numIndices;
+  }
+
+  const AlignedBuffer& PackedModel::stream( size_t stream ) const
+  {
+    return _streams[ stream ];
+  }
+
+  const AlignedBuffer& PackedModel::indices( void ) const
+  {
+    return _indices;
+  }
+
+  IndexFormat PackedModel::indexFormat( void ) const
+  {
+    return _indexFormat;
+  }
+
+} /* namespace reto */
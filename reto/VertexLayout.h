@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO__VERTEX_LAYOUT__
+#define __RETO__VERTEX_LAYOUT__
+
+#include <reto/api.h>
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace reto
+{
+  struct Model;
+
+  /**
+  * Vertex attributes produced by ObjParser
+  * @enum class VertexAttribute
+  */
+  enum class VertexAttribute
+  {
+    Position,
+    Normal,
+    TexCoord,
+    Tangent,
+    Bitangent
+  };
+
+  /**
+  * Storage format of a vertex attribute. Snorm formats clamp values to
+  * [ -1, 1 ]. Snorm10 packs three components in a 32 bit word with a zero
+  * fourth one ( GL_INT_2_10_10_10_REV ).
+  * @enum class AttributeFormat
+  */
+  enum class AttributeFormat
+  {
+    Float32,
+    Float16,
+    Snorm16,
+    Snorm8,
+    Snorm10
+  };
+
+  /**
+  * Index storage format. Auto uses 16 bit indices when every vertex can be
+  * addressed with them. UInt16 falls back to 32 bit indices when there are
+  * more than 65536 vertices.
+  * @enum class IndexFormat
+  */
+  enum class IndexFormat
+  {
+    Auto,
+    UInt16,
+    UInt32
+  };
+
+  /**
+   * Class describing how vertices are stored for GPU upload: one
+   * interleaved stream or one stream per attribute ( SoA ), each attribute
+   * with its own format, plus the index format. Attribute offsets and sizes
+   * are multiples of 4 bytes.
+   * @class VertexLayout
+   */
+  class VertexLayout
+  {
+    public:
+      /**
+       * Struct with the placement of an attribute, ready to be used with
+       * glVertexAttribPointer
+       * @struct Attribute
+       */
+      struct Attribute
+      {
+        //! Attribute
+        VertexAttribute attribute;
+        //! Storage format
+        AttributeFormat format;
+        //! Number of components ( 4 for Snorm10 )
+        unsigned int components;
+        //! Stream holding the attribute
+        unsigned int stream;
+        //! Offset from the start of the vertex in its stream, in bytes
+        size_t offset;
+        //! Stored size, including padding, in bytes
+        size_t size;
+        //! OpenGL component type
+        unsigned int glType;
+        //! Whether OpenGL must normalize integer components
+        bool normalized;
+      };
+
+      /**
+       * VertexLayout constructor
+       * @param interleaved: Store all attributes in one stream ( true ) or
+       *   each one in its own stream ( false ).
+       */
+      RETO_API
+      VertexLayout( bool interleaved = true );
+
+      /**
+       * Method to add an attribute, or change its format if already added.
+       * Attributes are stored in the order they are added.
+       * @param attribute: Attribute to add.
+       * @param format: Storage format.
+       * @return reference to this layout.
+       */
+      RETO_API
+      VertexLayout& add( VertexAttribute attribute,
+        AttributeFormat format = AttributeFormat::Float32 );
+
+      /**
+       * Method to set the index format
+       * @param format: Index format ( default = IndexFormat::Auto ).
+       * @return reference to this layout.
+       */
+      RETO_API
+      VertexLayout& setIndexFormat( IndexFormat format );
+
+      /**
+       * Method to set the stride alignment of every stream
+       * @param alignment: Power of two multiple of 4 ( default = 4 ). Use 16
+       *   to start every interleaved vertex on a 16 byte boundary.
+       * @return reference to this layout.
+       */
+      RETO_API
+      VertexLayout& setStrideAlignment( size_t alignment );
+
+      /**
+       * Method to check if the layout is interleaved
+       * @return bool
+       */
+      RETO_API
+      bool interleaved( void ) const;
+
+      /**
+       * Method to get the attributes
+       * @return attributes in the order they were added.
+       */
+      RETO_API
+      const std::vector< Attribute >& attributes( void ) const;
+
+      /**
+       * Method to find an attribute
+       * @param attribute: Attribute to find.
+       * @return pointer to the attribute or nullptr if not in the layout.
+       */
+      RETO_API
+      const Attribute* find( VertexAttribute attribute ) const;
+
+      /**
+       * Method to get the number of streams
+       * @return 1 if interleaved, one per attribute otherwise.
+       */
+      RETO_API
+      size_t numStreams( void ) const;
+
+      /**
+       * Method to get the stride of a stream
+       * @param stream: Stream index.
+       * @return bytes between consecutive vertices.
+       */
+      RETO_API
+      size_t stride( size_t stream ) const;
+
+      /**
+       * Method to get the size of a vertex adding all streams
+       * @return size in bytes.
+       */
+      RETO_API
+      size_t vertexSize( void ) const;
+
+      /**
+       * Method to get the index format
+       * @return IndexFormat
+       */
+      RETO_API
+      IndexFormat indexFormat( void ) const;
+
+    private:
+      void update( void );
+
+      //! Attributes
+      std::vector< Attribute > _attributes;
+
+      //! Stream strides
+      std::vector< size_t > _strides;
+
+      //! Interleaved flag
+      bool _interleaved;
+
+      //! Index format
+      IndexFormat _indexFormat;
+
+      //! Stride alignment
+      size_t _strideAlignment;
+
+  }; /* class VertexLayout */
+
+  /**
+   * Growable byte buffer whose data is 16 byte aligned
+   * @class AlignedBuffer
+   */
+  class AlignedBuffer
+  {
+    public:
+      RETO_API
+      AlignedBuffer( void );
+
+      RETO_API
+      AlignedBuffer( const AlignedBuffer& other );
+
+      RETO_API
+      AlignedBuffer& operator=( const AlignedBuffer& other );
+
+      RETO_API
+      AlignedBuffer( AlignedBuffer&& other );
+
+      RETO_API
+      AlignedBuffer& operator=( AlignedBuffer&& other );
+
+      /**
+       * Method to resize the buffer keeping its content. New bytes are
+       * not initialized.
+       * @param size: New size in bytes.
+       */
+      RETO_API
+      void resize( size_t size );
+
+      /**
+       * Method to reserve memory
+       * @param capacity: Capacity in bytes.
+       */
+      RETO_API
+      void reserve( size_t capacity );
+
+      /**
+       * Method to get the buffer size
+       * @return size in bytes.
+       */
+      RETO_API
+      size_t size( void ) const;
+
+      /**
+       * Method to get the buffer content
+       * @return 16 byte aligned pointer ( nullptr if never allocated ).
+       */
+      RETO_API
+      unsigned char* data( void );
+
+      RETO_API
+      const unsigned char* data( void ) const;
+
+    private:
+      //! Allocated memory
+      std::unique_ptr< unsigned char[ ] > _storage;
+
+      //! Aligned start of the allocated memory
+      unsigned char* _data;
+
+      //! Used bytes
+      size_t _size;
+
+      //! Available bytes
+      size_t _capacity;
+
+  }; /* class AlignedBuffer */
+
+  /**
+   * Model stored following a VertexLayout, ready for GPU upload
+   * @class PackedModel
+   */
+  class PackedModel
+  {
+    public:
+      /**
+       * PackedModel constructor
+       * @param layout: Vertex layout.
+       */
+      RETO_API
+      PackedModel( const VertexLayout& layout = VertexLayout( ));
+
+      /**
+       * Method to pack a Model. Attributes missing in the model are stored
+       * as zeros.
+       * @param model: Model to pack.
+       * @param layout: Vertex layout.
+       * @return PackedModel
+       */
+      RETO_API
+      static PackedModel pack( const Model& model,
+        const VertexLayout& layout );
+
+      /**
+       * Method to reserve memory
+       * @param numVertices: Expected number of vertices.
+       * @param numIndices: Expected number of indices.
+       */
+      RETO_API
+      void reserve( size_t numVertices, size_t numIndices );
+
+      /**
+       * Method to add a vertex. Null attributes are stored as zeros and
+       * attributes not in the layout are ignored.
+       * @param position: Position ( 3 floats ).
+       * @param normal: Normal ( 3 floats ).
+       * @param texCoord: Texture coordinates ( 2 floats ).
+       * @param tangent: Tangent ( 3 floats ).
+       * @param bitangent: Bitangent ( 3 floats ).
+       */
+      RETO_API
+      void addVertex( const float* position, const float* normal,
+        const float* texCoord, const float* tangent = nullptr,
+        const float* bitangent = nullptr );
+
+      /**
+       * Method to add an index
+       * @param index: Vertex index.
+       */
+      RETO_API
+      void addIndex( uint32_t index );
+
+      /**
+       * Method to choose the final index format once all vertices and
+       * indices have been added, narrowing indices to 16 bits if possible.
+       */
+      RETO_API
+      void finish( void );
+
+      /**
+       * Method to get the layout
+       * @return VertexLayout
+       */
+      RETO_API
+      const VertexLayout& layout( void ) const;
+
+      /**
+       * Method to get the number of vertices
+       * @return size_t
+       */
+      RETO_API
+      size_t numVertices( void ) const;
+
+      /**
+       * Method to get the number of indices
+       * @return size_t
+       */
+      RETO_API
+      size_t numIndices( void ) const;
+
+      /**
+       * Method to get a vertex stream
+       * @param stream: Stream index ( see VertexLayout::numStreams ).
+       * @return AlignedBuffer
+       */
+      RETO_API
+      const AlignedBuffer& stream( size_t stream ) const;
+
+      /**
+       * Method to get the indices, stored as indexFormat says
+       * @return AlignedBuffer
+       */
+      RETO_API
+      const AlignedBuffer& indices( void ) const;
+
+      /**
+       * Method to get the index format. It is UInt32 until finish is
+       * called.
+       * @return IndexFormat::UInt16 or IndexFormat::UInt32
+       */
+      RETO_API
+      IndexFormat indexFormat( void ) const;
+
+    private:
+      //! Vertex layout
+      VertexLayout _layout;
+
+      //! Vertex streams
+      std::vector< AlignedBuffer > _streams;
+
+      //! Indices
+      AlignedBuffer _indices;
+
+      //! Number of vertices
+      size_t _numVertices;
+
+      //! Number of indices
+      size_t _numIndices;
+
+      //! Current index format
+      IndexFormat _indexFormat;
+
+  }; /* class PackedModel */
+
+} /* namespace reto */
+
+#endif /* __RETO__VERTEX_LAYOUT__ */
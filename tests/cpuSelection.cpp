@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "retoTests.h"
+
+#include <cstdlib>
+
+using namespace reto;
+
+namespace
+{
+  // Pickable without rendering, a set of points
+  class CpuPoints : public reto::Pickable
+  {
+  public:
+    CpuPoints( const std::vector< float >& positions )
+      : _positions( positions )
+      , _selected( false )
+    {
+    }
+
+    void render( reto::ShaderProgram* ) { }
+    std::vector< float > getModel( void ) const { return _model; }
+    std::vector< float > getPositions( void ) const { return _positions; }
+    bool getSelected( void ) const { return _selected; }
+    void setSelected( const bool& selected ) { _selected = selected; }
+
+    void translate( float x, float y, float z )
+    {
+      _model.assign( 16, 0.0f );
+      _model[ 0 ] = _model[ 5 ] = _model[ 10 ] = _model[ 15 ] = 1.0f;
+      _model[ 12 ] = x;
+      _model[ 13 ] = y;
+      _model[ 14 ] = z;
+    }
+
+    std::vector< float > _model;
+    std::vector< float > _positions;
+    bool _selected;
+  };
+
+  const unsigned int SIZE = 500;
+
+  const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+  // Grid of side x side square outlines, one in the middle of each cell
+  std::vector< CpuPoints* > createGrid( unsigned int side )
+  {
+    std::vector< CpuPoints* > grid;
+    const float cell = 2.0f / side;
+    for ( unsigned int y = 0; y < side; ++y )
+    {
+      for ( unsigned int x = 0; x < side; ++x )
+      {
+        const float x0 = -1.0f + cell * ( x + 0.2f );
+        const float y0 = -1.0f + cell * ( y + 0.2f );
+        const float x1 = x0 + cell * 0.6f;
+        const float y1 = y0 + cell * 0.6f;
+        grid.push_back( new CpuPoints({ x0, y0, 0.0f, x1, y0, 0.0f,
+          x1, y1, 0.0f, x0, y1, 0.0f, x0, y0, 0.0f }));
+      }
+    }
+    return grid;
+  }
+
+  std::vector< bool > selectedFlags( const std::vector< CpuPoints* >& objects )
+  {
+    std::vector< bool > flags;
+    for ( auto o : objects )
+      flags.push_back( o->getSelected( ));
+    return flags;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( cpuSelection_rectangle )
+{
+  CpuSelection selection( SIZE, SIZE );
+
+  // Nothing to select
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 0, 0 ),
+    Point( 250, 250 ), IDENTITY ), 0u );
+
+  // The band covers the top left quarter of the window
+  const unsigned int side = 8;
+  std::vector< CpuPoints* > grid = createGrid( side );
+  for ( auto g : grid )
+    selection.addObject( g );
+  selection.addObject( grid[ 0 ]);
+  BOOST_CHECK_EQUAL( selection.objects( ).size( ), grid.size( ));
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 0, 0 ),
+    Point( 250, 250 ), IDENTITY ), 16u );
+  for ( unsigned int i = 0; i < grid.size( ); ++i )
+  {
+    const bool inside = i % side < side / 2 && i / side >= side / 2;
+    BOOST_CHECK_EQUAL( grid[ i ]->getSelected( ), inside );
+  }
+  BOOST_CHECK( selection.selected( ).front( ) == grid[ 32 ]);
+
+  // Points are read in any order, and an empty band selects nothing
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 250, 250 ),
+    Point( 0, 0 ), IDENTITY ), 16u );
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 100, 100 ),
+    Point( 100, 100 ), IDENTITY ), 0u );
+  BOOST_CHECK( !grid[ 32 ]->getSelected( ));
+
+  // Model matrices move the vertices of their object only
+  grid[ 0 ]->translate( 0.0f, 1.5f, 0.0f );
+  grid[ 63 ]->translate( 5.0f, 0.0f, 0.0f );
+  selection.selectRectangle( Point( 0, 0 ), Point( 250, 250 ), IDENTITY );
+  BOOST_CHECK( grid[ 0 ]->getSelected( ));
+  BOOST_CHECK( !grid[ 1 ]->getSelected( ));
+  BOOST_CHECK( grid[ 56 ]->getSelected( ));
+  selection.selectRectangle( Point( 440, 0 ), Point( 499, 60 ), IDENTITY );
+  BOOST_CHECK( !grid[ 63 ]->getSelected( ));
+  grid[ 63 ]->_model.clear( );
+  selection.selectRectangle( Point( 440, 0 ), Point( 499, 60 ), IDENTITY );
+  BOOST_CHECK( grid[ 63 ]->getSelected( ));
+  BOOST_CHECK( !grid[ 62 ]->getSelected( ));
+
+  // The view projection matrix is applied after the model
+  float zoom[ 16 ];
+  std::copy( IDENTITY, IDENTITY + 16, zoom );
+  zoom[ 15 ] = 5.0f;
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 200, 200 ),
+    Point( 300, 300 ), zoom ), 64u );
+
+  // Positions are read again on request
+  grid[ 1 ]->_positions.assign( 3, 0.9f );
+  selection.selectRectangle( Point( 440, 0 ), Point( 499, 60 ), IDENTITY );
+  BOOST_CHECK( !grid[ 1 ]->getSelected( ));
+  selection.updateGeometry( grid[ 1 ]);
+  selection.selectRectangle( Point( 440, 0 ), Point( 499, 60 ), IDENTITY );
+  BOOST_CHECK( grid[ 1 ]->getSelected( ));
+
+  // Removed objects keep their state
+  selection.removeObject( grid[ 63 ]);
+  BOOST_CHECK_EQUAL( selection.selectRectangle( Point( 0, 0 ),
+    Point( 499, 499 ), IDENTITY ), 63u );
+  BOOST_CHECK( grid[ 63 ]->getSelected( ));
+
+  // Objects outside the frustum of the culling system are not selected
+  grid[ 0 ]->translate( 0.0f, 0.0f, 0.0f );
+  CullingSystem culling;
+  for ( auto g : grid )
+    culling.AddObject( g );
+  float shift[ 16 ];
+  std::copy( IDENTITY, IDENTITY + 16, shift );
+  shift[ 12 ] = 1.5f;
+  culling.cull( shift );
+  selection.setCulling( &culling );
+  selection.selectRectangle( Point( 0, 0 ), Point( 499, 499 ), IDENTITY );
+  for ( unsigned int i = 0; i < grid.size( ) - 1; ++i )
+  {
+    BOOST_CHECK_EQUAL( grid[ i ]->getSelected( ),
+      culling.inFrustum( grid[ i ]));
+  }
+  selection.setCulling( nullptr );
+
+  selection.clear( );
+  BOOST_CHECK( selection.objects( ).empty( ));
+  BOOST_CHECK( selection.selected( ).empty( ));
+  for ( auto g : grid )
+    delete g;
+}
+
+BOOST_AUTO_TEST_CASE( cpuSelection_lasso )
+{
+  CpuSelection selection( SIZE, SIZE );
+
+  // Single points at the center, in an arm and in a gap of a star
+  std::vector< CpuPoints* > points = {
+    new CpuPoints({ 0.0f, 0.0f, 0.0f }),
+    new CpuPoints({ 0.0f, 0.6f, 0.0f }),
+    new CpuPoints({ 0.0f, -0.6f, 0.0f }),
+    new CpuPoints({})};
+  for ( auto p : points )
+    selection.addObject( p );
+
+  // Star drawn in one stroke, so its center is covered twice and it is
+  // outside by the even-odd rule
+  std::vector< Point > star;
+  for ( int i = 0; i < 5; ++i )
+  {
+    const float angle = 1.5707963f + i * 2.5132741f;
+    star.push_back( Point(
+      static_cast< unsigned int >( 250.0f + 225.0f * cosf( angle )),
+      static_cast< unsigned int >( 250.0f - 225.0f * sinf( angle ))));
+  }
+  BOOST_CHECK_EQUAL( selection.selectLasso( star, IDENTITY ), 1u );
+  BOOST_CHECK( points[ 1 ]->getSelected( ));
+
+  // Concave path around the gap of the star
+  const std::vector< Point > hook = { Point( 50, 50 ), Point( 450, 50 ),
+    Point( 450, 450 ), Point( 350, 450 ), Point( 350, 150 ),
+    Point( 150, 150 ), Point( 150, 450 ), Point( 50, 450 )};
+  BOOST_CHECK_EQUAL( selection.selectLasso( hook, IDENTITY ), 1u );
+  BOOST_CHECK( points[ 1 ]->getSelected( ));
+  std::vector< Point > flipped;
+  for ( auto p : hook )
+    flipped.push_back( Point( p.first, SIZE - p.second ));
+  BOOST_CHECK_EQUAL( selection.selectLasso( flipped, IDENTITY ), 1u );
+  BOOST_CHECK( points[ 2 ]->getSelected( ));
+  BOOST_CHECK( !points[ 1 ]->getSelected( ));
+
+  // Paths without area select nothing
+  BOOST_CHECK_EQUAL( selection.selectLasso( std::vector< Point >(
+    hook.begin( ), hook.begin( ) + 2 ), IDENTITY ), 0u );
+  BOOST_CHECK_EQUAL( selection.selectLasso({ Point( 0, 250 ),
+    Point( 250, 250 ), Point( 499, 250 )}, IDENTITY ), 0u );
+  BOOST_CHECK( !points[ 0 ]->getSelected( ));
+
+  for ( auto p : points )
+    delete p;
+}
+
+BOOST_AUTO_TEST_CASE( cpuSelection_backends )
+{
+  // Random clouds of different sizes, with the last vertex of each one
+  // somewhere in the window, so blocks of the same object race to select it
+  srand( 7 );
+  std::vector< CpuPoints* > clouds;
+  for ( unsigned int i = 0; i < 200; ++i )
+  {
+    std::vector< float > positions(( 1 + rand( ) % ( i % 10 == 0 ?
+      20000 : 50 )) * 3 );
+    for ( auto& p : positions )
+      p = 1.0f + static_cast< float >( rand( )) / RAND_MAX;
+    for ( unsigned int k = 0; k < 2; ++k )
+    {
+      positions[ positions.size( ) - 3 + k ] =
+        static_cast< float >( rand( )) / RAND_MAX * 2.0f - 1.0f;
+    }
+    clouds.push_back( new CpuPoints( positions ));
+  }
+
+  const std::vector< Point > lasso = { Point( 20, 30 ), Point( 480, 90 ),
+    Point( 200, 200 ), Point( 400, 470 ), Point( 60, 400 )};
+  std::vector< bool > reference[ 2 ];
+  for ( unsigned int threads = 1; threads <= 4; threads += 3 )
+  {
+    for ( int level = 0; level < 2; ++level )
+    {
+      CpuSelection selection( SIZE, SIZE );
+      selection.setNumThreads( threads );
+      BOOST_CHECK_EQUAL( selection.numThreads( ), threads );
+      selection.setSimdLevel( level == 0 ? SimdLevel::Scalar :
+        SimdLevel::AVX2 );
+      BOOST_CHECK( level == 1 || selection.simdLevel( ) ==
+        SimdLevel::Scalar );
+      BOOST_CHECK( selection.simdLevel( ) != SimdLevel::AVX2 );
+      for ( auto c : clouds )
+        selection.addObject( c );
+
+      selection.selectRectangle( Point( 100, 120 ), Point( 380, 410 ),
+        IDENTITY );
+      const std::vector< bool > rectangle = selectedFlags( clouds );
+      selection.selectLasso( lasso, IDENTITY );
+      const std::vector< bool > lassoFlags = selectedFlags( clouds );
+      if ( reference[ 0 ].empty( ))
+      {
+        reference[ 0 ] = rectangle;
+        reference[ 1 ] = lassoFlags;
+        for ( int k = 0; k < 2; ++k )
+        {
+          const size_t count = std::count( reference[ k ].begin( ),
+            reference[ k ].end( ), true );
+          BOOST_CHECK( count > 10u && count < clouds.size( ) - 10u );
+        }
+      }
+      BOOST_CHECK( rectangle == reference[ 0 ]);
+      BOOST_CHECK( lassoFlags == reference[ 1 ]);
+    }
+  }
+
+  for ( auto c : clouds )
+    delete c;
+}
+
+BOOST_AUTO_TEST_CASE( cpuSelection_bounds )
+{
+  // World boxes follow the model matrices
+  ObjectBounds bounds;
+  BOOST_CHECK( bounds.empty( ));
+  bounds.setPositions({ -0.1f, -0.1f, 0.0f, 0.1f, 0.2f, 0.5f });
+  BOOST_CHECK( !bounds.empty( ));
+  const float* world = bounds.world( std::vector< float >( ));
+  BOOST_CHECK_EQUAL( world[ 4 ], 0.2f );
+  std::vector< float > model( IDENTITY, IDENTITY + 16 );
+  model[ 12 ] = 0.5f;
+  world = bounds.world( model );
+  BOOST_CHECK_CLOSE( world[ 0 ], 0.4f, 1e-4f );
+  BOOST_CHECK_CLOSE( world[ 3 ], 0.6f, 1e-4f );
+  model[ 0 ] = 2.0f;
+  world = bounds.world( model );
+  BOOST_CHECK_CLOSE( world[ 0 ], 0.3f, 1e-4f );
+
+  // Boxes inside, outside and across the border of a rectangle
+  SelectionRegion region;
+  const float min[ 2 ] = { -0.5f, -0.5f };
+  const float max[ 2 ] = { 0.5f, 0.5f };
+  region.setRectangle( min, max );
+  const float inside[ 6 ] = { -0.2f, -0.2f, 0.0f, 0.2f, 0.2f, 0.0f };
+  const float outside[ 6 ] = { 0.6f, -0.2f, 0.0f, 0.8f, 0.2f, 0.0f };
+  const float across[ 6 ] = { 0.4f, -0.2f, 0.0f, 0.6f, 0.2f, 0.0f };
+  const float touching[ 6 ] = { 0.5f, -0.2f, 0.0f, 0.8f, 0.2f, 0.0f };
+  BOOST_CHECK_EQUAL( region.classify( inside ), SelectionRegion::INSIDE );
+  BOOST_CHECK_EQUAL( region.classify( outside ), SelectionRegion::OUTSIDE );
+  BOOST_CHECK_EQUAL( region.classify( across ),
+    SelectionRegion::STRADDLING );
+  BOOST_CHECK_EQUAL( region.classify( touching ),
+    SelectionRegion::STRADDLING );
+  region.setMargin( 0.35f, 0.0f );
+  BOOST_CHECK_EQUAL( region.classify( inside ),
+    SelectionRegion::STRADDLING );
+  region.setMargin( 0.0f, 0.0f );
+
+  // Boxes behind the eye are not classified
+  float flip[ 16 ];
+  std::copy( IDENTITY, IDENTITY + 16, flip );
+  flip[ 11 ] = 1.0f;
+  flip[ 15 ] = 0.1f;
+  region.setViewProj( flip );
+  const float behind[ 6 ] = { 0.6f, -0.2f, -0.5f, 0.8f, 0.2f, 0.0f };
+  BOOST_CHECK_EQUAL( region.classify( behind ),
+    SelectionRegion::STRADDLING );
+  region.setViewProj( IDENTITY );
+
+  // Lasso, the box of the points and the edges also classify
+  region.setLasso({ -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, 0.3f, 0.5f,
+    0.3f, -0.3f, -0.3f, -0.3f, -0.3f, 0.5f, -0.5f, 0.5f });
+  BOOST_CHECK( region.lasso( ));
+  const float gap[ 6 ] = { -0.1f, 0.0f, 0.0f, 0.1f, 0.2f, 0.0f };
+  const float bottom[ 6 ] = { -0.1f, -0.45f, 0.0f, 0.1f, -0.35f, 0.0f };
+  BOOST_CHECK_EQUAL( region.classify( gap ), SelectionRegion::OUTSIDE );
+  BOOST_CHECK_EQUAL( region.classify( bottom ), SelectionRegion::INSIDE );
+  BOOST_CHECK_EQUAL( region.classify( outside ), SelectionRegion::OUTSIDE );
+  BOOST_CHECK_EQUAL( region.classify( across ),
+    SelectionRegion::STRADDLING );
+  region.setLasso({ -0.5f, -0.5f, 0.5f, 0.5f });
+  BOOST_CHECK_EQUAL( region.classify( inside ), SelectionRegion::OUTSIDE );
+
+  // A coherent scene: only the objects under the border of the selection
+  // are tested vertex by vertex, with the same results
+  srand( 11 );
+  const unsigned int side = 30;
+  const float cell = 2.0f / side;
+  std::vector< CpuPoints* > clouds;
+  size_t numVertices = 0;
+  for ( unsigned int y = 0; y < side; ++y )
+  {
+    for ( unsigned int x = 0; x < side; ++x )
+    {
+      std::vector< float > positions( 300 );
+      for ( size_t i = 0; i < positions.size( ); ++i )
+      {
+        const float r = 0.8f * static_cast< float >( rand( )) / RAND_MAX;
+        positions[ i ] = i % 3 == 2 ? 0.0f :
+          -1.0f + cell * (( i % 3 == 0 ? x : y ) + 0.1f + r );
+      }
+      numVertices += positions.size( ) / 3;
+      clouds.push_back( new CpuPoints( positions ));
+    }
+  }
+  CpuSelection selection( SIZE, SIZE );
+  for ( auto c : clouds )
+    selection.addObject( c );
+  const std::vector< Point > lasso = { Point( 20, 30 ), Point( 480, 90 ),
+    Point( 200, 200 ), Point( 400, 470 ), Point( 60, 400 )};
+  for ( int k = 0; k < 2; ++k )
+  {
+    std::vector< bool > selected[ 2 ];
+    size_t tested[ 2 ];
+    for ( int boundsTest = 0; boundsTest < 2; ++boundsTest )
+    {
+      selection.setBoundsTest( boundsTest == 1 );
+      if ( k == 0 )
+      {
+        selection.selectRectangle( Point( 60, 80 ), Point( 430, 400 ),
+          IDENTITY );
+      }
+      else
+      {
+        selection.selectLasso( lasso, IDENTITY );
+      }
+      selected[ boundsTest ] = selectedFlags( clouds );
+      tested[ boundsTest ] = selection.testedVertices( );
+    }
+    BOOST_CHECK( selected[ 0 ] == selected[ 1 ]);
+    BOOST_CHECK_EQUAL( tested[ 0 ], numVertices );
+    BOOST_CHECK( tested[ 1 ] * ( k == 0 ? 10 : 5 ) < numVertices );
+    BOOST_CHECK( std::count( selected[ 1 ].begin( ), selected[ 1 ].end( ),
+      true ) > 100 );
+  }
+
+  for ( auto c : clouds )
+    delete c;
+}
+
+BOOST_AUTO_TEST_CASE( cpuSelection_incremental )
+{
+  // Growing rectangle, only boxes near the new strip are classified
+  SelectionRegion previous;
+  const float min[ 2 ] = { -0.5f, -0.5f };
+  const float max[ 2 ] = { 0.5f, 0.5f };
+  const float grown[ 2 ] = { 0.7f, 0.5f };
+  previous.setRectangle( min, max );
+  SelectionRegion region;
+  region.setRectangle( min, grown );
+  BOOST_CHECK( !region.incremental( ));
+  region.setPrevious( previous );
+  BOOST_CHECK( region.incremental( ));
+  const float inside[ 6 ] = { -0.2f, -0.2f, 0.0f, 0.2f, 0.2f, 0.0f };
+  const float strip[ 6 ] = { 0.55f, -0.2f, 0.0f, 0.65f, 0.2f, 0.0f };
+  const float outside[ 6 ] = { 0.8f, -0.2f, 0.0f, 0.9f, 0.2f, 0.0f };
+  BOOST_CHECK_EQUAL( region.classify( inside ), SelectionRegion::UNCHANGED );
+  BOOST_CHECK_EQUAL( region.classify( strip ), SelectionRegion::INSIDE );
+  BOOST_CHECK_EQUAL( region.classify( outside ),
+    SelectionRegion::UNCHANGED );
+
+  // Other matrices or kinds of region are not compared
+  float zoom[ 16 ];
+  std::copy( IDENTITY, IDENTITY + 16, zoom );
+  zoom[ 15 ] = 0.5f;
+  region.setViewProj( zoom );
+  region.setPrevious( previous );
+  BOOST_CHECK( !region.incremental( ));
+  region.setViewProj( IDENTITY );
+  region.setLasso({ -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f });
+  region.setPrevious( previous );
+  BOOST_CHECK( !region.incremental( ));
+
+  // Lassos extending the previous points differ near the new ones and
+  // the previous closing edge
+  const std::vector< float > path = { 0.0f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f,
+    -0.5f, 0.5f, -0.5f, -0.3f };
+  std::vector< float > closed( path );
+  closed.insert( closed.end( ), { -0.3f, -0.5f });
+  previous.setLasso( path );
+  region.setLasso( closed );
+  region.setPrevious( previous );
+  BOOST_CHECK( region.incremental( ));
+  const float cut[ 6 ] = { -0.45f, -0.45f, 0.0f, -0.35f, -0.35f, 0.0f };
+  const float low[ 6 ] = { 0.1f, -0.45f, 0.0f, 0.2f, -0.35f, 0.0f };
+  BOOST_CHECK_EQUAL( region.classify( cut ), SelectionRegion::STRADDLING );
+  BOOST_CHECK_EQUAL( region.classify( low ), SelectionRegion::UNCHANGED );
+  BOOST_CHECK_EQUAL( region.classify( inside ), SelectionRegion::UNCHANGED );
+  BOOST_CHECK_EQUAL( region.classify( outside ),
+    SelectionRegion::UNCHANGED );
+  closed[ 2 ] = 0.4f;
+  previous.setLasso( closed );
+  region.setPrevious( previous );
+  BOOST_CHECK( !region.incremental( ));
+
+  // Dragging over a scene gives the results of whole selections, testing
+  // only the objects near the changes
+  const unsigned int side = 30;
+  std::vector< CpuPoints* > grid = createGrid( side );
+  CpuSelection selection( SIZE, SIZE );
+  CpuSelection reference( SIZE, SIZE );
+  for ( auto o : grid )
+  {
+    selection.addObject( o );
+    reference.addObject( o );
+  }
+  const float corner[ 2 ] = { -0.75f, -0.7f };
+  size_t tested = 0;
+  size_t referenceTested = 0;
+  previous = SelectionRegion( );
+  for ( int step = 0; step < 12; ++step )
+  {
+    // An object moving under the selection is tested again
+    if ( step == 6 )
+      grid[ side * 5 + 5 ]->translate( 2.0f, 0.0f, 0.0f );
+
+    const float end[ 2 ] = { -0.6f + 0.12f * step, -0.55f + 0.1f * step };
+    SelectionRegion current;
+    current.setRectangle( corner, end );
+    current.setViewProj( IDENTITY );
+    reference.select( current );
+    const std::vector< bool > expected = selectedFlags( grid );
+
+    if ( step > 0 )
+      current.setPrevious( previous );
+    selection.select( current );
+    BOOST_CHECK( selectedFlags( grid ) == expected );
+    if ( step > 0 )
+    {
+      tested += selection.testedVertices( );
+      referenceTested += reference.testedVertices( );
+    }
+    previous = current;
+  }
+  BOOST_CHECK( tested * 3 < referenceTested * 2 );
+  BOOST_CHECK( !grid[ side * 5 + 5 ]->getSelected( ));
+  BOOST_CHECK( grid[ side * 5 + 6 ]->getSelected( ));
+
+  for ( auto o : grid )
+    delete o;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "retoTests.h"
+
+using namespace reto;
+
+namespace
+{
+  // Pickable without rendering, an axis aligned box
+  class CpuBox : public reto::Pickable
+  {
+  public:
+    CpuBox( float x0, float y0, float z0, float x1, float y1, float z1 )
+      : _positions{ x0, y0, z0, x1, y1, z1 }
+    {
+    }
+
+    void render( reto::ShaderProgram* ) { }
+    std::vector< float > getModel( void ) const { return _model; }
+    std::vector< float > getPositions( void ) const { return _positions; }
+    bool getSelected( void ) const { return false; }
+    void setSelected( const bool& ) { }
+
+    void translate( float x, float y, float z )
+    {
+      _model.assign( 16, 0.0f );
+      _model[ 0 ] = _model[ 5 ] = _model[ 10 ] = _model[ 15 ] = 1.0f;
+      _model[ 12 ] = x;
+      _model[ 13 ] = y;
+      _model[ 14 ] = z;
+    }
+
+    std::vector< float > _model;
+    std::vector< float > _positions;
+  };
+
+  const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+}
+
+BOOST_AUTO_TEST_CASE( culling_frustum )
+{
+  CullingSystem cs;
+  BOOST_CHECK( cs.cull( IDENTITY ).empty( ));
+
+  // Inside, crossing the right plane, outside on the right and behind the
+  // far plane of the normalized device space
+  std::vector< CpuBox* > boxes = {
+    new CpuBox( -0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f ),
+    new CpuBox( 0.5f, -0.5f, -0.5f, 1.5f, 0.5f, 0.5f ),
+    new CpuBox( 2.0f, -0.5f, -0.5f, 3.0f, 0.5f, 0.5f ),
+    new CpuBox( -0.5f, -0.5f, 1.5f, 0.5f, 0.5f, 2.5f )};
+  for ( auto b : boxes )
+    cs.AddObject( b );
+
+  // Objects count as visible until they are culled
+  BOOST_CHECK( cs.isVisible( boxes[ 2 ]));
+
+  std::vector< Pickable* > visible = cs.cull( IDENTITY );
+  BOOST_CHECK_EQUAL( visible.size( ), 2u );
+  BOOST_CHECK( visible[ 0 ] == boxes[ 0 ]);
+  BOOST_CHECK( visible[ 1 ] == boxes[ 1 ]);
+  BOOST_CHECK( !cs.isVisible( boxes[ 2 ]));
+  BOOST_CHECK( !cs.inFrustum( boxes[ 3 ]));
+  BOOST_CHECK_EQUAL( cs.stats( ).objects, 4u );
+  BOOST_CHECK_EQUAL( cs.stats( ).frustumCulled, 2u );
+  BOOST_CHECK_EQUAL( cs.stats( ).occlusionCulled, 0u );
+  BOOST_CHECK_EQUAL( cs.stats( ).submitted, 2u );
+
+  // Model matrices are read on each cull
+  const unsigned int frame = cs.frame( );
+  boxes[ 2 ]->translate( -2.5f, 0.0f, 0.0f );
+  boxes[ 0 ]->translate( 0.0f, -2.0f, 0.0f );
+  visible = cs.cull( IDENTITY );
+  BOOST_CHECK( cs.frame( ) != frame );
+  BOOST_CHECK_EQUAL( visible.size( ), 2u );
+  BOOST_CHECK( cs.isVisible( boxes[ 2 ]));
+  BOOST_CHECK( !cs.isVisible( boxes[ 0 ]));
+
+  // Rotated models are bounded by the box of their corners
+  boxes[ 0 ]->translate( 0.0f, 0.0f, 0.0f );
+  boxes[ 0 ]->_model[ 0 ] = boxes[ 0 ]->_model[ 5 ] = 0.70710678f;
+  boxes[ 0 ]->_model[ 1 ] = 0.70710678f;
+  boxes[ 0 ]->_model[ 4 ] = -0.70710678f;
+  boxes[ 0 ]->_model[ 12 ] = 1.6f;
+  BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 3u );
+  boxes[ 0 ]->_model[ 12 ] = 1.8f;
+  BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 2u );
+
+  // Bounds are computed again on request
+  boxes[ 3 ]->_positions[ 2 ] = boxes[ 3 ]->_positions[ 5 ] = 0.0f;
+  BOOST_CHECK( !cs.cull( IDENTITY ).empty( ) && !cs.isVisible( boxes[ 3 ]));
+  cs.updateGeometry( boxes[ 3 ]);
+  cs.cull( IDENTITY );
+  BOOST_CHECK( cs.isVisible( boxes[ 3 ]));
+
+  // Occlusion culling without a depth only tests the frustum
+  cs.setOcclusionCulling( true );
+  BOOST_CHECK( cs.occlusionCulling( ));
+  BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 3u );
+
+  cs.RemoveObject( boxes[ 1 ]);
+  BOOST_CHECK_EQUAL( cs.visible( ).size( ), 2u );
+  BOOST_CHECK( cs.isVisible( boxes[ 1 ]));
+  BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 2u );
+  BOOST_CHECK_EQUAL( cs.stats( ).objects, 3u );
+
+  // Camera overload uses its projection view matrix
+  Camera camera;
+  cs.cull( camera.projectionViewMatrix( ));
+  const std::vector< Pickable* > cameraVisible = cs.visible( );
+  BOOST_CHECK( cs.cull( &camera ) == cameraVisible );
+
+  cs.Clear( );
+  BOOST_CHECK( cs.visible( ).empty( ));
+  BOOST_CHECK( cs.cull( IDENTITY ).empty( ));
+  for ( auto b : boxes )
+    delete b;
+}
+
+#ifdef RETO_USE_GLUT
+  #include "pickingScene.h"
+
+  namespace
+  {
+    // Renders the depth of quads in a depth texture
+    class DepthTarget
+    {
+    public:
+      DepthTarget( void )
+      {
+        glGenTextures( 1, &texture );
+        glBindTexture( GL_TEXTURE_2D, texture );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24,
+          pickingScene::WIDTH, pickingScene::HEIGHT, 0, GL_DEPTH_COMPONENT,
+          GL_UNSIGNED_INT, nullptr );
+        glBindTexture( GL_TEXTURE_2D, 0 );
+        glGenFramebuffers( 1, &framebuffer );
+        glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+          GL_TEXTURE_2D, texture, 0 );
+        glDrawBuffer( GL_NONE );
+        glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+        program.loadFromText( pickingScene::vertexCode( ),
+          "#version 430\nvoid main( ) { }" );
+        program.compileAndLink( );
+        program.autocatching( );
+      }
+
+      ~DepthTarget( void )
+      {
+        glDeleteFramebuffers( 1, &framebuffer );
+        glDeleteTextures( 1, &texture );
+      }
+
+      void render( const std::vector< pickingScene::Quad* >& quads )
+      {
+        glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+        glClear( GL_DEPTH_BUFFER_BIT );
+        program.use( );
+        for ( auto q : quads )
+          q->render( &program );
+        glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+      }
+
+      GLuint texture;
+      GLuint framebuffer;
+      ShaderProgram program;
+    };
+  }
+
+  BOOST_AUTO_TEST_CASE( culling_occlusion )
+  {
+    pickingScene::initContext( );
+
+    // Occluder over the left side, quads behind and in front of it, one on
+    // the right and one outside the viewport
+    pickingScene::Quad* occluder = new pickingScene::Quad( -1.0f, -1.0f,
+      0.2f, 1.0f, -0.5f );
+    std::vector< pickingScene::Quad* > quads = { occluder,
+      new pickingScene::Quad( -0.9f, -0.5f, -0.1f, 0.5f, 0.5f ),
+      new pickingScene::Quad( 0.3f, -0.5f, 0.9f, 0.5f, 0.5f ),
+      new pickingScene::Quad( -0.9f, -0.9f, -0.5f, -0.5f, -0.8f ),
+      new pickingScene::Quad( 2.0f, -0.5f, 3.0f, 0.5f, 0.0f )};
+
+    DepthTarget depth;
+    depth.render({ occluder });
+
+    CullingSystem cs;
+    for ( auto q : quads )
+      cs.AddObject( q );
+    cs.setOcclusionCulling( true );
+    cs.updateOcclusion( depth.texture, pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    std::vector< Pickable* > visible = cs.cull( IDENTITY );
+    BOOST_CHECK_EQUAL( visible.size( ), 3u );
+    BOOST_CHECK( cs.isVisible( occluder ));
+    BOOST_CHECK( !cs.isVisible( quads[ 1 ]));
+    BOOST_CHECK( cs.inFrustum( quads[ 1 ]));
+    BOOST_CHECK( cs.isVisible( quads[ 2 ]));
+    BOOST_CHECK( cs.isVisible( quads[ 3 ]));
+    BOOST_CHECK( !cs.inFrustum( quads[ 4 ]));
+    BOOST_CHECK_EQUAL( cs.stats( ).frustumCulled, 1u );
+    BOOST_CHECK_EQUAL( cs.stats( ).occlusionCulled, 1u );
+    BOOST_CHECK_EQUAL( cs.stats( ).submitted, 3u );
+
+    // Without the occluder nothing is hidden
+    depth.render({ });
+    cs.updateOcclusion( depth.texture, pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 4u );
+    cs.clearOcclusion( );
+    depth.render({ occluder });
+    BOOST_CHECK_EQUAL( cs.cull( IDENTITY ).size( ), 4u );
+
+    // Picking renders the visible set only: with a stale depth the quad
+    // behind the removed occluder is not found
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+    for ( auto q : quads )
+      ps.AddObject( q );
+    ps.RemoveObject( occluder );
+    cs.updateOcclusion( depth.texture, pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    cs.cull( IDENTITY );
+
+    const Point behind( 100, 250 );
+    const int behindId = pickingScene::idOf( ps, quads[ 1 ]);
+    BOOST_CHECK_EQUAL( ps.click( behind ), behindId );
+    ps.setCulling( &cs );
+    BOOST_CHECK( ps.culling( ) == &cs );
+    BOOST_CHECK_EQUAL( ps.click( behind ), -1 );
+    BOOST_CHECK_EQUAL( ps.click( Point( 400, 250 )),
+      pickingScene::idOf( ps, quads[ 2 ]));
+
+    for ( bool indirect : { true, false })
+    {
+      ps.setIndirectRendering( indirect );
+      ps.setCulling( &cs );
+      BOOST_CHECK_EQUAL( ps.click( behind ), -1 );
+      BOOST_CHECK_EQUAL( ps.click( Point( 60, 60 )),
+        pickingScene::idOf( ps, quads[ 3 ]));
+      ps.setCulling( nullptr );
+      BOOST_CHECK_EQUAL( ps.click( behind ), behindId );
+
+      // A new cull reaches the draw commands
+      ps.setCulling( &cs );
+      cs.clearOcclusion( );
+      cs.cull( IDENTITY );
+      BOOST_CHECK_EQUAL( ps.click( behind ), behindId );
+      cs.updateOcclusion( depth.texture, pickingScene::WIDTH,
+        pickingScene::HEIGHT );
+      cs.cull( IDENTITY );
+    }
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    ps.setCulling( nullptr );
+    ps.AddObject( occluder );
+    pickingScene::destroy( ps, quads );
+  }
+#endif
@@ -21,10 +21,14 @@
  */
 
 #include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <reto/reto.h>
 #include "retoTests.h"
 
 #include <testData.h>
+#include "legacyObjParser.h"
 
 using namespace reto;
 
@@ -41,6 +45,422 @@ BOOST_AUTO_TEST_CASE( parse_obj_example )
   BOOST_CHECK_EQUAL( m.tangents.size( ), 8 * 3 * 3 );
   BOOST_CHECK_EQUAL( m.bitangents.size( ), 8 * 3 * 3 );
 }
+BOOST_AUTO_TEST_CASE( parse_obj_matches_legacy )
+{
+  LegacyObjParser obj;
+  Model legacy = obj.loadObjLegacy( OBJ_MODEL_TEST_DATA );
+  Model m = obj.loadObj( OBJ_MODEL_TEST_DATA );
+  BOOST_CHECK( m.vertices == legacy.vertices );
+  BOOST_CHECK( m.normals == legacy.normals );
+  BOOST_CHECK( m.texCoords == legacy.texCoords );
+  BOOST_CHECK( m.indices == legacy.indices );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_memory_mapped )
+{
+  ObjParser obj;
+  Model m = obj.loadObj( OBJ_POLYGONS_TEST_DATA );
+  obj.setMemoryMapping( true );
+  BOOST_CHECK( obj.memoryMapping( ));
+  Model mapped = obj.loadObj( OBJ_POLYGONS_TEST_DATA );
+  BOOST_CHECK( mapped.vertices == m.vertices );
+  BOOST_CHECK( mapped.normals == m.normals );
+  BOOST_CHECK( mapped.indices == m.indices );
+
+  Model missing = obj.loadObj( "missing.obj" );
+  BOOST_CHECK( missing.vertices.empty( ));
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_parallel )
+{
+  // Strips of quads using relative indices, big enough to be split in
+  // several chunks. Texture coordinates are only declared half way.
+  std::stringstream content;
+  const unsigned int strips = 60000;
+  content << "v 0 0 0\nv 0 1 0\nvn 0 0 1\n";
+  for ( unsigned int i = 1; i <= strips; ++i )
+  {
+    content << "v " << i << " 0 0.5\nv " << i << " 1 0.25\n";
+    if ( i == strips / 2 )
+      content << "vt 0.5 0.5\n";
+    content << "f -4//1 -2//-1 -1/-1/1 -3//1\n";
+    content << "f 1/1/1 " << 2 * i + 1 << "//1 -1//1\n";
+  }
+  const std::string text = content.str( );
+
+  ObjParser obj;
+  Model sequential = obj.loadObjFromMemory( text.data( ), text.size( ));
+  obj.setNumThreads( 4 );
+  BOOST_CHECK_EQUAL( obj.numThreads( ), 4 );
+  Model parallel = obj.loadObjFromMemory( text.data( ), text.size( ));
+
+  BOOST_CHECK_EQUAL( sequential.indices.size( ), strips * 9 );
+  BOOST_CHECK( parallel.vertices == sequential.vertices );
+  BOOST_CHECK( parallel.normals == sequential.normals );
+  BOOST_CHECK( parallel.texCoords == sequential.texCoords );
+  BOOST_CHECK( parallel.indices == sequential.indices );
+
+  obj.setNumThreads( 1 );
+  BOOST_CHECK_EQUAL( obj.numThreads( ), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_polygons )
+{
+  ObjParser obj;
+  Model m = obj.loadObj( OBJ_POLYGONS_TEST_DATA );
+  BOOST_CHECK_EQUAL( m.vertices.size( ), 10 * 3 );
+  BOOST_CHECK_EQUAL( m.normals.size( ), 10 * 3 );
+  BOOST_CHECK_EQUAL( m.texCoords.size( ), 0 );
+
+  const std::vector< int > indices =
+    { 0, 1, 2, 2, 3, 0, 0, 1, 4, 5, 6, 7, 7, 8, 5, 8, 9, 5 };
+  BOOST_CHECK( m.indices == indices );
+
+  BOOST_CHECK_EQUAL( m.vertices[ 4 * 3 ], 2.0f );
+  BOOST_CHECK_EQUAL( m.vertices[ 4 * 3 + 1 ], 1.0f );
+  BOOST_CHECK_EQUAL( m.normals[ 4 * 3 + 2 ], 1.0f );
+  BOOST_CHECK_EQUAL( m.normals[ 5 * 3 + 2 ], 0.0f );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_positions_only )
+{
+  ObjParser obj;
+  Model m = obj.loadObj( OBJ_TRIANGLE_TEST_DATA );
+  BOOST_CHECK_EQUAL( m.vertices.size( ), 3 * 3 );
+  BOOST_CHECK_EQUAL( m.normals.size( ), 0 );
+  BOOST_CHECK_EQUAL( m.texCoords.size( ), 0 );
+  const std::vector< int > indices = { 0, 1, 2 };
+  BOOST_CHECK( m.indices == indices );
+  BOOST_CHECK_EQUAL( m.vertices[ 3 ], 0.0f );
+  BOOST_CHECK_EQUAL( m.vertices[ 4 ], 1.0f );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_from_memory )
+{
+  const std::string content =
+    "v 1.5 -2.25e1 3\nv 0.1 0.2 0.3\nv 1 1 1\nf 1 2 3\n";
+  ObjParser obj;
+  Model m = obj.loadObjFromMemory( content.data( ), content.size( ) );
+  BOOST_CHECK_EQUAL( m.vertices.size( ), 9 );
+  BOOST_CHECK_EQUAL( m.vertices[ 1 ], -22.5f );
+  BOOST_CHECK_EQUAL( m.vertices[ 3 ], static_cast< float >( std::stod( "0.1" )));
+  BOOST_CHECK_EQUAL( m.indices.size( ), 3 );
+}
+
+namespace
+{
+  // Concatenates streamed batches checking their consistency
+  struct BatchCollector
+  {
+    Model model;
+    size_t batches = 0;
+    size_t bytesRead = 0;
+    size_t bytesTotal = 0;
+    size_t cancelAfter = 0;
+
+    bool operator( )( const ModelBatch& batch )
+    {
+      BOOST_CHECK_EQUAL( batch.firstVertex, model.vertices.size( ) / 3 );
+      BOOST_CHECK_EQUAL( batch.firstIndex, model.indices.size( ));
+      BOOST_CHECK( batch.bytesRead >= bytesRead );
+      BOOST_CHECK( batch.bytesRead <= batch.bytesTotal );
+
+      model.vertices.insert( model.vertices.end( ),
+        batch.vertices.begin( ), batch.vertices.end( ));
+      model.normals.insert( model.normals.end( ),
+        batch.normals.begin( ), batch.normals.end( ));
+      model.texCoords.insert( model.texCoords.end( ),
+        batch.texCoords.begin( ), batch.texCoords.end( ));
+      model.indices.insert( model.indices.end( ),
+        batch.indices.begin( ), batch.indices.end( ));
+      for ( int index : batch.indices )
+        BOOST_CHECK( size_t( index ) < model.vertices.size( ) / 3 );
+
+      bytesRead = batch.bytesRead;
+      bytesTotal = batch.bytesTotal;
+      return ++batches != cancelAfter;
+    }
+  };
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_stream )
+{
+  ObjParser obj;
+  const Model m = obj.loadObj( OBJ_POLYGONS_TEST_DATA );
+
+  for ( bool mapped : { false, true } )
+  {
+    obj.setMemoryMapping( mapped );
+    BatchCollector collector;
+    BOOST_CHECK( obj.loadObjStream( OBJ_POLYGONS_TEST_DATA,
+      std::ref( collector ), 2 ));
+
+    // 6 triangles in batches of 2, plus the final one
+    BOOST_CHECK_EQUAL( collector.batches, 4u );
+    BOOST_CHECK_EQUAL( collector.bytesRead, collector.bytesTotal );
+    BOOST_CHECK( collector.model.vertices == m.vertices );
+    BOOST_CHECK( collector.model.normals == m.normals );
+    BOOST_CHECK( collector.model.indices == m.indices );
+  }
+
+  const std::string content = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "f 1 2 3\nf 1 3 4\nf 4 3 2\n";
+  BatchCollector collector;
+  BOOST_CHECK( obj.loadObjStreamFromMemory( content.data( ), content.size( ),
+    std::ref( collector ), 1 ));
+  BOOST_CHECK_EQUAL( collector.batches, 4u );
+  BOOST_CHECK_EQUAL( collector.model.vertices.size( ), 4 * 3 );
+  BOOST_CHECK_EQUAL( collector.bytesTotal, content.size( ));
+
+  BatchCollector cancelled;
+  cancelled.cancelAfter = 1;
+  BOOST_CHECK( !obj.loadObjStreamFromMemory( content.data( ),
+    content.size( ), std::ref( cancelled ), 1 ));
+  BOOST_CHECK_EQUAL( cancelled.batches, 1u );
+  BOOST_CHECK_EQUAL( cancelled.model.indices.size( ), 3u );
+
+  BOOST_CHECK( !obj.loadObjStream( "missing.obj",
+    []( const ModelBatch& ){ return true; } ));
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_mesh_cache )
+{
+  const std::string source = "retoMeshCacheTest.obj";
+  const std::string cacheFile = MeshCache::cacheFilename( source );
+  {
+    std::ifstream in( OBJ_MODEL_TEST_DATA, std::ios::binary );
+    std::ofstream out( source.c_str( ), std::ios::binary );
+    out << in.rdbuf( );
+  }
+  std::remove( cacheFile.c_str( ));
+
+  ObjParser obj;
+  const Model m = obj.loadObj( source );
+  obj.setMeshCache( true );
+  BOOST_CHECK( obj.meshCache( ));
+  obj.loadObj( source );
+
+  {
+    MeshCache cache( cacheFile );
+    BOOST_CHECK( cache.isValid( ));
+    MeshSource current;
+    BOOST_CHECK( MeshCache::identify( source, current ));
+    BOOST_CHECK_EQUAL( cache.source( ).size, current.size );
+    BOOST_CHECK_EQUAL( cache.source( ).hash, current.hash );
+
+    size_t count = 0;
+    const float* vertices = static_cast< const float* >(
+      cache.data( MeshSection::Vertices, count ));
+    BOOST_CHECK_EQUAL( count, m.vertices.size( ));
+    BOOST_CHECK_EQUAL( reinterpret_cast< size_t >( vertices ) % 64, 0u );
+    BOOST_CHECK( std::equal( m.vertices.begin( ), m.vertices.end( ),
+      vertices ));
+    BOOST_CHECK( cache.data( MeshSection::Tangents, count ) == nullptr );
+    BOOST_CHECK_EQUAL( count, 0u );
+  }
+
+  Model cached = obj.loadObj( source );
+  BOOST_CHECK_EQUAL( obj.vertexIndexStats( ).lookups, 0u );
+  BOOST_CHECK( cached.vertices == m.vertices );
+  BOOST_CHECK( cached.normals == m.normals );
+  BOOST_CHECK( cached.texCoords == m.texCoords );
+  BOOST_CHECK( cached.indices == m.indices );
+
+  // Tangents are added to the cache when first requested
+  const Model tangents = obj.loadObj( source, true );
+  BOOST_CHECK( !tangents.tangents.empty( ));
+  cached = obj.loadObj( source, true );
+  BOOST_CHECK_EQUAL( obj.vertexIndexStats( ).lookups, 0u );
+  // Compared bitwise, the cache must keep exactly what was stored
+  BOOST_CHECK_EQUAL( cached.tangents.size( ), tangents.tangents.size( ));
+  BOOST_CHECK_EQUAL( cached.bitangents.size( ), tangents.bitangents.size( ));
+  BOOST_CHECK( memcmp( cached.tangents.data( ), tangents.tangents.data( ),
+    tangents.tangents.size( ) * sizeof( float )) == 0 );
+  BOOST_CHECK( memcmp( cached.bitangents.data( ),
+    tangents.bitangents.data( ),
+    tangents.bitangents.size( ) * sizeof( float )) == 0 );
+  cached = obj.loadObj( source );
+  BOOST_CHECK( cached.tangents.empty( ));
+
+  // A changed source invalidates the cache
+  {
+    std::ofstream out( source.c_str( ), std::ios::app | std::ios::binary );
+    out << "\nf 1 2 3\n";
+  }
+  cached = obj.loadObj( source );
+  BOOST_CHECK_EQUAL( cached.indices.size( ), m.indices.size( ) + 3 );
+  BOOST_CHECK( obj.vertexIndexStats( ).lookups > 0 );
+
+  // Damaged caches are ignored
+  {
+    std::ofstream out( cacheFile.c_str( ), std::ios::binary | std::ios::trunc );
+    out << "RETOMESH";
+  }
+  BOOST_CHECK( !MeshCache( cacheFile ).isValid( ));
+  cached = obj.loadObj( source );
+  BOOST_CHECK_EQUAL( cached.indices.size( ), m.indices.size( ) + 3 );
+  BOOST_CHECK( MeshCache( cacheFile ).isValid( ));
+
+  std::remove( source.c_str( ));
+  std::remove( cacheFile.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( vertex_index_map )
+{
+  VertexIndexMap map( 4 );
+  const size_t initialCapacity = map.capacity( );
+
+  BOOST_CHECK_EQUAL( map.findOrInsert( 0, -1, -1, 0 ), 0 );
+  BOOST_CHECK_EQUAL( map.findOrInsert( 0, 0, -1, 1 ), 1 );
+  BOOST_CHECK_EQUAL( map.findOrInsert( 0, -1, -1, 2 ), 0 );
+  BOOST_CHECK_EQUAL( map.find( 0, 0, -1 ), 1 );
+  BOOST_CHECK_EQUAL( map.find( 1, 0, -1 ), -1 );
+
+  // Force several growths and check that all corners survive them
+  const int n = 10000;
+  for ( int i = 0; i < n; ++i )
+    BOOST_CHECK_EQUAL( map.findOrInsert( i + 1, i, i % 7, i + 2 ), i + 2 );
+  for ( int i = 0; i < n; ++i )
+    BOOST_CHECK_EQUAL( map.find( i + 1, i, i % 7 ), i + 2 );
+
+  const VertexIndexMap::Stats stats = map.stats( );
+  BOOST_CHECK_EQUAL( stats.size, size_t( n + 2 ));
+  BOOST_CHECK( stats.capacity > initialCapacity );
+  BOOST_CHECK( stats.rehashes > 0 );
+  BOOST_CHECK( stats.loadFactor <= 0.7f );
+  BOOST_CHECK_EQUAL( stats.lookups, uint64_t( n + 3 ));
+  BOOST_CHECK( stats.probes >= stats.lookups );
+
+  map.clear( );
+  BOOST_CHECK_EQUAL( map.size( ), 0u );
+  BOOST_CHECK_EQUAL( map.find( 1, 0, 0 ), -1 );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_vertex_index_stats )
+{
+  ObjParser obj;
+  Model m = obj.loadObj( OBJ_MODEL_TEST_DATA );
+
+  VertexIndexMap::Stats stats = obj.vertexIndexStats( );
+  BOOST_CHECK_EQUAL( stats.size, m.vertices.size( ) / 3 );
+  BOOST_CHECK_EQUAL( stats.lookups, uint64_t( m.indices.size( )));
+  BOOST_CHECK( stats.loadFactor > 0.0f && stats.loadFactor <= 0.7f );
+  BOOST_CHECK( stats.maxProbes >= 1 );
+
+  // Positions only: the table is presized for all the vertices
+  m = obj.loadObj( OBJ_TRIANGLE_TEST_DATA );
+  stats = obj.vertexIndexStats( );
+  BOOST_CHECK_EQUAL( stats.size, 3u );
+  BOOST_CHECK_EQUAL( stats.rehashes, 0u );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_tangents )
+{
+  ObjParser obj;
+  const Model m = obj.loadObj( OBJ_MODEL_TEST_DATA, true );
+  BOOST_REQUIRE_EQUAL( m.tangents.size( ), m.vertices.size( ));
+  BOOST_REQUIRE_EQUAL( m.bitangents.size( ), m.vertices.size( ));
+
+  // Same directions as the original implementation, but normalized
+  Model legacy = m;
+  legacy.tangents.clear( );
+  legacy.bitangents.clear( );
+  LegacyObjParser::calculateTangentsLegacy( legacy );
+  for ( size_t v = 0; v < m.tangents.size( ); v += 3 )
+  {
+    const float* t = &m.tangents[ v ];
+    const float* b = &m.bitangents[ v ];
+    BOOST_CHECK_CLOSE( t[ 0 ] * t[ 0 ] + t[ 1 ] * t[ 1 ] + t[ 2 ] * t[ 2 ],
+      1.0f, 1e-4f );
+    BOOST_CHECK_CLOSE( b[ 0 ] * b[ 0 ] + b[ 1 ] * b[ 1 ] + b[ 2 ] * b[ 2 ],
+      1.0f, 1e-4f );
+
+    const float* lt = &legacy.tangents[ v ];
+    const float* lb = &legacy.bitangents[ v ];
+    const float tLength = sqrtf( lt[ 0 ] * lt[ 0 ] + lt[ 1 ] * lt[ 1 ] +
+      lt[ 2 ] * lt[ 2 ]);
+    const float bLength = sqrtf( lb[ 0 ] * lb[ 0 ] + lb[ 1 ] * lb[ 1 ] +
+      lb[ 2 ] * lb[ 2 ]);
+    for ( int k = 0; k < 3; ++k )
+    {
+      BOOST_CHECK_SMALL( t[ k ] - lt[ k ] / tLength, 1e-5f );
+      BOOST_CHECK_SMALL( b[ k ] - lb[ k ] / bLength, 1e-5f );
+    }
+  }
+
+  // Without texture coordinates the frames are zero
+  const Model positions = obj.loadObj( OBJ_TRIANGLE_TEST_DATA, true );
+  BOOST_CHECK_EQUAL( positions.tangents.size( ), positions.vertices.size( ));
+  for ( size_t i = 0; i < positions.tangents.size( ); ++i )
+  {
+    BOOST_CHECK_EQUAL( positions.tangents[ i ], 0.0f );
+    BOOST_CHECK_EQUAL( positions.bitangents[ i ], 0.0f );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( tangent_generator )
+{
+  // Curved grid, big enough to be split between threads. Odd number of
+  // triangles to exercise the SIMD tails.
+  const int side = 181;
+  Model m;
+  for ( int y = 0; y < side; ++y )
+  {
+    for ( int x = 0; x < side; ++x )
+    {
+      m.vertices.push_back( float( x ));
+      m.vertices.push_back( float( y ));
+      m.vertices.push_back( sinf( x * 0.1f ) * cosf( y * 0.07f ) * 4.0f );
+      m.texCoords.push_back( x / float( side ) + y * 0.001f );
+      m.texCoords.push_back( y / float( side ));
+    }
+  }
+  for ( int y = 0; y + 1 < side; ++y )
+  {
+    for ( int x = 0; x + 1 < side; ++x )
+    {
+      const int i = y * side + x;
+      const int quad[ 6 ] = { i, i + 1, i + side, i + 1, i + side + 1,
+        i + side };
+      m.indices.insert( m.indices.end( ), quad, quad + 6 );
+    }
+  }
+  m.indices.push_back( 0 );
+  m.indices.push_back( 1 );
+  m.indices.push_back( side );
+
+  TangentGenerator generator;
+  generator.setSimdLevel( SimdLevel::Scalar );
+  BOOST_CHECK( generator.simdLevel( ) == SimdLevel::Scalar );
+  Model scalar = m;
+  generator.generate( scalar );
+
+  const int supported = int( TangentGenerator::supportedSimdLevel( ));
+  for ( int level = 0; level <= supported; ++level )
+  {
+    generator.setSimdLevel( SimdLevel( level ));
+    BOOST_CHECK_EQUAL( int( generator.simdLevel( )), level );
+
+    generator.setThreadPool( nullptr );
+    Model sequential = m;
+    generator.generate( sequential );
+    for ( size_t i = 0; i < scalar.tangents.size( ); ++i )
+    {
+      BOOST_CHECK_SMALL( sequential.tangents[ i ] - scalar.tangents[ i ],
+        1e-5f );
+      BOOST_CHECK_SMALL( sequential.bitangents[ i ] - scalar.bitangents[ i ],
+        1e-5f );
+    }
+
+    // Threads accumulate in the same order
+    generator.setThreadPool( std::make_shared< ThreadPool >( 4 ));
+    Model parallel = m;
+    generator.generate( parallel );
+    BOOST_CHECK( parallel.tangents == sequential.tangents );
+    BOOST_CHECK( parallel.bitangents == sequential.bitangents );
+  }
+}
+
 /*
 BOOST_AUTO_TEST_CASE( parse_obj_example2 )
 {
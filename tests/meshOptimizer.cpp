@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <tuple>
+#include <reto/reto.h>
+#include "retoTests.h"
+
+#include <testData.h>
+
+using namespace reto;
+
+namespace
+{
+  typedef std::tuple< float, float, float > Position;
+  typedef std::tuple< Position, Position, Position > Triangle;
+
+  // Grid with positions, normals and texture coordinates, with its
+  // triangles shuffled
+  Model shuffledGrid( int side )
+  {
+    Model m;
+    for ( int y = 0; y < side; ++y )
+    {
+      for ( int x = 0; x < side; ++x )
+      {
+        const float position[ 3 ] = { float( x ), float( y ), 0.0f };
+        const float normal[ 3 ] = { 0.0f, float( y ), 1.0f };
+        const float texCoord[ 2 ] = { float( x ) / side, float( y ) / side };
+        m.vertices.insert( m.vertices.end( ), position, position + 3 );
+        m.normals.insert( m.normals.end( ), normal, normal + 3 );
+        m.texCoords.insert( m.texCoords.end( ), texCoord, texCoord + 2 );
+      }
+    }
+
+    std::vector< std::tuple< int, int, int >> triangles;
+    for ( int y = 0; y + 1 < side; ++y )
+    {
+      for ( int x = 0; x + 1 < side; ++x )
+      {
+        const int i = y * side + x;
+        triangles.push_back( std::make_tuple( i, i + 1, i + side + 1 ));
+        triangles.push_back( std::make_tuple( i, i + side + 1, i + side ));
+      }
+    }
+    unsigned int seed = 12345;
+    for ( size_t i = triangles.size( ) - 1; i > 0; --i )
+    {
+      seed = seed * 1103515245u + 12345u;
+      std::swap( triangles[ i ], triangles[( seed >> 8 ) % ( i + 1 )]);
+    }
+    for ( const auto& t : triangles )
+    {
+      m.indices.push_back( std::get< 0 >( t ));
+      m.indices.push_back( std::get< 1 >( t ));
+      m.indices.push_back( std::get< 2 >( t ));
+    }
+    return m;
+  }
+
+  Position position( const Model& m, int index )
+  {
+    const float* p = &m.vertices[ size_t( index ) * 3 ];
+    return std::make_tuple( p[ 0 ], p[ 1 ], p[ 2 ]);
+  }
+
+  // Triangles by position, rotated to start with the lowest corner so the
+  // winding is kept, and sorted
+  std::vector< Triangle > triangles( const Model& m )
+  {
+    std::vector< Triangle > result;
+    for ( size_t i = 0; i + 2 < m.indices.size( ); i += 3 )
+    {
+      Position c[ 3 ] = { position( m, m.indices[ i ]),
+        position( m, m.indices[ i + 1 ]), position( m, m.indices[ i + 2 ])};
+      std::rotate( c, std::min_element( c, c + 3 ), c + 3 );
+      result.push_back( std::make_tuple( c[ 0 ], c[ 1 ], c[ 2 ]));
+    }
+    std::sort( result.begin( ), result.end( ));
+    return result;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mesh_optimizer_analyze )
+{
+  MeshOptimizer optimizer;
+  BOOST_CHECK_EQUAL( optimizer.cacheSize( ), 32u );
+  optimizer.setCacheSize( 1 );
+  BOOST_CHECK_EQUAL( optimizer.cacheSize( ), 4u );
+  optimizer.setCacheSize( 1000 );
+  BOOST_CHECK_EQUAL( optimizer.cacheSize( ), 64u );
+
+  // Two triangles sharing an edge, and a third one reusing the first
+  // vertices after they left a 4 entry FIFO cache
+  std::vector< int > indices = { 0, 1, 2, 0, 2, 3 };
+  float acmr, atvr;
+  optimizer.analyze( indices, 6, acmr, atvr );
+  BOOST_CHECK_CLOSE( acmr, 2.0f, 1e-4f );
+  BOOST_CHECK_CLOSE( atvr, 1.0f, 1e-4f );
+
+  optimizer.setCacheSize( 4 );
+  indices.insert( indices.end( ), { 4, 5, 3, 0, 1, 4 });
+  optimizer.analyze( indices, 6, acmr, atvr );
+  BOOST_CHECK_CLOSE( acmr, 8.0f / 4.0f, 1e-4f );
+  BOOST_CHECK_CLOSE( atvr, 8.0f / 6.0f, 1e-4f );
+
+  optimizer.analyze( std::vector< int >( ), 0, acmr, atvr );
+  BOOST_CHECK_EQUAL( acmr, 0.0f );
+  BOOST_CHECK_EQUAL( atvr, 0.0f );
+}
+
+BOOST_AUTO_TEST_CASE( mesh_optimizer_grid )
+{
+  const Model original = shuffledGrid( 64 );
+  Model m = original;
+  MeshOptimizer optimizer;
+  const MeshOptimizer::Stats stats = optimizer.optimize( m );
+
+  BOOST_CHECK( stats.acmrBefore > 2.5f );
+  BOOST_CHECK( stats.acmrAfter < 0.8f );
+  BOOST_CHECK( stats.atvrAfter < stats.atvrBefore );
+  BOOST_CHECK( stats.atvrAfter >= 1.0f );
+
+  // Same triangles and per vertex attributes
+  BOOST_CHECK_EQUAL( m.indices.size( ), original.indices.size( ));
+  BOOST_CHECK_EQUAL( m.vertices.size( ), original.vertices.size( ));
+  BOOST_CHECK( triangles( m ) == triangles( original ));
+  for ( size_t v = 0; v < m.vertices.size( ) / 3; ++v )
+  {
+    BOOST_CHECK_EQUAL( m.normals[ v * 3 + 1 ], m.vertices[ v * 3 + 1 ]);
+    BOOST_CHECK_EQUAL( m.texCoords[ v * 2 ] * 64.0f, m.vertices[ v * 3 ]);
+  }
+
+  // Vertices are numbered in order of first use
+  int next = 0;
+  for ( int index : m.indices )
+  {
+    BOOST_REQUIRE( index <= next );
+    if ( index == next )
+      ++next;
+  }
+
+  float acmr, atvr;
+  optimizer.analyze( m.indices, m.vertices.size( ) / 3, acmr, atvr );
+  BOOST_CHECK_EQUAL( acmr, stats.acmrAfter );
+  BOOST_CHECK_EQUAL( atvr, stats.atvrAfter );
+}
+
+BOOST_AUTO_TEST_CASE( mesh_optimizer_unused_vertices )
+{
+  Model m;
+  m.vertices = { 9, 9, 9, 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+  m.indices = { 3, 1, 2 };
+  MeshOptimizer::optimizeVertexFetch( m );
+  const std::vector< int > indices = { 0, 1, 2 };
+  const std::vector< float > vertices = { 0, 1, 0, 0, 0, 0, 1, 0, 0,
+    9, 9, 9 };
+  BOOST_CHECK( m.indices == indices );
+  BOOST_CHECK( m.vertices == vertices );
+}
+
+BOOST_AUTO_TEST_CASE( parse_obj_mesh_optimization )
+{
+  ObjParser obj;
+  BOOST_CHECK( !obj.meshOptimization( ));
+  const Model original = obj.loadObj( OBJ_MODEL_TEST_DATA );
+  BOOST_CHECK_EQUAL( obj.meshOptimizationStats( ).acmrBefore, 0.0f );
+
+  obj.setMeshOptimization( true );
+  const Model optimized = obj.loadObj( OBJ_MODEL_TEST_DATA, true );
+  const MeshOptimizer::Stats stats = obj.meshOptimizationStats( );
+  BOOST_CHECK( stats.acmrBefore > 0.0f );
+  BOOST_CHECK( stats.acmrAfter <= stats.acmrBefore );
+  BOOST_CHECK( triangles( optimized ) == triangles( original ));
+  BOOST_CHECK_EQUAL( optimized.tangents.size( ), optimized.vertices.size( ));
+
+  VertexLayout layout;
+  layout.add( VertexAttribute::Position );
+  const PackedModel packed = obj.loadObjPacked( OBJ_MODEL_TEST_DATA, layout );
+  BOOST_CHECK_EQUAL( packed.numVertices( ), optimized.vertices.size( ) / 3 );
+  BOOST_CHECK_EQUAL( packed.numIndices( ), optimized.indices.size( ));
+
+  // Caches written without the optimization are parsed again
+  const std::string source = "retoMeshOptimization.obj";
+  {
+    std::ifstream in( OBJ_MODEL_TEST_DATA, std::ios::binary );
+    std::ofstream out( source.c_str( ), std::ios::binary );
+    out << in.rdbuf( );
+  }
+  const std::string cacheFile = MeshCache::cacheFilename( source );
+  obj.setMeshCache( true );
+  obj.setMeshOptimization( false );
+  obj.loadObj( source );
+  BOOST_CHECK_EQUAL( MeshCache( cacheFile ).flags( ), 0u );
+
+  obj.setMeshOptimization( true );
+  Model cached = obj.loadObj( source );
+  BOOST_CHECK( obj.meshOptimizationStats( ).acmrBefore > 0.0f );
+  BOOST_CHECK_EQUAL( MeshCache( cacheFile ).flags( ), MeshCache::OPTIMIZED );
+  BOOST_CHECK( cached.indices == optimized.indices );
+
+  cached = obj.loadObj( source );
+  BOOST_CHECK_EQUAL( obj.meshOptimizationStats( ).acmrBefore, 0.0f );
+  BOOST_CHECK( cached.indices == optimized.indices );
+  BOOST_CHECK( cached.vertices == optimized.vertices );
+
+  std::remove( source.c_str( ));
+  std::remove( cacheFile.c_str( ));
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <set>
+#include <tuple>
+#include <reto/reto.h>
+#include "retoTests.h"
+
+#include <testData.h>
+
+using namespace reto;
+
+namespace
+{
+  typedef std::tuple< float, float, float > Position;
+
+  // Grid on the xy plane with height z = height( x, y ). With seam the
+  // vertices of the middle column are split, with different texture
+  // coordinates on each side.
+  Model grid( int side, float ( *height )( float, float ), bool seam )
+  {
+    Model m;
+    std::vector< int > index( side * side );
+    std::vector< int > right( side * side, -1 );
+    for ( int y = 0; y < side; ++y )
+    {
+      for ( int x = 0; x < side; ++x )
+      {
+        const int copies = seam && x == side / 2 ? 2 : 1;
+        for ( int c = 0; c < copies; ++c )
+        {
+          const float position[ 3 ] = { float( x ), float( y ),
+            height( float( x ), float( y ))};
+          const float texCoord[ 2 ] = { float( x ) / side + c,
+            float( y ) / side };
+          const float normal[ 3 ] = { 0.0f, 0.0f, 1.0f };
+          ( c == 0 ? index : right )[ y * side + x ] =
+            int( m.vertices.size( ) / 3 );
+          m.vertices.insert( m.vertices.end( ), position, position + 3 );
+          m.texCoords.insert( m.texCoords.end( ), texCoord, texCoord + 2 );
+          m.normals.insert( m.normals.end( ), normal, normal + 3 );
+        }
+      }
+    }
+    for ( int y = 0; y + 1 < side; ++y )
+    {
+      for ( int x = 0; x + 1 < side; ++x )
+      {
+        // Quads right of the seam use the second copy
+        const int i = y * side + x;
+        auto at = [ & ]( int j )
+        {
+          return right[ j ] >= 0 && x == side / 2 ? right[ j ] : index[ j ];
+        };
+        const int quad[ 6 ] = { at( i ), at( i + 1 ), at( i + side + 1 ),
+          at( i ), at( i + side + 1 ), at( i + side ) };
+        m.indices.insert( m.indices.end( ), quad, quad + 6 );
+      }
+    }
+    return m;
+  }
+
+  float flat( float, float )
+  {
+    return 0.0f;
+  }
+
+  float wave( float x, float y )
+  {
+    return sinf( x * 0.15f ) * cosf( y * 0.1f ) * 3.0f;
+  }
+
+  std::set< Position > positions( const Model& m )
+  {
+    std::set< Position > result;
+    for ( size_t i = 0; i < m.vertices.size( ); i += 3 )
+    {
+      result.insert( std::make_tuple( m.vertices[ i ], m.vertices[ i + 1 ],
+        m.vertices[ i + 2 ]));
+    }
+    return result;
+  }
+
+  // Smallest z of the triangle normals, negative if some triangle flipped
+  float minNormalZ( const Model& m )
+  {
+    float result = 1.0f;
+    for ( size_t i = 0; i < m.indices.size( ); i += 3 )
+    {
+      const float* a = &m.vertices[ m.indices[ i ] * 3 ];
+      const float* b = &m.vertices[ m.indices[ i + 1 ] * 3 ];
+      const float* c = &m.vertices[ m.indices[ i + 2 ] * 3 ];
+      const float e1[ 2 ] = { b[ 0 ] - a[ 0 ], b[ 1 ] - a[ 1 ]};
+      const float e2[ 2 ] = { c[ 0 ] - a[ 0 ], c[ 1 ] - a[ 1 ]};
+      result = std::min( result, e1[ 0 ] * e2[ 1 ] - e1[ 1 ] * e2[ 0 ]);
+    }
+    return result;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mesh_simplifier_flat )
+{
+  const int side = 48;
+  const Model m = grid( side, flat, false );
+  MeshSimplifier simplifier;
+  float error = -1.0f;
+  const Model simple = simplifier.simplify( m, 400, 0.01f, &error );
+
+  BOOST_CHECK( simple.indices.size( ) / 3 <= 400 );
+  BOOST_CHECK( simple.indices.size( ) > 0 );
+  BOOST_CHECK_SMALL( error, 1e-5f );
+  BOOST_CHECK( minNormalZ( simple ) > 0.0f );
+  BOOST_CHECK_EQUAL( simple.normals.size( ), simple.vertices.size( ));
+  BOOST_CHECK_EQUAL( simple.texCoords.size( ) / 2,
+    simple.vertices.size( ) / 3 );
+
+  // Borders are kept
+  const std::set< Position > kept = positions( simple );
+  for ( int i = 0; i < side; ++i )
+  {
+    BOOST_CHECK( kept.count( std::make_tuple( float( i ), 0.0f, 0.0f )));
+    BOOST_CHECK( kept.count( std::make_tuple( 0.0f, float( i ), 0.0f )));
+    BOOST_CHECK( kept.count( std::make_tuple( float( side - 1 ), float( i ),
+      0.0f )));
+  }
+
+  // Only used vertices are kept
+  std::vector< bool > used( simple.vertices.size( ) / 3, false );
+  for ( int index : simple.indices )
+    used[ index ] = true;
+  BOOST_CHECK( std::find( used.begin( ), used.end( ), false ) == used.end( ));
+}
+
+BOOST_AUTO_TEST_CASE( mesh_simplifier_seams )
+{
+  const int side = 40;
+  const Model m = grid( side, wave, true );
+  const Model simple = MeshSimplifier( ).simplify( m, 0, 0.05f );
+  BOOST_CHECK( simple.indices.size( ) < m.indices.size( ) / 4 );
+  BOOST_CHECK( minNormalZ( simple ) > 0.0f );
+
+  // Both copies of every seam vertex are kept, with their attributes
+  size_t seamVertices = 0;
+  for ( size_t v = 0; v < simple.vertices.size( ) / 3; ++v )
+  {
+    const float x = simple.vertices[ v * 3 ];
+    const float u = simple.texCoords[ v * 2 ];
+    if ( x == float( side / 2 ))
+    {
+      ++seamVertices;
+      BOOST_CHECK( u == x / side || u == x / side + 1.0f );
+    }
+    else
+    {
+      BOOST_CHECK_EQUAL( u, x / side );
+    }
+  }
+  BOOST_CHECK_EQUAL( seamVertices, size_t( side * 2 ));
+}
+
+BOOST_AUTO_TEST_CASE( mesh_simplifier_lods )
+{
+  const Model m = grid( 64, wave, false );
+  MeshSimplifier simplifier;
+  const std::vector< LodLevel > lods = simplifier.buildLods( m, 4, 0.5f, 0.02f );
+  BOOST_REQUIRE( lods.size( ) >= 2 );
+  BOOST_CHECK( lods.size( ) <= 4 );
+
+  size_t previous = m.indices.size( );
+  float previousError = 0.0f;
+  for ( const LodLevel& level : lods )
+  {
+    BOOST_CHECK( level.model.indices.size( ) < previous );
+    BOOST_CHECK( level.model.indices.size( ) >= previous / 2 - 3 );
+    BOOST_CHECK( level.error >= previousError );
+    BOOST_CHECK( level.error <= 0.02f );
+    BOOST_CHECK( minNormalZ( level.model ) > 0.0f );
+    previous = level.model.indices.size( );
+    previousError = level.error;
+  }
+
+  // A tighter error bound stops earlier
+  float error;
+  const Model tight = simplifier.simplify( m, 0, 0.0005f, &error );
+  BOOST_CHECK( error <= 0.0005f );
+  BOOST_CHECK( tight.indices.size( ) > lods.back( ).model.indices.size( ));
+
+  // The cube has hard edges only: every vertex is on a seam
+  ObjParser obj;
+  BOOST_CHECK( simplifier.buildLods( obj.loadObj( OBJ_MODEL_TEST_DATA ),
+    4 ).empty( ));
+}
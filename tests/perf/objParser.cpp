@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "../retoTests.h"
+#include "../legacyObjParser.h"
+
+#include <testData.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <thread>
+#include <tuple>
+
+using namespace reto;
+
+namespace
+{
+  const std::string SYNTHETIC_FILE = "retoPerfSynthetic.obj";
+
+  // Writes a grid mesh with positions, texture coordinates and normals
+  void writeSyntheticMesh( const std::string& filename, unsigned int side )
+  {
+    std::ofstream out( filename.c_str( ));
+    out << std::fixed << std::setprecision( 6 );
+    for ( unsigned int y = 0; y < side; ++y )
+    {
+      for ( unsigned int x = 0; x < side; ++x )
+      {
+        const float u = float( x ) / side;
+        const float v = float( y ) / side;
+        out << "v " << u * 100.0f << " " << v * 100.0f << " "
+            << u * v << "\n";
+        out << "vt " << u << " " << v << "\n";
+        out << "vn " << 0.0f << " " << -v << " " << 1.0f << "\n";
+      }
+    }
+    for ( unsigned int y = 0; y + 1 < side; ++y )
+    {
+      for ( unsigned int x = 0; x + 1 < side; ++x )
+      {
+        const unsigned int i0 = y * side + x + 1;
+        const unsigned int i1 = i0 + 1;
+        const unsigned int i2 = i0 + side;
+        const unsigned int i3 = i2 + 1;
+        out << "f " << i0 << "/" << i0 << "/" << i0 << " "
+            << i1 << "/" << i1 << "/" << i1 << " "
+            << i3 << "/" << i3 << "/" << i3 << "\n";
+        out << "f " << i0 << "/" << i0 << "/" << i0 << " "
+            << i3 << "/" << i3 << "/" << i3 << " "
+            << i2 << "/" << i2 << "/" << i2 << "\n";
+      }
+    }
+  }
+
+  double fileSizeMB( const std::string& filename )
+  {
+    std::ifstream in( filename.c_str( ), std::ios::binary | std::ios::ate );
+    return double( in.tellg( )) / ( 1024.0 * 1024.0 );
+  }
+
+  template< typename F >
+  double seconds( F func, unsigned int loops )
+  {
+    const auto start = std::chrono::high_resolution_clock::now( );
+    for ( unsigned int i = 0; i < loops; ++i )
+      func( );
+    const auto end = std::chrono::high_resolution_clock::now( );
+    return std::chrono::duration< double >( end - start ).count( ) / loops;
+  }
+
+  void benchmark( const std::string& name, const std::string& filename,
+    unsigned int loops )
+  {
+    LegacyObjParser parser;
+    Model legacy, current, mapped;
+
+    const double mb = fileSizeMB( filename );
+    const double legacyTime =
+      seconds( [ & ]( ){ legacy = parser.loadObjLegacy( filename ); }, loops );
+    const double currentTime =
+      seconds( [ & ]( ){ current = parser.loadObj( filename ); }, loops );
+    parser.setMemoryMapping( true );
+    const double mappedTime =
+      seconds( [ & ]( ){ mapped = parser.loadObj( filename ); }, loops );
+    const VertexIndexMap::Stats stats = parser.vertexIndexStats( );
+
+    // Streamed from regular reads in blocks, keeping only the batch counts
+    // and the index checksum so the model is never held whole
+    parser.setMemoryMapping( false );
+    size_t streamedVertices = 0;
+    size_t streamedIndices = 0;
+    long long indexSum = 0;
+    const double streamTime = seconds( [ & ]( )
+    {
+      streamedVertices = streamedIndices = 0;
+      indexSum = 0;
+      parser.loadObjStream( filename, [ & ]( const ModelBatch& batch )
+      {
+        streamedVertices += batch.vertices.size( );
+        streamedIndices += batch.indices.size( );
+        for ( int index : batch.indices )
+          indexSum += index;
+        return true;
+      });
+    }, loops );
+
+    BOOST_CHECK( current.vertices == legacy.vertices );
+    BOOST_CHECK( current.normals == legacy.normals );
+    BOOST_CHECK( current.texCoords == legacy.texCoords );
+    BOOST_CHECK( current.indices == legacy.indices );
+    BOOST_CHECK( mapped.vertices == current.vertices );
+    BOOST_CHECK( mapped.indices == current.indices );
+    BOOST_CHECK_EQUAL( streamedVertices, current.vertices.size( ));
+    BOOST_CHECK_EQUAL( streamedIndices, current.indices.size( ));
+    long long currentSum = 0;
+    for ( int index : current.indices )
+      currentSum += index;
+    BOOST_CHECK_EQUAL( indexSum, currentSum );
+
+    std::cout << std::fixed << std::setprecision( 2 )
+      << name << " (" << mb << " MB)" << std::endl
+      << "  legacy:      " << mb / legacyTime << " MB/s" << std::endl
+      << "  single pass: " << mb / currentTime << " MB/s" << std::endl
+      << "  mapped:      " << mb / mappedTime << " MB/s" << std::endl
+      << "  streamed:    " << mb / streamTime << " MB/s" << std::endl
+      << "  speedup:     " << legacyTime / currentTime << "x" << std::endl;
+
+    std::cout << "  vertex table: load factor " << stats.loadFactor
+      << ", probes/lookup " << double( stats.probes ) / double( stats.lookups )
+      << ", rehashes " << stats.rehashes << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( obj_parser_throughput )
+{
+  benchmark( "cube", OBJ_MODEL_TEST_DATA, 1000 );
+
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  benchmark( "synthetic grid", SYNTHETIC_FILE, 1 );
+  std::remove( SYNTHETIC_FILE.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( obj_mesh_cache_load )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  const std::string cacheFile = MeshCache::cacheFilename( SYNTHETIC_FILE );
+  std::remove( cacheFile.c_str( ));
+
+  ObjParser parser;
+  parser.setMemoryMapping( true );
+  parser.setMeshCache( true );
+  Model parsed, cached;
+  const double parseTime =
+    seconds( [ & ]( ){ parsed = parser.loadObj( SYNTHETIC_FILE ); }, 1 );
+  const double cacheTime =
+    seconds( [ & ]( ){ cached = parser.loadObj( SYNTHETIC_FILE ); }, 1 );
+
+  BOOST_CHECK( cached.vertices == parsed.vertices );
+  BOOST_CHECK( cached.normals == parsed.normals );
+  BOOST_CHECK( cached.texCoords == parsed.texCoords );
+  BOOST_CHECK( cached.indices == parsed.indices );
+
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "mesh cache (" << fileSizeMB( SYNTHETIC_FILE ) << " MB obj, "
+    << fileSizeMB( cacheFile ) << " MB cache)" << std::endl
+    << "  parse and write: " << parseTime * 1000.0 << " ms" << std::endl
+    << "  cached load:     " << cacheTime * 1000.0 << " ms, "
+    << parseTime / cacheTime << "x" << std::endl;
+
+  std::remove( cacheFile.c_str( ));
+  std::remove( SYNTHETIC_FILE.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( obj_packed_load )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+
+  VertexLayout layout;
+  layout.add( VertexAttribute::Position )
+    .add( VertexAttribute::Normal, AttributeFormat::Float16 )
+    .add( VertexAttribute::TexCoord );
+
+  ObjParser parser;
+  parser.setMemoryMapping( true );
+  PackedModel direct, repacked;
+  Model model;
+  const double directTime = seconds( [ & ]( )
+  {
+    direct = parser.loadObjPacked( SYNTHETIC_FILE, layout );
+  }, 1 );
+  const double repackTime = seconds( [ & ]( )
+  {
+    model = parser.loadObj( SYNTHETIC_FILE );
+    repacked = PackedModel::pack( model, layout );
+  }, 1 );
+
+  BOOST_CHECK_EQUAL( direct.stream( 0 ).size( ), repacked.stream( 0 ).size( ));
+  BOOST_CHECK( memcmp( direct.stream( 0 ).data( ), repacked.stream( 0 ).data( ),
+    direct.stream( 0 ).size( )) == 0 );
+
+  const double modelBytes = double( model.vertices.size( ) +
+    model.normals.size( ) + model.texCoords.size( )) * sizeof( float );
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "packed load (" << direct.numVertices( ) << " vertices)" << std::endl
+    << "  loadObj + pack: " << repackTime * 1000.0 << " ms" << std::endl
+    << "  loadObjPacked:  " << directTime * 1000.0 << " ms, "
+    << repackTime / directTime << "x" << std::endl
+    << "  vertex memory:  " << direct.stream( 0 ).size( ) / modelBytes * 100.0
+    << "% of Model" << std::endl;
+
+  std::remove( SYNTHETIC_FILE.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( vertex_index_map_scaling )
+{
+  // Corners of a smooth grid mesh with shared v/vt/vn indices, in face
+  // order, as produced by a typical exporter
+  const char* cornersEnv = ::getenv( "RETO_PERF_CORNERS" );
+  const size_t numCorners =
+    cornersEnv ? size_t( ::atoll( cornersEnv )) : size_t( 10000000 );
+  const int side = int( ::sqrt( double( numCorners ) / 6.0 )) + 2;
+
+  std::vector< int > corners;
+  corners.reserve( numCorners );
+  for ( int y = 0; corners.size( ) < numCorners; ++y )
+  {
+    for ( int x = 0; x + 1 < side && corners.size( ) < numCorners; ++x )
+    {
+      const int i0 = y * side + x;
+      const int quad[ 6 ] = { i0, i0 + 1, i0 + side + 1,
+        i0, i0 + side + 1, i0 + side };
+      for ( int k = 0; k < 6 && corners.size( ) < numCorners; ++k )
+        corners.push_back( quad[ k ] );
+    }
+  }
+
+  std::vector< int > mapIndices( numCorners ), hashIndices( numCorners );
+  const double mapTime = seconds( [ & ]( )
+  {
+    std::map< std::tuple< int, int, int >, int > cache;
+    int next = 0;
+    for ( size_t i = 0; i < numCorners; ++i )
+    {
+      const int c = corners[ i ];
+      auto inserted = cache.insert(
+        std::make_pair( std::make_tuple( c, c, c ), next ));
+      if ( inserted.second )
+        ++next;
+      mapIndices[ i ] = inserted.first->second;
+    }
+  }, 1 );
+
+  VertexIndexMap::Stats stats;
+  const double hashTime = seconds( [ & ]( )
+  {
+    VertexIndexMap table( size_t( side ) * side );
+    int next = 0;
+    for ( size_t i = 0; i < numCorners; ++i )
+    {
+      const int c = corners[ i ];
+      const int index = table.findOrInsert( c, c, c, next );
+      if ( index == next )
+        ++next;
+      hashIndices[ i ] = index;
+    }
+    stats = table.stats( );
+  }, 1 );
+
+  BOOST_CHECK( hashIndices == mapIndices );
+  BOOST_CHECK( stats.loadFactor <= 0.7f );
+
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "vertex deduplication (" << numCorners << " corners, "
+    << stats.size << " vertices)" << std::endl
+    << "  std::map:       " << numCorners / mapTime / 1e6
+    << " M corners/s" << std::endl
+    << "  VertexIndexMap: " << numCorners / hashTime / 1e6
+    << " M corners/s, " << mapTime / hashTime << "x" << std::endl
+    << "  load factor " << stats.loadFactor << ", capacity "
+    << stats.capacity << ", probes/lookup "
+    << double( stats.probes ) / double( stats.lookups )
+    << ", max probes " << stats.maxProbes << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( obj_parser_thread_scaling )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  const double mb = fileSizeMB( SYNTHETIC_FILE );
+
+  ObjParser parser;
+  parser.setMemoryMapping( true );
+  Model sequential;
+  const double sequentialTime =
+    seconds( [ & ]( ){ sequential = parser.loadObj( SYNTHETIC_FILE ); }, 1 );
+
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "thread scaling (" << mb << " MB)" << std::endl
+    << "  1 thread: " << mb / sequentialTime << " MB/s" << std::endl;
+
+  const unsigned int maxThreads =
+    std::max( 4u, std::thread::hardware_concurrency( ));
+  for ( unsigned int threads = 2; threads <= maxThreads; threads *= 2 )
+  {
+    Model parallel;
+    parser.setNumThreads( threads );
+    const double time =
+      seconds( [ & ]( ){ parallel = parser.loadObj( SYNTHETIC_FILE ); }, 1 );
+
+    BOOST_CHECK( parallel.vertices == sequential.vertices );
+    BOOST_CHECK( parallel.normals == sequential.normals );
+    BOOST_CHECK( parallel.texCoords == sequential.texCoords );
+    BOOST_CHECK( parallel.indices == sequential.indices );
+
+    std::cout << std::fixed << std::setprecision( 2 )
+      << "  " << threads << " threads: " << mb / time << " MB/s, "
+      << sequentialTime / time << "x" << std::endl;
+  }
+  std::remove( SYNTHETIC_FILE.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( tangent_throughput )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  ObjParser parser;
+  const Model base = parser.loadObj( SYNTHETIC_FILE );
+  std::remove( SYNTHETIC_FILE.c_str( ));
+  const double triangles = double( base.indices.size( ) / 3 );
+
+  Model legacy = base;
+  const double legacyTime = seconds( [ & ]( )
+  {
+    legacy.tangents.clear( );
+    legacy.bitangents.clear( );
+    LegacyObjParser::calculateTangentsLegacy( legacy );
+  }, 1 );
+
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "tangents (" << base.indices.size( ) / 3 << " triangles)" << std::endl
+    << "  legacy:          " << triangles / legacyTime / 1e6
+    << " M triangles/s" << std::endl;
+
+  // Largest angle between the new frames and the normalized legacy sums
+  auto maxAngle = [ & ]( const std::vector< float >& current,
+    const std::vector< float >& reference )
+  {
+    double worst = 0.0;
+    for ( size_t v = 0; v < current.size( ); v += 3 )
+    {
+      const float* a = &current[ v ];
+      const float* b = &reference[ v ];
+      const double cross[ 3 ] = {
+        double( a[ 1 ]) * b[ 2 ] - double( a[ 2 ]) * b[ 1 ],
+        double( a[ 2 ]) * b[ 0 ] - double( a[ 0 ]) * b[ 2 ],
+        double( a[ 0 ]) * b[ 1 ] - double( a[ 1 ]) * b[ 0 ]};
+      const double dot = double( a[ 0 ]) * b[ 0 ] +
+        double( a[ 1 ]) * b[ 1 ] + double( a[ 2 ]) * b[ 2 ];
+      worst = std::max( worst, ::atan2( ::sqrt( cross[ 0 ] * cross[ 0 ] +
+        cross[ 1 ] * cross[ 1 ] + cross[ 2 ] * cross[ 2 ]), dot ));
+    }
+    return worst * 180.0 / ::acos( -1.0 );
+  };
+
+  const char* names[ 3 ] = { "scalar", "sse", "avx2" };
+  const unsigned int hardwareThreads =
+    std::max( 2u, std::thread::hardware_concurrency( ));
+  const int supported = int( TangentGenerator::supportedSimdLevel( ));
+  TangentGenerator generator;
+  Model sequential;
+  for ( int level = 0; level <= supported; ++level )
+  {
+    generator.setSimdLevel( SimdLevel( level ));
+    generator.setThreadPool( nullptr );
+    Model current = base;
+    const double time =
+      seconds( [ & ]( ){ generator.generate( current ); }, 3 );
+    if ( level == 0 )
+      sequential = current;
+
+    std::cout << std::fixed << std::setprecision( 2 )
+      << "  " << std::setw( 6 ) << std::left << names[ level ]
+      << std::right << ":         " << triangles / time / 1e6
+      << " M triangles/s, " << legacyTime / time << "x, max angle "
+      << std::scientific
+      << maxAngle( current.tangents, legacy.tangents ) << " / "
+      << maxAngle( current.bitangents, legacy.bitangents )
+      << " deg" << std::endl;
+
+    generator.setThreadPool(
+      std::make_shared< ThreadPool >( hardwareThreads ));
+    Model parallel = base;
+    const double parallelTime =
+      seconds( [ & ]( ){ generator.generate( parallel ); }, 3 );
+    BOOST_CHECK( parallel.tangents == current.tangents );
+    BOOST_CHECK( parallel.bitangents == current.bitangents );
+
+    std::cout << std::fixed << std::setprecision( 2 )
+      << "  " << std::setw( 6 ) << std::left << names[ level ]
+      << std::right << " x" << std::setw( 2 ) << hardwareThreads << " threads: "
+      << triangles / parallelTime / 1e6 << " M triangles/s, "
+      << legacyTime / parallelTime << "x" << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mesh_optimizer_throughput )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  ObjParser parser;
+  const Model base = parser.loadObj( SYNTHETIC_FILE );
+  std::remove( SYNTHETIC_FILE.c_str( ));
+
+  // File order, and triangles shuffled as a worst case
+  Model shuffled = base;
+  std::vector< size_t > order( base.indices.size( ) / 3 );
+  for ( size_t i = 0; i < order.size( ); ++i )
+    order[ i ] = i;
+  unsigned int seed = 12345;
+  for ( size_t i = order.size( ) - 1; i > 0; --i )
+  {
+    seed = seed * 1103515245u + 12345u;
+    std::swap( order[ i ], order[( seed >> 8 ) % ( i + 1 )]);
+  }
+  for ( size_t i = 0; i < order.size( ); ++i )
+    std::copy( base.indices.begin( ) + order[ i ] * 3,
+      base.indices.begin( ) + order[ i ] * 3 + 3,
+      shuffled.indices.begin( ) + i * 3 );
+
+  std::cout << "mesh optimization (" << base.indices.size( ) / 3
+    << " triangles, " << MeshOptimizer( ).cacheSize( )
+    << " entry cache)" << std::endl;
+  const Model* inputs[ 2 ] = { &base, &shuffled };
+  const char* names[ 2 ] = { "file order", "shuffled" };
+  for ( int i = 0; i < 2; ++i )
+  {
+    Model m;
+    MeshOptimizer::Stats stats;
+    const double time = seconds( [ & ]( )
+    {
+      m = *inputs[ i ];
+      stats = MeshOptimizer( ).optimize( m );
+    }, 1 );
+    BOOST_CHECK( stats.acmrAfter <= stats.acmrBefore );
+
+    std::cout << std::fixed << std::setprecision( 3 )
+      << "  " << names[ i ] << ": ACMR " << stats.acmrBefore << " -> "
+      << stats.acmrAfter << ", ATVR " << stats.atvrBefore << " -> "
+      << stats.atvrAfter << ", " << std::setprecision( 2 )
+      << time * 1000.0 << " ms" << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mesh_simplifier_lods )
+{
+  const char* sideEnv = ::getenv( "RETO_PERF_OBJ_SIDE" );
+  const unsigned int side = sideEnv ? unsigned( ::atoi( sideEnv )) : 512;
+  writeSyntheticMesh( SYNTHETIC_FILE, side );
+  ObjParser parser;
+  const Model base = parser.loadObj( SYNTHETIC_FILE );
+  std::remove( SYNTHETIC_FILE.c_str( ));
+
+  std::vector< LodLevel > lods;
+  const double time = seconds( [ & ]( )
+  {
+    lods = MeshSimplifier( ).buildLods( base, 6, 0.5f, 0.01f );
+  }, 1 );
+  BOOST_CHECK( !lods.empty( ));
+
+  std::cout << std::fixed << std::setprecision( 2 )
+    << "lod chain (" << base.indices.size( ) / 3 << " triangles, "
+    << base.vertices.size( ) / 3 << " vertices): " << time * 1000.0
+    << " ms" << std::endl;
+  for ( size_t i = 0; i < lods.size( ); ++i )
+  {
+    const Model& m = lods[ i ].model;
+    std::cout << "  level " << i + 1 << ": " << m.indices.size( ) / 3
+      << " triangles, " << m.vertices.size( ) / 3 << " vertices ("
+      << double( base.vertices.size( )) / m.vertices.size( )
+      << "x fewer), error " << std::scientific << std::setprecision( 2 )
+      << lods[ i ].error << std::fixed << std::endl;
+  }
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifdef RETO_USE_GLUT
+  #include <reto/reto.h>
+  #include "../retoTests.h"
+  #include "../pickingScene.h"
+
+  #include <chrono>
+  #include <iomanip>
+
+  using namespace reto;
+
+  namespace
+  {
+    template< typename F >
+    double seconds( F func, unsigned int loops )
+    {
+      const auto start = std::chrono::high_resolution_clock::now( );
+      for ( unsigned int i = 0; i < loops; ++i )
+        func( );
+      const auto end = std::chrono::high_resolution_clock::now( );
+      return std::chrono::duration< double >( end - start ).count( ) / loops;
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_area_throughput )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    pickingScene::TestPickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 32 );
+
+    std::cout << "area picking (" << quads.size( ) << " objects, "
+      << pickingScene::WIDTH << "x" << pickingScene::HEIGHT << ")"
+      << std::endl;
+    const unsigned int sizes[] = { 16, 64, 128, 256, 500 };
+    for ( unsigned int size : sizes )
+    {
+      const Point minPoint( 0, 0 );
+      const Point maxPoint( size, size );
+      std::set< unsigned int > ids, legacy;
+      const double time = seconds( [ & ]( )
+      {
+        ids = ps.area( minPoint, maxPoint );
+      }, 20 );
+      // The previous path: one glReadPixels per pixel of the last render
+      const double legacyTime = seconds( [ & ]( )
+      {
+        legacy = pickingScene::areaPerPixel( ps.framebuffer( ), minPoint,
+          maxPoint );
+      }, 1 );
+      BOOST_CHECK( ids == legacy );
+
+      std::cout << std::fixed << std::setprecision( 3 )
+        << "  " << size << "x" << size << ": " << time * 1000.0
+        << " ms (" << ids.size( ) << " ids), per pixel readback "
+        << legacyTime * 1000.0 << " ms" << std::endl;
+    }
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_click_async_throughput )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 32 );
+
+    const unsigned int loops = 200;
+    std::vector< Point > points;
+    for ( unsigned int i = 0; i < loops; ++i )
+      points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+
+    std::vector< int > sync( loops );
+    unsigned int i = 0;
+    const double syncTime = seconds( [ & ]( )
+    {
+      sync[ i ] = ps.click( points[ i ]);
+      ++i;
+    }, loops );
+
+    // A mouse move per frame: issue a pick and collect the previous ones
+    // that are ready, without blocking
+    std::vector< int > async( loops, -2 );
+    std::vector< PickTicket > tickets( loops );
+    i = 0;
+    const double asyncTime = seconds( [ & ]( )
+    {
+      tickets[ i ] = ps.clickAsync( points[ i ]);
+      for ( unsigned int j = 0; j < i; ++j )
+      {
+        if ( async[ j ] == -2 )
+          ps.clickResult( tickets[ j ], async[ j ]);
+      }
+      ++i;
+    }, loops );
+    unsigned int late = 0;
+    for ( unsigned int j = 0; j < loops; ++j )
+    {
+      if ( async[ j ] == -2 )
+      {
+        async[ j ] = ps.clickWait( tickets[ j ]);
+        ++late;
+      }
+    }
+    BOOST_CHECK( async == sync );
+
+    std::cout << std::fixed << std::setprecision( 3 )
+      << "click picking (" << quads.size( ) << " objects)" << std::endl
+      << "  synchronous:  " << syncTime * 1000.0 << " ms per click"
+      << std::endl
+      << "  asynchronous: " << asyncTime * 1000.0 << " ms per click, "
+      << loops - late << "/" << loops << " resolved without waiting"
+      << std::endl;
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_click_batch_throughput )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 32 );
+
+    std::cout << "batched click picking (" << quads.size( ) << " objects)"
+      << std::endl;
+    const unsigned int counts[] = { 4, 16, 64 };
+    for ( unsigned int count : counts )
+    {
+      // Points scattered over the whole frame
+      std::vector< Point > points;
+      for ( unsigned int i = 0; i < count; ++i )
+        points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+
+      std::vector< int > batch, single( count );
+      const double batchTime = seconds( [ & ]( )
+      {
+        batch = ps.clickBatch( points );
+      }, 20 );
+      const double singleTime = seconds( [ & ]( )
+      {
+        for ( unsigned int i = 0; i < count; ++i )
+          single[ i ] = ps.click( points[ i ]);
+      }, 5 );
+      BOOST_CHECK( batch == single );
+
+      std::cout << std::fixed << std::setprecision( 3 )
+        << "  " << count << " points: " << batchTime * 1000.0
+        << " ms batched, " << singleTime * 1000.0 << " ms with click"
+        << std::endl;
+    }
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_indirect_throughput )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    std::cout << "indirect picking" << std::endl;
+    const unsigned int sides[] = { 32, 128 };
+    for ( unsigned int side : sides )
+    {
+      auto quads = pickingScene::createGrid( ps, side );
+      std::vector< Point > points;
+      for ( unsigned int i = 0; i < 20; ++i )
+        points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+
+      std::vector< int > regular( points.size( )), indirect( points.size( ));
+      unsigned int i = 0;
+      const double regularTime = seconds( [ & ]( )
+      {
+        regular[ i ] = ps.click( points[ i ]);
+        ++i;
+      }, unsigned( points.size( )));
+
+      ps.setIndirectRendering( true );
+      const double buildTime = seconds( [ & ]( )
+      {
+        ps.click( points[ 0 ]);
+      }, 1 );
+      i = 0;
+      const double indirectTime = seconds( [ & ]( )
+      {
+        indirect[ i ] = ps.click( points[ i ]);
+        ++i;
+      }, unsigned( points.size( )));
+      ps.setIndirectRendering( false );
+      BOOST_CHECK( regular == indirect );
+
+      std::cout << std::fixed << std::setprecision( 3 )
+        << "  " << quads.size( ) << " objects: " << indirectTime * 1000.0
+        << " ms per click indirect ( first " << buildTime * 1000.0
+        << " ms ), " << regularTime * 1000.0 << " ms with render"
+        << std::endl;
+
+      pickingScene::destroy( ps, quads );
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_culling_throughput )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    // Zoom on the center, leaving most of the grid outside the frustum
+    const float zoom[ 16 ] = { 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 4.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    auto quads = pickingScene::createGrid( ps, 128 );
+    ps.setIndirectRendering( true );
+    ps.setProjectionView( zoom );
+
+    CullingSystem cs;
+    for ( auto q : quads )
+      cs.AddObject( q );
+    const double cullTime = seconds( [ & ]( ) { cs.cull( zoom ); }, 20 );
+
+    std::vector< Point > points;
+    for ( unsigned int i = 0; i < 20; ++i )
+      points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+    std::vector< int > all( points.size( )), culled( points.size( ));
+    ps.click( points[ 0 ]);
+    unsigned int i = 0;
+    const double allTime = seconds( [ & ]( )
+    {
+      all[ i ] = ps.click( points[ i ]);
+      ++i;
+    }, unsigned( points.size( )));
+
+    ps.setCulling( &cs );
+    i = 0;
+    const double culledTime = seconds( [ & ]( )
+    {
+      culled[ i ] = ps.click( points[ i ]);
+      ++i;
+    }, unsigned( points.size( )));
+    ps.setCulling( nullptr );
+    BOOST_CHECK( all == culled );
+
+    std::cout << std::fixed << std::setprecision( 3 )
+      << "culled indirect picking (" << cs.stats( ).objects << " objects, "
+      << cs.stats( ).submitted << " submitted)" << std::endl
+      << "  cull: " << cullTime * 1000.0 << " ms" << std::endl
+      << "  click: " << culledTime * 1000.0 << " ms culled, "
+      << allTime * 1000.0 << " ms without culling" << std::endl;
+
+    pickingScene::destroy( ps, quads );
+  }
+#endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "../retoTests.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+using namespace reto;
+
+namespace
+{
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double elapsedMs( Clock::time_point start )
+  {
+    return std::chrono::duration< double, std::milli >(
+      Clock::now( ) - start ).count( );
+  }
+
+  // Wavy grid of side x side quads over [ 0, 1 ]^2, placed by its model
+  class Surface : public reto::Pickable
+  {
+  public:
+    Surface( unsigned int side, float x, float y )
+    {
+      for ( unsigned int j = 0; j <= side; ++j )
+      {
+        for ( unsigned int i = 0; i <= side; ++i )
+        {
+          const float u = float( i ) / side;
+          const float v = float( j ) / side;
+          _positions.push_back( u );
+          _positions.push_back( v );
+          _positions.push_back( 0.1f * std::sin( 6.0f * u + 4.0f * v ));
+        }
+      }
+      for ( unsigned int j = 0; j < side; ++j )
+      {
+        for ( unsigned int i = 0; i < side; ++i )
+        {
+          const unsigned int k = j * ( side + 1 ) + i;
+          const unsigned int quad[ 6 ] = { k, k + 1, k + side + 1,
+            k + side + 1, k + 1, k + side + 2 };
+          _indices.insert( _indices.end( ), quad, quad + 6 );
+        }
+      }
+      moveTo( x, y, 0.0f );
+    }
+
+    void render( reto::ShaderProgram* ) { }
+    std::vector< float > getModel( void ) const { return _model; }
+    std::vector< float > getPositions( void ) const { return _positions; }
+    std::vector< unsigned int > getIndices( void ) const { return _indices; }
+    bool getSelected( void ) const { return false; }
+    void setSelected( const bool& ) { }
+
+    void moveTo( float x, float y, float z )
+    {
+      _model.assign( 16, 0.0f );
+      _model[ 0 ] = _model[ 5 ] = _model[ 10 ] = _model[ 15 ] = 1.0f;
+      _model[ 12 ] = x;
+      _model[ 13 ] = y;
+      _model[ 14 ] = z;
+    }
+
+  private:
+    std::vector< float > _model;
+    std::vector< float > _positions;
+    std::vector< unsigned int > _indices;
+  };
+}
+
+BOOST_AUTO_TEST_CASE( ray_picking_throughput )
+{
+  const unsigned int SIDE = 32;
+  const unsigned int OBJECTS_SIDE = 32;
+  const unsigned int SIZE = 500;
+
+  std::vector< Surface* > surfaces;
+  RayPickingSystem rps;
+  for ( unsigned int j = 0; j < OBJECTS_SIDE; ++j )
+  {
+    for ( unsigned int i = 0; i < OBJECTS_SIDE; ++i )
+    {
+      surfaces.push_back( new Surface( SIDE, float( i ), float( j )));
+      rps.AddObject( surfaces.back( ));
+    }
+  }
+
+  // Orthographic view of the whole grid of objects
+  const float scale = 2.0f / OBJECTS_SIDE;
+  const float projectionView[ 16 ] = { scale, 0.0f, 0.0f, 0.0f,
+    0.0f, scale, 0.0f, 0.0f, 0.0f, 0.0f, -0.5f, 0.0f,
+    -1.0f, -1.0f, 0.0f, 1.0f };
+
+  Clock::time_point start = Clock::now( );
+  rps.update( );
+  const double buildMs = elapsedMs( start );
+
+  // Move a tenth of the objects, refitting the top level
+  for ( size_t i = 0; i < surfaces.size( ); i += 10 )
+    surfaces[ i ]->moveTo( float( i % OBJECTS_SIDE ) + 0.25f,
+      float( i / OBJECTS_SIDE ), 0.5f );
+  start = Clock::now( );
+  const size_t moved = rps.update( );
+  const double refitMs = elapsedMs( start );
+  BOOST_CHECK_EQUAL( moved, ( surfaces.size( ) + 9 ) / 10 );
+
+  unsigned int clicks = 0;
+  unsigned int hits = 0;
+  start = Clock::now( );
+  for ( unsigned int y = 0; y < SIZE; y += 5 )
+  {
+    for ( unsigned int x = 0; x < SIZE; x += 5 )
+    {
+      hits += rps.clickHit( Point( x, y ), projectionView, SIZE, SIZE )
+        .object >= 0;
+      ++clicks;
+    }
+  }
+  const double clickMs = elapsedMs( start );
+  BOOST_CHECK( hits > clicks * 9 / 10 );
+
+  std::cout << std::fixed << std::setprecision( 3 )
+            << "ray picking (" << surfaces.size( ) << " objects, "
+            << surfaces.size( ) * SIDE * SIDE * 2 << " triangles)\n"
+            << "  build: " << buildMs << " ms, refit of " << moved
+            << " objects: " << refitMs << " ms\n"
+            << "  click: " << clickMs * 1000.0 / clicks << " us ("
+            << hits << "/" << clicks << " hits)" << std::endl;
+
+  rps.Clear( );
+  for ( auto s : surfaces )
+    delete s;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifdef RETO_USE_GLUT
+  #include <reto/reto.h>
+  #include "../retoTests.h"
+  #include "../pickingScene.h"
+
+  #include <chrono>
+  #include <iomanip>
+
+  using namespace reto;
+
+  BOOST_AUTO_TEST_CASE( selection_rubberband_throughput )
+  {
+    pickingScene::initContext( );
+
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    float viewProj[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // A band over a single cell, so the report stays short
+    const unsigned int side = 144;
+    std::vector< pickingScene::Quad* > quads;
+    const float cell = 2.0f / side;
+    for ( unsigned int y = 0; y < side; ++y )
+    {
+      for ( unsigned int x = 0; x < side; ++x )
+      {
+        quads.push_back( new pickingScene::Quad( -1.0f + cell * x,
+          -1.0f + cell * y, -1.0f + cell * ( x + 0.5f ),
+          -1.0f + cell * ( y + 0.5f )));
+        rubberBand.addObject( quads.back( ));
+      }
+    }
+
+    std::cout << "rubberband selection (" << quads.size( ) << " objects)"
+      << std::endl;
+    for ( int i = 0; i < 4; ++i )
+    {
+      // Transform feedback first, including the packing, then compute
+      rubberBand.setComputeSelection( i >= 2 );
+      const auto start = std::chrono::high_resolution_clock::now( );
+      rubberBand.mouseDown( Point( 0, 500 ));
+      rubberBand.mouseUp( Point( 3, 497 ), viewProj );
+      const auto end = std::chrono::high_resolution_clock::now( );
+      const char* names[] = { "first feedback release: ",
+        "feedback release: ", "first compute release: ",
+        "compute release: " };
+      std::cout << std::fixed << std::setprecision( 3 ) << "  " << names[ i ]
+        << std::chrono::duration< double >( end - start ).count( ) * 1000.0
+        << " ms" << std::endl;
+      BOOST_CHECK( quads[ 0 ]->getSelected( ));
+      BOOST_CHECK( !quads[ 1 ]->getSelected( ));
+    }
+
+    // Every vertex through the shaders, as before the bounds test
+    for ( int i = 0; i < 4; ++i )
+    {
+      const bool boundsTest = i % 2 == 1;
+      rubberBand.setBoundsTest( boundsTest );
+      rubberBand.setComputeSelection( i >= 2 );
+      const auto start = std::chrono::high_resolution_clock::now( );
+      rubberBand.mouseDown( Point( 0, 500 ));
+      rubberBand.mouseUp( Point( 3, 497 ), viewProj );
+      const auto end = std::chrono::high_resolution_clock::now( );
+      std::cout << std::fixed << std::setprecision( 3 ) << "  "
+        << ( i >= 2 ? "compute" : "feedback" ) << " release, bounds test "
+        << ( boundsTest ? "on: " : "off: " )
+        << std::chrono::duration< double >( end - start ).count( ) * 1000.0
+        << " ms, " << rubberBand.transformFeedback( )->testedVertices( )
+        << " vertices tested" << std::endl;
+      BOOST_CHECK( quads[ 0 ]->getSelected( ));
+      BOOST_CHECK( !quads[ 1 ]->getSelected( ));
+    }
+
+    // Live preview while dragging a small band, each preview testing only
+    // the objects near the change since the previous one
+    rubberBand.setBoundsTest( true );
+    rubberBand.setComputeSelection( false );
+    rubberBand.setLivePreview( true, 0.0f );
+    const unsigned int numPreviews = 10;
+    unsigned int tested = 0;
+    rubberBand.mouseDown( Point( 0, 500 ));
+    const auto start = std::chrono::high_resolution_clock::now( );
+    for ( unsigned int i = 1; i <= numPreviews; ++i )
+    {
+      rubberBand.mouseMove( Point( 4 * i, 500 - 4 * i ), viewProj );
+      tested += rubberBand.transformFeedback( )->testedVertices( );
+    }
+    const auto end = std::chrono::high_resolution_clock::now( );
+    rubberBand.mouseUp( Point( 4 * numPreviews, 500 - 4 * numPreviews ),
+      viewProj );
+    rubberBand.setLivePreview( false );
+    std::cout << std::fixed << std::setprecision( 3 ) << "  feedback preview: "
+      << std::chrono::duration< double >( end - start ).count( ) * 1000.0 /
+      numPreviews << " ms, " << tested / numPreviews
+      << " vertices tested per move" << std::endl;
+    BOOST_CHECK( quads[ 0 ]->getSelected( ));
+    BOOST_CHECK( quads[ side + 1 ]->getSelected( ));
+
+    // Same band on the CPU engine
+    CpuSelection cpu( pickingScene::WIDTH, pickingScene::HEIGHT );
+    for ( auto q : quads )
+      cpu.addObject( q );
+    for ( int i = 0; i < 3; ++i )
+    {
+      cpu.setSimdLevel( i == 0 ? SimdLevel::Scalar : SimdLevel::SSE );
+      cpu.setNumThreads( i == 2 ? 0 : 1 );
+      const auto start = std::chrono::high_resolution_clock::now( );
+      cpu.selectRectangle( Point( 0, 500 ), Point( 3, 497 ), viewProj );
+      const auto end = std::chrono::high_resolution_clock::now( );
+      const char* names[] = { "cpu scalar: ", "cpu simd: ",
+        "cpu simd, all threads: " };
+      std::cout << std::fixed << std::setprecision( 3 ) << "  " << names[ i ]
+        << std::chrono::duration< double >( end - start ).count( ) * 1000.0
+        << " ms" << std::endl;
+      BOOST_CHECK( quads[ 0 ]->getSelected( ));
+      BOOST_CHECK( !quads[ 1 ]->getSelected( ));
+    }
+
+    for ( auto q : quads )
+      delete q;
+  }
+#endif
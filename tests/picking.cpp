@@ -0,0 +1,692 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifdef RETO_USE_GLUT
+  #include <reto/reto.h>
+  #include "retoTests.h"
+  #include "pickingScene.h"
+
+  using namespace reto;
+
+  namespace
+  {
+    // Indices of the quads of a grid of side x side covering an area
+    std::set< unsigned int > gridArea( const PickingSystem& ps,
+      const std::vector< pickingScene::Quad* >& quads, unsigned int side,
+      Point minPoint, Point maxPoint )
+    {
+      const unsigned int cellWidth = pickingScene::WIDTH / side;
+      const unsigned int cellHeight = pickingScene::HEIGHT / side;
+      std::set< unsigned int > ids;
+      for ( unsigned int y = 0; y < side; ++y )
+      {
+        for ( unsigned int x = 0; x < side; ++x )
+        {
+          if ( x * cellWidth < maxPoint.first &&
+            minPoint.first < ( x + 1 ) * cellWidth &&
+            y * cellHeight < maxPoint.second &&
+            minPoint.second < ( y + 1 ) * cellHeight )
+          {
+            ids.insert( pickingScene::idOf( ps, quads[ y * side + x ]));
+          }
+        }
+      }
+      return ids;
+    }
+
+    void clearWindow( void )
+    {
+      glClearColor( 0.0f, 0.0f, 1.0f, 1.0f );
+      glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    }
+
+    // Checks that the window keeps the color of clearWindow
+    void checkWindow( void )
+    {
+      GLubyte color[ 4 ];
+      glReadPixels( 250, 250, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, color );
+      BOOST_CHECK_EQUAL( int( color[ 0 ]), 0 );
+      BOOST_CHECK_EQUAL( int( color[ 2 ]), 255 );
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_click )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 4 );
+    clearWindow( );
+
+    for ( unsigned int y = 0; y < 4; ++y )
+    {
+      for ( unsigned int x = 0; x < 4; ++x )
+      {
+        BOOST_CHECK_EQUAL( ps.click( Point( x * 125 + 60, y * 125 + 3 )),
+          pickingScene::idOf( ps, quads[ y * 4 + x ]));
+      }
+    }
+
+    // Nothing in front of the background
+    pickingScene::Quad* q = quads.back( );
+    ps.RemoveObject( q );
+    BOOST_CHECK_EQUAL( ps.click( Point( 499, 499 )), -1 );
+    ps.AddObject( q );
+
+    // The visible frame is not modified
+    checkWindow( );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_area )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    pickingScene::TestPickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 4 );
+    clearWindow( );
+
+    // Empty areas do not render nor read anything
+    BOOST_CHECK( ps.area( Point( 10, 10 ), Point( 10, 20 )).empty( ));
+    BOOST_CHECK( ps.area( Point( 20, 20 ), Point( 10, 10 )).empty( ));
+
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    const std::vector< std::pair< Point, Point >> areas = {
+      { Point( 0, 0 ), Point( 500, 500 ) },
+      { Point( 100, 110 ), Point( 401, 333 ) },
+      { Point( 130, 140 ), Point( 240, 240 ) },
+      { Point( 499, 0 ), Point( 500, 500 ) },
+      { Point( 7, 260 ), Point( 20, 261 ) }
+    };
+    for ( const auto& a : areas )
+    {
+      std::set< unsigned int > ids = ps.area( a.first, a.second );
+      BOOST_CHECK( ids == gridArea( ps, quads, 4, a.first, a.second ));
+      BOOST_CHECK( ids == pickingScene::areaPerPixel( ps.framebuffer( ),
+        a.first, a.second ));
+    }
+
+    // Inside a single quad the area matches click
+    std::set< unsigned int > single = ps.area( Point( 140, 140 ),
+      Point( 240, 240 ));
+    BOOST_CHECK_EQUAL( single.size( ), 1u );
+    BOOST_CHECK_EQUAL( int( *single.begin( )),
+      ps.click( Point( 190, 190 )));
+
+    // The pack state of the caller and the visible frame are kept
+    GLint alignment = 0;
+    glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+    BOOST_CHECK_EQUAL( alignment, 1 );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    BOOST_CHECK( !glIsEnabled( GL_SCISSOR_TEST ));
+
+    // And so is its scissor, which does not limit the picks
+    glEnable( GL_SCISSOR_TEST );
+    glScissor( 10, 20, 30, 40 );
+    BOOST_CHECK_EQUAL( int( *single.begin( )),
+      ps.click( Point( 190, 190 )));
+    GLint scissorBox[ 4 ];
+    glGetIntegerv( GL_SCISSOR_BOX, scissorBox );
+    BOOST_CHECK( glIsEnabled( GL_SCISSOR_TEST ));
+    BOOST_CHECK_EQUAL( scissorBox[ 0 ], 10 );
+    BOOST_CHECK_EQUAL( scissorBox[ 1 ], 20 );
+    BOOST_CHECK_EQUAL( scissorBox[ 2 ], 30 );
+    BOOST_CHECK_EQUAL( scissorBox[ 3 ], 40 );
+    glDisable( GL_SCISSOR_TEST );
+    checkWindow( );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_large_ids )
+  {
+    pickingScene::initContext( );
+
+    // An object taking ids beyond the 2^24 of an RGB8 target
+    class WideQuad : public pickingScene::Quad
+    {
+    public:
+      WideQuad( void )
+        : pickingScene::Quad( -1.0f, -1.0f, 1.0f, 1.0f, 0.5f )
+      {
+        setNumIDs( 1 << 25 );
+      }
+    };
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    WideQuad* wide = new WideQuad( );
+    pickingScene::Quad* front = new pickingScene::Quad( 0.0f, 0.0f,
+      1.0f, 1.0f );
+    ps.AddObject( wide );
+    ps.AddObject( front );
+
+    const int frontId = pickingScene::idOf( ps, front );
+    const int wideId = pickingScene::idOf( ps, wide );
+    BOOST_CHECK( wideId + ( 1 << 25 ) > ( 1 << 24 ));
+    BOOST_CHECK( frontId < wideId || frontId >= wideId + ( 1 << 25 ));
+    BOOST_CHECK_EQUAL( ps.click( Point( 400, 400 )), frontId );
+    BOOST_CHECK_EQUAL( ps.click( Point( 100, 100 )), wideId );
+
+    std::set< unsigned int > ids = ps.area( Point( 200, 200 ),
+      Point( 300, 300 ));
+    BOOST_CHECK( ids == std::set< unsigned int >(
+      { unsigned( frontId ), unsigned( wideId ) }));
+
+    ps.Clear( );
+    delete wide;
+    delete front;
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_hits )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    // Four instances in columns of 125 pixels up to a height of 375, and a
+    // quad in front of them on the top right
+    pickingScene::Quad* columns = new pickingScene::Quad( -1.0f, -1.0f,
+      -0.5f, 0.5f, 0.5f, 4, 0.5f );
+    pickingScene::Quad* front = new pickingScene::Quad( 0.0f, 0.0f,
+      1.0f, 1.0f, -0.5f );
+    ps.AddObject( columns );
+    ps.AddObject( front );
+    const int columnsIndex = pickingScene::idOf( ps, columns );
+    const int frontIndex = pickingScene::idOf( ps, front );
+
+    for ( unsigned int i = 0; i < 4; ++i )
+    {
+      // Lower left and upper right triangles of each instance
+      const Point lower( i * 125 + 10, 10 );
+      const Point upper( i * 125 + 115, 365 );
+      PickHit hit = ps.clickHit( lower );
+      BOOST_CHECK_EQUAL( hit.object, columnsIndex );
+      BOOST_CHECK_EQUAL( hit.instance, i );
+      BOOST_CHECK_EQUAL( hit.primitive, 0u );
+      BOOST_CHECK_CLOSE( hit.depth, 0.75f, 0.01f );
+      BOOST_CHECK_EQUAL( hit.id, ps.click( lower ));
+
+      hit = ps.clickHit( upper );
+      BOOST_CHECK_EQUAL( hit.object, i < 2 ? columnsIndex : frontIndex );
+      BOOST_CHECK_EQUAL( hit.instance, i < 2 ? i : 0u );
+      BOOST_CHECK_EQUAL( hit.primitive, i == 2 ? 0u : 1u );
+      BOOST_CHECK_CLOSE( hit.depth, i < 2 ? 0.75f : 0.25f, 0.01f );
+      BOOST_CHECK_EQUAL( hit.id, ps.click( upper ));
+    }
+    BOOST_CHECK_EQUAL( ps.clickHit( Point( 400, 490 )).object, frontIndex );
+
+    PickHit background = ps.clickHit( Point( 60, 450 ));
+    BOOST_CHECK_EQUAL( background.id, -1 );
+    BOOST_CHECK_EQUAL( background.object, -1 );
+    BOOST_CHECK_EQUAL( background.depth, 1.0f );
+
+    // Asynchronous hits match
+    const Point point( 300, 200 );
+    const PickHit hit = ps.clickHit( point );
+    PickTicket ticket = ps.clickAsync( point );
+    PickHit async;
+    while ( !ps.clickResult( ticket, async ))
+    {
+    }
+    BOOST_CHECK_EQUAL( async.id, hit.id );
+    BOOST_CHECK_EQUAL( async.object, hit.object );
+    BOOST_CHECK_EQUAL( async.instance, hit.instance );
+    BOOST_CHECK_EQUAL( async.primitive, hit.primitive );
+    BOOST_CHECK_EQUAL( async.depth, hit.depth );
+    async = ps.clickWaitHit( ps.clickAsync( point ));
+    BOOST_CHECK_EQUAL( async.id, hit.id );
+    BOOST_CHECK_EQUAL( async.primitive, hit.primitive );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    ps.Clear( );
+    delete columns;
+    delete front;
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_ray_backend )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    // Grid with a quad in front of its center, also picked by rays
+    auto quads = pickingScene::createGrid( ps, 4 );
+    quads.push_back( new pickingScene::Quad( -0.3f, -0.3f, 0.5f, 0.5f,
+      -0.5f ));
+    ps.AddObject( quads.back( ));
+    RayPickingSystem rps;
+    for ( auto q : quads )
+      rps.AddObject( q );
+
+    const float identity[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Pixel centers off the triangle diagonals, where rasterization and
+    // ray ties may differ
+    for ( unsigned int y = 11; y < pickingScene::HEIGHT; y += 16 )
+    {
+      for ( unsigned int x = 7; x < pickingScene::WIDTH; x += 16 )
+      {
+        const Point point( x, y );
+        const PickHit expected = ps.clickHit( point );
+        const PickHit hit = rps.clickHit( point, identity,
+          pickingScene::WIDTH, pickingScene::HEIGHT );
+        BOOST_CHECK_EQUAL( hit.object, expected.object );
+        BOOST_CHECK_EQUAL( hit.primitive, expected.primitive );
+        BOOST_CHECK_CLOSE( hit.depth, expected.depth, 0.01f );
+      }
+    }
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_click_async )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 8 );
+    clearWindow( );
+
+    std::vector< Point > points;
+    for ( unsigned int i = 0; i < 40; ++i )
+      points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+
+    std::vector< PickTicket > tickets;
+    for ( const auto& point : points )
+      tickets.push_back( ps.clickAsync( point ));
+    BOOST_CHECK_EQUAL( ps.pendingPicks( ), points.size( ));
+    checkWindow( );
+
+    // Half polled until ready, half waited, all equal to click
+    std::vector< int > results( points.size( ), -2 );
+    size_t ready = 0;
+    while ( ready < points.size( ) / 2 )
+    {
+      for ( size_t i = 0; i < points.size( ) / 2; ++i )
+      {
+        if ( results[ i ] == -2 && ps.clickResult( tickets[ i ],
+          results[ i ]))
+        {
+          ++ready;
+        }
+      }
+    }
+    for ( size_t i = points.size( ) / 2; i < points.size( ); ++i )
+      results[ i ] = ps.clickWait( tickets[ i ]);
+    BOOST_CHECK_EQUAL( ps.pendingPicks( ), 0u );
+
+    for ( size_t i = 0; i < points.size( ); ++i )
+    {
+      BOOST_CHECK_EQUAL( results[ i ], ps.click( points[ i ]));
+      BOOST_CHECK( results[ i ] >= 0 );
+    }
+
+    // Released tickets resolve to nothing
+    int selected = 0;
+    BOOST_CHECK( ps.clickResult( tickets[ 0 ], selected ));
+    BOOST_CHECK_EQUAL( selected, -1 );
+    BOOST_CHECK_EQUAL( ps.clickWait( tickets[ 0 ]), -1 );
+
+    // Buffers are reused and the window framebuffer stays bound
+    GLint window = -1, framebuffer = -1;
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &window );
+    ps.clickWait( ps.clickAsync( points[ 3 ]));
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer );
+    BOOST_CHECK_EQUAL( framebuffer, window );
+    checkWindow( );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_click_batch )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 8 );
+    quads.push_back( new pickingScene::Quad( -1.0f, -1.0f, -0.5f, 0.5f,
+      -0.5f, 4, 0.5f ));
+    ps.AddObject( quads.back( ));
+    clearWindow( );
+
+    BOOST_CHECK( ps.clickBatch( std::vector< Point >( )).empty( ));
+    BOOST_CHECK( ps.clickHitBatch( std::vector< Point >( )).empty( ));
+
+    // Scattered points, repeated points and a single point
+    std::vector< Point > points;
+    for ( unsigned int i = 0; i < 50; ++i )
+      points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+    points.push_back( points[ 7 ]);
+    const std::vector< Point > single( 1, Point( 480, 20 ));
+
+    for ( const auto& batch : { points, single })
+    {
+      const std::vector< int > ids = ps.clickBatch( batch );
+      const std::vector< PickHit > hits = ps.clickHitBatch( batch );
+      BOOST_CHECK_EQUAL( ids.size( ), batch.size( ));
+      BOOST_CHECK_EQUAL( hits.size( ), batch.size( ));
+      for ( size_t i = 0; i < batch.size( ); ++i )
+      {
+        const PickHit expected = ps.clickHit( batch[ i ]);
+        BOOST_CHECK_EQUAL( ids[ i ], ps.click( batch[ i ]));
+        BOOST_CHECK_EQUAL( hits[ i ].id, ids[ i ]);
+        BOOST_CHECK_EQUAL( hits[ i ].object, expected.object );
+        BOOST_CHECK_EQUAL( hits[ i ].instance, expected.instance );
+        BOOST_CHECK_EQUAL( hits[ i ].primitive, expected.primitive );
+        BOOST_CHECK_EQUAL( hits[ i ].depth, expected.depth );
+      }
+    }
+
+    // Background in a batch
+    ps.RemoveObject( quads[ 63 ]);
+    const std::vector< int > ids = ps.clickBatch(
+      { Point( 499, 499 ), Point( 10, 10 )});
+    BOOST_CHECK_EQUAL( ids[ 0 ], -1 );
+    BOOST_CHECK_EQUAL( ids[ 1 ], ps.click( Point( 10, 10 )));
+    ps.AddObject( quads[ 63 ]);
+
+    checkWindow( );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_indirect )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 8 );
+    quads.push_back( new pickingScene::Quad( -0.3f, -0.3f, 0.5f, 0.5f,
+      -0.5f ));
+    ps.AddObject( quads.back( ));
+    clearWindow( );
+
+    std::vector< Point > points;
+    for ( unsigned int i = 0; i < 50; ++i )
+      points.push_back( Point(( i * 37 ) % 500, ( i * 91 + 13 ) % 500 ));
+    const std::vector< PickHit > expected = ps.clickHitBatch( points );
+    const std::set< unsigned int > expectedArea =
+      ps.area( Point( 30, 60 ), Point( 420, 300 ));
+
+    // Same hits with one indirect draw
+    BOOST_CHECK( !ps.indirectRendering( ));
+    ps.setIndirectRendering( true );
+    BOOST_CHECK( ps.indirectRendering( ));
+    for ( size_t i = 0; i < points.size( ); ++i )
+    {
+      const PickHit hit = ps.clickHit( points[ i ]);
+      BOOST_CHECK_EQUAL( hit.id, expected[ i ].id );
+      BOOST_CHECK_EQUAL( hit.object, expected[ i ].object );
+      BOOST_CHECK_EQUAL( hit.primitive, expected[ i ].primitive );
+      BOOST_CHECK_EQUAL( hit.depth, expected[ i ].depth );
+    }
+    BOOST_CHECK( ps.area( Point( 30, 60 ), Point( 420, 300 )) ==
+      expectedArea );
+
+    // The program and vertex array in use are kept
+    GLint program = 0;
+    glGetIntegerv( GL_CURRENT_PROGRAM, &program );
+    BOOST_CHECK_EQUAL( GLuint( program ), prog.program( ));
+
+    // Model matrices are read on each pick, the projection view after them
+    std::vector< float > model = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, -0.9f, 1.0f };
+    quads[ 0 ]->setModel( model );
+    BOOST_CHECK_EQUAL( ps.click( Point( 280, 10 )),
+      pickingScene::idOf( ps, quads[ 0 ]));
+    const float half[ 16 ] = { 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f,
+      0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    ps.setProjectionView( half );
+    BOOST_CHECK_EQUAL( ps.click( Point( 10, 10 )), -1 );
+    BOOST_CHECK_EQUAL( ps.click( Point( 130, 130 )), -1 );
+    BOOST_CHECK_EQUAL( ps.click( Point( 160, 130 )),
+      pickingScene::idOf( ps, quads[ 1 ]));
+    BOOST_CHECK_EQUAL( ps.click( Point( 260, 130 )),
+      pickingScene::idOf( ps, quads[ 0 ]));
+
+    // Removed objects are dropped from the shared geometry
+    ps.RemoveObject( quads[ 0 ]);
+    BOOST_CHECK_EQUAL( ps.click( Point( 260, 130 )),
+      pickingScene::idOf( ps, quads[ 4 ]));
+    ps.AddObject( quads[ 0 ]);
+
+    // Objects with several ids or with indices out of their positions are
+    // rendered with Pickable::render, with the same hits
+    class BadIndicesQuad : public pickingScene::Quad
+    {
+    public:
+      BadIndicesQuad( void )
+        : pickingScene::Quad( 0.5f, 0.5f, 0.7f, 0.7f, -0.95f )
+      {
+      }
+
+      std::vector< unsigned int > getIndices( void ) const
+      {
+        return std::vector< unsigned int >{ 0, 1, 2, 2, 1, 7 };
+      }
+    };
+    const float identity[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+      0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    ps.setProjectionView( identity );
+    quads.push_back( new pickingScene::Quad( -1.0f, 0.8f, -0.9f, 0.9f,
+      -0.95f, 3, 0.5f ));
+    ps.AddObject( quads.back( ));
+    quads.push_back( new BadIndicesQuad( ));
+    ps.AddObject( quads.back( ));
+    const std::vector< Point > fallbackPoints = { Point( 12, 462 ),
+      Point( 262, 462 ), Point( 400, 400 )};
+    ps.setIndirectRendering( false );
+    const std::vector< PickHit > direct = ps.clickHitBatch( fallbackPoints );
+    ps.setIndirectRendering( true );
+    for ( size_t i = 0; i < fallbackPoints.size( ); ++i )
+    {
+      const PickHit hit = ps.clickHit( fallbackPoints[ i ]);
+      BOOST_CHECK( hit.id >= 0 );
+      BOOST_CHECK_EQUAL( hit.id, direct[ i ].id );
+      BOOST_CHECK_EQUAL( hit.object, direct[ i ].object );
+      BOOST_CHECK_EQUAL( hit.instance, direct[ i ].instance );
+    }
+    BOOST_CHECK_EQUAL( direct[ 1 ].instance, 2u );
+    BOOST_CHECK_EQUAL( direct[ 2 ].object,
+      pickingScene::idOf( ps, quads.back( )));
+
+    // Back to the regular path
+    ps.setIndirectRendering( false );
+    BOOST_CHECK_EQUAL( ps.clickHit( points[ 3 ]).id, expected[ 3 ].id );
+
+    checkWindow( );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_stable_ids )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    auto quads = pickingScene::createGrid( ps, 4 );
+
+    // Ids map back to their objects directly
+    for ( unsigned int i = 0; i < quads.size( ); ++i )
+    {
+      const int id = ps.click( Point(( i % 4 ) * 125 + 60,
+        ( i / 4 ) * 125 + 60 ));
+      BOOST_CHECK_EQUAL( id, quads[ i ]->getId( ));
+      BOOST_CHECK_EQUAL( ps.registry( ).object( uint32_t( id )),
+        quads[ i ]);
+    }
+
+    // Removing and adding objects keeps the ids of the others
+    const int id5 = quads[ 5 ]->getId( );
+    ps.RemoveObject( quads[ 2 ]);
+    ps.RemoveObject( quads[ 9 ]);
+    BOOST_CHECK_EQUAL( ps.click( Point( 185, 185 )), id5 );
+    BOOST_CHECK_EQUAL( ps.click( Point( 310, 60 )), -1 );
+    ps.AddObject( quads[ 9 ]);
+    ps.AddObject( quads[ 2 ]);
+    BOOST_CHECK_EQUAL( ps.click( Point( 185, 185 )), id5 );
+    BOOST_CHECK_EQUAL( ps.click( Point( 310, 60 )), quads[ 2 ]->getId( ));
+
+    const std::set< unsigned int > ids = ps.area( Point( 0, 0 ),
+      Point( 250, 250 ));
+    for ( unsigned int i : { 0u, 1u, 4u, 5u })
+      BOOST_CHECK( ids.count( unsigned( quads[ i ]->getId( ))) == 1 );
+    BOOST_CHECK_EQUAL( ids.size( ), 4u );
+
+    pickingScene::destroy( ps, quads );
+  }
+
+  BOOST_AUTO_TEST_CASE( picking_world_hits )
+  {
+    pickingScene::initContext( );
+
+    ShaderProgram prog;
+    prog.loadVertexShaderFromText( pickingScene::vertexCode( ));
+    PickingSystem ps( &prog );
+    prog.use( );
+
+    // Without transforms the world is the normalized device space
+    pickingScene::Quad* flat = new pickingScene::Quad( -1.0f, -1.0f,
+      1.0f, 1.0f, 0.5f );
+    ps.AddObject( flat );
+    PickHit hit = ps.clickHit( Point( 100, 300 ));
+    BOOST_CHECK_CLOSE( hit.position[ 0 ], 100.5f / 250.0f - 1.0f, 0.01f );
+    BOOST_CHECK_CLOSE( hit.position[ 1 ], 300.5f / 250.0f - 1.0f, 0.01f );
+    BOOST_CHECK_CLOSE( hit.position[ 2 ], 0.5f, 0.01f );
+    BOOST_CHECK_SMALL( hit.normal[ 0 ], 1e-4f );
+    BOOST_CHECK_SMALL( hit.normal[ 1 ], 1e-4f );
+    BOOST_CHECK_CLOSE( hit.normal[ 2 ], -1.0f, 0.01f );
+    ps.RemoveObject( flat );
+
+    // Tilted quads seen in perspective, compared with ray picking
+    const float step = 3.14159265f / 6.0f;
+    std::vector< pickingScene::Quad* > quads;
+    RayPickingSystem rps;
+    for ( int i = 0; i < 3; ++i )
+    {
+      const float c = std::cos( step * ( i - 1 ));
+      const float s = std::sin( step * ( i - 1 ));
+      quads.push_back( new pickingScene::Quad( -0.6f, -1.0f, 0.6f, 1.0f ));
+      quads.back( )->setModel({ c, 0.0f, -s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+        s, 0.0f, c, 0.0f, 1.5f * ( i - 1 ), 0.2f * i, -0.5f * i, 1.0f });
+      ps.AddObject( quads.back( ));
+      rps.AddObject( quads.back( ));
+    }
+
+    // Camera at z = 4 looking at the origin
+    const float f = 1.0f / std::tan( 0.5f );
+    const float n = 1.0f, fa = 20.0f;
+    const float projectionView[ 16 ] = { f, 0.0f, 0.0f, 0.0f, 0.0f, f, 0.0f,
+      0.0f, 0.0f, 0.0f, ( fa + n ) / ( n - fa ), -1.0f, 0.0f, 0.0f,
+      -4.0f * ( fa + n ) / ( n - fa ) + 2.0f * fa * n / ( n - fa ), 4.0f };
+    ps.setIndirectRendering( true );
+    ps.setProjectionView( projectionView );
+
+    unsigned int hits = 0;
+    for ( unsigned int y = 11; y < pickingScene::HEIGHT; y += 32 )
+    {
+      for ( unsigned int x = 7; x < pickingScene::WIDTH; x += 32 )
+      {
+        const Point point( x, y );
+        hit = ps.clickHit( point );
+        const PickHit ray = rps.clickHit( point, projectionView,
+          pickingScene::WIDTH, pickingScene::HEIGHT );
+        BOOST_CHECK_EQUAL( hit.object, ray.object );
+        if ( hit.object < 0 || hit.object != ray.object )
+          continue;
+        ++hits;
+        for ( int i = 0; i < 3; ++i )
+        {
+          BOOST_CHECK_SMALL( hit.position[ i ] - ray.position[ i ], 2e-3f );
+          BOOST_CHECK_SMALL( hit.normal[ i ] - ray.normal[ i ], 2e-3f );
+        }
+      }
+    }
+    BOOST_CHECK( hits > 50 );
+
+    // Asynchronous hits keep the view of their pick
+    const Point point( 250, 250 );
+    const PickHit expected = ps.clickHit( point );
+    const PickTicket ticket = ps.clickAsync( point );
+    const float identity[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    ps.setProjectionView( identity );
+    const PickHit async = ps.clickWaitHit( ticket );
+    for ( int i = 0; i < 3; ++i )
+      BOOST_CHECK_EQUAL( async.position[ i ], expected.position[ i ]);
+
+    // A camera gives the matrix of each pick
+    Camera camera( 60.0f, 1.0f );
+    ps.setCamera( &camera );
+    const PickHit cameraHit = ps.clickHit( point );
+    ps.setCamera( nullptr );
+    ps.setProjectionView( camera.projectionViewMatrix( ));
+    const PickHit matrixHit = ps.clickHit( point );
+    BOOST_CHECK_EQUAL( cameraHit.id, matrixHit.id );
+    for ( int i = 0; i < 3; ++i )
+      BOOST_CHECK_EQUAL( cameraHit.position[ i ], matrixHit.position[ i ]);
+
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    quads.push_back( flat );
+    pickingScene::destroy( ps, quads );
+  }
+#endif
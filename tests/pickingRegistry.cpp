@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "retoTests.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace reto;
+
+namespace
+{
+  class Dummy : public reto::Pickable
+  {
+  public:
+    void render( reto::ShaderProgram* ) { }
+    std::vector< float > getModel( void ) const
+    {
+      return std::vector< float >( );
+    }
+    std::vector< float > getPositions( void ) const
+    {
+      return std::vector< float >( );
+    }
+    bool getSelected( void ) const { return false; }
+    void setSelected( const bool& ) { }
+  };
+}
+
+BOOST_AUTO_TEST_CASE( picking_registry_ids )
+{
+  PickingRegistry registry;
+  std::vector< Dummy > objects( 5 );
+
+  // Ids are dense in registration order, ranges are consecutive
+  PickHandle handles[ 5 ];
+  handles[ 0 ] = registry.add( &objects[ 0 ]);
+  handles[ 1 ] = registry.add( &objects[ 1 ], 4 );
+  handles[ 2 ] = registry.add( &objects[ 2 ]);
+  BOOST_CHECK_EQUAL( handles[ 0 ].id, 0u );
+  BOOST_CHECK_EQUAL( handles[ 1 ].id, 1u );
+  BOOST_CHECK_EQUAL( handles[ 2 ].id, 5u );
+  BOOST_CHECK_EQUAL( registry.size( ), 3u );
+  for ( uint32_t id = 1; id < 5; ++id )
+  {
+    BOOST_CHECK_EQUAL( registry.object( id ), &objects[ 1 ]);
+    BOOST_CHECK_EQUAL( registry.owner( id ).id, 1u );
+  }
+  BOOST_CHECK( registry.object( 6 ) == nullptr );
+  BOOST_CHECK_EQUAL( registry.owner( 6 ).generation, 0u );
+
+  // Adding twice keeps the handle
+  const PickHandle again = registry.add( &objects[ 1 ], 4 );
+  BOOST_CHECK_EQUAL( again.id, handles[ 1 ].id );
+  BOOST_CHECK_EQUAL( again.generation, handles[ 1 ].generation );
+  BOOST_CHECK_EQUAL( registry.size( ), 3u );
+
+  // Removing keeps the ids of the others
+  BOOST_CHECK( registry.remove( &objects[ 0 ]));
+  BOOST_CHECK( !registry.remove( &objects[ 0 ]));
+  BOOST_CHECK( registry.object( 0 ) == nullptr );
+  BOOST_CHECK( registry.object( handles[ 0 ]) == nullptr );
+  BOOST_CHECK_EQUAL( registry.handle( &objects[ 2 ]).id, 5u );
+  BOOST_CHECK_EQUAL( registry.object( handles[ 2 ]), &objects[ 2 ]);
+
+  // Freed ids are reused, old handles stay invalid
+  handles[ 3 ] = registry.add( &objects[ 3 ]);
+  BOOST_CHECK_EQUAL( handles[ 3 ].id, 0u );
+  BOOST_CHECK( handles[ 3 ].generation != handles[ 0 ].generation );
+  BOOST_CHECK( registry.object( handles[ 0 ]) == nullptr );
+  BOOST_CHECK_EQUAL( registry.object( handles[ 3 ]), &objects[ 3 ]);
+
+  // Dense objects and their first ids
+  const auto& dense = registry.objects( );
+  const auto& firstIds = registry.firstIds( );
+  BOOST_CHECK_EQUAL( dense.size( ), 3u );
+  BOOST_CHECK_EQUAL( firstIds.size( ), 3u );
+  for ( size_t i = 0; i < dense.size( ); ++i )
+    BOOST_CHECK_EQUAL( registry.handle( dense[ i ]).id, firstIds[ i ]);
+
+  registry.clear( );
+  BOOST_CHECK_EQUAL( registry.size( ), 0u );
+  BOOST_CHECK( registry.object( handles[ 2 ]) == nullptr );
+  BOOST_CHECK_EQUAL( registry.handle( &objects[ 2 ]).generation, 0u );
+  handles[ 4 ] = registry.add( &objects[ 4 ]);
+  BOOST_CHECK_EQUAL( handles[ 4 ].id, 0u );
+  BOOST_CHECK( registry.object( handles[ 3 ]) == nullptr );
+}
+
+BOOST_AUTO_TEST_CASE( picking_registry_large_ranges )
+{
+  PickingRegistry registry;
+  std::vector< Dummy > objects( 3 );
+
+  // Large ranges do not need one entry per id
+  const PickHandle wide = registry.add( &objects[ 0 ], 1u << 25 );
+  const PickHandle odd = registry.add( &objects[ 1 ], 5000 );
+  const PickHandle single = registry.add( &objects[ 2 ]);
+  BOOST_CHECK( wide.generation != 0 );
+  BOOST_CHECK_EQUAL( single.id, 0u );
+  BOOST_CHECK_EQUAL( registry.object( wide.id ), &objects[ 0 ]);
+  BOOST_CHECK_EQUAL( registry.object( wide.id + ( 1u << 25 ) - 1 ),
+    &objects[ 0 ]);
+  BOOST_CHECK_EQUAL( registry.owner( wide.id + 12345 ).id, wide.id );
+  BOOST_CHECK_EQUAL( registry.object( odd.id + 4999 ), &objects[ 1 ]);
+  BOOST_CHECK( registry.object( odd.id + 5000 ) == nullptr );
+  BOOST_CHECK( wide.id + ( 1u << 25 ) <= odd.id || odd.id + 5000 <= wide.id );
+
+  // Ids fit in the int returned by picks
+  BOOST_CHECK( odd.id + 5000 < ( 1u << 31 ));
+
+  BOOST_CHECK( registry.remove( &objects[ 0 ]));
+  BOOST_CHECK( registry.object( wide.id + 7 ) == nullptr );
+  const PickHandle reused = registry.add( &objects[ 0 ], 1u << 25 );
+  BOOST_CHECK_EQUAL( reused.id, wide.id );
+  BOOST_CHECK( registry.object( wide ) == nullptr );
+}
+
+BOOST_AUTO_TEST_CASE( picking_registry_reuse )
+{
+  PickingRegistry registry;
+  std::vector< Dummy > objects( 32 );
+  std::vector< uint32_t > sizes( objects.size( ), 0 );
+
+  // Objects keep coming back with other sizes, the freed ranges are
+  // merged and split so the ids stay below twice the live ones
+  std::srand( 7 );
+  uint32_t maxLive = 0;
+  uint32_t highest = 0;
+  for ( int round = 0; round < 2000; ++round )
+  {
+    const size_t i = size_t( std::rand( )) % objects.size( );
+    if ( sizes[ i ] != 0 )
+      BOOST_CHECK( registry.remove( &objects[ i ]));
+    sizes[ i ] = 1 + uint32_t( std::rand( )) % 64;
+    const PickHandle handle = registry.add( &objects[ i ], sizes[ i ]);
+    BOOST_CHECK( handle.generation != 0 );
+    highest = std::max( highest, handle.id + sizes[ i ]);
+    uint32_t live = 0;
+    for ( auto size : sizes )
+      live += size;
+    maxLive = std::max( maxLive, live );
+  }
+  BOOST_CHECK( highest <= 2 * maxLive );
+
+  // Ranges do not overlap
+  for ( size_t i = 0; i < objects.size( ); ++i )
+  {
+    const uint32_t first = registry.handle( &objects[ i ]).id;
+    for ( uint32_t id = first; id < first + sizes[ i ]; ++id )
+      BOOST_CHECK_EQUAL( registry.object( id ), &objects[ i ]);
+  }
+
+  // Without objects the whole space is free again
+  for ( auto& object : objects )
+    BOOST_CHECK( registry.remove( &object ));
+  BOOST_CHECK_EQUAL( registry.add( &objects[ 0 ], 4096 ).id, 0u );
+  BOOST_CHECK_EQUAL( registry.add( &objects[ 1 ]).id, 4096u );
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __RETO_TESTS_PICKING_SCENE_H__
+#define __RETO_TESTS_PICKING_SCENE_H__
+
+#include <reto/reto.h>
+
+#include <GL/glew.h>
+
+#ifdef Darwin
+  #define __gl_h_
+  #define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED
+  #include <OpenGL/gl.h>
+  #include <OpenGL/glu.h>
+  #include <GL/freeglut.h>
+#else
+  #include <GL/gl.h>
+  #include <GL/freeglut.h>
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+/*
+  Helpers shared by the picking tests and benchmarks: a GLUT context, an
+  axis aligned quad Pickable drawn in normalized device coordinates and a
+  reference per pixel readback of the picking target.
+*/
+namespace pickingScene
+{
+  const int WIDTH = 500;
+  const int HEIGHT = 500;
+
+  // Creates the window once per test executable
+  inline void initContext( void )
+  {
+    static bool created = false;
+    if ( created )
+      return;
+    created = true;
+
+    char fooParam[] = "foo";
+    char *fooargv[] = { fooParam, NULL };
+    int fooargc = 1;
+
+    glutInit( &fooargc, fooargv );
+
+    glutInitContextVersion( 4, 3 );
+    glutInitContextFlags( GLUT_FORWARD_COMPATIBLE );
+    glutInitContextProfile( GLUT_CORE_PROFILE );
+
+    glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH );
+    glutInitWindowSize( WIDTH, HEIGHT );
+    glutInitWindowPosition( 0, 0 );
+    glutCreateWindow( "Picking Window" );
+
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit( );
+    if ( GLEW_OK != err )
+    {
+      std::cout << "Error: " << glewGetErrorString( err ) << std::endl;
+      exit( -1 );
+    }
+    glViewport( 0, 0, WIDTH, HEIGHT );
+    glEnable( GL_DEPTH_TEST );
+  }
+
+  // Vertex shader for PickingSystem( ShaderProgram* ) without transforms
+  inline std::string vertexCode( void )
+  {
+    return std::string( "#version 430\n"
+      "layout (location = 0) in vec3 Position;\n"
+      "uniform uint id;\n"
+      "uniform float instanceStep;\n"
+      "flat out uint pid;\n"
+      "void main( ) {\n"
+      "    pid = id + uint( gl_InstanceID );\n"
+      "    gl_Position = vec4( Position.x + instanceStep * gl_InstanceID,\n"
+      "      Position.yz, 1.0 );\n"
+      "}" );
+  }
+
+  // Quad from ( x0, y0 ) to ( x1, y1 ) in normalized device coordinates,
+  // drawn as a strip of two triangles and repeated instanceStep to the
+  // right for each instance
+  class Quad : public reto::Pickable
+  {
+  public:
+    Quad( float x0, float y0, float x1, float y1, float z = 0.0f,
+      unsigned int instances = 1, float instanceStep = 0.0f )
+      : _selected( false )
+      , _instances( instances )
+      , _instanceStep( instanceStep )
+    {
+      setNumIDs( int( instances ));
+      _positions = { x0, y0, z, x1, y0, z, x0, y1, z, x1, y1, z };
+
+      glGenVertexArrays( 1, &_vao );
+      glBindVertexArray( _vao );
+      glGenBuffers( 1, &_vbo );
+      glBindBuffer( GL_ARRAY_BUFFER, _vbo );
+      glBufferData( GL_ARRAY_BUFFER, _positions.size( ) * sizeof( float ),
+        _positions.data( ), GL_STATIC_DRAW );
+      glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+      glEnableVertexAttribArray( 0 );
+      glBindVertexArray( 0 );
+    }
+
+    ~Quad( void )
+    {
+      glDeleteBuffers( 1, &_vbo );
+      glDeleteVertexArrays( 1, &_vao );
+    }
+
+    void render( reto::ShaderProgram* prog )
+    {
+      prog->sendUniformf( "instanceStep", _instanceStep );
+      glBindVertexArray( _vao );
+      glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, GLsizei( _instances ));
+      glBindVertexArray( 0 );
+    }
+
+    // Only used by the paths that do not call render ( indirect and ray
+    // picking ), empty means identity
+    std::vector< float > getModel( void ) const
+    {
+      return _model;
+    }
+
+    void setModel( const std::vector< float >& model )
+    {
+      _model = model;
+    }
+
+    std::vector< float > getPositions( void ) const
+    {
+      return _positions;
+    }
+
+    std::vector< unsigned int > getIndices( void ) const
+    {
+      // Triangles of the strip, in gl_PrimitiveID order
+      return std::vector< unsigned int >{ 0, 1, 2, 2, 1, 3 };
+    }
+
+    bool getSelected( void ) const
+    {
+      return _selected;
+    }
+
+    void setSelected( const bool& selected )
+    {
+      _selected = selected;
+    }
+
+  protected:
+    std::vector< float > _model;
+    std::vector< float > _positions;
+    bool _selected;
+    unsigned int _instances;
+    float _instanceStep;
+    GLuint _vao;
+    GLuint _vbo;
+  };
+
+  // Picking system giving access to its offscreen target
+  class TestPickingSystem : public reto::PickingSystem
+  {
+  public:
+    TestPickingSystem( reto::ShaderProgram* prog )
+      : reto::PickingSystem( prog )
+    {
+    }
+
+    GLuint framebuffer( void ) const
+    {
+      return _framebuffer;
+    }
+  };
+
+  // Id of each object, -1 if it is not registered
+  inline int idOf( const reto::PickingSystem& ps,
+    const reto::Pickable* object )
+  {
+    const reto::PickHandle handle = ps.registry( ).handle( object );
+    return handle.generation == 0 ? -1 : int( handle.id );
+  }
+
+  // Covers the viewport with side x side quads, row by row from the bottom
+  inline std::vector< Quad* > createGrid( reto::PickingSystem& ps,
+    unsigned int side )
+  {
+    std::vector< Quad* > quads;
+    const float step = 2.0f / side;
+    for ( unsigned int y = 0; y < side; ++y )
+    {
+      for ( unsigned int x = 0; x < side; ++x )
+      {
+        Quad* q = new Quad( -1.0f + x * step, -1.0f + y * step,
+          -1.0f + ( x + 1 ) * step, -1.0f + ( y + 1 ) * step );
+        quads.push_back( q );
+        ps.AddObject( q );
+      }
+    }
+    return quads;
+  }
+
+  inline void destroy( reto::PickingSystem& ps, std::vector< Quad* >& quads )
+  {
+    ps.Clear( );
+    for ( auto q : quads )
+      delete q;
+    quads.clear( );
+  }
+
+  /*
+    Reference copy of the original area readback (one glReadPixels per
+    pixel) over the ids left in the offscreen target by the last pick
+  */
+  inline std::set< unsigned int > areaPerPixel( GLuint framebuffer,
+    reto::Point minPoint, reto::Point maxPoint )
+  {
+    GLint previous;
+    glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &previous );
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffer );
+
+    std::set< unsigned int > ret;
+    GLuint value;
+    for ( auto x = minPoint.first; x < maxPoint.first; x++ )
+    {
+      for ( auto y = minPoint.second; y < maxPoint.second; y++ )
+      {
+        glReadPixels( x, y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, &value );
+        if ( value != 0 )
+          ret.insert( value - 1 );
+      }
+    }
+
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, previous );
+    return ret;
+  }
+}
+
+#endif // __RETO_TESTS_PICKING_SCENE_H__
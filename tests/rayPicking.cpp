@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <reto/reto.h>
+#include "retoTests.h"
+
+using namespace reto;
+
+namespace
+{
+  // Pickable without rendering, a quad [ x0, x1 ] x [ y0, y1 ] at depth z
+  // with two triangles, or a grid of side x side quads
+  class CpuQuad : public reto::Pickable
+  {
+  public:
+    CpuQuad( float x0, float y0, float x1, float y1, float z, int side = 1 )
+      : _model( )
+    {
+      for ( int y = 0; y <= side; ++y )
+      {
+        for ( int x = 0; x <= side; ++x )
+        {
+          _positions.push_back( x0 + ( x1 - x0 ) * x / side );
+          _positions.push_back( y0 + ( y1 - y0 ) * y / side );
+          _positions.push_back( z );
+        }
+      }
+      for ( int y = 0; y < side; ++y )
+      {
+        for ( int x = 0; x < side; ++x )
+        {
+          const unsigned int i = y * ( side + 1 ) + x;
+          const unsigned int quad[ 6 ] = { i, i + 1, i + side + 1,
+            i + side + 1, i + 1, i + side + 2 };
+          _indices.insert( _indices.end( ), quad, quad + 6 );
+        }
+      }
+    }
+
+    void render( reto::ShaderProgram* ) { }
+    std::vector< float > getModel( void ) const { return _model; }
+    std::vector< float > getPositions( void ) const { return _positions; }
+    std::vector< unsigned int > getIndices( void ) const { return _indices; }
+    bool getSelected( void ) const { return false; }
+    void setSelected( const bool& ) { }
+
+    void translate( float x, float y, float z )
+    {
+      _model.assign( 16, 0.0f );
+      _model[ 0 ] = _model[ 5 ] = _model[ 10 ] = _model[ 15 ] = 1.0f;
+      _model[ 12 ] = x;
+      _model[ 13 ] = y;
+      _model[ 14 ] = z;
+    }
+
+    std::vector< float > _model;
+    std::vector< float > _positions;
+    std::vector< unsigned int > _indices;
+  };
+
+  const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+  const unsigned int SIZE = 100;
+}
+
+BOOST_AUTO_TEST_CASE( ray_picking_click )
+{
+  RayPickingSystem rps;
+  BOOST_CHECK_EQUAL( rps.click( Point( 50, 50 ), IDENTITY, SIZE, SIZE ), -1 );
+
+  // Back quad over the whole viewport, front quad on its left half
+  std::vector< CpuQuad* > quads = {
+    new CpuQuad( -1.0f, -1.0f, 1.0f, 1.0f, 0.5f ),
+    new CpuQuad( -1.0f, -1.0f, 0.0f, 1.0f, -0.5f )};
+  for ( auto q : quads )
+    rps.AddObject( q );
+
+  BOOST_CHECK_EQUAL( rps.click( Point( 75, 60 ), IDENTITY, SIZE, SIZE ), 0 );
+  BOOST_CHECK_EQUAL( rps.click( Point( 25, 60 ), IDENTITY, SIZE, SIZE ), 1 );
+
+  // Window depth and triangle of the hit
+  PickHit hit = rps.clickHit( Point( 25, 10 ), IDENTITY, SIZE, SIZE );
+  BOOST_CHECK_EQUAL( hit.object, 1 );
+  BOOST_CHECK_EQUAL( hit.instance, 0u );
+  BOOST_CHECK_EQUAL( hit.primitive, 0u );
+  BOOST_CHECK_CLOSE( hit.depth, 0.25f, 1e-3f );
+  hit = rps.clickHit( Point( 45, 90 ), IDENTITY, SIZE, SIZE );
+  BOOST_CHECK_EQUAL( hit.primitive, 1u );
+  hit = rps.clickHit( Point( 75, 60 ), IDENTITY, SIZE, SIZE );
+  BOOST_CHECK_CLOSE( hit.depth, 0.75f, 1e-3f );
+
+  // World space position and normal facing the viewer
+  BOOST_CHECK_CLOSE( hit.position[ 0 ], 2.0f * 75.5f / SIZE - 1.0f, 1e-3f );
+  BOOST_CHECK_CLOSE( hit.position[ 1 ], 2.0f * 60.5f / SIZE - 1.0f, 1e-3f );
+  BOOST_CHECK_CLOSE( hit.position[ 2 ], 0.5f, 1e-3f );
+  BOOST_CHECK_EQUAL( hit.normal[ 0 ], 0.0f );
+  BOOST_CHECK_EQUAL( hit.normal[ 1 ], 0.0f );
+  BOOST_CHECK_EQUAL( hit.normal[ 2 ], -1.0f );
+
+  // Behind the far plane
+  rps.RemoveObject( quads[ 1 ]);
+  quads[ 0 ]->translate( 0.0f, 0.0f, 1.0f );
+  BOOST_CHECK_EQUAL( rps.click( Point( 25, 60 ), IDENTITY, SIZE, SIZE ), -1 );
+
+  // Camera overload uses its projection view matrix
+  Camera camera;
+  quads[ 0 ]->translate( 0.0f, 0.0f, 0.0f );
+  for ( int y = 0; y < int( SIZE ); y += 10 )
+  {
+    for ( int x = 0; x < int( SIZE ); x += 10 )
+    {
+      BOOST_CHECK_EQUAL( rps.click( Point( x, y ), &camera, SIZE, SIZE ),
+        rps.click( Point( x, y ), camera.projectionViewMatrix( ), SIZE,
+        SIZE ));
+    }
+  }
+
+  for ( auto q : quads )
+    delete q;
+}
+
+BOOST_AUTO_TEST_CASE( ray_picking_refit )
+{
+  RayPickingSystem rps;
+  std::vector< CpuQuad* > quads;
+  for ( int i = 0; i < 64; ++i )
+  {
+    const float x = -1.0f + ( i % 8 ) * 0.25f;
+    const float y = -1.0f + ( i / 8 ) * 0.25f;
+    quads.push_back( new CpuQuad( x, y, x + 0.25f, y + 0.25f, 0.0f, 4 ));
+    rps.AddObject( quads.back( ));
+  }
+  BOOST_CHECK_EQUAL( rps.update( ), quads.size( ));
+  BOOST_CHECK_EQUAL( rps.update( ), 0u );
+
+  // Ids follow the registration order, each pixel hits the quad of its
+  // cell
+  for ( int i = 0; i < 64; ++i )
+  {
+    const Point p(( i % 8 ) * 12 + 6, ( i / 8 ) * 12 + 7 );
+    BOOST_CHECK_EQUAL( rps.click( p, IDENTITY, 96, 96 ), i );
+  }
+
+  // Moving an object refits the top level without rebuilding it
+  quads[ 0 ]->translate( 1.0f, 1.0f, 0.0f );
+  BOOST_CHECK_EQUAL( rps.update( ), 1u );
+  BOOST_CHECK_EQUAL( rps.click( Point( 6, 7 ), IDENTITY, 96, 96 ), -1 );
+  PickHit hit = rps.clickHit( Point( 54, 55 ), IDENTITY, 96, 96 );
+  BOOST_CHECK( hit.object == 0 || hit.object == 36 );
+
+  // Pushed back, the moved object is hidden by the other one
+  quads[ 0 ]->translate( 1.0f, 1.0f, 0.5f );
+  BOOST_CHECK_EQUAL( rps.click( Point( 54, 55 ), IDENTITY, 96, 96 ), 36 );
+
+  // Geometry changes need updateGeometry
+  quads[ 36 ]->_indices.resize( 6 );
+  rps.updateGeometry( quads[ 36 ]);
+  BOOST_CHECK_EQUAL( rps.click( Point( 54, 55 ), IDENTITY, 96, 96 ), 0 );
+  BOOST_CHECK_EQUAL( rps.click( Point( 49, 50 ), IDENTITY, 96, 96 ), 36 );
+
+  // Singular model matrices are not pickable
+  quads[ 0 ]->_model.assign( 16, 0.0f );
+  BOOST_CHECK_EQUAL( rps.click( Point( 54, 55 ), IDENTITY, 96, 96 ), -1 );
+
+  // World space rays
+  const float origin[ 3 ] = { -0.9f, -0.9f, -10.0f };
+  const float direction[ 3 ] = { 0.0f, 0.0f, 1.0f };
+  float distance;
+  BOOST_CHECK( !rps.raycast( origin, direction, hit, distance ));
+  const float origin2[ 3 ] = { -0.6f, -0.9f, -10.0f };
+  BOOST_CHECK( rps.raycast( origin2, direction, hit, distance ));
+  BOOST_CHECK_EQUAL( hit.object, 1 );
+  BOOST_CHECK_CLOSE( distance, 10.0f, 1e-3f );
+  BOOST_CHECK( !rps.raycast( origin2, direction, hit, distance, 5.0f ));
+
+  rps.Clear( );
+  BOOST_CHECK_EQUAL( rps.click( Point( 50, 50 ), IDENTITY, 96, 96 ), -1 );
+  for ( auto q : quads )
+    delete q;
+}
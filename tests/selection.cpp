@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifdef RETO_USE_GLUT
+  #include <reto/reto.h>
+  #include "retoTests.h"
+  #include "pickingScene.h"
+
+  #include <chrono>
+  #include <thread>
+
+  using namespace reto;
+
+  namespace
+  {
+    const float IDENTITY[ 16 ] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+      0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Grid of side x side small quads, one in the middle of each cell
+    std::vector< pickingScene::Quad* > createGrid( unsigned int side )
+    {
+      std::vector< pickingScene::Quad* > quads;
+      const float cell = 2.0f / side;
+      for ( unsigned int y = 0; y < side; ++y )
+      {
+        for ( unsigned int x = 0; x < side; ++x )
+        {
+          const float x0 = -1.0f + cell * ( x + 0.2f );
+          const float y0 = -1.0f + cell * ( y + 0.2f );
+          quads.push_back( new pickingScene::Quad( x0, y0, x0 + cell * 0.6f,
+            y0 + cell * 0.6f ));
+        }
+      }
+      return quads;
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( selection_rubberband )
+  {
+    pickingScene::initContext( );
+
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    float viewProj[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, viewProj );
+
+    // Nothing to select
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 250, 250 ), viewProj );
+
+    // More objects than bits in a word, the band covers the top left
+    // quarter of the window
+    const unsigned int side = 8;
+    std::vector< pickingScene::Quad* > quads = createGrid( side );
+    for ( auto q : quads )
+      rubberBand.addObject( q );
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 250, 250 ), viewProj );
+    for ( unsigned int i = 0; i < quads.size( ); ++i )
+    {
+      const bool inside = i % side < side / 2 && i / side >= side / 2;
+      BOOST_CHECK_EQUAL( quads[ i ]->getSelected( ), inside );
+    }
+
+    // Model matrices move the vertices of their object only
+    quads[ 0 ]->setModel({ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.5f, 0.0f, 1.0f });
+    quads[ 63 ]->setModel({ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 0.0f, 5.0f, 0.0f, 0.0f, 1.0f });
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 250, 250 ), viewProj );
+    BOOST_CHECK( quads[ 0 ]->getSelected( ));
+    BOOST_CHECK( !quads[ 1 ]->getSelected( ));
+    BOOST_CHECK( quads[ 56 ]->getSelected( ));
+
+    // The band on the right selects the last quad only if it is not moved
+    rubberBand.mouseDown( Point( 440, 0 ));
+    rubberBand.mouseUp( Point( 499, 60 ), viewProj );
+    BOOST_CHECK( !quads[ 63 ]->getSelected( ));
+    quads[ 63 ]->setModel( std::vector< float >( ));
+    rubberBand.mouseUp( Point( 499, 60 ), viewProj );
+    BOOST_CHECK( quads[ 63 ]->getSelected( ));
+    BOOST_CHECK( !quads[ 62 ]->getSelected( ));
+
+    // Removed objects keep their state, the rest are packed again
+    rubberBand.removeObject( quads[ 63 ]);
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 499, 499 ), viewProj );
+    BOOST_CHECK( quads[ 63 ]->getSelected( ));
+    for ( unsigned int i = 1; i < quads.size( ) - 1; ++i )
+      BOOST_CHECK( quads[ i ]->getSelected( ));
+
+    // Objects outside the frustum of the culling system are not selected
+    CullingSystem culling;
+    for ( auto q : quads )
+      culling.AddObject( q );
+    float shift[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, shift );
+    shift[ 12 ] = 1.5f;
+    culling.cull( shift );
+    rubberBand.setCulling( &culling );
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 499, 499 ), viewProj );
+    for ( unsigned int i = 1; i < quads.size( ) - 1; ++i )
+    {
+      BOOST_CHECK_EQUAL( quads[ i ]->getSelected( ),
+        culling.inFrustum( quads[ i ]));
+    }
+    BOOST_CHECK( culling.stats( ).frustumCulled > 0u );
+    rubberBand.setCulling( nullptr );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    for ( auto q : quads )
+      delete q;
+  }
+
+  BOOST_AUTO_TEST_CASE( selection_shader_contract )
+  {
+    pickingScene::initContext( );
+
+    const std::vector< const char* > varyings = { "inside" };
+    const std::string body =
+      "uniform mat4 model;\n"
+      "out float inside;\n"
+      "void main( void )\n"
+      "{\n"
+      "  inside = ( model * vec4( inPos, 1.0 )).x;\n"
+      "}\n";
+    const std::string position = "layout( location = 0 ) in vec3 inPos;\n";
+
+    // The uniform model is replaced by the one of each object
+    TransformFeedback tf( "#version 430\n" + position + body, varyings,
+      GL_INTERLEAVED_ATTRIBS );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    // Shaders without the models buffer or with the object location
+    BOOST_CHECK_THROW( TransformFeedback( position + body, varyings,
+      GL_INTERLEAVED_ATTRIBS ), std::runtime_error );
+    BOOST_CHECK_THROW( TransformFeedback( "#version 330\n" + position + body,
+      varyings, GL_INTERLEAVED_ATTRIBS ), std::runtime_error );
+    BOOST_CHECK_THROW( TransformFeedback( "#version 430\n" + position +
+      "layout( location = 1 ) in vec3 inNormal;\n" + body, varyings,
+      GL_INTERLEAVED_ATTRIBS ), std::runtime_error );
+  }
+
+  BOOST_AUTO_TEST_CASE( selection_compute )
+  {
+    pickingScene::initContext( );
+
+    // Vertices right of a threshold, in both backends
+    TransformFeedback tf( "#version 430\n"
+      "layout( location = 0 ) in vec3 inPos;\n"
+      "uniform float threshold;\n"
+      "out float insideBS;\n"
+      "void main( void )\n"
+      "{\n"
+      "  insideBS = ( model * vec4( inPos, 1.0 )).x > threshold ? 1.0 : 0.0;\n"
+      "}", { "insideBS" }, GL_SEPARATE_ATTRIBS,
+      "uniform float threshold;\n"
+      "float inside( vec3 position, mat4 model )\n"
+      "{\n"
+      "  return ( model * vec4( position, 1.0 )).x > threshold ? 1.0 : 0.0;\n"
+      "}\n" );
+    std::vector< pickingScene::Quad* > quads = {
+      new pickingScene::Quad( -1.0f, -1.0f, -0.5f, 1.0f ),
+      new pickingScene::Quad( -0.2f, -1.0f, 0.2f, 1.0f ),
+      new pickingScene::Quad( 0.5f, -1.0f, 0.9f, 1.0f )};
+    for ( auto q : quads )
+      tf.addObject( q );
+    BOOST_CHECK( tf.objects( ) ==
+      std::vector< Pickable* >( quads.begin( ), quads.end( )));
+
+    BOOST_CHECK( !tf.computeSelection( ));
+    tf.program( )->use( );
+    tf.program( )->sendUniformf( "threshold", 0.0f );
+    tf.draw( );
+    BOOST_CHECK( tf.hitCounts( ) ==
+      std::vector< unsigned int >({ 0u, 1u, 1u }));
+
+    tf.setComputeSelection( true );
+    BOOST_CHECK( tf.computeSelection( ));
+    tf.program( )->use( );
+    tf.program( )->sendUniformf( "threshold", 0.0f );
+    tf.draw( );
+    BOOST_CHECK( tf.hitCounts( ) ==
+      std::vector< unsigned int >({ 0u, 2u, 4u }));
+    BOOST_CHECK( !quads[ 0 ]->getSelected( ));
+    BOOST_CHECK( quads[ 1 ]->getSelected( ));
+    BOOST_CHECK( quads[ 2 ]->getSelected( ));
+
+    quads[ 2 ]->setModel({ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 0.0f, -2.0f, 0.0f, 0.0f, 1.0f });
+    tf.draw( );
+    BOOST_CHECK( tf.hitCounts( ) ==
+      std::vector< unsigned int >({ 0u, 2u, 0u }));
+    BOOST_CHECK( !quads[ 2 ]->getSelected( ));
+    for ( auto q : quads )
+      delete q;
+
+    // Both backends select the same objects of a grid
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    float viewProj[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, viewProj );
+    quads = createGrid( 12 );
+    for ( auto q : quads )
+      rubberBand.addObject( q );
+    const Point bands[][ 2 ] = {{ Point( 0, 0 ), Point( 250, 250 )},
+      { Point( 499, 10 ), Point( 120, 300 )}, { Point( 30, 470 ),
+      Point( 60, 440 )}, { Point( 0, 0 ), Point( 499, 499 )}};
+    for ( const auto& band : bands )
+    {
+      std::vector< bool > selected[ 2 ];
+      for ( int compute = 0; compute < 2; ++compute )
+      {
+        rubberBand.setComputeSelection( compute == 1 );
+        rubberBand.mouseDown( band[ 0 ]);
+        rubberBand.mouseUp( band[ 1 ], viewProj );
+        for ( auto q : quads )
+          selected[ compute ].push_back( q->getSelected( ));
+      }
+      BOOST_CHECK( selected[ 0 ] == selected[ 1 ]);
+      BOOST_CHECK( std::count( selected[ 1 ].begin( ), selected[ 1 ].end( ),
+        true ) > 0 );
+    }
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    for ( auto q : quads )
+      delete q;
+  }
+  BOOST_AUTO_TEST_CASE( selection_cpu )
+  {
+    pickingScene::initContext( );
+
+    // The CPU engine selects the same objects as the GPU from the same
+    // mouse input
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    CpuSelection cpu( pickingScene::WIDTH, pickingScene::HEIGHT );
+    cpu.setNumThreads( 2 );
+    float viewProj[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, viewProj );
+    viewProj[ 0 ] = 0.8f;
+    viewProj[ 13 ] = 0.1f;
+    std::vector< pickingScene::Quad* > quads = createGrid( 12 );
+    for ( auto q : quads )
+    {
+      rubberBand.addObject( q );
+      cpu.addObject( q );
+    }
+    quads[ 5 ]->setModel({ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 0.0f, 0.3f, -0.2f, 0.0f, 1.0f });
+
+    const Point bands[][ 2 ] = {{ Point( 0, 0 ), Point( 250, 250 )},
+      { Point( 499, 10 ), Point( 120, 300 )}, { Point( 30, 470 ),
+      Point( 60, 440 )}, { Point( 0, 0 ), Point( 499, 499 )}};
+    for ( const auto& band : bands )
+    {
+      rubberBand.mouseDown( band[ 0 ]);
+      rubberBand.mouseUp( band[ 1 ], viewProj );
+      std::vector< bool > gpu;
+      for ( auto q : quads )
+        gpu.push_back( q->getSelected( ));
+      BOOST_CHECK( cpu.selectRectangle( band[ 0 ], band[ 1 ], viewProj ) >
+        0u );
+      for ( size_t i = 0; i < quads.size( ); ++i )
+        BOOST_CHECK_EQUAL( quads[ i ]->getSelected( ), gpu[ i ]);
+    }
+
+    // Convex and concave paths, the last point is drawn before release
+    SelectionSystem::Lasso lasso( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    for ( auto q : quads )
+      lasso.addObject( q );
+    const std::vector< Point > paths[] = {{ Point( 40, 60 ),
+      Point( 300, 20 ), Point( 460, 200 ), Point( 380, 420 ),
+      Point( 90, 380 )}, { Point( 30, 30 ), Point( 470, 30 ),
+      Point( 470, 470 ), Point( 330, 470 ), Point( 330, 170 ),
+      Point( 170, 170 ), Point( 170, 470 ), Point( 30, 470 )}};
+    for ( const auto& path : paths )
+    {
+      lasso.mouseDown( path[ 0 ]);
+      for ( size_t i = 1; i < path.size( ); ++i )
+        lasso.mouseMove( path[ i ]);
+      lasso.draw( );
+      lasso.mouseUp( path.back( ), viewProj );
+      std::vector< bool > gpu;
+      for ( auto q : quads )
+        gpu.push_back( q->getSelected( ));
+      BOOST_CHECK( cpu.selectLasso( path, viewProj ) > 0u );
+      for ( size_t i = 0; i < quads.size( ); ++i )
+        BOOST_CHECK_EQUAL( quads[ i ]->getSelected( ), gpu[ i ]);
+    }
+
+    // Without a draw, the selection samples its own filling whatever is
+    // bound in unit 0, and the framebuffer of the caller is kept
+    GLuint framebuffer, texture;
+    glGenFramebuffers( 1, &framebuffer );
+    glGenTextures( 1, &texture );
+    glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_2D, texture );
+    const std::vector< Point >& path = paths[ 0 ];
+    lasso.mouseDown( path[ 0 ]);
+    for ( size_t i = 1; i < path.size( ); ++i )
+      lasso.mouseMove( path[ i ]);
+    lasso.mouseUp( path.back( ), viewProj );
+    std::vector< bool > gpu;
+    for ( auto q : quads )
+      gpu.push_back( q->getSelected( ));
+    GLint drawFramebuffer, readFramebuffer;
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer );
+    glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer );
+    BOOST_CHECK_EQUAL( drawFramebuffer, GLint( framebuffer ));
+    BOOST_CHECK_EQUAL( readFramebuffer, GLint( framebuffer ));
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+    glDeleteFramebuffers( 1, &framebuffer );
+    glDeleteTextures( 1, &texture );
+    BOOST_CHECK( cpu.selectLasso( path, viewProj ) > 0u );
+    for ( size_t i = 0; i < quads.size( ); ++i )
+      BOOST_CHECK_EQUAL( quads[ i ]->getSelected( ), gpu[ i ]);
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    for ( auto q : quads )
+      delete q;
+  }
+  BOOST_AUTO_TEST_CASE( selection_bounds )
+  {
+    pickingScene::initContext( );
+
+    // Only the objects under the border of the selection are tested
+    // vertex by vertex, with the same results in both backends
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    SelectionSystem::Lasso lasso( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    float viewProj[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, viewProj );
+    std::vector< pickingScene::Quad* > quads = createGrid( 16 );
+    for ( auto q : quads )
+    {
+      rubberBand.addObject( q );
+      lasso.addObject( q );
+    }
+    const unsigned int numVertices = 4 * quads.size( );
+
+    const std::vector< Point > path = { Point( 40, 60 ), Point( 300, 20 ),
+      Point( 460, 200 ), Point( 380, 420 ), Point( 90, 380 )};
+    for ( int tool = 0; tool < 2; ++tool )
+    {
+      TransformFeedback* tf = tool == 0 ? rubberBand.transformFeedback( ) :
+        lasso.transformFeedback( );
+      std::vector< bool > selected[ 4 ];
+      unsigned int tested[ 4 ];
+      for ( int run = 0; run < 4; ++run )
+      {
+        const bool boundsTest = run % 2 == 1;
+        if ( tool == 0 )
+        {
+          rubberBand.setBoundsTest( boundsTest );
+          rubberBand.setComputeSelection( run >= 2 );
+          rubberBand.mouseDown( Point( 70, 90 ));
+          rubberBand.mouseUp( Point( 410, 380 ), viewProj );
+        }
+        else
+        {
+          lasso.setBoundsTest( boundsTest );
+          lasso.setComputeSelection( run >= 2 );
+          lasso.mouseDown( path[ 0 ]);
+          for ( size_t i = 1; i < path.size( ); ++i )
+            lasso.mouseMove( path[ i ]);
+          lasso.draw( );
+          lasso.mouseUp( path.back( ), viewProj );
+        }
+        for ( auto q : quads )
+          selected[ run ].push_back( q->getSelected( ));
+        tested[ run ] = tf->testedVertices( );
+      }
+      for ( int run = 1; run < 4; ++run )
+        BOOST_CHECK( selected[ run ] == selected[ 0 ]);
+      BOOST_CHECK( std::count( selected[ 0 ].begin( ),
+        selected[ 0 ].end( ), true ) > 50 );
+      BOOST_CHECK_EQUAL( tested[ 0 ], numVertices );
+      BOOST_CHECK_EQUAL( tested[ 2 ], numVertices );
+      BOOST_CHECK( tested[ 1 ] * 2 < numVertices );
+      BOOST_CHECK_EQUAL( tested[ 1 ], tested[ 3 ]);
+    }
+
+    // Selections with every object inside or outside skip the shaders
+    rubberBand.setBoundsTest( true );
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseUp( Point( 499, 499 ), viewProj );
+    BOOST_CHECK_EQUAL( rubberBand.transformFeedback( )->testedVertices( ),
+      0u );
+    for ( auto q : quads )
+      BOOST_CHECK( q->getSelected( ));
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    for ( auto q : quads )
+      delete q;
+  }
+
+  BOOST_AUTO_TEST_CASE( selection_livePreview )
+  {
+    pickingScene::initContext( );
+
+    // Previews while dragging give the selection of releasing the mouse
+    // there, testing only the objects near the change
+    SelectionSystem::RubberBand rubberBand( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    SelectionSystem::RubberBand rubberBandReference( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    SelectionSystem::Lasso lasso( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    SelectionSystem::Lasso lassoReference( pickingScene::WIDTH,
+      pickingScene::HEIGHT );
+    BOOST_CHECK( !rubberBand.livePreview( ));
+    rubberBand.setLivePreview( true, 0.0f );
+    lasso.setLivePreview( true, 0.0f );
+    BOOST_CHECK( rubberBand.livePreview( ));
+    float viewProj[ 16 ];
+    std::copy( IDENTITY, IDENTITY + 16, viewProj );
+    std::vector< pickingScene::Quad* > quads = createGrid( 16 );
+    for ( auto q : quads )
+    {
+      rubberBand.addObject( q );
+      rubberBandReference.addObject( q );
+      lasso.addObject( q );
+      lassoReference.addObject( q );
+    }
+    const auto flags = [ & ]( )
+    {
+      std::vector< bool > selected;
+      for ( auto q : quads )
+        selected.push_back( q->getSelected( ));
+      return selected;
+    };
+
+    unsigned int tested = 0;
+    unsigned int referenceTested = 0;
+    rubberBand.mouseDown( Point( 50, 450 ));
+    for ( unsigned int step = 1; step <= 10; ++step )
+    {
+      const Point end( 50 + 40 * step, 450 - 35 * step );
+      rubberBandReference.mouseDown( Point( 50, 450 ));
+      rubberBandReference.mouseUp( end, viewProj );
+      const std::vector< bool > expected = flags( );
+      referenceTested +=
+        rubberBandReference.transformFeedback( )->testedVertices( );
+
+      rubberBand.mouseMove( end, viewProj );
+      BOOST_CHECK( flags( ) == expected );
+      tested += rubberBand.transformFeedback( )->testedVertices( );
+    }
+    BOOST_CHECK( tested * 3 < referenceTested * 2 );
+    rubberBand.mouseUp( Point( 460, 90 ), viewProj );
+    const std::vector< bool > released = flags( );
+    BOOST_CHECK( std::count( released.begin( ), released.end( ), true ) >
+      100 );
+
+    const std::vector< Point > path = { Point( 250, 40 ), Point( 460, 60 ),
+      Point( 470, 300 ), Point( 420, 460 ), Point( 200, 470 ),
+      Point( 40, 420 ), Point( 30, 200 ), Point( 120, 60 )};
+    std::vector< bool > expected;
+    lasso.mouseDown( path[ 0 ]);
+    for ( size_t i = 1; i < path.size( ); ++i )
+    {
+      lassoReference.mouseDown( path[ 0 ]);
+      for ( size_t j = 1; j < i; ++j )
+        lassoReference.mouseMove( path[ j ]);
+      lassoReference.mouseUp( path[ i ], viewProj );
+      expected = flags( );
+
+      lasso.mouseMove( path[ i ], viewProj );
+      BOOST_CHECK( flags( ) == expected );
+    }
+    lasso.mouseUp( path.back( ), viewProj );
+    BOOST_CHECK( flags( ) == expected );
+    BOOST_CHECK( std::count( expected.begin( ), expected.end( ), true ) >
+      100 );
+
+    // Previews are throttled, the release always selects
+    rubberBand.setLivePreview( true, 1000.0f );
+    rubberBand.mouseDown( Point( 0, 0 ));
+    rubberBand.mouseMove( Point( 30, 30 ), viewProj );
+    const std::vector< bool > first = flags( );
+    rubberBand.mouseMove( Point( 499, 499 ), viewProj );
+    BOOST_CHECK( flags( ) == first );
+    BOOST_CHECK( std::count( first.begin( ), first.end( ), true ) < 4 );
+    rubberBand.mouseUp( Point( 499, 499 ), viewProj );
+    for ( auto q : quads )
+      BOOST_CHECK( q->getSelected( ));
+
+    // Two moves inside one interval, the skipped one is previewed once the
+    // interval has passed
+    rubberBandReference.mouseDown( Point( 20, 480 ));
+    rubberBandReference.mouseUp( Point( 300, 200 ), viewProj );
+    const std::vector< bool > outline = flags( );
+    rubberBand.setLivePreview( true, 0.2f );
+    rubberBand.mouseDown( Point( 20, 480 ));
+    rubberBand.mouseMove( Point( 60, 440 ), viewProj );
+    rubberBand.mouseMove( Point( 300, 200 ), viewProj );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 250 ));
+    BOOST_CHECK( rubberBand.flushPreview( viewProj ));
+    BOOST_CHECK( flags( ) == outline );
+    BOOST_CHECK( !rubberBand.flushPreview( viewProj ));
+    BOOST_CHECK( std::count( outline.begin( ), outline.end( ), true ) > 20 );
+    rubberBand.mouseUp( Point( 300, 200 ), viewProj );
+    BOOST_CHECK( flags( ) == outline );
+    BOOST_CHECK_EQUAL( glGetError( ), GLenum( GL_NO_ERROR ));
+
+    for ( auto q : quads )
+      delete q;
+  }
+#endif
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2014-2019 VG-Lab/URJC.
+ *
+ * This file is part of ReTo <https://gitlab.vg-lab.es/nsviz/ReTo>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <reto/reto.h>
+#include "retoTests.h"
+
+#include <testData.h>
+
+using namespace reto;
+
+namespace
+{
+  template< typename T >
+  T read( const AlignedBuffer& buffer, size_t offset )
+  {
+    T value;
+    memcpy( &value, buffer.data( ) + offset, sizeof( T ));
+    return value;
+  }
+
+  bool sameContent( const AlignedBuffer& a, const AlignedBuffer& b )
+  {
+    return a.size( ) == b.size( ) &&
+      memcmp( a.data( ), b.data( ), a.size( )) == 0;
+  }
+
+  bool samePacking( const PackedModel& a, const PackedModel& b )
+  {
+    if ( a.numVertices( ) != b.numVertices( ) ||
+      a.numIndices( ) != b.numIndices( ) ||
+      a.indexFormat( ) != b.indexFormat( ) ||
+      !sameContent( a.indices( ), b.indices( )))
+    {
+      return false;
+    }
+    for ( size_t i = 0; i < a.layout( ).numStreams( ); ++i )
+    {
+      if ( !sameContent( a.stream( i ), b.stream( i )))
+        return false;
+    }
+    return true;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( vertex_layout_interleaved )
+{
+  VertexLayout layout;
+  layout.add( VertexAttribute::Position )
+    .add( VertexAttribute::Normal, AttributeFormat::Float16 )
+    .add( VertexAttribute::TexCoord )
+    .add( VertexAttribute::Tangent, AttributeFormat::Snorm10 )
+    .add( VertexAttribute::Bitangent, AttributeFormat::Snorm10 );
+
+  BOOST_CHECK( layout.interleaved( ));
+  BOOST_CHECK_EQUAL( layout.numStreams( ), 1u );
+  BOOST_CHECK_EQUAL( layout.stride( 0 ), 36u );
+  BOOST_CHECK_EQUAL( layout.vertexSize( ), 36u );
+
+  const VertexLayout::Attribute* normal =
+    layout.find( VertexAttribute::Normal );
+  BOOST_REQUIRE( normal );
+  BOOST_CHECK_EQUAL( normal->offset, 12u );
+  BOOST_CHECK_EQUAL( normal->size, 8u );
+  BOOST_CHECK_EQUAL( normal->components, 3u );
+  BOOST_CHECK_EQUAL( normal->glType, GL_HALF_FLOAT );
+  BOOST_CHECK( !normal->normalized );
+
+  const VertexLayout::Attribute* tangent =
+    layout.find( VertexAttribute::Tangent );
+  BOOST_REQUIRE( tangent );
+  BOOST_CHECK_EQUAL( tangent->offset, 28u );
+  BOOST_CHECK_EQUAL( tangent->components, 4u );
+  BOOST_CHECK_EQUAL( tangent->glType, GL_INT_2_10_10_10_REV );
+  BOOST_CHECK( tangent->normalized );
+
+  layout.setStrideAlignment( 16 );
+  BOOST_CHECK_EQUAL( layout.stride( 0 ), 48u );
+
+  // Adding an attribute again changes its format in place
+  layout.add( VertexAttribute::Normal, AttributeFormat::Snorm8 );
+  BOOST_CHECK_EQUAL( layout.attributes( ).size( ), 5u );
+  BOOST_CHECK_EQUAL( layout.find( VertexAttribute::Normal )->size, 4u );
+  BOOST_CHECK_EQUAL( layout.find( VertexAttribute::TexCoord )->offset, 16u );
+  BOOST_CHECK( layout.find( VertexAttribute::Normal )->normalized );
+}
+
+BOOST_AUTO_TEST_CASE( vertex_layout_soa )
+{
+  VertexLayout layout( false );
+  layout.add( VertexAttribute::Position )
+    .add( VertexAttribute::Normal, AttributeFormat::Snorm16 )
+    .add( VertexAttribute::TexCoord, AttributeFormat::Float16 );
+
+  BOOST_CHECK( !layout.interleaved( ));
+  BOOST_CHECK_EQUAL( layout.numStreams( ), 3u );
+  BOOST_CHECK_EQUAL( layout.stride( 0 ), 12u );
+  BOOST_CHECK_EQUAL( layout.stride( 1 ), 8u );
+  BOOST_CHECK_EQUAL( layout.stride( 2 ), 4u );
+  BOOST_CHECK_EQUAL( layout.find( VertexAttribute::TexCoord )->stream, 2u );
+  BOOST_CHECK_EQUAL( layout.find( VertexAttribute::TexCoord )->offset, 0u );
+  BOOST_CHECK( layout.find( VertexAttribute::Tangent ) == nullptr );
+}
+
+BOOST_AUTO_TEST_CASE( vertex_layout_formats )
+{
+  VertexLayout layout( false );
+  layout.add( VertexAttribute::Position, AttributeFormat::Float16 )
+    .add( VertexAttribute::Normal, AttributeFormat::Snorm16 )
+    .add( VertexAttribute::TexCoord, AttributeFormat::Snorm8 )
+    .add( VertexAttribute::Tangent, AttributeFormat::Snorm10 );
+
+  PackedModel packed( layout );
+  const float position[ 3 ] = { 1.0f, -2.0f, 65504.0f };
+  const float normal[ 3 ] = { 0.5f, -1.0f, 2.0f };
+  const float texCoord[ 2 ] = { 1.0f, -0.5f };
+  const float tangent[ 3 ] = { 1.0f, -1.0f, 0.0f };
+  packed.addVertex( position, normal, texCoord, tangent );
+  const float tiny[ 3 ] = { 5.9604645e-8f, 1e-9f, 1e6f };
+  packed.addVertex( tiny, nullptr, nullptr );
+  BOOST_CHECK_EQUAL( packed.numVertices( ), 2u );
+
+  const AlignedBuffer& halves = packed.stream( 0 );
+  BOOST_CHECK_EQUAL( halves.size( ), 16u );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 0 ), 0x3C00 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 2 ), 0xC000 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 4 ), 0x7BFF );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 6 ), 0 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 8 ), 0x0001 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 10 ), 0 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( halves, 12 ), 0x7C00 );
+
+  const AlignedBuffer& shorts = packed.stream( 1 );
+  BOOST_CHECK_EQUAL( read< int16_t >( shorts, 0 ), 16384 );
+  BOOST_CHECK_EQUAL( read< int16_t >( shorts, 2 ), -32767 );
+  BOOST_CHECK_EQUAL( read< int16_t >( shorts, 4 ), 32767 );
+  BOOST_CHECK_EQUAL( read< int16_t >( shorts, 8 ), 0 );
+
+  const AlignedBuffer& bytes = packed.stream( 2 );
+  BOOST_CHECK_EQUAL( read< int8_t >( bytes, 0 ), 127 );
+  BOOST_CHECK_EQUAL( read< int8_t >( bytes, 1 ), -64 );
+
+  const AlignedBuffer& words = packed.stream( 3 );
+  BOOST_CHECK_EQUAL( read< uint32_t >( words, 0 ),
+    0x1FFu | ( 0x201u << 10 ));
+  BOOST_CHECK_EQUAL( read< uint32_t >( words, 4 ), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( vertex_layout_parse )
+{
+  VertexLayout compact;
+  compact.add( VertexAttribute::Position )
+    .add( VertexAttribute::Normal, AttributeFormat::Float16 )
+    .add( VertexAttribute::TexCoord );
+
+  ObjParser obj;
+  const Model m = obj.loadObj( OBJ_MODEL_TEST_DATA );
+  const PackedModel packed = obj.loadObjPacked( OBJ_MODEL_TEST_DATA, compact );
+  BOOST_CHECK( samePacking( packed, PackedModel::pack( m, compact )));
+
+  BOOST_CHECK_EQUAL( packed.numVertices( ), m.vertices.size( ) / 3 );
+  BOOST_CHECK_EQUAL( packed.numIndices( ), m.indices.size( ));
+  BOOST_CHECK( packed.indexFormat( ) == IndexFormat::UInt16 );
+  BOOST_CHECK_EQUAL( packed.indices( ).size( ), m.indices.size( ) * 2 );
+  BOOST_CHECK_EQUAL( read< uint16_t >( packed.indices( ), 2 ), m.indices[ 1 ]);
+  BOOST_CHECK_EQUAL(
+    reinterpret_cast< size_t >( packed.stream( 0 ).data( )) % 16, 0u );
+  BOOST_CHECK_EQUAL( read< float >( packed.stream( 0 ), 28 + 20 ),
+    m.texCoords[ 2 ]);
+
+  // SoA, 32 bit indices, mapped and parallel parsing give the same streams
+  VertexLayout soa( false );
+  soa.add( VertexAttribute::Position )
+    .add( VertexAttribute::TexCoord, AttributeFormat::Float16 )
+    .setIndexFormat( IndexFormat::UInt32 );
+  obj.setMemoryMapping( true );
+  obj.setNumThreads( 2 );
+  const PackedModel soaPacked = obj.loadObjPacked( OBJ_MODEL_TEST_DATA, soa );
+  BOOST_CHECK( samePacking( soaPacked, PackedModel::pack( m, soa )));
+  BOOST_CHECK( soaPacked.indexFormat( ) == IndexFormat::UInt32 );
+  BOOST_CHECK_EQUAL( soaPacked.indices( ).size( ), m.indices.size( ) * 4 );
+  BOOST_CHECK_EQUAL( soaPacked.stream( 0 ).size( ), m.vertices.size( ) * 4 );
+
+  // Full tangent frame in 36 bytes instead of 56
+  VertexLayout frame( compact );
+  frame.add( VertexAttribute::Tangent, AttributeFormat::Snorm10 )
+    .add( VertexAttribute::Bitangent, AttributeFormat::Snorm10 );
+  const PackedModel framePacked =
+    obj.loadObjPacked( OBJ_MODEL_TEST_DATA, frame );
+  BOOST_CHECK_EQUAL( framePacked.numVertices( ), m.vertices.size( ) / 3 );
+  BOOST_CHECK_EQUAL( framePacked.stream( 0 ).size( ),
+    framePacked.numVertices( ) * 36 );
+}